@@ -13,15 +13,116 @@
 // limitations under the License.
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
 #include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
 #include "nvs_flash.h"
 
+#include "ble_mesh_example_nvs.h"
+
 #define TAG     "EXAMPLE_NVS"
 
 #define NVS_NAME    "mesh_example"
 
+#define DEFER_TASK_STACK    3072
+#define DEFER_TASK_PRIO     (tskIDLE_PRIORITY + 1)
+
+typedef struct {
+    nvs_handle_t handle;
+    const char *key;
+    void *data;
+    size_t size;
+    size_t length;
+    bool dirty;
+} defer_entry_t;
+
+/* A dirty entry taken out by a flush, written to flash without holding the lock */
+typedef struct {
+    nvs_handle_t handle;
+    const char *key;
+    void *data;
+    size_t size;
+    size_t length;
+} defer_write_t;
+
+static struct {
+    SemaphoreHandle_t lock;
+    SemaphoreHandle_t flush_lock;   /* Held across the flash writes of a flush, never by the stores */
+    esp_timer_handle_t timer;
+    TaskHandle_t task;          /* Writes the window out, flash writes do not belong in the esp_timer task */
+    bool armed;
+    defer_entry_t entry[BLE_MESH_NVS_DEFER_KEY_MAX];
+    ble_mesh_nvs_stats_t stats;
+} s_defer;
+
+static void ble_mesh_nvs_defer_task(void *arg)
+{
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        ble_mesh_nvs_flush();
+    }
+}
+
+static void ble_mesh_nvs_defer_timer_cb(void *arg)
+{
+    xTaskNotifyGive(s_defer.task);
+}
+
+static void ble_mesh_nvs_shutdown_handler(void)
+{
+    ble_mesh_nvs_flush();
+}
+
+static esp_err_t ble_mesh_nvs_defer_init(void)
+{
+    if (s_defer.lock) {
+        return ESP_OK;
+    }
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = ble_mesh_nvs_defer_timer_cb,
+        .name     = "nvs_defer",
+    };
+
+    esp_err_t err = esp_timer_create(&timer_args, &s_defer.timer);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Defer, esp_timer_create failed, err %d", err);
+        return err;
+    }
+
+    if (xTaskCreate(ble_mesh_nvs_defer_task, "nvs_defer", DEFER_TASK_STACK, NULL,
+                    DEFER_TASK_PRIO, &s_defer.task) != pdPASS) {
+        esp_timer_delete(s_defer.timer);
+        return ESP_ERR_NO_MEM;
+    }
+
+    s_defer.flush_lock = xSemaphoreCreateMutex();
+    if (s_defer.flush_lock == NULL) {
+        vTaskDelete(s_defer.task);
+        esp_timer_delete(s_defer.timer);
+        return ESP_ERR_NO_MEM;
+    }
+
+    s_defer.lock = xSemaphoreCreateMutex();
+    if (s_defer.lock == NULL) {
+        vSemaphoreDelete(s_defer.flush_lock);
+        s_defer.flush_lock = NULL;
+        vTaskDelete(s_defer.task);
+        esp_timer_delete(s_defer.timer);
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_register_shutdown_handler(ble_mesh_nvs_shutdown_handler);
+
+    return ESP_OK;
+}
+
 esp_err_t ble_mesh_nvs_open(nvs_handle_t *handle)
 {
     esp_err_t err = ESP_OK;
@@ -37,8 +138,13 @@ esp_err_t ble_mesh_nvs_open(nvs_handle_t *handle)
         return err;
     }
 
+    err = ble_mesh_nvs_defer_init();
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Open, deferred stores disabled, err %d", err);
+    }
+
     ESP_LOGI(TAG, "Open namespace done, name \"%s\"", NVS_NAME);
-    return err;
+    return ESP_OK;
 }
 
 esp_err_t ble_mesh_nvs_store(nvs_handle_t handle, const char *key, const void *data, size_t length)
@@ -155,3 +261,200 @@ esp_err_t ble_mesh_nvs_erase(nvs_handle_t handle, const char *key)
     }
     return err;
 }
+
+esp_err_t ble_mesh_nvs_store_deferred(nvs_handle_t handle, const char *key, const void *data, size_t length)
+{
+    defer_entry_t *entry = NULL;
+
+    if (key == NULL || data == NULL || length == 0) {
+        ESP_LOGE(TAG, "Defer, invalid parameter");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (s_defer.lock == NULL) {
+        return ble_mesh_nvs_store(handle, key, data, length);
+    }
+
+    xSemaphoreTake(s_defer.lock, portMAX_DELAY);
+
+    for (int i = 0; i < BLE_MESH_NVS_DEFER_KEY_MAX; i++) {
+        if (s_defer.entry[i].key && s_defer.entry[i].handle == handle
+                && !strcmp(s_defer.entry[i].key, key)) {
+            entry = &s_defer.entry[i];
+            break;
+        }
+
+        if (!s_defer.entry[i].key && !entry) {
+            entry = &s_defer.entry[i];
+        }
+    }
+
+    if (entry && entry->size < length) {
+        void *buf = realloc(entry->data, length);
+
+        if (buf) {
+            entry->data = buf;
+            entry->size = length;
+        } else {
+            entry = NULL;
+        }
+    }
+
+    if (entry == NULL) {
+        xSemaphoreGive(s_defer.lock);
+        ESP_LOGW(TAG, "Defer, no slot for key \"%s\", store now", key);
+        return ble_mesh_nvs_store(handle, key, data, length);
+    }
+
+    s_defer.stats.requests++;
+
+    entry->handle = handle;
+    entry->key    = key;
+    entry->length = length;
+    memcpy(entry->data, data, length);
+
+    if (entry->dirty) {
+        s_defer.stats.avoided++;
+    }
+    entry->dirty = true;
+
+    if (!s_defer.armed) {
+        s_defer.armed = true;
+        esp_timer_start_once(s_defer.timer, BLE_MESH_NVS_DEFER_WINDOW_MS * 1000);
+    }
+
+    xSemaphoreGive(s_defer.lock);
+
+    ESP_LOGD(TAG, "Defer, key \"%s\", length %u", key, length);
+    return ESP_OK;
+}
+
+esp_err_t ble_mesh_nvs_flush(void)
+{
+    esp_err_t ret = ESP_OK;
+    esp_err_t err = ESP_OK;
+    defer_write_t write[BLE_MESH_NVS_DEFER_KEY_MAX] = {0};
+    bool written[BLE_MESH_NVS_DEFER_KEY_MAX] = {0};
+    uint32_t writes = 0;
+    uint32_t commits = 0;
+
+    if (s_defer.lock == NULL) {
+        return ESP_OK;
+    }
+
+    /* Flushes write in the order they took their snapshot, an older value never lands last */
+    xSemaphoreTake(s_defer.flush_lock, portMAX_DELAY);
+
+    /* Take the dirty buffers out, stores made during the writes fill new ones for the next flush */
+    xSemaphoreTake(s_defer.lock, portMAX_DELAY);
+
+    if (s_defer.armed) {
+        esp_timer_stop(s_defer.timer);
+        s_defer.armed = false;
+    }
+
+    for (int i = 0; i < BLE_MESH_NVS_DEFER_KEY_MAX; i++) {
+        defer_entry_t *entry = &s_defer.entry[i];
+
+        if (!entry->dirty) {
+            continue;
+        }
+
+        write[i].handle = entry->handle;
+        write[i].key    = entry->key;
+        write[i].data   = entry->data;
+        write[i].size   = entry->size;
+        write[i].length = entry->length;
+
+        entry->data  = NULL;
+        entry->size  = 0;
+        entry->dirty = false;
+    }
+
+    xSemaphoreGive(s_defer.lock);
+
+    for (int i = 0; i < BLE_MESH_NVS_DEFER_KEY_MAX; i++) {
+        if (!write[i].data) {
+            continue;
+        }
+
+        err = nvs_set_blob(write[i].handle, write[i].key, write[i].data, write[i].length);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Flush, nvs_set_blob failed, key \"%s\", err %d", write[i].key, err);
+            ret = err;
+            continue;
+        }
+
+        written[i] = true;
+        writes++;
+        ESP_LOGI(TAG, "Flush, key \"%s\", length %u", write[i].key, write[i].length);
+    }
+
+    /* One commit per namespace handle written in this window */
+    for (int i = 0; i < BLE_MESH_NVS_DEFER_KEY_MAX; i++) {
+        bool committed = false;
+
+        if (!written[i]) {
+            continue;
+        }
+
+        for (int j = 0; j < i; j++) {
+            if (written[j] && write[j].handle == write[i].handle) {
+                committed = true;
+                break;
+            }
+        }
+
+        if (committed) {
+            continue;
+        }
+
+        err = nvs_commit(write[i].handle);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Flush, nvs_commit failed, err %d", err);
+            ret = err;
+        } else {
+            commits++;
+        }
+    }
+
+    xSemaphoreTake(s_defer.lock, portMAX_DELAY);
+
+    s_defer.stats.writes  += writes;
+    s_defer.stats.commits += commits;
+
+    /* Hand the buffers back to the entries that did not need a new one meanwhile */
+    for (int i = 0; i < BLE_MESH_NVS_DEFER_KEY_MAX; i++) {
+        if (write[i].data && !s_defer.entry[i].data) {
+            s_defer.entry[i].data = write[i].data;
+            s_defer.entry[i].size = write[i].size;
+            write[i].data = NULL;
+        }
+    }
+
+    xSemaphoreGive(s_defer.lock);
+
+    for (int i = 0; i < BLE_MESH_NVS_DEFER_KEY_MAX; i++) {
+        free(write[i].data);
+    }
+
+    xSemaphoreGive(s_defer.flush_lock);
+
+    return ret;
+}
+
+void ble_mesh_nvs_get_stats(ble_mesh_nvs_stats_t *stats)
+{
+    if (stats == NULL) {
+        return;
+    }
+
+    if (s_defer.lock == NULL) {
+        memset(stats, 0, sizeof(ble_mesh_nvs_stats_t));
+        return;
+    }
+
+    xSemaphoreTake(s_defer.lock, portMAX_DELAY);
+    *stats = s_defer.stats;
+    xSemaphoreGive(s_defer.lock);
+}
@@ -29,4 +29,32 @@ esp_err_t ble_mesh_nvs_restore(nvs_handle_t handle, const char *key, void *data,
 
 esp_err_t ble_mesh_nvs_erase(nvs_handle_t handle, const char *key);
 
+/* Window after the first deferred store in which further stores are merged */
+#define BLE_MESH_NVS_DEFER_WINDOW_MS    2000
+#define BLE_MESH_NVS_DEFER_KEY_MAX      4
+
+typedef struct {
+    uint32_t requests;  /* Deferred store requests */
+    uint32_t avoided;   /* Requests merged into a write that was already pending */
+    uint32_t writes;    /* Blobs written to flash */
+    uint32_t commits;   /* nvs_commit() calls */
+} ble_mesh_nvs_stats_t;
+
+/*
+ * Snapshot the data and write it at the end of the current window, together with
+ * every other key stored in the same window. The write runs in a low-priority
+ * task, not in the esp_timer task. The key is kept by reference and
+ * must stay valid. Falls back to ble_mesh_nvs_store() when all slots are taken.
+ */
+esp_err_t ble_mesh_nvs_store_deferred(nvs_handle_t handle, const char *key, const void *data, size_t length);
+
+/*
+ * Write every pending deferred store now, for reset and power-down paths. The
+ * pending data is taken out first, deferred stores are not held up by the flash
+ * writes and wait for the next flush.
+ */
+esp_err_t ble_mesh_nvs_flush(void);
+
+void ble_mesh_nvs_get_stats(ble_mesh_nvs_stats_t *stats);
+
 #endif /* _BLE_MESH_EXAMPLE_NVS_H_ */
@@ -16,6 +16,8 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
 #include "nvs_flash.h"
 
@@ -33,13 +35,33 @@
 static const char *TAG  = "genie_model_srv";
 
 /**
- * g_vnd_msg_list was used to save the unconfirmed vendor messages
- * g_vnd_msg_timer was used to control when the vendor messages saved in g_vnd_msg_list will be resent
+ * Resent messages carry a tid in [GENIE_VENDOR_MSG_TID_MIN, GENIE_VENDOR_MSG_TID_MAX),
+ * which indexes g_vnd_msg_tid_map directly
  **/
-static genie_dlist_t g_vnd_msg_list = {0};
+#define GENIE_VENDOR_MSG_TID_MIN   0x7F
+#define GENIE_VENDOR_MSG_TID_MAX   0xC0
+#define GENIE_VENDOR_MSG_SLOT_NONE 0xFF
+
+/**
+ * g_vnd_msg_pool was used to save the unconfirmed vendor messages
+ * g_vnd_msg_heap orders the used pool slots by their absolute resend deadline
+ * g_vnd_msg_tid_map maps the tid of a saved message to its pool slot
+ * g_vnd_msg_timer was used to control when the vendor messages saved in g_vnd_msg_pool will be resent
+ * g_vnd_msg_timer_lock serializes the arming of g_vnd_msg_timer with the deadline it is armed for
+ **/
+static genie_model_msg_node_t g_vnd_msg_pool[GENIE_VENDOR_MSG_LIST_MAXSIZE] = {0};
+static uint8_t g_vnd_msg_heap[GENIE_VENDOR_MSG_LIST_MAXSIZE] = {0};
+static uint8_t g_vnd_msg_heap_size = 0;
+static uint8_t g_vnd_msg_tid_map[GENIE_VENDOR_MSG_TID_MAX - GENIE_VENDOR_MSG_TID_MIN] = {0};
+static uint32_t g_vnd_msg_free_mask = 0;
+static int64_t g_vnd_msg_timer_deadline = 0;
+static portMUX_TYPE g_vnd_msg_lock = portMUX_INITIALIZER_UNLOCKED;
 static util_timer_t g_vnd_msg_timer = {0};
+static SemaphoreHandle_t g_vnd_msg_timer_lock = NULL;
+static StaticSemaphore_t g_vnd_msg_timer_lock_buf;
 
 static void genie_model_retry_timer_cb(void *args);
+static esp_err_t genie_model_msg_transmit(esp_ble_mesh_model_t *p_model, genie_model_msg_t *p_model_msg);
 
 /**
  * @brief Get Genie Vendor Model Appkey ID
@@ -107,17 +129,104 @@ static uint16_t genie_model_init(void)
 
     if (!init_flag) {
         ESP_LOGD(TAG, "init g_vnd_msg_timer");
-        util_timer_init(&g_vnd_msg_timer, genie_model_retry_timer_cb, &g_vnd_msg_list);
-        genie_dlist_init(&g_vnd_msg_list);
+        util_timer_init(&g_vnd_msg_timer, genie_model_retry_timer_cb, NULL);
+        g_vnd_msg_timer_lock = xSemaphoreCreateMutexStatic(&g_vnd_msg_timer_lock_buf);
+        memset(g_vnd_msg_tid_map, GENIE_VENDOR_MSG_SLOT_NONE, sizeof(g_vnd_msg_tid_map));
+        g_vnd_msg_free_mask = (1UL << GENIE_VENDOR_MSG_LIST_MAXSIZE) - 1;
     }
     init_flag = true;
 
     return true;
 }
 
+/** @def genie_model_msg_tid_slot
+ *
+ *  @brief get the tid map entry of a vendor model message, must be called with g_vnd_msg_lock held
+ *
+ *  @param tid of the vendor model message
+ *
+ *  @return pointer to the map entry, NULL if the tid is never resent
+ */
+static uint8_t *genie_model_msg_tid_slot(uint8_t tid)
+{
+    if (tid < GENIE_VENDOR_MSG_TID_MIN || tid >= GENIE_VENDOR_MSG_TID_MAX) {
+        return NULL;
+    }
+
+    return &g_vnd_msg_tid_map[tid - GENIE_VENDOR_MSG_TID_MIN];
+}
+
+/** @def genie_model_msg_heap_less
+ *
+ *  @brief compare the deadlines of two heap entries
+ *
+ *  @param heap index a and b
+ *
+ *  @return true if entry a is due before entry b
+ */
+static inline bool genie_model_msg_heap_less(uint8_t a, uint8_t b)
+{
+    return g_vnd_msg_pool[g_vnd_msg_heap[a]].timeout < g_vnd_msg_pool[g_vnd_msg_heap[b]].timeout;
+}
+
+/** @def genie_model_msg_heap_swap
+ *
+ *  @brief swap two heap entries and refresh their nodes' heap index
+ *
+ *  @param heap index a and b
+ *
+ *  @return N/A
+ */
+static void genie_model_msg_heap_swap(uint8_t a, uint8_t b)
+{
+    uint8_t slot = g_vnd_msg_heap[a];
+
+    g_vnd_msg_heap[a] = g_vnd_msg_heap[b];
+    g_vnd_msg_heap[b] = slot;
+    g_vnd_msg_pool[g_vnd_msg_heap[a]].heap_index = a;
+    g_vnd_msg_pool[g_vnd_msg_heap[b]].heap_index = b;
+}
+
+/** @def genie_model_msg_heap_fix
+ *
+ *  @brief restore the heap order after the deadline of one entry changed,
+ *         must be called with g_vnd_msg_lock held
+ *
+ *  @param heap index of the changed entry
+ *
+ *  @return N/A
+ */
+static void genie_model_msg_heap_fix(uint8_t index)
+{
+    while (index > 0 && genie_model_msg_heap_less(index, (index - 1) / 2)) {
+        genie_model_msg_heap_swap(index, (index - 1) / 2);
+        index = (index - 1) / 2;
+    }
+
+    for (;;) {
+        uint8_t child = 2 * index + 1;
+
+        if (child >= g_vnd_msg_heap_size) {
+            break;
+        }
+
+        if (child + 1 < g_vnd_msg_heap_size && genie_model_msg_heap_less(child + 1, child)) {
+            child++;
+        }
+
+        if (!genie_model_msg_heap_less(child, index)) {
+            break;
+        }
+
+        genie_model_msg_heap_swap(index, child);
+        index = child;
+    }
+}
+
 /** @def genie_model_msg_node_free
  *
- *  @brief free the vendor model message node struct's memory
+ *  @brief remove the vendor model message node from the heap and return it to the pool,
+ *         must be called with g_vnd_msg_lock held
  *
  *  @param pointer to the vendor model message node to be freed
  *
@@ -125,55 +234,69 @@ static uint16_t genie_model_init(void)
  */
 static esp_err_t genie_model_msg_node_free(genie_model_msg_node_t *p_node)
 {
-    ENTER_FUNC();
+    uint8_t index = p_node->heap_index;
+    uint8_t last  = --g_vnd_msg_heap_size;
 
-    free(p_node);
+    if (index != last) {
+        genie_model_msg_heap_swap(index, last);
+        genie_model_msg_heap_fix(index);
+    }
+
+    *genie_model_msg_tid_slot(p_node->msg.tid) = GENIE_VENDOR_MSG_SLOT_NONE;
+    g_vnd_msg_free_mask |= 1UL << (p_node - g_vnd_msg_pool);
 
     return ESP_OK;
 }
 
-/** @def genie_model_msg_node_generate
+/** @def genie_model_retry_timer_update
  *
- *  @brief duplicate genie_model_msg_t and save to genie_model_msg_node_t
+ *  @brief rearm g_vnd_msg_timer for the earliest deadline, or stop it if no message is left
  *
- *  @param pointer to the vendor model message to be duplicated
+ *  g_vnd_msg_timer_lock is held from reading the deadline until the timer is armed or
+ *  stopped, so a caller that read an older heap can not stop or arm the timer after a
+ *  caller that read a newer one
+ *
+ *  @param NULL
  *
- *  @return pointer to genie_model_msg_node_t for success, NULL for failure
+ *  @return N/A
  */
-static genie_model_msg_node_t *genie_model_msg_node_generate(genie_model_msg_t *p_model_msg)
+static void genie_model_retry_timer_update(void)
 {
     ENTER_FUNC();
-    genie_model_msg_node_t *p_node = NULL;
+    int64_t deadline = 0;
+    int64_t delay    = 0;
+    bool    changed  = false;
 
-    if (!p_model_msg->retry) {
-        p_model_msg->retry = GENIE_MODEL_MSG_DFT_RETRY_TIMES;
-    } else if (p_model_msg->retry > GENIE_MODEL_MSG_MAX_RETRY_TIMES) {
-        p_model_msg->retry = GENIE_MODEL_MSG_MAX_RETRY_TIMES;
-    }
+    xSemaphoreTake(g_vnd_msg_timer_lock, portMAX_DELAY);
 
-    p_node = malloc(sizeof(genie_model_msg_node_t) + p_model_msg->len);
-    if (!p_node) {
-        ESP_LOGE(TAG, "malloc for genie_model_msg_node_t failed");
-        return NULL;
+    portENTER_CRITICAL(&g_vnd_msg_lock);
+    if (g_vnd_msg_heap_size) {
+        deadline = g_vnd_msg_pool[g_vnd_msg_heap[0]].timeout;
     }
+    changed = (deadline != g_vnd_msg_timer_deadline);
+    g_vnd_msg_timer_deadline = deadline;
+    portEXIT_CRITICAL(&g_vnd_msg_lock);
 
-    memcpy(&p_node->msg, p_model_msg, sizeof(genie_model_msg_t));
-    ESP_LOGD(TAG, "p_node->msg: %p, data: %p, %p", &p_node->msg, &p_node->msg.data, &p_node->msg.data + 1);
-    p_node->msg.data = (uint8_t *)(&p_node->msg.data + 1);
-    memcpy(p_node->msg.data, p_model_msg->data, p_model_msg->len);
-    ESP_LOGD(TAG, "p_model_msg->data: %p, data: 0x%s, p_node->msg.data: %p, data: 0x%s",
-             p_model_msg->data, util_hex2str(p_model_msg->data, p_model_msg->len),
-             p_node->msg.data, util_hex2str(p_node->msg.data, p_node->msg.len));
-    p_node->timeout = esp_timer_get_time() + p_model_msg->retry_period;
+    if (changed && !deadline) {
+        util_timer_stop(&g_vnd_msg_timer);
+        ESP_LOGD(TAG, "list empty, stop timer");
+    } else if (changed) {
+        /* round up so that the timer never fires before the deadline */
+        delay = (deadline - esp_timer_get_time() + 999) / 1000;
+        if (delay < 1) {
+            delay = 1;
+        }
 
-    p_node->left_retry = p_model_msg->retry;
+        util_timer_start(&g_vnd_msg_timer, (uint32_t)delay);
+        ESP_LOGD(TAG, "restart retry timer, timeout: %d", (uint32_t)delay);
+    }
 
-    return p_node;
+    xSemaphoreGive(g_vnd_msg_timer_lock);
 }
 
 /** @def genie_model_msg_list_append
  *
- *  @brief duplicate genie_model_msg_t and append it to vendor model message list to be monitored
+ *  @brief duplicate genie_model_msg_t into a pool slot and schedule its resend
  *
  *  @param pointer to the vendor model message to be duplicated
  *
@@ -182,26 +305,50 @@ static genie_model_msg_node_t *genie_model_msg_node_generate(genie_model_msg_t *
 static esp_err_t genie_model_msg_list_append(genie_model_msg_t *p_model_msg)
 {
     ENTER_FUNC();
-    genie_model_msg_node_t *p_msg_node = NULL;
+    genie_model_msg_node_t *p_node = NULL;
+    uint8_t                *p_slot = NULL;
+    uint8_t                 slot   = 0;
 
-    p_msg_node = genie_model_msg_node_generate(p_model_msg);
+    if (p_model_msg->len > GENIE_VENDOR_MSG_DATA_MAXSIZE) {
+        ESP_LOGW(TAG, "msg len %d exceeds %d, not resent", p_model_msg->len, GENIE_VENDOR_MSG_DATA_MAXSIZE);
+        return ESP_ERR_INVALID_SIZE;
+    }
 
-    if (!p_msg_node) {
-        return ESP_ERR_INVALID_ARG;
+    if (!p_model_msg->retry) {
+        p_model_msg->retry = GENIE_MODEL_MSG_DFT_RETRY_TIMES;
+    } else if (p_model_msg->retry > GENIE_MODEL_MSG_MAX_RETRY_TIMES) {
+        p_model_msg->retry = GENIE_MODEL_MSG_MAX_RETRY_TIMES;
     }
 
-    ESP_LOGD(TAG, "append msg: %p, opid: 0x%02x, retry: %d, head: %p, node: %p", p_model_msg, p_model_msg->opid, p_model_msg->retry, &g_vnd_msg_list, &p_msg_node->node);
-    if (genie_dlist_node_number(&g_vnd_msg_list) >= GENIE_VENDOR_MSG_LIST_MAXSIZE) {
+    portENTER_CRITICAL(&g_vnd_msg_lock);
+
+    p_slot = genie_model_msg_tid_slot(p_model_msg->tid);
+    if (!g_vnd_msg_free_mask || !p_slot || *p_slot != GENIE_VENDOR_MSG_SLOT_NONE) {
+        portEXIT_CRITICAL(&g_vnd_msg_lock);
         ESP_LOGW(TAG, "List Full, discard!!!");
-        return ESP_OK;
+        return ESP_ERR_NO_MEM;
     }
 
-    genie_dlist_append(&g_vnd_msg_list, &p_msg_node->node);
+    slot = __builtin_ctz(g_vnd_msg_free_mask);
+    g_vnd_msg_free_mask &= ~(1UL << slot);
+    *p_slot = slot;
 
-    // Check retry timer, if timer is not started yet, start it
-    if (!util_timer_is_started(&g_vnd_msg_timer)) {
-        util_timer_start(&g_vnd_msg_timer, p_model_msg->retry_period);
-    }
+    p_node = &g_vnd_msg_pool[slot];
+    memcpy(&p_node->msg, p_model_msg, sizeof(genie_model_msg_t));
+    memcpy(p_node->data, p_model_msg->data, p_model_msg->len);
+    p_node->msg.data   = p_node->data;
+    p_node->left_retry = p_model_msg->retry;
+    p_node->timeout    = esp_timer_get_time() + p_model_msg->retry_period * 1000LL;
+
+    p_node->heap_index = g_vnd_msg_heap_size;
+    g_vnd_msg_heap[g_vnd_msg_heap_size++] = slot;
+    genie_model_msg_heap_fix(p_node->heap_index);
+
+    portEXIT_CRITICAL(&g_vnd_msg_lock);
+
+    ESP_LOGD(TAG, "append msg: %p, opid: 0x%02x, retry: %d, slot: %d", p_model_msg, p_model_msg->opid, p_model_msg->retry, slot);
+
+    genie_model_retry_timer_update();
 
     return ESP_OK;
 }
@@ -210,97 +357,96 @@ static esp_err_t genie_model_msg_list_append(genie_model_msg_t *p_model_msg)
  *
  *  @brief timeout handler for the g_vnd_msg_timer
  *
- *  @param p_timer - pointer to the timer; args - pointer to g_vnd_msg_list
+ *  @param args - unused
  *
  *  @return N/A
  */
 static void genie_model_retry_timer_cb(void *args)
 {
     ENTER_FUNC();
-    uint32_t               nearest     = 0;
-    genie_dnode_t          *p_node     = NULL;
-    genie_model_msg_node_t *p_msg_node = NULL;
-    genie_model_msg_t      *p_msg      = NULL;
-    genie_dlist_t          *p_head     = (genie_dlist_t *)args;
+    int64_t                 now    = esp_timer_get_time();
+    genie_model_msg_node_t *p_node = NULL;
+    genie_model_msg_t       msg    = {0};
+    uint8_t                 slot   = 0;
+    bool                    resend = false;
+    uint8_t                 data[GENIE_VENDOR_MSG_DATA_MAXSIZE];
+    esp_ble_mesh_model_t   *p_model = NULL;
 
-    ESP_LOGD(TAG, "g_vnd_msg_timer timeout, p_head: %p", p_head);
+    ESP_LOGD(TAG, "g_vnd_msg_timer timeout");
 
     /**
-     * 1. go through p_head
-     * 2. resend the no responsed messages if timeout happens and refresh timeout value
+     * pop every message whose deadline has passed, reschedule it or drop it after its
+     * last retry, and resend a copy outside of the lock; a rescheduled message is due
+     * after now, so each message is sent at most once per pass. The copy is transmitted
+     * directly, it never goes through genie_model_msg_send() and is never queued again
      * */
-    GENIE_DLIST_FOR_EACH_NODE(p_head, p_node) {
-        p_msg_node = CONTAINER_OF(p_node, genie_model_msg_node_t, node);
-        nearest    = p_msg_node->msg.retry_period;
-        p_msg      = &p_msg_node->msg;
-        ESP_LOGD(TAG, "msg: %p, opid: 0x%02x, left: %d", p_msg, p_msg->opid, p_msg_node->left_retry);
-
-        if (p_msg_node->timeout <= esp_timer_get_time()) {
-            ESP_LOGD(TAG, "timeout - msg: %p, opid: 0x%02x, left: %d", p_msg, p_msg->opid, p_msg_node->left_retry);
-            genie_model_msg_send(p_msg);
-            if (--p_msg_node->left_retry <= 0) {
-                genie_dlist_remove(p_node);
-                genie_model_msg_node_free((genie_model_msg_node_t *)p_node);
-                break;
-            }
-            p_msg_node->timeout = esp_timer_get_time() + p_msg_node->msg.retry_period;
+    for (;;) {
+        portENTER_CRITICAL(&g_vnd_msg_lock);
+        g_vnd_msg_timer_deadline = 0;
+
+        if (!g_vnd_msg_heap_size || g_vnd_msg_pool[g_vnd_msg_heap[0]].timeout > now) {
+            portEXIT_CRITICAL(&g_vnd_msg_lock);
+            break;
+        }
+
+        slot   = g_vnd_msg_heap[0];
+        p_node = &g_vnd_msg_pool[slot];
+        msg    = p_node->msg;
+        memcpy(data, p_node->data, msg.len);
+        msg.data  = data;
+        msg.retry = --p_node->left_retry;
+
+        if (p_node->left_retry <= 0) {
+            genie_model_msg_node_free(p_node);
         } else {
-            if (nearest > p_msg_node->timeout) {
-                nearest = p_msg_node->timeout;
-            }
+            p_node->timeout = now + p_node->msg.retry_period * 1000LL;
+            genie_model_msg_heap_fix(0);
         }
-    }
 
-    /* start new timer */
-    if (!genie_dlist_is_empty(p_head)) {
-        util_timer_start(&g_vnd_msg_timer, nearest);
-        ESP_LOGD(TAG, "restart retry timer, timeout: %d", nearest);
-    } else {
-        util_timer_stop(&g_vnd_msg_timer);
-        ESP_LOGD(TAG, "list empty, stop timer");
+        portEXIT_CRITICAL(&g_vnd_msg_lock);
+
+        p_model = esp_ble_mesh_find_vendor_model(msg.p_elem, CID_ALIBABA, GENIE_VENDOR_MODEL_SRV_ID);
+
+        /* the confirmation may have dequeued the message since it was popped */
+        portENTER_CRITICAL(&g_vnd_msg_lock);
+        resend = msg.retry <= 0 || *genie_model_msg_tid_slot(msg.tid) == slot;
+        portEXIT_CRITICAL(&g_vnd_msg_lock);
+
+        ESP_LOGD(TAG, "timeout - tid: 0x%02x, opid: 0x%02x, left: %d", msg.tid, msg.opid, msg.retry);
+
+        if (resend && p_model) {
+            genie_model_msg_transmit(p_model, &msg);
+        }
     }
 
-    return;
+    genie_model_retry_timer_update();
 }
 
 /** @def genie_model_msg_check_tid
  *
- *  @brief check received vendor message's tid
+ *  @brief check received vendor message's tid and dequeue the saved message it confirms
  *
- *  @param pointer to g_vnd_msg_list, tid of the received vendor model message
+ *  @param tid of the received vendor model message
  *
  *  @return 0 for success; negative for failure
  */
-static esp_err_t genie_model_msg_check_tid(genie_dlist_t *p_head, uint8_t tid)
+static esp_err_t genie_model_msg_check_tid(uint8_t tid)
 {
     ENTER_FUNC();
-    genie_dnode_t *p_node = NULL;
-
-    if (!p_head) {
-        return ESP_FAIL;
+    uint8_t *p_slot = NULL;
+    bool     found  = false;
+
+    portENTER_CRITICAL(&g_vnd_msg_lock);
+    p_slot = genie_model_msg_tid_slot(tid);
+    if (p_slot && *p_slot != GENIE_VENDOR_MSG_SLOT_NONE) {
+        genie_model_msg_node_free(&g_vnd_msg_pool[*p_slot]);
+        found = true;
     }
+    portEXIT_CRITICAL(&g_vnd_msg_lock);
 
-    if (genie_dlist_is_empty(p_head)) {
-        return ESP_OK;
-    }
-
-    /**
-     * go through message list and dequeue the vendor model's message and free it if received message
-     * s tid equals this message's tid
-     * */
-    GENIE_DLIST_FOR_EACH_NODE(p_head, p_node) {
-        genie_model_msg_t      *p_msg      = NULL;
-        genie_model_msg_node_t *p_msg_node = NULL;
-
-        p_msg_node = CONTAINER_OF(p_node, genie_model_msg_node_t, node);
-        p_msg      = &p_msg_node->msg;
-
-        if (p_msg->tid == tid) {
-            ESP_LOGD(TAG, "dequeue msg: %p, opid: 0x%02x, retry: %2d", p_msg, p_msg->opid, p_msg->retry);
-            genie_dlist_remove(p_node);
-            genie_model_msg_node_free((genie_model_msg_node_t *)p_node);
-            break;
-        }
+    if (found) {
+        ESP_LOGD(TAG, "dequeue msg, tid: 0x%02x", tid);
+        genie_model_retry_timer_update();
     }
 
     return ESP_OK;
@@ -320,7 +466,6 @@ esp_err_t genie_model_msg_send(genie_model_msg_t *p_model_msg)
     ENTER_FUNC();
     esp_err_t err                   = ESP_FAIL;
     bool resend_flag                = false;
-    esp_ble_mesh_msg_ctx_t ctx      = {0};
     esp_ble_mesh_model_t *p_model   = esp_ble_mesh_find_vendor_model(p_model_msg->p_elem, CID_ALIBABA, GENIE_VENDOR_MODEL_SRV_ID);
 
     genie_model_init();
@@ -349,35 +494,17 @@ esp_err_t genie_model_msg_send(genie_model_msg_t *p_model_msg)
         ((p_model_msg->opid == GENIE_OP_ATTR_INDICATE) ||
         (p_model_msg->opid == GENIE_OP_ATTR_INDICATE_TG) ||
         (p_model_msg->opid == GENIE_OP_ATTR_TRANS_INDICATE))) {
-        resend_flag = true;
         ESP_LOGD(TAG, "set resend flag");
 
-        genie_dnode_t *p_node = NULL;
-        GENIE_DLIST_FOR_EACH_NODE(&g_vnd_msg_list, p_node) {
-            genie_model_msg_t *p_msg = NULL;
-            genie_model_msg_node_t *p_msg_node = NULL;
-
-            p_msg_node = CONTAINER_OF(p_node, genie_model_msg_node_t, node);
-            p_msg = &p_msg_node->msg;
+        portENTER_CRITICAL(&g_vnd_msg_lock);
+        resend_flag = (*genie_model_msg_tid_slot(p_model_msg->tid) == GENIE_VENDOR_MSG_SLOT_NONE);
+        portEXIT_CRITICAL(&g_vnd_msg_lock);
 
-            if (p_msg->tid == p_model_msg->tid) {
-                ESP_LOGI(TAG, "no resend");
-                resend_flag = false;
-                break;
-            }
+        if (!resend_flag) {
+            ESP_LOGI(TAG, "no resend");
         }
     }
 
-    // prepare buffer
-    uint8_t *data = NULL;
-    data = malloc(p_model_msg->len + 1);
-    if (!data) {
-        ESP_LOGE(TAG, "malloc failed");
-        return ESP_FAIL;
-    }
-    data[0] = p_model_msg->tid;
-    memcpy(data + 1, p_model_msg->data, p_model_msg->len);
-
     p_model_msg->retry--;
 
     ESP_LOGD(TAG, "p_model_msg->opid: 0x%02x, p_model_msg->data: %p, len: %d, data: 0x%s",
@@ -388,6 +515,32 @@ esp_err_t genie_model_msg_send(genie_model_msg_t *p_model_msg)
         genie_model_msg_list_append(p_model_msg);
     }
 
+    return genie_model_msg_transmit(p_model, p_model_msg);
+}
+
+/** @def genie_model_msg_transmit
+ *
+ *  @brief put the vendor model message on air once, without queueing it for resend
+ *
+ *  @param p_model - vendor model server of the message element
+ *  @param p_model_msg - the message, retry is the number of resends left
+ *
+ *  @return 0 for success; negative for failure
+ */
+static esp_err_t genie_model_msg_transmit(esp_ble_mesh_model_t *p_model, genie_model_msg_t *p_model_msg)
+{
+    ENTER_FUNC();
+    esp_err_t err              = ESP_FAIL;
+    esp_ble_mesh_msg_ctx_t ctx = {0};
+    uint8_t *data              = malloc(p_model_msg->len + 1);
+
+    if (!data) {
+        ESP_LOGE(TAG, "malloc failed");
+        return ESP_FAIL;
+    }
+    data[0] = p_model_msg->tid;
+    memcpy(data + 1, p_model_msg->data, p_model_msg->len);
+
     ctx.app_idx  = bt_mesh_model_get_appkey_id(p_model_msg->p_elem, p_model);
     ctx.net_idx  = bt_mesh_model_get_netkey_id(p_model_msg->p_elem);
     ctx.addr     = GENIE_RECV_ADDR;
@@ -536,7 +689,7 @@ static void genie_model_confirm(esp_ble_mesh_model_t *model,
 
     tid = net_buf_simple_pull_u8(buf);
     ESP_LOGI(TAG, "confirm tid: 0x%02x", tid);
-    genie_model_msg_check_tid(&g_vnd_msg_list, tid);
+    genie_model_msg_check_tid(tid);
 }
 
 /** @def genie_model_confirm_tg
@@ -561,7 +714,7 @@ static void genie_model_confirm_tg(esp_ble_mesh_model_t *model,
 
     tid = net_buf_simple_pull_u8(buf);
     ESP_LOGI(TAG, "confirm_tg tid: 0x%02x", tid);
-    genie_model_msg_check_tid(&g_vnd_msg_list, tid);
+    genie_model_msg_check_tid(tid);
 }
 
 /** @def genie_model_transparent
@@ -601,7 +754,7 @@ static void genie_model_transparent_ack(esp_ble_mesh_model_t *model,
     }
 
     tid = net_buf_simple_pull_u8(buf);
-    genie_model_msg_check_tid(&g_vnd_msg_list, tid);
+    genie_model_msg_check_tid(tid);
 }
 
 static genie_opcode_cb_t genie_opcode_cb[] = {
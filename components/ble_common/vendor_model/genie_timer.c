@@ -36,8 +36,6 @@ extern nvs_handle_t NVS_HANDLE;
 
 static const char *TAG = "genie_timer";
 
-static utc_time_t local_time = {0};
-
 typedef enum {
     TIMER_OFF     = 0,
     TIMER_ON      = 1,
@@ -71,27 +69,35 @@ struct {
 struct {
     uint32_t init: 1;
     uint32_t update: 1;
-    esp_timer_handle_t timer;
+    esp_timer_handle_t timer;       /**< One-shot, armed for the nearest deadline */
     struct k_work work;
     util_semaphore_t lock;
-    genie_slist_t timer_list_active;
+    genie_slist_t timer_list_active; /**< Sorted by unixtime_match, earliest first */
     genie_slist_t timer_list_idle;
-    uint32_t unix_time;
+    uint32_t unix_time;              /**< Unix time at unix_time_us */
+    int64_t  unix_time_us;           /**< esp_timer time of the last local time update */
     uint32_t unix_time_sync_match;
     uint8_t  unix_time_sync_retry_times;
     genie_timer_event_func_t cb;
 } g_genie_timer;
 
 static inline uint8_t is_leap_year(uint16_t year);
+static inline utc_time_t convert_unix_to_utc(uint32_t unix_time);
+
+/* The local clock is derived from esp_timer, so it does not need a periodic tick */
+static uint32_t genie_timer_unixtime_now(void)
+{
+    return g_genie_timer.unix_time + (uint32_t)((esp_timer_get_time() - g_genie_timer.unix_time_us) / (1000 * 1000));
+}
 
 utc_time_t genie_timer_local_time_get(void)
 {
-    return local_time;
+    return convert_unix_to_utc(genie_timer_unixtime_now() + g_timing_data.timezone * HOUR);
 }
 
 uint32_t genie_timer_local_unixtime_get(void)
 {
-    return g_genie_timer.unix_time;
+    return genie_timer_unixtime_now();
 }
 
 static inline utc_time_t convert_unix_to_utc(uint32_t unix_time)
@@ -258,83 +264,9 @@ static inline uint8_t is_leap_year(uint16_t year)
     }
 }
 
-static inline void month_update(void)
-{
-    local_time.month++;
-
-    if (local_time.month >= 12) {
-        local_time.month = 0;
-        local_time.year++;
-    }
-}
-
-static inline void days_update(void)
-{
-    uint8_t month_days_list[12] = {
-        31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31,
-    };
-
-    local_time.day++;
-
-    if (is_leap_year(local_time.year)) {
-        month_days_list[1] = 29;
-    }
-
-    uint8_t month_day = month_days_list[local_time.month];
-
-    if (local_time.day > month_day) {
-        local_time.day = 0;
-        month_update();
-    }
-
-    local_time.weekday = (local_time.weekday + 1) % 7;
-}
-
-static inline void hours_update(void)
-{
-    local_time.hour++;
-
-    if (local_time.hour == 24) {
-        local_time.hour = 0;
-        days_update();
-    }
-}
-
-static inline void minutes_update(void)
-{
-    local_time.minutes++;
-
-    if (local_time.minutes == 60) {
-        local_time.minutes = 0;
-        hours_update();
-    }
-}
-
-static inline void seconds_update(void)
-{
-    local_time.seconds++;
-
-    if (local_time.seconds == 60) {
-        local_time.seconds = 0;
-        minutes_update();
-    }
-}
-
 static void genie_timer_update(void *args)
 {
-    if (!g_genie_timer.update) {
-        ESP_LOGD(TAG, "g_genie_timer.update %d", g_genie_timer.update);
-        return;
-    }
-
-    g_genie_timer.unix_time += 1;
-    seconds_update();
-
     k_work_submit(&g_genie_timer.work);
-
-    if (g_genie_timer.unix_time % 60 == 0) {
-        ESP_LOGI(TAG, "genie_timer_update %d", g_genie_timer.unix_time);
-    }
 }
 
 static inline uint8_t next_weekday_diff_get(uint8_t weekday_now, uint8_t schedule)
@@ -365,25 +297,73 @@ static inline uint8_t is_weekday_match(uint8_t weekday_now, uint8_t schedule)
     return (weekday_mask == (schedule & weekday_mask));
 }
 
-static inline uint8_t next_weekday(uint8_t weekday_now)
+static inline uint8_t unix_to_local_weekday(uint32_t unix_time)
 {
-    return (weekday_now + 1) % 7;
+    return ((unix_time + g_timing_data.timezone * HOUR) / DAY + 4) % 7; // 1970/1/1 is thursday
 }
 
-static int genie_timer_save(void)
+/* Changes are merged with the other deferred NVS stores into one write per window */
+static void genie_timer_save_request(void)
 {
 #ifdef GENIE_VENDOR_TIMER_STORE
-    int ret = 0;
+    VT_LOCK;
+    ble_mesh_nvs_store_deferred(NVS_HANDLE, GENIE_STORE_VENDOR_TIMER, &g_timing_data, sizeof(g_timing_data));
+    VT_UNLOCK;
+#endif
+}
 
-    ret = ble_mesh_nvs_store(NVS_HANDLE, GENIE_STORE_VENDOR_TIMER, &g_timing_data, sizeof(g_timing_data));
-    if (ret) {
-        ESP_LOGI(TAG, "vendor timers save fail %d", ret);
+/* Must be called with VT_LOCK held */
+static void genie_timer_active_insert(struct genie_timer_t *vendor_timer)
+{
+    struct genie_timer_t *node = NULL;
+    genie_snode_t *prev = NULL;
+
+    GENIE_SLIST_FOR_EACH_CONTAINER(&g_genie_timer.timer_list_active, node, next) {
+        if (node->unixtime_match > vendor_timer->unixtime_match) {
+            break;
+        }
+
+        prev = &node->next;
     }
 
-    return ret;
-#else
-    return -1;
-#endif
+    genie_slist_insert(&g_genie_timer.timer_list_active, prev, &vendor_timer->next);
+}
+
+/* Arm the one-shot timer for the nearest timer or time sync deadline */
+static void genie_timer_schedule(void)
+{
+    struct genie_timer_t *node = NULL;
+    uint32_t deadline = 0;
+    int64_t  delay_us = 0;
+
+    VT_LOCK;
+
+    esp_timer_stop(g_genie_timer.timer);
+
+    if (!g_genie_timer.update) {
+        VT_UNLOCK;
+        return;
+    }
+
+    node = GENIE_SLIST_PEEK_HEAD_CONTAINER(&g_genie_timer.timer_list_active, node, next);
+
+    if (node) {
+        deadline = node->unixtime_match;
+    }
+
+    if (g_genie_timer.unix_time_sync_match
+            && (!deadline || g_genie_timer.unix_time_sync_match < deadline)) {
+        deadline = g_genie_timer.unix_time_sync_match;
+    }
+
+    if (deadline) {
+        delay_us = g_genie_timer.unix_time_us + (int64_t)(deadline - g_genie_timer.unix_time) * 1000 * 1000
+                   - esp_timer_get_time();
+        esp_timer_start_once(g_genie_timer.timer, delay_us > 0 ? delay_us : 0);
+        ESP_LOGD(TAG, "next deadline %d in %lld us", deadline, delay_us);
+    }
+
+    VT_UNLOCK;
 }
 
 static int genie_timer_restore(void)
@@ -409,7 +389,7 @@ static int genie_timer_restore(void)
 
     for (int i = 0; i < VT_NUM; i++) {
         if (g_timing_data.timer_data[i].state != TIMER_INVAILD) {
-            genie_slist_append(&g_genie_timer.timer_list_active, &g_timing_data.timer_data[i].next);
+            genie_timer_active_insert(&g_timing_data.timer_data[i]);
         } else {
             genie_slist_append(&g_genie_timer.timer_list_idle, &g_timing_data.timer_data[i].next);
         }
@@ -426,64 +406,85 @@ static int genie_timer_restore(void)
 #endif
 }
 
-static uint8_t is_genie_timer_timeout(struct genie_timer_t *vendor_timer)
+/* The first occurrence of a periodic timer after unix_time */
+static uint32_t genie_timer_periodic_next(struct genie_timer_t *vendor_timer, uint32_t unix_time)
 {
-    if (vendor_timer->state == TIMER_INVAILD) {
-        return 0;
+    uint32_t match = vendor_timer->unixtime_match;
+
+    if (match <= unix_time) {
+        match += ((unix_time - match) / DAY + 1) * DAY;
     }
 
-    if (vendor_timer->periodic) {
-        if (is_weekday_match(local_time.weekday, vendor_timer->schedule)
-                && vendor_timer->unixtime_match < g_genie_timer.unix_time) {
-            vendor_timer->unixtime_match += (1 + next_weekday_diff_get(next_weekday(local_time.weekday), vendor_timer->schedule)) * DAY;
-        }
+    for (int i = 0; i < 7 && !is_weekday_match(unix_to_local_weekday(match), vendor_timer->schedule); i++) {
+        match += DAY;
     }
 
-    return vendor_timer->unixtime_match == g_genie_timer.unix_time;
+    return match;
 }
 
 static void genie_timer_check(void)
 {
-    struct genie_timer_t *tmp, *node;
-    GENIE_SLIST_FOR_EACH_CONTAINER_SAFE(&g_genie_timer.timer_list_active, node,  tmp, next) {
-        if (is_genie_timer_timeout(node)) {
-            if (g_genie_timer.cb) {
-                g_genie_timer.cb(GENIE_TIME_EVT_TIMEOUT, node->index, &node->attr_data);
-            }
+    uint32_t unix_time = genie_timer_unixtime_now();
+    struct genie_timer_t *node = NULL;
+    genie_timer_attr_data_t attr_data;
+    uint8_t index = 0;
+    bool retired = false;
 
-            VT_LOCK;
+    /* Handle every timer that is due, the active list is sorted by deadline */
+    for (;;) {
+        VT_LOCK;
 
-            if (!node->periodic) {
-                node->unixtime_match = 0xffffffff;
-                node->state          = TIMER_INVAILD;
-                genie_slist_find_and_remove(&g_genie_timer.timer_list_active, &node->next);
-                genie_slist_append(&g_genie_timer.timer_list_idle, &node->next);
-            } else {
-                node->unixtime_match += 24 * HOUR;
-            }
+        node = GENIE_SLIST_PEEK_HEAD_CONTAINER(&g_genie_timer.timer_list_active, node, next);
 
+        if (!node || node->unixtime_match > unix_time) {
             VT_UNLOCK;
-            genie_timer_save();
+            break;
+        }
+
+        genie_slist_get_not_empty(&g_genie_timer.timer_list_active);
+        index     = node->index;
+        attr_data = node->attr_data;
+
+        if (!node->periodic) {
+            node->unixtime_match = 0xffffffff;
+            node->state          = TIMER_INVAILD;
+            genie_slist_append(&g_genie_timer.timer_list_idle, &node->next);
+            retired = true;
+        } else {
+            /* The next occurrence follows from the schedule, no need to persist it */
+            node->unixtime_match = genie_timer_periodic_next(node, unix_time);
+            genie_timer_active_insert(node);
         }
+
+        VT_UNLOCK;
+
+        if (g_genie_timer.cb) {
+            g_genie_timer.cb(GENIE_TIME_EVT_TIMEOUT, index, &attr_data);
+        }
+    }
+
+    if (retired) {
+        genie_timer_save_request();
     }
 
     if (g_genie_timer.unix_time_sync_match
-            && g_genie_timer.unix_time_sync_match <= g_genie_timer.unix_time) {
+            && g_genie_timer.unix_time_sync_match <= unix_time) {
+        int ret = 0;
+
         if (g_genie_timer.cb) {
-            int ret = g_genie_timer.cb(GENIE_TIME_EVT_TIMING_SYNC, 0, NULL);
-
-            if (ret) {
-                if (g_genie_timer.unix_time_sync_retry_times > 0) {
-                    g_genie_timer.unix_time_sync_match += g_timing_data.timing_sync_config.retry_delay * MINU;
-                    g_genie_timer.unix_time_sync_retry_times--;
-                    return;
-                }
-            }
+            ret = g_genie_timer.cb(GENIE_TIME_EVT_TIMING_SYNC, 0, NULL);
         }
 
-        g_genie_timer.unix_time_sync_match       = g_genie_timer.unix_time + g_timing_data.timing_sync_config.period_time * MINU;
-        g_genie_timer.unix_time_sync_retry_times = g_timing_data.timing_sync_config.retry_times;
+        if (ret && g_genie_timer.unix_time_sync_retry_times > 0) {
+            g_genie_timer.unix_time_sync_match += g_timing_data.timing_sync_config.retry_delay * MINU;
+            g_genie_timer.unix_time_sync_retry_times--;
+        } else {
+            g_genie_timer.unix_time_sync_match       = unix_time + g_timing_data.timing_sync_config.period_time * MINU;
+            g_genie_timer.unix_time_sync_retry_times = g_timing_data.timing_sync_config.retry_times;
+        }
     }
+
+    genie_timer_schedule();
 }
 
 static void genie_timer_check_work(struct k_work *work)
@@ -549,7 +550,7 @@ int genie_timer_start(uint8_t index, uint32_t unix_time, genie_timer_attr_data_t
         //return -GENIE_TIMER_ERR_INDEX;
     }
 
-    if (unix_time <= g_genie_timer.unix_time) {
+    if (unix_time <= genie_timer_unixtime_now()) {
         return -GENIE_TIMER_ERR_PARAM;
     }
 
@@ -568,16 +569,18 @@ int genie_timer_start(uint8_t index, uint32_t unix_time, genie_timer_attr_data_t
     }
 
     vendor_timer->index          = index;
+    vendor_timer->periodic       = 0;
     vendor_timer->unixtime_match = unix_time;        // + g_genie_timer.timezone * HOUR;
     vendor_timer->state          = TIMER_ON;
     vendor_timer->attr_data.type = attr_data->type;
     vendor_timer->attr_data.para = attr_data->para;
 
     VT_LOCK;
-    genie_slist_append(&g_genie_timer.timer_list_active, &vendor_timer->next);
+    genie_timer_active_insert(vendor_timer);
     VT_UNLOCK;
 
-    genie_timer_save();
+    genie_timer_schedule();
+    genie_timer_save_request();
 
     return 0;
 }
@@ -626,6 +629,7 @@ int genie_timer_periodic_start(uint8_t index, uint16_t periodic_time, uint8_t sc
     vendor_timer->schedule      = schedule;
     vendor_timer->state         = TIMER_ON;
 
+    utc_time_t local_time  = genie_timer_local_time_get();
     utc_time_t utc         = local_time;
     utc.hour    = 0;
     utc.minutes = 0;
@@ -633,13 +637,16 @@ int genie_timer_periodic_start(uint8_t index, uint16_t periodic_time, uint8_t sc
     utc.day     = utc.day + next_weekday_diff_get(local_time.weekday, schedule);
 
     vendor_timer->unixtime_match = convert_utc_to_unix(&utc) + periodic_time - g_timing_data.timezone * HOUR;
+    vendor_timer->unixtime_match = genie_timer_periodic_next(vendor_timer, genie_timer_unixtime_now());
 
     ESP_LOGI(TAG, "periodic timer unixtime_match %d", vendor_timer->unixtime_match);
 
     VT_LOCK;
-    genie_slist_append(&g_genie_timer.timer_list_active, &vendor_timer->next);
+    genie_timer_active_insert(vendor_timer);
     VT_UNLOCK;
-    genie_timer_save();
+
+    genie_timer_schedule();
+    genie_timer_save_request();
     return 0;
 }
 
@@ -691,12 +698,15 @@ int genie_timer_remove(uint8_t index)
             genie_timer_stop(i);
         }
 
+        genie_timer_schedule();
+        genie_timer_save_request();
         return 0;
     }
 
     ret = genie_timer_stop(index);
 
-    genie_timer_save();
+    genie_timer_schedule();
+    genie_timer_save_request();
 
     return ret;
 }
@@ -704,6 +714,8 @@ int genie_timer_remove(uint8_t index)
 void genie_timer_local_time_show(void)
 {
     ENTER_FUNC();
+    utc_time_t local_time = genie_timer_local_time_get();
+
     ESP_LOGI(TAG, "unix_time revert %d", convert_utc_to_unix(&local_time));
     ESP_LOGI(TAG, "%4d/%2d/%2d %2d:%2d:%d weekday %2d %04d",
              local_time.year, local_time.month + 1, local_time.day,
@@ -750,9 +762,11 @@ int genie_timer_time_sync_set(uint16_t period_time, uint8_t retry_delay,   uint8
     g_timing_data.timing_sync_config.retry_delay = retry_delay;
     g_timing_data.timing_sync_config.retry_times = retry_times;
 
-    g_genie_timer.unix_time_sync_match       = g_genie_timer.unix_time +  g_timing_data.timing_sync_config.period_time * MINU;
+    g_genie_timer.unix_time_sync_match       = genie_timer_unixtime_now() +  g_timing_data.timing_sync_config.period_time * MINU;
     g_genie_timer.unix_time_sync_retry_times = retry_times;
 
+    genie_timer_schedule();
+
     return 0;
 }
 
@@ -775,10 +789,50 @@ int genie_timer_local_time_update(uint32_t unix_time)
         return -GENIE_TIMER_ERR_INIT;
     }
 
-    g_genie_timer.update    = 1;
-    g_genie_timer.unix_time = unix_time;
+    struct genie_timer_t *node = NULL;
+    genie_slist_t list;
+    bool retired = false;
+
+    VT_LOCK;
+    /* The time sync deadline was set on the old clock, keep the same distance to it on the new one */
+    if (g_genie_timer.unix_time_sync_match) {
+        g_genie_timer.unix_time_sync_match += unix_time - genie_timer_unixtime_now();
+    }
+
+    g_genie_timer.update       = 1;
+    g_genie_timer.unix_time    = unix_time;
+    g_genie_timer.unix_time_us = esp_timer_get_time();
+
+    /**
+     * The clock may have jumped, move periodic timers to their next occurrence and retire
+     * one-shot timers whose time has already passed, then sort the active list again
+     */
+    list = g_genie_timer.timer_list_active;
+    genie_slist_init(&g_genie_timer.timer_list_active);
+
+    while ((node = GENIE_SLIST_CONTAINER(genie_slist_get(&list), node, next))) {
+        if (node->periodic) {
+            node->unixtime_match = genie_timer_periodic_next(node, unix_time);
+        } else if (node->unixtime_match <= unix_time) {
+            ESP_LOGI(TAG, "timer %d expired while the local time was unknown", node->index);
+            node->unixtime_match = 0xffffffff;
+            node->state          = TIMER_INVAILD;
+            genie_slist_append(&g_genie_timer.timer_list_idle, &node->next);
+            retired = true;
+            continue;
+        }
+
+        genie_timer_active_insert(node);
+    }
+    VT_UNLOCK;
+
+    genie_timer_schedule();
+
+    if (retired) {
+        genie_timer_save_request();
+    }
 
-    local_time = convert_unix_to_utc(unix_time + g_timing_data.timezone * HOUR);
+    utc_time_t local_time = genie_timer_local_time_get();
 
     ESP_LOGI(TAG, "unix_time %d", unix_time);
     ESP_LOGI(TAG, "localtime update %4d/%2d/%2d %2d:%2d:%d weekday %2d",
@@ -804,7 +858,6 @@ int genie_timer_init(genie_timer_event_func_t cb)
     }
 
     memset(&g_genie_timer, 0, sizeof(g_genie_timer));
-    memset(&local_time, 0, sizeof(local_time));
 
     g_genie_timer.cb = cb;
 
@@ -820,8 +873,8 @@ int genie_timer_init(genie_timer_event_func_t cb)
         .name     = "genie_timer"
     };
 
+    /* Armed by genie_timer_schedule() for the nearest deadline only */
     ESP_ERROR_CHECK(esp_timer_create(&create_args, &g_genie_timer.timer));
-    ESP_ERROR_CHECK(esp_timer_start_periodic(g_genie_timer.timer, 1000 * 1000));
 
     g_genie_timer.init = 1;
 
@@ -24,12 +24,14 @@ extern "C" {
 #endif /**< __cplusplus */
 
 #define GENIE_VENDOR_MSG_LIST_MAXSIZE 8
+#define GENIE_VENDOR_MSG_DATA_MAXSIZE 32 /**< Largest payload kept for retransmission */
 
 typedef struct _genie_vendor_model_msg_node {
-    genie_dnode_t node;
+    uint8_t heap_index;                            /**< Position in the deadline heap */
     int8_t left_retry;
-    int64_t timeout;
+    int64_t timeout;                               /**< Absolute deadline of the next resend, in us */
     genie_model_msg_t msg;
+    uint8_t data[GENIE_VENDOR_MSG_DATA_MAXSIZE];   /**< Inline copy of msg.data */
 } genie_model_msg_node_t;
 
 typedef void (* genie_model_opcode_cb_t)(esp_ble_mesh_model_t *model, esp_ble_mesh_msg_ctx_t *ctx, struct net_buf_simple *buf);
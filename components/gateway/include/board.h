@@ -28,6 +28,19 @@ extern "C" {
 
 #define POWERUP_KEY  "powerup"
 
+/**
+ * @brief The mesh state of an element, as shown on the light
+ */
+typedef struct {
+    uint8_t  onoff;       /**< Generic OnOff */
+    bool     color;       /**< Show hue/saturation/lightness, otherwise actual/temperature on the white channels */
+    uint16_t actual;      /**< Light Lightness Actual */
+    uint16_t temperature; /**< Light CTL Temperature */
+    uint16_t hue;         /**< Light HSL Hue */
+    uint16_t saturation;  /**< Light HSL Saturation */
+    uint16_t lightness;   /**< Light HSL Lightness */
+} board_led_state_t;
+
 /**
  * @brief
  */
@@ -53,6 +66,11 @@ void board_led_lightness(uint8_t elem_index, uint16_t actual);
  */
 void board_led_switch(uint8_t elem_index, uint8_t onoff);
 
+/**
+ * @brief Show the whole state of an element with a single light driver update
+ */
+void board_led_update(uint8_t elem_index, const board_led_state_t *state);
+
 /**
  * @brief
  */
@@ -28,6 +28,9 @@
 #define ESP_GATEWAY_WIFI_ROUTER_STA_PASSWORD CONFIG_WIFI_ROUTER_STA_PASSWORD
 #define ESP_GATEWAY_WIFI_ROUTER_AP_SSID      CONFIG_WIFI_ROUTER_AP_SSID
 #define ESP_GATEWAY_WIFI_ROUTER_AP_PASSWORD  CONFIG_WIFI_ROUTER_AP_PASSWORD
+#define ESP_GATEWAY_WIFI_ROUTER_BRIDGE       CONFIG_WIFI_ROUTER_BRIDGE
+#define ESP_GATEWAY_WIFI_ROUTER_STEERING     CONFIG_WIFI_ROUTER_STEERING
+#define ESP_GATEWAY_WIFI_ROUTER_MAX_STA_CONN CONFIG_WIFI_ROUTER_MAX_STA_CONN
 
 #define ESP_GATEWAY_4G_ROUTER_AP_SSID        CONFIG_4G_ROUTER_AP_SSID
 #define ESP_GATEWAY_4G_ROUTER_AP_PASSWORD    CONFIG_4G_ROUTER_AP_PASSWORD
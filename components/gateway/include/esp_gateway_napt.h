@@ -0,0 +1,76 @@
+// Copyright 2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <esp_err.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define ESP_GATEWAY_NAPT_NETIF_MAX          4       /**< Interfaces NAPT can be enabled on at the same time */
+#define ESP_GATEWAY_NAPT_MONITOR_PERIOD_MS  10000   /**< Period of the table pressure check */
+
+typedef struct {
+    uint8_t netif_num;              /**< Interfaces with NAPT enabled */
+    bool stats_valid;               /**< false if lwIP was built without NAPT statistics */
+    uint16_t active_tcp;            /**< TCP entries in the table */
+    uint16_t active_udp;
+    uint16_t active_icmp;
+    uint16_t max_active_tcp;        /**< Peak number of TCP entries */
+    uint16_t max_active_udp;
+    uint16_t max_active_icmp;
+    uint32_t forced_evictions;      /**< Live entries dropped because the table was full */
+    uint16_t ports_in_use;          /**< External ports held by TCP and UDP entries, one per entry */
+    uint16_t port_capacity;         /**< Entries of the table, at most this many ports can be in use */
+    uint32_t port_allocations;      /**< External ports allocated since NAPT was first enabled, a lower bound:
+                                         lwIP does not count them, so they are inferred from the growth of the
+                                         entries and the evictions each time the counters are read, and
+                                         a flow that starts and expires between two reads is missed */
+} esp_gateway_napt_stats_t;
+
+/**
+ * @brief Enable NAPT on the interface with address `ip`. Enabling the same
+ *        address again is a no-op. The first call allocates the NAPT table
+ *        with CONFIG_GATEWAY_NAPT_TABLE_SIZE entries.
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_NO_MEM: ESP_GATEWAY_NAPT_NETIF_MAX interfaces already have NAPT
+ */
+esp_err_t esp_gateway_napt_enable(uint32_t ip);
+
+/**
+ * @brief Disable NAPT on the interface with address `ip`. Disabling the last
+ *        interface frees the NAPT table, the next enable allocates it again.
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_NOT_FOUND: NAPT was not enabled on it
+ */
+esp_err_t esp_gateway_napt_disable(uint32_t ip);
+
+/**
+ * @brief Get the NAPT table counters.
+ */
+esp_err_t esp_gateway_napt_get_stats(esp_gateway_napt_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -30,7 +30,20 @@ extern "C"
 #define VENDOR_OUI_2 CONFIG_VENDOR_OUI_2
 
 #define VENDOR_IE_DATA_LENGTH_MINIMUM 4
-#define VENDOR_IE_DATA_LENGTH (VENDOR_IE_DATA_LENGTH_MINIMUM + VENDOR_IE_MAX)
+#define VENDOR_IE_DATA_LENGTH_BASE (VENDOR_IE_DATA_LENGTH_MINIMUM + VENDOR_IE_MAX)
+#define VENDOR_IE_DATA_LENGTH (VENDOR_IE_DATA_LENGTH_BASE + VENDOR_IE_EXT_LENGTH)
+
+/**
+ * The fixed fields are followed by an extension: a version byte, then TLVs of
+ * one type byte, one length byte and the value. Nodes that predate it read the
+ * fixed fields only, readers skip the TLV types they do not know.
+ */
+#define VENDOR_IE_EXT_VERSION 1
+#define VENDOR_IE_EXT_LENGTH  (1 + (2 + 2) + (2 + 1))
+#define VENDOR_IE_METRIC_UNKNOWN 0xFF   /**< Percentage not measured */
+
+#define ESP_GATEWAY_VENDOR_IE_UPDATE_DELAY_MS     100     /**< Changes made within this window share one beacon update */
+#define ESP_GATEWAY_VENDOR_IE_UPDATE_INTERVAL_MS  1000    /**< Minimum time between two beacon updates */
 
 typedef enum {
     WIFI_ROUTER_LEVEL_0 = 0,
@@ -51,6 +64,27 @@ typedef enum {
     VENDOR_IE_MAX,
 } esp_gateway_vendor_ie_t;
 
+/**
+ * Types 1 and 3 carried an uplink throughput guessed from the RSSI and a channel
+ * utilization that was never measured, they are no longer sent nor read.
+ */
+typedef enum {
+    VENDOR_IE_TLV_QUEUE_OCCUPANCY = 2,      /**< uint8_t, percent */
+    VENDOR_IE_TLV_FORWARD_RATE    = 4,      /**< uint16_t little endian, frames per second */
+} esp_gateway_vendor_ie_tlv_t;
+
+typedef struct {
+    uint16_t forward_rate;          /**< Frames per second handled by this node, see esp_gateway_wifi_link_state_t */
+    uint8_t queue_occupancy;        /**< Percent of the lwIP input queue, VENDOR_IE_METRIC_UNKNOWN if unknown */
+} esp_gateway_vendor_ie_metrics_t;
+
+#define ESP_GATEWAY_VENDOR_IE_PARENT_MAX          8       /**< Candidate parents kept in the topology table */
+#define ESP_GATEWAY_VENDOR_IE_PARENT_AGE_MS       180000  /**< Candidates not heard for this long are ignored */
+#define ESP_GATEWAY_VENDOR_IE_EVALUATE_PERIOD_MS  60000   /**< Period of the scan looking for a better parent */
+#define ESP_GATEWAY_VENDOR_IE_EVALUATE_DWELL_MS   120     /**< That scan only covers the current channel, a little over a beacon interval */
+#define ESP_GATEWAY_VENDOR_IE_SWITCH_HYSTERESIS   60      /**< Path cost a candidate must save to replace the parent */
+#define ESP_GATEWAY_VENDOR_IE_SWITCH_CONFIRM      2       /**< Evaluations in a row the same candidate must win */
+
 typedef struct {
     uint8_t level;
     uint8_t rssi;
@@ -60,6 +94,78 @@ typedef struct {
 void esp_gateway_vendor_ie_cb(void *ctx, wifi_vendor_ie_type_t type, const uint8_t sa[6], const vendor_ie_data_t *vnd_ie, int rssi);
 
 vendor_ie_data_t *esp_wifi_vendor_ie_init(void);
+
+/**
+ * @brief Set a fixed field of the advertised vendor ie.
+ *
+ * @note  The beacon is not rewritten right away, changes are coalesced and
+ *        applied by a single updater at most every ESP_GATEWAY_VENDOR_IE_UPDATE_INTERVAL_MS.
+ */
+void esp_gateway_vendor_ie_set(esp_gateway_vendor_ie_t field, uint8_t value);
+
+/**
+ * @brief Add `delta` to a fixed field, e.g. STATION_NUMBER on station join and leave.
+ */
+void esp_gateway_vendor_ie_add(esp_gateway_vendor_ie_t field, int delta);
+
+/**
+ * @brief Set the load metrics carried in the extension, coalesced like esp_gateway_vendor_ie_set().
+ */
+void esp_gateway_vendor_ie_set_metrics(const esp_gateway_vendor_ie_metrics_t *metrics);
+
+/**
+ * @brief Look for another repeater of the mesh a station could move to.
+ *
+ * Only repeaters at the level of this node or closer to the router count, so
+ * the children of this node are never offered.
+ *
+ * @param[out] station_num  Stations on the least loaded one, may be NULL
+ *
+ * @return true if a repeater connected to the router with room left is known
+ */
+bool esp_gateway_vendor_ie_neighbor_available(uint8_t *station_num);
+
+/**
+ * @brief Forget all candidate parents, e.g. before looking for a new parent
+ *        after the link was lost.
+ */
+void esp_gateway_vendor_ie_parent_reset(void);
+
+/**
+ * @brief Add the upstream router APs found by a scan as level 0 candidates, so
+ *        a repeater with a good enough link can connect to the router directly.
+ */
+void esp_gateway_vendor_ie_router_update(const wifi_ap_record_t *records, uint16_t number);
+
+/**
+ * @brief Pick the candidate with the lowest path cost.
+ *
+ * The path cost adds up the hop count, the RSSI of the link to the candidate,
+ * the RSSI of the candidate's own uplink, the stations already sharing it and
+ * the traffic and queue occupancy it advertises.
+ * Only candidates connected to the router, with room left and a level below
+ * `max_level` are considered.
+ *
+ * @param max_level  Pass UINT8_MAX to accept any level
+ * @param[out] parent  Set to the best candidate, or to level 0 without MAC if none
+ *
+ * @return true if a candidate was found
+ */
+bool esp_gateway_vendor_ie_select_parent(uint8_t max_level, ap_router_t *parent);
+
+/**
+ * @brief Check whether switching away from the current parent is worth it.
+ *
+ * A candidate is only returned once it has beaten the current parent by
+ * ESP_GATEWAY_VENDOR_IE_SWITCH_HYSTERESIS on ESP_GATEWAY_VENDOR_IE_SWITCH_CONFIRM
+ * calls in a row. Only candidates below `own_level` are considered, so a node
+ * never attaches to one of its own descendants.
+ *
+ * @param bssid      BSSID of the current parent
+ * @param own_level  LEVEL advertised by this node
+ * @param[out] parent  Set to the new parent when true is returned
+ */
+bool esp_gateway_vendor_ie_better_parent(const uint8_t bssid[MAC_LEN], uint8_t own_level, ap_router_t *parent);
 #endif // SET_VENDOR_IE
 
 #ifdef __cplusplus
@@ -0,0 +1,61 @@
+// Copyright 2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <esp_err.h>
+#include "esp_netif.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define ESP_GATEWAY_BRIDGE_MAC_NAT_MAX      16      /**< Clients the MAC-NAT table can hold */
+#define ESP_GATEWAY_BRIDGE_MAC_NAT_AGE_MS   300000  /**< Entries not refreshed for this long may be replaced */
+
+typedef struct {
+    uint32_t uplink_frames;     /**< Frames forwarded from the SoftAP to the station interface */
+    uint32_t downlink_frames;   /**< Frames forwarded from the station interface to the SoftAP */
+    uint32_t local_frames;      /**< Frames from the router handed to lwIP */
+    uint32_t dropped_frames;    /**< Frames that could not be forwarded */
+} esp_gateway_wifi_bridge_stats_t;
+
+/**
+ * @brief Bridge the SoftAP and the station interface at layer 2.
+ *
+ * Frames from SoftAP clients are sent to the router with the station MAC as
+ * source, and frames from the router are sent on to the client owning the
+ * destination IPv4 address, like a MAC-NAT repeater. Clients get their address
+ * from the upstream DHCP server. Only frames addressed to the gateway itself
+ * reach lwIP, through the station netif. No SoftAP netif is needed.
+ *
+ * @note  Call it after esp_wifi_start() with the Wi-Fi mode set to WIFI_MODE_APSTA.
+ *        Only IPv4 and ARP are translated, other protocols are forwarded uplink
+ *        with the station MAC and delivered to lwIP downlink.
+ *
+ * @param sta_netif  Station netif, receives the frames addressed to the gateway
+ */
+esp_err_t esp_gateway_wifi_bridge_start(esp_netif_t *sta_netif);
+
+/**
+ * @brief Stop bridging and give the interfaces back to their netifs.
+ */
+esp_err_t esp_gateway_wifi_bridge_stop(void);
+
+esp_err_t esp_gateway_wifi_bridge_get_stats(esp_gateway_wifi_bridge_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,99 @@
+// Copyright 2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <esp_err.h>
+#include "esp_wifi.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define ESP_GATEWAY_WIFI_LINK_PERIOD_MS         1000    /**< Period of the link adaptation */
+#define ESP_GATEWAY_WIFI_LINK_IDLE_FPS          20      /**< Frames per second below which the link is idle */
+#define ESP_GATEWAY_WIFI_LINK_IDLE_PERIODS      5       /**< Idle periods in a row before modem sleep */
+#define ESP_GATEWAY_WIFI_LINK_TARGET_RSSI       (-67)   /**< RSSI the weakest peer should receive this node at */
+#define ESP_GATEWAY_WIFI_LINK_PEER_TX_POWER     20      /**< dBm, assumed TX power of the peers */
+#define ESP_GATEWAY_WIFI_LINK_TX_POWER_MAX      80      /**< 0.25 dBm, 20 dBm */
+#define ESP_GATEWAY_WIFI_LINK_TX_POWER_MIN      44      /**< 0.25 dBm, 11 dBm keeps the SoftAP visible to new stations */
+#define ESP_GATEWAY_WIFI_LINK_TX_POWER_STEP     8       /**< 0.25 dBm, largest decrease per period */
+#define ESP_GATEWAY_WIFI_LINK_HT40_RSSI         (-82)   /**< Weaker BSSs do not count as overlapping */
+#define ESP_GATEWAY_WIFI_LINK_HT40_OVERLAP_MAX  2       /**< Overlapping BSSs tolerated before falling back to HT20 */
+
+typedef enum {
+    ESP_GATEWAY_WIFI_LINK_PROFILE_ROUTER = 0,   /**< SoftAP or uplink forwarding for several stations */
+    ESP_GATEWAY_WIFI_LINK_PROFILE_DONGLE,       /**< Station forwarding for a single host */
+} esp_gateway_wifi_link_profile_t;
+
+#define ESP_GATEWAY_WIFI_LINK_ROUTER_STATIC_RX_BUF   16
+#define ESP_GATEWAY_WIFI_LINK_ROUTER_DYNAMIC_RX_BUF  64
+#define ESP_GATEWAY_WIFI_LINK_ROUTER_DYNAMIC_TX_BUF  64
+#define ESP_GATEWAY_WIFI_LINK_DONGLE_STATIC_RX_BUF   12
+#define ESP_GATEWAY_WIFI_LINK_DONGLE_DYNAMIC_RX_BUF  48
+#define ESP_GATEWAY_WIFI_LINK_DONGLE_DYNAMIC_TX_BUF  32
+
+typedef struct {
+    wifi_ps_type_t ps_type;
+    int8_t tx_power;                /**< 0.25 dBm */
+    wifi_bandwidth_t ap_bandwidth;
+    uint32_t frames_per_second;     /**< Received and sent by lwIP or reported by esp_gateway_wifi_link_activity() */
+    uint8_t queue_occupancy;        /**< Percent of the lwIP input queue at its peak, smoothed over a few periods,
+                                         UINT8_MAX if lwIP keeps no pool statistics */
+    int8_t weakest_rssi;            /**< Weakest station or uplink, 0 if there is none */
+} esp_gateway_wifi_link_state_t;
+
+/**
+ * @brief Raise the Wi-Fi buffer counts of `cfg` for the given profile, values
+ *        already larger in sdkconfig are kept. Call it before esp_wifi_init().
+ */
+void esp_gateway_wifi_link_init_config(wifi_init_config_t *cfg, esp_gateway_wifi_link_profile_t profile);
+
+/**
+ * @brief Start adapting the link to the traffic and to the peers.
+ *
+ * - Modem sleep is used while a station-only link is idle and left as soon as
+ *   traffic comes back. It is never used while the SoftAP is on: the IDF v4.4
+ *   Wi-Fi driver does not sleep in AP or APSTA mode, so repeaters stay awake.
+ *   The dongle runs station-only unless ENABLE_SOFTAP_FOR_WIFI_CONFIG is set,
+ *   and so does an Ethernet router started as a station.
+ *   If esp_wifi_set_ps() fails, e.g. under BLE coexistence, the adaptation
+ *   stops until the next start.
+ * - The TX power is sized so that the weakest station or uplink still hears
+ *   this node at ESP_GATEWAY_WIFI_LINK_TARGET_RSSI, assuming a symmetric path.
+ *   It is only lowered while no station is attached to the SoftAP, so child
+ *   repeaters do not see their path cost move under them.
+ * - The SoftAP uses HT40 when the last scan found at most
+ *   ESP_GATEWAY_WIFI_LINK_HT40_OVERLAP_MAX BSSs on the neighbouring channels.
+ *
+ * @note  Call it after esp_wifi_start() and after the Wi-Fi mode is final.
+ */
+esp_err_t esp_gateway_wifi_link_start(void);
+
+esp_err_t esp_gateway_wifi_link_stop(void);
+
+/**
+ * @brief Report forwarded frames, the data paths that bypass lwIP call it so
+ *        the controller can tell an idle link from a busy one.
+ */
+void esp_gateway_wifi_link_activity(uint32_t frames);
+
+esp_err_t esp_gateway_wifi_link_get_state(esp_gateway_wifi_link_state_t *state);
+
+#ifdef __cplusplus
+}
+#endif
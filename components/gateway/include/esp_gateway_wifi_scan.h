@@ -0,0 +1,98 @@
+// Copyright 2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <esp_err.h>
+#include "esp_wifi.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define ESP_GATEWAY_WIFI_SCAN_CACHE_SIZE     40  /**< Max AP records kept in the scan cache */
+#define ESP_GATEWAY_WIFI_SCAN_SUBSCRIBER_MAX 4
+#define ESP_GATEWAY_WIFI_SCAN_WAIT_MS        5000 /**< Upper bound for one all-channel scan */
+
+/**
+ * @brief Called from the default event loop task each time a scan finishes.
+ *
+ * @note  `records` points into the cache and is sorted by RSSI, strongest first.
+ *        It is only valid during the call. The callback must not block, and of
+ *        this API it may only call esp_gateway_wifi_scan_request().
+ */
+typedef void (*esp_gateway_wifi_scan_cb_t)(const wifi_ap_record_t *records, uint16_t number, void *arg);
+
+/**
+ * @brief Initialise the shared scan service. Must be called after esp_wifi_init(),
+ *        calling it more than once is harmless.
+ */
+esp_err_t esp_gateway_wifi_scan_init(void);
+
+/**
+ * @brief Start a non-blocking scan. Returns immediately; if a scan is already
+ *        running the request is merged into it.
+ */
+esp_err_t esp_gateway_wifi_scan_request(void);
+
+/**
+ * @brief Start a non-blocking active scan of one channel, `dwell_ms` long.
+ *        Its records only go to `cb`, the cache and the subscribers are left
+ *        alone since they hold all channels.
+ *
+ * @note  If a scan of all channels is already running, `cb` gets its records
+ *        instead. A scan of all channels requested meanwhile starts once this
+ *        one is done. `cb` has the constraints of esp_gateway_wifi_scan_cb_t,
+ *        `records` is NULL and `number` 0 if the scan failed.
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_STATE: another channel scan is pending
+ *     - Others: the scan could not be started
+ */
+esp_err_t esp_gateway_wifi_scan_request_channel(uint8_t channel, uint16_t dwell_ms,
+        esp_gateway_wifi_scan_cb_t cb, void *arg);
+
+/**
+ * @brief Make sure the cache is no older than `max_age_ms`, starting a scan
+ *        and waiting up to `wait_ms` for it if needed.
+ *
+ * @note  Must not be called from the default event loop task.
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_TIMEOUT: the scan did not finish in time
+ *     - Others: the scan could not be started
+ */
+esp_err_t esp_gateway_wifi_scan_wait(uint32_t max_age_ms, uint32_t wait_ms);
+
+/**
+ * @brief Copy the cached records, strongest first.
+ *
+ * @param[in,out] number  In: capacity of `records`; out: records copied
+ * @param[out]    age_ms  Age of the cache, may be NULL
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_NOT_FOUND: no scan has completed yet
+ */
+esp_err_t esp_gateway_wifi_scan_get_records(wifi_ap_record_t *records, uint16_t *number, uint32_t *age_ms);
+
+esp_err_t esp_gateway_wifi_scan_subscribe(esp_gateway_wifi_scan_cb_t cb, void *arg);
+esp_err_t esp_gateway_wifi_scan_unsubscribe(esp_gateway_wifi_scan_cb_t cb, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
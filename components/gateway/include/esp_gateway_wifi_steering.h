@@ -0,0 +1,69 @@
+// Copyright 2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <esp_err.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define ESP_GATEWAY_STEERING_PERIOD_MS      5000    /**< Period of the station check */
+#define ESP_GATEWAY_STEERING_RSSI_MIN       (-75)   /**< Stations below this are poorly served */
+#define ESP_GATEWAY_STEERING_WEAK_CHECKS    3       /**< Checks in a row a station must stay weak */
+#define ESP_GATEWAY_STEERING_HOLD_MS        30000   /**< Stations are never steered sooner after joining */
+#define ESP_GATEWAY_STEERING_LOAD_MARGIN    2       /**< Stations a neighbor must have fewer of to take load */
+#define ESP_GATEWAY_STEERING_BLACKLIST_MAX  8
+#define ESP_GATEWAY_STEERING_BLACKLIST_MS   20000   /**< How long a steered station is kept off this AP */
+#define ESP_GATEWAY_STEERING_REJECT_MAX     3       /**< Rejoins refused before the station is let back in */
+
+/**
+ * Load is judged on station counts only, the traffic of each station is not
+ * measured and plays no part in the decisions counted here.
+ */
+typedef struct {
+    uint32_t weak_steered;      /**< Stations moved off because of their RSSI */
+    uint32_t load_steered;      /**< Stations moved off because this AP had more stations than a neighbor */
+    uint32_t rejected;          /**< Rejoins refused during the blacklist window */
+    uint32_t readmitted;        /**< Stations let back in after ESP_GATEWAY_STEERING_REJECT_MAX rejoins */
+} esp_gateway_wifi_steering_stats_t;
+
+/**
+ * @brief Start steering SoftAP stations to other repeaters of the mesh.
+ *
+ * Stations are checked every ESP_GATEWAY_STEERING_PERIOD_MS. A station whose
+ * RSSI stays below ESP_GATEWAY_STEERING_RSSI_MIN, or the weakest one when
+ * this AP is full and a neighbor is clearly less loaded, is deauthenticated
+ * and refused for ESP_GATEWAY_STEERING_BLACKLIST_MS so it joins a neighbor.
+ * Neighbors and their station count are known from the vendor ie beacons,
+ * only repeaters at the level of this node or closer to the router are
+ * neighbors. The throughput of each station is not used: a busy station and
+ * an idle one weigh the same.
+ *
+ * @note  Requires SET_VENDOR_IE. A station that keeps coming back is let in
+ *        again, it has no better AP in range.
+ */
+esp_err_t esp_gateway_wifi_steering_start(void);
+
+esp_err_t esp_gateway_wifi_steering_stop(void);
+
+esp_err_t esp_gateway_wifi_steering_get_stats(esp_gateway_wifi_steering_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
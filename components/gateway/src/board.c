@@ -19,6 +19,7 @@
 
 // #include "iot_button.h"
 #include "light_driver.h"
+#include "board.h"
 
 #define BUTTON_ON_OFF          0   /* on/off button */
 #define BUTTON_ACTIVE_LEVEL    0
@@ -143,6 +144,34 @@ void board_led_switch(uint8_t elem_index, uint8_t onoff)
     }
 }
 
+/**
+ * all channels at once
+ */
+void board_led_update(uint8_t elem_index, const board_led_state_t *state)
+{
+    static light_driver_frame_t last_frame = {0};
+    light_driver_frame_t frame = {
+        .on                = state->onoff != 0,
+        .mode              = state->color ? MODE_HSV : MODE_CTB,
+        .hue               = state->hue,
+        .saturation        = state->saturation,
+        .value             = state->lightness,
+        .color_temperature = state->temperature,
+        .brightness        = state->actual,
+    };
+
+    /* A settled element ticks the same frame again, it does not touch the channels */
+    if (last_frame.on != frame.on || last_frame.mode != frame.mode
+            || last_frame.hue != frame.hue || last_frame.saturation != frame.saturation || last_frame.value != frame.value
+            || last_frame.color_temperature != frame.color_temperature || last_frame.brightness != frame.brightness) {
+        last_frame = frame;
+
+        ESP_LOGD(TAG, "on: %d, mode: %d, hsv: %d, %d, %d, ctb: %d, %d", frame.on, frame.mode,
+                 frame.hue, frame.saturation, frame.value, frame.color_temperature, frame.brightness);
+        light_driver_set_frame(&frame);
+    }
+}
+
 #define MINDIFF (2.25e-308)
 
 static float bt_mesh_sqrt(float square)
@@ -17,7 +17,11 @@
 #include <errno.h>
 #include <math.h>
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "nvs_flash.h"
 
 #include "mbedtls/sha256.h"
@@ -47,6 +51,10 @@ nvs_handle_t NVS_HANDLE;
 elem_state_t g_elem_state[MESH_ELEM_STATE_COUNT] = {0};
 model_powerup_t g_powerup[MESH_ELEM_STATE_COUNT] = {0};
 
+/* Each element is stored under its own key, a change only rewrites that element */
+#define POWERUP_ELEM_KEY_LEN    16
+static char s_powerup_key[MESH_ELEM_STATE_COUNT][POWERUP_ELEM_KEY_LEN];
+
 static uint8_t static_val[16] = {0x64, 0xda, 0x19, 0x8f, 0x58, 0xea, 0x55, 0x85,
                                  0x75, 0x84, 0x0d, 0xbf, 0x4f, 0x6e, 0x36, 0x8f
                                 };
@@ -280,9 +288,24 @@ void user_prov_reset(void)
 {
     ENTER_FUNC();
     // todo: add custom code
+    ble_mesh_nvs_flush();
     esp_restart();
 }
 
+static const char *powerup_key(uint8_t elem_index)
+{
+    if (!s_powerup_key[elem_index][0]) {
+        snprintf(s_powerup_key[elem_index], POWERUP_ELEM_KEY_LEN, POWERUP_KEY "_%d", elem_index);
+    }
+
+    return s_powerup_key[elem_index];
+}
+
+static void save_powerup(uint8_t elem_index)
+{
+    ble_mesh_nvs_store_deferred(NVS_HANDLE, powerup_key(elem_index), &g_powerup[elem_index], sizeof(model_powerup_t));
+}
+
 void reset_light_para(void)
 {
     ENTER_FUNC();
@@ -318,36 +341,53 @@ void reset_light_para(void)
         i++;
     }
 
-    ble_mesh_nvs_store(NVS_HANDLE, POWERUP_KEY, g_powerup, sizeof(g_powerup));
+    /* The node may restart right after a reset, write the defaults out now */
+    for (i = 0; i < MESH_ELEM_STATE_COUNT; i++) {
+        save_powerup(i);
+    }
+    ble_mesh_nvs_flush();
 }
 
 void save_light_state(elem_state_t *p_elem)
 {
     ENTER_FUNC();
+    bool dirty = false;
+
 #ifdef CONFIG_MESH_MODEL_LIGHTNESS_SRV
     if (p_elem->state.actual[VALUE_TYPE_CUR] != 0) {
         p_elem->powerup.last_actual = p_elem->state.actual[VALUE_TYPE_CUR];
+        dirty |= g_powerup[p_elem->elem_index].last_actual != p_elem->state.actual[VALUE_TYPE_CUR];
         g_powerup[p_elem->elem_index].last_actual = p_elem->state.actual[VALUE_TYPE_CUR];
     }
     ESP_LOGD(TAG, "elem %d, actual %d", p_elem->elem_index, g_powerup[p_elem->elem_index].last_actual);
 #endif
 #ifdef CONFIG_MESH_MODEL_CTL_SRV
     p_elem->powerup.last_temp = p_elem->state.temp[VALUE_TYPE_CUR];
+    dirty |= g_powerup[p_elem->elem_index].last_temp != p_elem->state.temp[VALUE_TYPE_CUR];
     g_powerup[p_elem->elem_index].last_temp = p_elem->state.temp[VALUE_TYPE_CUR];
     ESP_LOGD(TAG, "elem %d, temp %d", p_elem->elem_index, g_powerup[p_elem->elem_index].last_temp);
 #endif
 
-    ble_mesh_nvs_store(NVS_HANDLE, POWERUP_KEY, g_powerup, sizeof(g_powerup));
+    /* Only an element whose power-up state changed needs a write, slider traffic is merged */
+    if (dirty) {
+        save_powerup(p_elem->elem_index);
+    }
 }
 
 void load_light_state(void)
 {
     ENTER_FUNC();
     uint8_t   i     = 0;
-    bool      exist = false;
     esp_err_t ret   = ESP_OK;
 
-    ret = ble_mesh_nvs_restore(NVS_HANDLE, POWERUP_KEY, g_powerup, sizeof(g_powerup), &exist);
+    /* Older firmware kept all the elements in one blob, the per-element keys override it */
+    ret = ble_mesh_nvs_restore(NVS_HANDLE, POWERUP_KEY, g_powerup, sizeof(g_powerup), NULL);
+
+    for (i = 0; i < MESH_ELEM_STATE_COUNT && ret == ESP_OK; i++) {
+        ret = ble_mesh_nvs_restore(NVS_HANDLE, powerup_key(i), &g_powerup[i], sizeof(model_powerup_t), NULL);
+    }
+
+    i = 0;
 
     if (ret == ESP_OK) {
         while (i < MESH_ELEM_STATE_COUNT) {
@@ -391,6 +431,344 @@ void load_light_state(void)
     }
 }
 
+/**
+ * The light shows each element fading from its last output to the current mesh state.
+ * All running fades are stepped from one periodic tick, which writes the light once
+ * and sends the status replies held back until the element settles.
+ */
+#define LIGHT_TRANS_TICK_MS     20  /**< Matches the duty update cycle of iot_led */
+#define LIGHT_TRANS_FRAC_BITS   16
+
+typedef enum {
+#ifdef CONFIG_MESH_MODEL_LIGHTNESS_SRV
+    LIGHT_TRANS_ACTUAL,
+#endif
+#ifdef CONFIG_MESH_MODEL_CTL_SRV
+    LIGHT_TRANS_TEMP,
+#endif
+#ifdef CONFIG_MESH_MODEL_HSL_SRV
+    LIGHT_TRANS_HUE,
+    LIGHT_TRANS_SATURATION,
+    LIGHT_TRANS_LIGHTNESS,
+#endif
+    LIGHT_TRANS_NUM,
+} light_trans_value_t;
+
+typedef enum {
+    LIGHT_STATUS_LIGHTNESS,
+    LIGHT_STATUS_LINEAR,
+    LIGHT_STATUS_CTL,
+    LIGHT_STATUS_NUM,
+} light_status_type_t;
+
+typedef struct {
+    bool     active;
+    bool     color;                         /**< Last set by HSL, otherwise by lightness/CTL */
+    uint8_t  onoff;                         /**< On/off shown by the light */
+    uint8_t  to_onoff;
+    int64_t  start_us;
+    uint32_t duration_us;
+    uint16_t from[LIGHT_TRANS_NUM];
+    uint16_t to[LIGHT_TRANS_NUM];
+    uint16_t out[LIGHT_TRANS_NUM];          /**< Values shown by the light */
+    uint8_t  status_pending;                /**< Bit mask of light_status_type_t */
+    esp_ble_mesh_model_t *status_model[LIGHT_STATUS_NUM];   /**< Publishes the pending status */
+} light_trans_t;
+
+static light_trans_t      s_light_trans[MESH_ELEM_STATE_COUNT];
+static esp_timer_handle_t s_light_trans_timer   = NULL;
+static SemaphoreHandle_t  s_light_trans_lock    = NULL;
+static bool               s_light_trans_running = false;
+
+static uint16_t light_trans_cur_value(elem_state_t *p_elem, light_trans_value_t value)
+{
+    switch (value) {
+#ifdef CONFIG_MESH_MODEL_LIGHTNESS_SRV
+    case LIGHT_TRANS_ACTUAL:
+        return p_elem->state.actual[VALUE_TYPE_CUR];
+#endif
+#ifdef CONFIG_MESH_MODEL_CTL_SRV
+    case LIGHT_TRANS_TEMP:
+        return p_elem->state.temp[VALUE_TYPE_CUR];
+#endif
+#ifdef CONFIG_MESH_MODEL_HSL_SRV
+    case LIGHT_TRANS_HUE:
+        return p_elem->state.hue[VALUE_TYPE_CUR];
+    case LIGHT_TRANS_SATURATION:
+        return p_elem->state.saturation[VALUE_TYPE_CUR];
+    case LIGHT_TRANS_LIGHTNESS:
+        return p_elem->state.lightness[VALUE_TYPE_CUR];
+#endif
+    default:
+        return 0;
+    }
+}
+
+/**
+ * @brief Interpolate with a progress of frac / 2^LIGHT_TRANS_FRAC_BITS
+ */
+static uint16_t light_trans_lerp(light_trans_value_t value, uint16_t from, uint16_t to, uint32_t frac)
+{
+    int32_t delta = (int32_t)to - from;
+
+#ifdef CONFIG_MESH_MODEL_HSL_SRV
+    /* Hue is an angle, go round the shorter way and let the sum wrap */
+    if (value == LIGHT_TRANS_HUE) {
+        delta = (int16_t)(uint16_t)delta;
+    }
+#endif
+
+    return (uint16_t)(from + (int32_t)(((int64_t)delta * frac) >> LIGHT_TRANS_FRAC_BITS));
+}
+
+/**
+ * @brief Whether the value sets how bright the light is
+ */
+static bool light_trans_is_level(light_trans_value_t value)
+{
+    switch (value) {
+#ifdef CONFIG_MESH_MODEL_LIGHTNESS_SRV
+    case LIGHT_TRANS_ACTUAL:
+        return true;
+#endif
+#ifdef CONFIG_MESH_MODEL_HSL_SRV
+    case LIGHT_TRANS_LIGHTNESS:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief The value a fade heads for, switching off dims the level to 0 while
+ *        the light is still on, the real level is restored once it is off
+ */
+static uint16_t light_trans_fade_to(const light_trans_t *trans, light_trans_value_t value)
+{
+    return (!trans->to_onoff && light_trans_is_level(value)) ? 0 : trans->to[value];
+}
+
+static void light_trans_led_state(const light_trans_t *trans, board_led_state_t *led)
+{
+    memset(led, 0, sizeof(board_led_state_t));
+    led->onoff = trans->onoff;
+    led->color = trans->color;
+#ifdef CONFIG_MESH_MODEL_LIGHTNESS_SRV
+    led->actual = trans->out[LIGHT_TRANS_ACTUAL];
+#endif
+#ifdef CONFIG_MESH_MODEL_CTL_SRV
+    led->temperature = trans->out[LIGHT_TRANS_TEMP];
+#endif
+#ifdef CONFIG_MESH_MODEL_HSL_SRV
+    led->hue        = trans->out[LIGHT_TRANS_HUE];
+    led->saturation = trans->out[LIGHT_TRANS_SATURATION];
+    led->lightness  = trans->out[LIGHT_TRANS_LIGHTNESS];
+#endif
+}
+
+/**
+ * @brief Publish the state the element settled on, if the model has a publish address
+ */
+static void light_status_publish(elem_state_t *p_elem, light_status_type_t type, esp_ble_mesh_model_t *model)
+{
+    uint32_t opcode   = 0;
+    uint16_t value[2] = {0};
+    uint16_t length   = sizeof(value[0]);
+
+    switch (type) {
+#ifdef CONFIG_MESH_MODEL_LIGHTNESS_SRV
+    case LIGHT_STATUS_LIGHTNESS:
+        opcode   = ESP_BLE_MESH_MODEL_OP_LIGHT_LIGHTNESS_STATUS;
+        value[0] = p_elem->state.actual[VALUE_TYPE_CUR];
+        break;
+    case LIGHT_STATUS_LINEAR:
+        opcode   = ESP_BLE_MESH_MODEL_OP_LIGHT_LIGHTNESS_LINEAR_STATUS;
+        value[0] = convert_lightness_actual_to_linear(p_elem->state.actual[VALUE_TYPE_CUR]);
+        break;
+#endif
+#ifdef CONFIG_MESH_MODEL_CTL_SRV
+    case LIGHT_STATUS_CTL:
+        /* Present lightness and temperature, as the reply of light_ctl_set() */
+        opcode   = ESP_BLE_MESH_MODEL_OP_LIGHT_CTL_STATUS;
+        value[0] = p_elem->state.actual[VALUE_TYPE_CUR];
+        value[1] = p_elem->state.temp[VALUE_TYPE_CUR];
+        length   = sizeof(value);
+        break;
+#endif
+    default:
+        return;
+    }
+
+    if (!model->pub || model->pub->publish_addr == ESP_BLE_MESH_ADDR_UNASSIGNED) {
+        return;
+    }
+
+    esp_ble_mesh_model_publish(model, opcode, length, (uint8_t *)value, ROLE_NODE);
+}
+
+/**
+ * @brief Publish the status once the element settles. The requester of an
+ *        acknowledged Set already got its reply, only the publication waits,
+ *        and the requests made during a fade share one publication.
+ */
+static void light_status_defer(elem_state_t *p_elem, light_status_type_t type, esp_ble_mesh_model_t *model)
+{
+    light_trans_t *trans = &s_light_trans[p_elem->elem_index];
+
+    xSemaphoreTake(s_light_trans_lock, portMAX_DELAY);
+    trans->status_model[type] = model;
+    trans->status_pending    |= (1 << type);
+    xSemaphoreGive(s_light_trans_lock);
+}
+
+/**
+ * @brief Publish a status held back by light_status_defer() now, when no fade follows
+ */
+static void light_status_flush(elem_state_t *p_elem, light_status_type_t type)
+{
+    light_trans_t        *trans = &s_light_trans[p_elem->elem_index];
+    esp_ble_mesh_model_t *model = NULL;
+    bool                  pending;
+
+    xSemaphoreTake(s_light_trans_lock, portMAX_DELAY);
+    pending = trans->status_pending & (1 << type);
+    model   = trans->status_model[type];
+    trans->status_pending &= ~(1 << type);
+    xSemaphoreGive(s_light_trans_lock);
+
+    if (pending) {
+        light_status_publish(p_elem, type, model);
+    }
+}
+
+/**
+ * @brief Record which model set the element last, HSL drives the color channels
+ */
+static void light_trans_set_color(elem_state_t *p_elem, bool color)
+{
+    s_light_trans[p_elem->elem_index].color = color;
+}
+
+static void light_trans_tick(void *arg)
+{
+    board_led_state_t  led;
+    uint8_t            settled[MESH_ELEM_STATE_COUNT] = {0};
+    esp_ble_mesh_model_t *status[MESH_ELEM_STATE_COUNT][LIGHT_STATUS_NUM];
+    bool               running = false;
+    int64_t            now     = esp_timer_get_time();
+
+    xSemaphoreTake(s_light_trans_lock, portMAX_DELAY);
+
+    for (int i = 0; i < MESH_ELEM_STATE_COUNT; ++i) {
+        light_trans_t *trans = &s_light_trans[i];
+
+        if (!trans->active) {
+            continue;
+        }
+
+        int64_t elapsed = now - trans->start_us;
+
+        if (elapsed >= trans->duration_us) {
+            memcpy(trans->out, trans->to, sizeof(trans->out));
+            trans->onoff  = trans->to_onoff;
+            trans->active = false;
+
+            settled[i] = trans->status_pending;
+            memcpy(status[i], trans->status_model, sizeof(status[i]));
+            trans->status_pending = 0;
+        } else {
+            uint32_t frac = ((uint64_t)elapsed << LIGHT_TRANS_FRAC_BITS) / trans->duration_us;
+
+            for (int value = 0; value < LIGHT_TRANS_NUM; ++value) {
+                trans->out[value] = light_trans_lerp(value, trans->from[value], light_trans_fade_to(trans, value), frac);
+            }
+
+            running = true;
+        }
+
+        /* One driver update per element and tick, however many values moved */
+        light_trans_led_state(trans, &led);
+        board_led_update(g_elem_state[i].elem_index, &led);
+    }
+
+    if (!running && s_light_trans_running) {
+        s_light_trans_running = false;
+        esp_timer_stop(s_light_trans_timer);
+    }
+
+    xSemaphoreGive(s_light_trans_lock);
+
+    /* Outside the lock, the mesh callbacks take it while the stack queues messages */
+    for (int i = 0; i < MESH_ELEM_STATE_COUNT; ++i) {
+        for (int type = 0; type < LIGHT_STATUS_NUM; ++type) {
+            if (settled[i] & (1 << type)) {
+                light_status_publish(&g_elem_state[i], type, status[i][type]);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Fade the light of an element to its current state within duration_ms
+ */
+static void light_trans_start(elem_state_t *p_elem, uint32_t duration_ms)
+{
+    ENTER_FUNC();
+    light_trans_t *trans = &s_light_trans[p_elem->elem_index];
+    bool first = false;
+
+    xSemaphoreTake(s_light_trans_lock, portMAX_DELAY);
+
+    /* A running fade turns towards the new state from where the light is now */
+    memcpy(trans->from, trans->out, sizeof(trans->from));
+
+    for (int value = 0; value < LIGHT_TRANS_NUM; ++value) {
+        trans->to[value] = light_trans_cur_value(p_elem, value);
+
+        /* A light that is off fades up from dark */
+        if (!trans->onoff && light_trans_is_level(value)) {
+            trans->from[value] = 0;
+        }
+    }
+
+#ifdef CONFIG_MESH_MODEL_GEN_ONOFF_SRV
+    trans->to_onoff = p_elem->state.onoff[VALUE_TYPE_CUR];
+#else
+    trans->to_onoff = 1;
+#endif
+    /* Switch on when the fade starts, switching off dims first and goes off when it ends */
+    trans->onoff      |= trans->to_onoff;
+    trans->start_us    = esp_timer_get_time();
+    trans->duration_us = duration_ms * 1000;
+    trans->active      = true;
+
+    if (!s_light_trans_running) {
+        s_light_trans_running = true;
+        first = true;
+        esp_timer_start_periodic(s_light_trans_timer, LIGHT_TRANS_TICK_MS * 1000);
+    }
+
+    xSemaphoreGive(s_light_trans_lock);
+
+    /* Show the first step now rather than a tick later */
+    if (first) {
+        light_trans_tick(NULL);
+    }
+}
+
+static void light_trans_init(void)
+{
+    esp_timer_create_args_t timer_args = {
+        .callback = light_trans_tick,
+        .name     = "light_trans",
+    };
+
+    s_light_trans_lock = xSemaphoreCreateMutex();
+    ESP_ERROR_CHECK(s_light_trans_lock ? ESP_OK : ESP_ERR_NO_MEM);
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &s_light_trans_timer));
+}
+
 void user_genie_event_handle(genie_event_t event, void *p_arg)
 {
     genie_event_t next_event = event;
@@ -438,22 +816,22 @@ void user_genie_event_handle(genie_event_t event, void *p_arg)
         elem_state_t *p_elem = (elem_state_t *)p_arg;
 #ifdef CONFIG_MESH_MODEL_HSL_SRV
         ESP_LOGI(TAG, "hue: %d, saturation: %d, lightness: %d", p_elem->state.hue[VALUE_TYPE_CUR], p_elem->state.saturation[VALUE_TYPE_CUR], p_elem->state.lightness[VALUE_TYPE_CUR]);
-        board_led_hsl(p_elem->elem_index, p_elem->state.hue[VALUE_TYPE_CUR], p_elem->state.saturation[VALUE_TYPE_CUR], p_elem->state.lightness[VALUE_TYPE_CUR]);
 #endif
 #ifdef CONFIG_MESH_MODEL_CTL_SRV
         ESP_LOGI(TAG, "temperature: %d", p_elem->state.temp[VALUE_TYPE_CUR]);
-        board_led_temperature(p_elem->elem_index, p_elem->state.temp[VALUE_TYPE_CUR]);
 #endif
 #ifdef CONFIG_MESH_MODEL_LIGHTNESS_SRV
         ESP_LOGI(TAG, "lightness actual: %d", p_elem->state.actual[VALUE_TYPE_CUR]);
-        board_led_lightness(p_elem->elem_index, p_elem->state.actual[VALUE_TYPE_CUR]);
 #endif
 #ifdef CONFIG_MESH_MODEL_GEN_ONOFF_SRV
         ESP_LOGI(TAG, "onoff: %d", p_elem->state.onoff[VALUE_TYPE_CUR]);
-        board_led_switch(p_elem->elem_index, p_elem->state.onoff[VALUE_TYPE_CUR]);
 #endif
         if (event == GENIE_EVT_SDK_ACTION_DONE) {
+            light_trans_start(p_elem, CONFIG_LIGHT_FADE_PERIOD_MS);
             save_light_state(p_elem);
+        } else {
+            /* The mesh transition steps the state, the light follows within a tick */
+            light_trans_start(p_elem, LIGHT_TRANS_TICK_MS);
         }
         break;
     }
@@ -710,6 +1088,7 @@ static void light_color_set(uint16_t lightness, uint16_t hue, uint16_t saturatio
     if (g_elem_state[0].state.hue[VALUE_TYPE_CUR] != g_elem_state[0].state.hue[VALUE_TYPE_TAR] || g_elem_state[0].state.saturation[VALUE_TYPE_CUR] != g_elem_state[0].state.saturation[VALUE_TYPE_TAR]
             || g_elem_state[0].state.lightness[VALUE_TYPE_CUR] != g_elem_state[0].state.lightness[VALUE_TYPE_TAR]) {
         g_indication_flag |= INDICATION_FLAG_HSL;
+        light_trans_set_color(&g_elem_state[0], true);
 
         /* Change corresponding binded states in root element */
         bind_onoff_with_hsl(&g_elem_state[0], VALUE_TYPE_TAR);
@@ -731,8 +1110,11 @@ static void light_ctl_set(uint32_t opcode, esp_ble_mesh_model_t *model,
     ESP_LOGI(TAG, "lightness 0x%d", lightness);
 
     if (opcode == ESP_BLE_MESH_MODEL_OP_LIGHT_CTL_SET) {
+        /* Answered right away with the target, the fade only delays the publication */
+        uint16_t status[2] = {lightness, temperature};
+
         esp_ble_mesh_server_model_send_msg(model, ctx, ESP_BLE_MESH_MODEL_OP_LIGHT_CTL_STATUS,
-                                           sizeof(lightness), (uint8_t *)&lightness);
+                                           sizeof(status), (uint8_t *)status);
     }
 
     g_elem_state[0].state.actual[VALUE_TYPE_TAR] = lightness;
@@ -741,8 +1123,9 @@ static void light_ctl_set(uint32_t opcode, esp_ble_mesh_model_t *model,
         g_indication_flag |= INDICATION_FLAG_LIGHTNESS;
         g_indication_flag |= INDICATION_FLAG_CTL;
 
-        esp_ble_mesh_server_model_send_msg(model, ctx, ESP_BLE_MESH_MODEL_OP_LIGHT_CTL_STATUS,
-                                           sizeof(g_elem_state[0].state.temp[VALUE_TYPE_CUR]), (uint8_t *)&g_elem_state[0].state.temp[VALUE_TYPE_CUR]);
+        /* Published once the light has settled on the new temperature, the Set was answered above */
+        light_status_defer(&g_elem_state[0], LIGHT_STATUS_CTL, model);
+        light_trans_set_color(&g_elem_state[0], false);
 
         /* Change corresponding binded states in root element */
         bind_onoff_with_ctl(&g_elem_state[0], VALUE_TYPE_TAR);
@@ -750,6 +1133,9 @@ static void light_ctl_set(uint32_t opcode, esp_ble_mesh_model_t *model,
         if (esp_ble_mesh_node_is_provisioned()) {
             // update led status
             genie_event(GENIE_EVT_SDK_ANALYZE_MSG, &g_elem_state[0]);
+        } else {
+            /* No fade starts, nothing would publish the held status */
+            light_status_flush(&g_elem_state[0], LIGHT_STATUS_CTL);
         }
     }
 }
@@ -772,8 +1158,9 @@ static void light_lightness_actual_set(uint32_t opcode, esp_ble_mesh_model_t *mo
     if (g_elem_state[0].state.actual[VALUE_TYPE_CUR] != g_elem_state[0].state.actual[VALUE_TYPE_TAR]) {
         g_indication_flag |= INDICATION_FLAG_LIGHTNESS;
 
-        esp_ble_mesh_server_model_send_msg(model, ctx, ESP_BLE_MESH_MODEL_OP_LIGHT_LIGHTNESS_STATUS,
-                                           sizeof(g_elem_state[0].state.actual[VALUE_TYPE_CUR]), (uint8_t *)&g_elem_state[0].state.actual[VALUE_TYPE_CUR]);
+        /* Published once the light has settled on the new lightness, the Set was answered above */
+        light_status_defer(&g_elem_state[0], LIGHT_STATUS_LIGHTNESS, model);
+        light_trans_set_color(&g_elem_state[0], false);
 
         /* Change corresponding binded states in root element */
         bind_onoff_with_lightness(&g_elem_state[0], VALUE_TYPE_TAR);
@@ -781,6 +1168,9 @@ static void light_lightness_actual_set(uint32_t opcode, esp_ble_mesh_model_t *mo
         if (esp_ble_mesh_node_is_provisioned()) {
             // update led status
             genie_event(GENIE_EVT_SDK_ANALYZE_MSG, &g_elem_state[0]);
+        } else {
+            /* No fade starts, nothing would publish the held status */
+            light_status_flush(&g_elem_state[0], LIGHT_STATUS_LIGHTNESS);
         }
     }
 }
@@ -801,8 +1191,9 @@ static void light_lightness_linear_set(uint32_t opcode, esp_ble_mesh_model_t *mo
     if (g_elem_state[0].state.linear[VALUE_TYPE_CUR] != g_elem_state[0].state.linear[VALUE_TYPE_TAR]) {
         g_indication_flag |= INDICATION_FLAG_LIGHTNESS;
 
-        esp_ble_mesh_server_model_send_msg(model, ctx, ESP_BLE_MESH_MODEL_OP_LIGHT_LIGHTNESS_LINEAR_STATUS,
-                                           sizeof(g_elem_state[0].state.linear[VALUE_TYPE_CUR]), (uint8_t *)&g_elem_state[0].state.linear[VALUE_TYPE_CUR]);
+        /* Published once the light has settled on the new lightness, the Set was answered above */
+        light_status_defer(&g_elem_state[0], LIGHT_STATUS_LINEAR, model);
+        light_trans_set_color(&g_elem_state[0], false);
 
         /* Change corresponding binded states in root element */
         bind_onoff_with_lightness(&g_elem_state[0], VALUE_TYPE_TAR);
@@ -810,6 +1201,9 @@ static void light_lightness_linear_set(uint32_t opcode, esp_ble_mesh_model_t *mo
         if (esp_ble_mesh_node_is_provisioned()) {
             // update led status
             genie_event(GENIE_EVT_SDK_ANALYZE_MSG, &g_elem_state[0]);
+        } else {
+            /* No fade starts, nothing would publish the held status */
+            light_status_flush(&g_elem_state[0], LIGHT_STATUS_LINEAR);
         }
     }
 }
@@ -1320,6 +1714,7 @@ void esp_gateway_ble_init(void)
     ESP_LOGI(TAG, "Initializing...");
 
     // board_init();
+    light_trans_init();
 
 #ifdef CONFIG_GENIE_RESET_BY_REPEAT
     genie_reset_by_repeat_init();
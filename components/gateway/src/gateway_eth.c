@@ -27,6 +27,8 @@
 #include "driver/gpio.h"
 #include "sdkconfig.h"
 
+#include "esp_gateway_wifi_link.h"
+
 static const char *TAG                 = "gateway_eth";
 static esp_eth_handle_t s_eth_handle   = NULL;
 static xQueueHandle flow_control_queue = NULL;
@@ -53,6 +55,8 @@ typedef struct {
 // Forward packets from Wi-Fi to Ethernet
 static esp_err_t pkt_wifi2eth(void *buffer, uint16_t len, void *eb)
 {
+    esp_gateway_wifi_link_activity(1);
+
     if (g_wifi_mode == WIFI_MODE_AP) {
         struct eth_hdr* eth_header = NULL;
         eth_header = buffer;
@@ -102,6 +106,8 @@ static esp_err_t pkt_eth2wifi(esp_eth_handle_t eth_handle, uint8_t *buffer, uint
         .length = len
     };
 
+    esp_gateway_wifi_link_activity(1);
+
     if (g_wifi_mode == WIFI_MODE_STA) {
         if (xQueueSend(flow_control_queue, &msg, pdMS_TO_TICKS(FLOW_CONTROL_QUEUE_TIMEOUT_MS)) != pdTRUE) {
             ESP_LOGE(TAG, "send flow control message failed or timeout, free_heap: %d", esp_get_free_heap_size());
@@ -0,0 +1,295 @@
+// Copyright 2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "lwip/opt.h"
+#include "lwip/tcpip.h"
+#include "lwip/lwip_napt.h"
+
+#include "esp_utils.h"
+#include "esp_gateway_napt.h"
+
+static const char *TAG = "gateway_napt";
+
+#ifdef CONFIG_GATEWAY_NAPT_TABLE_SIZE
+#define NAPT_TABLE_SIZE     CONFIG_GATEWAY_NAPT_TABLE_SIZE
+#define NAPT_PORTMAP_SIZE   CONFIG_GATEWAY_NAPT_PORTMAP_SIZE
+#else
+#define NAPT_TABLE_SIZE     IP_NAPT_MAX
+#define NAPT_PORTMAP_SIZE   IP_PORTMAP_MAX
+#endif
+
+typedef struct {
+    tcpip_callback_fn fn;
+    void *arg;
+} napt_tcpip_call_t;
+
+static SemaphoreHandle_t s_napt_lock = NULL;
+static bool s_napt_table_ready = false;
+#if !LWIP_TCPIP_CORE_LOCKING
+static SemaphoreHandle_t s_napt_call_done = NULL;
+#endif
+static esp_timer_handle_t s_napt_monitor_timer = NULL;
+static uint32_t s_napt_addr[ESP_GATEWAY_NAPT_NETIF_MAX] = {0};
+static uint8_t s_napt_netif_num = 0;
+#if IP_NAPT_STATS
+static uint32_t s_napt_last_evictions = 0;
+static uint32_t s_napt_port_allocations = 0;
+static uint16_t s_napt_last_ports = 0;      /**< `ports_in_use` at the previous read */
+static uint32_t s_napt_port_evictions = 0;  /**< `forced_evictions` at the previous read */
+#endif
+
+#if !LWIP_TCPIP_CORE_LOCKING
+static void napt_tcpip_call_cb(void *arg)
+{
+    napt_tcpip_call_t *call = (napt_tcpip_call_t *)arg;
+
+    call->fn(call->arg);
+    xSemaphoreGive(s_napt_call_done);
+}
+#endif
+
+/**
+ * @brief Run `fn` in the tcpip thread context, the NAPT table belongs to it.
+ *        `s_napt_lock` must be held.
+ */
+static void napt_tcpip_call(tcpip_callback_fn fn, void *arg)
+{
+#if LWIP_TCPIP_CORE_LOCKING
+    LOCK_TCPIP_CORE();
+    fn(arg);
+    UNLOCK_TCPIP_CORE();
+#else
+    /**< Without core locking LOCK_TCPIP_CORE() is a no-op, hand the call over to the tcpip thread */
+    napt_tcpip_call_t call = {
+        .fn  = fn,
+        .arg = arg,
+    };
+
+    if (tcpip_callback(napt_tcpip_call_cb, &call) == ERR_OK) {
+        xSemaphoreTake(s_napt_call_done, portMAX_DELAY);
+    } else {
+        ESP_LOGE(TAG, "tcpip_callback fail");
+    }
+#endif
+}
+
+static void napt_table_init_cb(void *arg)
+{
+    ip_napt_init(NAPT_TABLE_SIZE, NAPT_PORTMAP_SIZE);
+}
+
+static void napt_enable_cb(void *arg)
+{
+    ip_napt_enable(*(uint32_t *)arg, 1);
+}
+
+static void napt_disable_cb(void *arg)
+{
+    ip_napt_enable(*(uint32_t *)arg, 0);
+}
+
+#if IP_NAPT_STATS
+static void napt_get_stats_cb(void *arg)
+{
+    ip_napt_get_stats((struct stats_ip_napt *)arg);
+}
+#endif
+
+static void napt_read_stats(esp_gateway_napt_stats_t *stats)
+{
+    memset(stats, 0, sizeof(esp_gateway_napt_stats_t));
+
+    if (!s_napt_lock) {
+        return;
+    }
+
+#if IP_NAPT_STATS
+    struct stats_ip_napt napt_stats = {0};
+
+    xSemaphoreTake(s_napt_lock, portMAX_DELAY);
+    stats->netif_num = s_napt_netif_num;
+    napt_tcpip_call(napt_get_stats_cb, &napt_stats);
+
+    stats->stats_valid      = true;
+    stats->active_tcp       = napt_stats.nr_active_tcp;
+    stats->active_udp       = napt_stats.nr_active_udp;
+    stats->active_icmp      = napt_stats.nr_active_icmp;
+    stats->max_active_tcp   = napt_stats.max_active_tcp;
+    stats->max_active_udp   = napt_stats.max_active_udp;
+    stats->max_active_icmp  = napt_stats.max_active_icmp;
+    stats->forced_evictions = napt_stats.nr_forced_evictions;
+    stats->ports_in_use     = napt_stats.nr_active_tcp + napt_stats.nr_active_udp;
+    stats->port_capacity    = NAPT_TABLE_SIZE;
+
+    /**< Every new entry allocated a port, either into a free slot or over an evicted one */
+    if (stats->ports_in_use > s_napt_last_ports) {
+        s_napt_port_allocations += stats->ports_in_use - s_napt_last_ports;
+    }
+
+    /**< lwIP may restart its counters along with the table */
+    s_napt_port_allocations += stats->forced_evictions >= s_napt_port_evictions
+                               ? stats->forced_evictions - s_napt_port_evictions : stats->forced_evictions;
+    s_napt_last_ports        = stats->ports_in_use;
+    s_napt_port_evictions    = stats->forced_evictions;
+    stats->port_allocations  = s_napt_port_allocations;
+
+    xSemaphoreGive(s_napt_lock);
+#else
+    stats->netif_num = s_napt_netif_num;
+#endif
+}
+
+#if IP_NAPT_STATS
+/**
+ * @brief Warn when live flows are being evicted, this is what clients see as
+ *        stalled or reset connections
+ */
+static void napt_monitor_timer_cb(void *arg)
+{
+    esp_gateway_napt_stats_t stats;
+
+    napt_read_stats(&stats);
+
+    if (stats.forced_evictions < s_napt_last_evictions) {
+        s_napt_last_evictions = 0;
+    }
+
+    if (stats.forced_evictions != s_napt_last_evictions) {
+        ESP_LOGW(TAG, "NAPT table full, %u live entries evicted in the last %d ms (tcp: %d, udp: %d, icmp: %d)",
+                 stats.forced_evictions - s_napt_last_evictions, ESP_GATEWAY_NAPT_MONITOR_PERIOD_MS,
+                 stats.active_tcp, stats.active_udp, stats.active_icmp);
+        s_napt_last_evictions = stats.forced_evictions;
+    }
+}
+#endif
+
+static esp_err_t napt_init(void)
+{
+    if (s_napt_lock) {
+        return ESP_OK;
+    }
+
+#if !LWIP_TCPIP_CORE_LOCKING
+    s_napt_call_done = xSemaphoreCreateBinary();
+    ESP_ERROR_RETURN(!s_napt_call_done, ESP_ERR_NO_MEM, "napt call semaphore create fail");
+#endif
+
+    s_napt_lock = xSemaphoreCreateMutex();
+    ESP_ERROR_RETURN(!s_napt_lock, ESP_ERR_NO_MEM, "napt lock create fail");
+
+#if IP_NAPT_STATS
+    esp_timer_create_args_t timer_args = {
+        .callback = napt_monitor_timer_cb,
+        .name     = "napt_monitor",
+    };
+
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &s_napt_monitor_timer));
+#else
+    ESP_LOGW(TAG, "lwIP is built without IP_NAPT_STATS (CONFIG_GATEWAY_NAPT_STATS), NAPT counters are not available");
+#endif
+
+    return ESP_OK;
+}
+
+esp_err_t esp_gateway_napt_enable(uint32_t ip)
+{
+    esp_err_t ret = napt_init();
+    ESP_ERROR_RETURN(ret != ESP_OK, ret, "");
+
+    xSemaphoreTake(s_napt_lock, portMAX_DELAY);
+
+    for (int i = 0; i < s_napt_netif_num; i++) {
+        if (s_napt_addr[i] == ip) {
+            xSemaphoreGive(s_napt_lock);
+            return ESP_OK;
+        }
+    }
+
+    if (s_napt_netif_num >= ESP_GATEWAY_NAPT_NETIF_MAX) {
+        xSemaphoreGive(s_napt_lock);
+        ESP_LOGE(TAG, "NAPT already enabled on %d interfaces", s_napt_netif_num);
+        return ESP_ERR_NO_MEM;
+    }
+
+    /**< Size the table before ip_napt_enable() would allocate it with the lwIP defaults */
+    if (!s_napt_table_ready) {
+        napt_tcpip_call(napt_table_init_cb, NULL);
+        s_napt_table_ready = true;
+        ESP_LOGI(TAG, "NAPT table: %d entries, %d port mappings", NAPT_TABLE_SIZE, NAPT_PORTMAP_SIZE);
+    }
+
+    napt_tcpip_call(napt_enable_cb, &ip);
+    s_napt_addr[s_napt_netif_num++] = ip;
+
+    if (s_napt_netif_num == 1 && s_napt_monitor_timer) {
+        esp_timer_start_periodic(s_napt_monitor_timer, ESP_GATEWAY_NAPT_MONITOR_PERIOD_MS * 1000ULL);
+    }
+
+    xSemaphoreGive(s_napt_lock);
+
+    ESP_LOGI(TAG, "NAT is enabled");
+
+    return ESP_OK;
+}
+
+esp_err_t esp_gateway_napt_disable(uint32_t ip)
+{
+    ESP_ERROR_RETURN(!s_napt_lock, ESP_ERR_NOT_FOUND, "NAPT is not enabled");
+
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+
+    xSemaphoreTake(s_napt_lock, portMAX_DELAY);
+
+    for (int i = 0; i < s_napt_netif_num; i++) {
+        if (s_napt_addr[i] == ip) {
+            napt_tcpip_call(napt_disable_cb, &ip);
+            s_napt_addr[i] = s_napt_addr[--s_napt_netif_num];
+            ret = ESP_OK;
+            break;
+        }
+    }
+
+    /**< lwIP frees the table with the last interface, size it again on the next enable */
+    if (s_napt_netif_num == 0) {
+        s_napt_table_ready = false;
+#if IP_NAPT_STATS
+        s_napt_last_ports  = 0;
+#endif
+
+        if (s_napt_monitor_timer) {
+            esp_timer_stop(s_napt_monitor_timer);
+        }
+    }
+
+    xSemaphoreGive(s_napt_lock);
+
+    return ret;
+}
+
+esp_err_t esp_gateway_napt_get_stats(esp_gateway_napt_stats_t *stats)
+{
+    ESP_PARAM_CHECK(stats);
+
+    napt_read_stats(stats);
+
+    return ESP_OK;
+}
@@ -21,6 +21,7 @@
 #include "lwip/tcp.h"
 
 #include "esp_gateway_config.h"
+#include "esp_gateway_wifi_link.h"
 
 uint8_t dongle_mac[6] = {0};
 esp_netif_t* dongle_netif = NULL;
@@ -35,6 +36,7 @@ static esp_err_t netsuite_io_transmit_wrap(void *h, void *buffer, size_t len, vo
 static esp_err_t netsuite_io_attach(esp_netif_t * esp_netif, void * args);
 
 esp_err_t pkt_netif2driver(void *buffer, uint16_t len);
+void tusb_net_free_rx_buffer(void *h, void *buffer);
 esp_err_t esp_netif_up(esp_netif_t *esp_netif);
 
 /**
@@ -42,7 +44,7 @@ esp_err_t esp_netif_up(esp_netif_t *esp_netif);
  * and pointer to the IO object instance (unused as this is a singleton)
  */
 static const esp_netif_driver_ifconfig_t c_driver_ifconfig = {
-        .driver_free_rx_buffer = NULL,
+        .driver_free_rx_buffer = tusb_net_free_rx_buffer,
         .transmit = netsuite_io_transmit,
         .transmit_wrap = netsuite_io_transmit_wrap,
         .handle = "netsuite-io-object" // this IO object is a singleton, its handle uses as a name
@@ -69,6 +71,7 @@ static const esp_netif_driver_base_t s_driver_base = {
 static esp_err_t netsuite_io_transmit(void *h, void *buffer, size_t len)
 {
     // send data to driver
+    esp_gateway_wifi_link_activity(1);
     pkt_netif2driver(buffer, len);
     return ESP_OK;
 }
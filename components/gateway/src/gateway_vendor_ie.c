@@ -14,7 +14,11 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "esp_log.h"
+#include "esp_wifi.h"
+#include "esp_timer.h"
 
 #include "esp_gateway_vendor_ie.h"
 
@@ -22,9 +26,39 @@
 
 static const char *TAG = "vendor_ie";
 
-bool first_vendor_ie_tag = true;
+#define VENDOR_IE_HOP_COST   100    /**< Each hop halves the airtime left for the leaves */
+#define VENDOR_IE_RSSI_GOOD  (-50)  /**< Links stronger than this run at the top rate */
+#define VENDOR_IE_RSSI_COST  8      /**< Per dB below VENDOR_IE_RSSI_GOOD */
+#define VENDOR_IE_LOAD_COST  20     /**< Per station already attached to the candidate */
+#define VENDOR_IE_BUSY_COST  2      /**< Per percent of queue occupancy */
+#define VENDOR_IE_FORWARD_UNIT  25  /**< Frames per second handled by the candidate per cost point */
 
-extern ap_router_t *ap_router;
+typedef struct {
+    uint8_t mac[MAC_LEN];
+    uint8_t level;              /**< LEVEL of the candidate, 0 is the router itself */
+    uint8_t station_num;
+    uint8_t max_connect;
+    uint8_t uplink_rssi;        /**< ROUTER_RSSI of the candidate, dBm without sign */
+    uint16_t forward_rate;      /**< From the extension, 0 if not advertised */
+    uint8_t queue_occupancy;
+    bool router_connected;
+    bool valid;
+    int16_t rssi_x4;            /**< Smoothed RSSI of the link to the candidate, 1/4 dBm */
+    TickType_t last_seen;
+} vendor_ie_parent_t;
+
+static vendor_ie_parent_t s_parent_table[ESP_GATEWAY_VENDOR_IE_PARENT_MAX];
+static portMUX_TYPE s_parent_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint8_t s_switch_mac[MAC_LEN];
+static uint8_t s_switch_wins = 0;
+
+static vendor_ie_data_t *s_vendor_ie = NULL;
+static portMUX_TYPE s_update_lock = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t s_update_timer = NULL;
+static bool s_update_pending = false;
+static bool s_vendor_ie_enabled = false;
+static int64_t s_last_update = 0;
+static uint16_t s_forward_rate = 0;     /**< Advertised by this node, read without s_update_lock */
 
 void print_vendor_ie_info(vendor_ie_data_t *vendor_ie)
 {
@@ -37,45 +71,485 @@ void print_vendor_ie_info(vendor_ie_data_t *vendor_ie)
         vendor_ie->payload[LEVEL]);
 }
 
+/**
+ * @brief Find the entry of `mac`, or the one to overwrite: a free entry first,
+ *        else the one heard least recently. Called with s_parent_lock held.
+ */
+static vendor_ie_parent_t *vendor_ie_parent_slot(const uint8_t *mac, bool *found)
+{
+    vendor_ie_parent_t *victim = NULL;
+
+    for (int i = 0; i < ESP_GATEWAY_VENDOR_IE_PARENT_MAX; i++) {
+        vendor_ie_parent_t *entry = s_parent_table + i;
+
+        if (!entry->valid) {
+            if (!victim || victim->valid) {
+                victim = entry;
+            }
+            continue;
+        }
+
+        if (!memcmp(entry->mac, mac, MAC_LEN)) {
+            *found = true;
+            return entry;
+        }
+
+        if (!victim || (victim->valid && (int32_t)(entry->last_seen - victim->last_seen) < 0)) {
+            victim = entry;
+        }
+    }
+
+    *found = false;
+    return victim;
+}
+
+static void vendor_ie_parent_update(const uint8_t *mac, uint8_t level, uint8_t station_num, uint8_t max_connect,
+                                    uint8_t uplink_rssi, bool router_connected, int rssi,
+                                    const esp_gateway_vendor_ie_metrics_t *metrics)
+{
+    bool found = false;
+
+    portENTER_CRITICAL(&s_parent_lock);
+
+    vendor_ie_parent_t *entry = vendor_ie_parent_slot(mac, &found);
+
+    if (found) {
+        entry->rssi_x4 += (rssi * 4 - entry->rssi_x4) / 4;
+    } else {
+        memcpy(entry->mac, mac, MAC_LEN);
+        entry->rssi_x4 = rssi * 4;
+        entry->valid   = true;
+    }
+
+    entry->level            = level;
+    entry->station_num      = station_num;
+    entry->max_connect      = max_connect;
+    entry->uplink_rssi      = uplink_rssi;
+    entry->router_connected = router_connected;
+    entry->last_seen        = xTaskGetTickCount();
+    entry->forward_rate     = metrics->forward_rate;
+    entry->queue_occupancy  = metrics->queue_occupancy;
+
+    portEXIT_CRITICAL(&s_parent_lock);
+}
+
+static uint32_t vendor_ie_rssi_cost(int rssi)
+{
+    return rssi >= VENDOR_IE_RSSI_GOOD ? 0 : (VENDOR_IE_RSSI_GOOD - rssi) * VENDOR_IE_RSSI_COST;
+}
+
+/**
+ * @brief Path cost to the router through `entry`, `current` is set when this
+ *        node is already one of the candidate's stations
+ */
+static uint32_t vendor_ie_path_cost(const vendor_ie_parent_t *entry, bool current)
+{
+    uint32_t cost = (entry->level + 1) * VENDOR_IE_HOP_COST
+                    + vendor_ie_rssi_cost(entry->rssi_x4 / 4)
+                    + vendor_ie_rssi_cost(-entry->uplink_rssi);
+    uint32_t station_num  = entry->station_num;
+    uint32_t forward_rate = entry->forward_rate;
+
+    /**< This node and its traffic leave the current parent with it */
+    if (current) {
+        uint16_t own_rate = __atomic_load_n(&s_forward_rate, __ATOMIC_RELAXED);
+
+        station_num  = station_num > 0 ? station_num - 1 : 0;
+        forward_rate = forward_rate > own_rate ? forward_rate - own_rate : 0;
+    }
+
+    cost += station_num * VENDOR_IE_LOAD_COST + forward_rate / VENDOR_IE_FORWARD_UNIT;
+
+    if (entry->queue_occupancy != VENDOR_IE_METRIC_UNKNOWN) {
+        cost += entry->queue_occupancy * VENDOR_IE_BUSY_COST;
+    }
+
+    return cost;
+}
+
+static bool vendor_ie_parent_usable(const vendor_ie_parent_t *entry, TickType_t now)
+{
+    return entry->valid && entry->router_connected
+           && now - entry->last_seen < pdMS_TO_TICKS(ESP_GATEWAY_VENDOR_IE_PARENT_AGE_MS)
+           && (entry->level == WIFI_ROUTER_LEVEL_0 || entry->station_num < entry->max_connect);
+}
+
+/**
+ * @brief Lowest cost usable candidate below `max_level`, skipping `exclude`.
+ *        Called with s_parent_lock held.
+ */
+static const vendor_ie_parent_t *vendor_ie_parent_best(uint8_t max_level, const uint8_t *exclude, uint32_t *cost)
+{
+    const vendor_ie_parent_t *best = NULL;
+    TickType_t now = xTaskGetTickCount();
+
+    *cost = UINT32_MAX;
+
+    for (int i = 0; i < ESP_GATEWAY_VENDOR_IE_PARENT_MAX; i++) {
+        const vendor_ie_parent_t *entry = s_parent_table + i;
+
+        if (!vendor_ie_parent_usable(entry, now) || entry->level >= max_level
+                || (exclude && !memcmp(entry->mac, exclude, MAC_LEN))) {
+            continue;
+        }
+
+        uint32_t entry_cost = vendor_ie_path_cost(entry, false);
+
+        if (entry_cost < *cost) {
+            *cost = entry_cost;
+            best  = entry;
+        }
+    }
+
+    return best;
+}
+
+static void vendor_ie_parent_export(const vendor_ie_parent_t *entry, ap_router_t *parent)
+{
+    memcpy(parent->router_mac, entry->mac, MAC_LEN);
+    parent->level = entry->level;
+    parent->rssi  = -(entry->rssi_x4 / 4);
+}
+
+static void vendor_ie_encode_ext(uint8_t *data, const esp_gateway_vendor_ie_metrics_t *metrics)
+{
+    *data++ = VENDOR_IE_EXT_VERSION;
+
+    *data++ = VENDOR_IE_TLV_FORWARD_RATE;
+    *data++ = 2;
+    *data++ = metrics->forward_rate;
+    *data++ = metrics->forward_rate >> 8;
+
+    *data++ = VENDOR_IE_TLV_QUEUE_OCCUPANCY;
+    *data++ = 1;
+    *data++ = metrics->queue_occupancy;
+}
+
+static void vendor_ie_decode_ext(const uint8_t *data, int size, esp_gateway_vendor_ie_metrics_t *metrics)
+{
+    metrics->forward_rate    = 0;
+    metrics->queue_occupancy = VENDOR_IE_METRIC_UNKNOWN;
+
+    if (size < 1 || data[0] < 1) {
+        return;
+    }
+
+    for (int i = 1; i + 2 <= size && i + 2 + data[i + 1] <= size; i += 2 + data[i + 1]) {
+        const uint8_t *value = data + i + 2;
+
+        switch (data[i]) {
+            case VENDOR_IE_TLV_FORWARD_RATE:
+                if (data[i + 1] >= 2) {
+                    metrics->forward_rate = value[0] | (value[1] << 8);
+                }
+                break;
+
+            case VENDOR_IE_TLV_QUEUE_OCCUPANCY:
+                if (data[i + 1] >= 1) {
+                    metrics->queue_occupancy = value[0];
+                }
+                break;
+
+            default:
+                break;
+        }
+    }
+}
+
 void esp_gateway_vendor_ie_cb(void *ctx, wifi_vendor_ie_type_t type, const uint8_t sa[6], const vendor_ie_data_t *vnd_ie, int rssi)
 {
     if (type == WIFI_VND_IE_TYPE_BEACON) {
-        vendor_ie_data_t *vendor_ie;
-        vendor_ie = vnd_ie;
-        if (vendor_ie->vendor_oui[0] == VENDOR_OUI_0 && vendor_ie->vendor_oui[1] == VENDOR_OUI_1 && vendor_ie->vendor_oui[2] == VENDOR_OUI_2) {
-            // memcpy(ap_router->router_mac, (char*)sa, MAC_LEN);
-            // printf("MAC "MACSTR"", MAC2STR(ap_router->router_mac));
-            // print_vendor_ie_info(vendor_ie);
-            if (vendor_ie->payload[MAX_CONNECT_NUMBER] > vendor_ie->payload[STATION_NUMBER]) {
-                if (vendor_ie->payload[CONNECT_ROUTER_STATUS] == 1) {
-                    if (first_vendor_ie_tag == true || vendor_ie->payload[LEVEL] < ap_router->level) {
-                        memcpy(ap_router->router_mac, (char*)sa, MAC_LEN);
-                        ap_router->level = vendor_ie->payload[LEVEL];
-                        ap_router->rssi  = (~((rssi & 0x7f) - 1)) & 0x7f;
-                        ESP_LOGI(TAG, "router_level: %d rssi: -%d SoftAP MAC "MACSTR"", ap_router->level, ap_router->rssi, MAC2STR(ap_router->router_mac));
-                        first_vendor_ie_tag = false;
-                    }
-                } else {
-                    printf("CONNECT_ROUTER_STATUS false\r\n");
-                }
-            } else {
-                printf("Station is MAX\r\n");
-            }
+        const vendor_ie_data_t *vendor_ie = vnd_ie;
+
+        if (vendor_ie->vendor_oui[0] == VENDOR_OUI_0 && vendor_ie->vendor_oui[1] == VENDOR_OUI_1 && vendor_ie->vendor_oui[2] == VENDOR_OUI_2
+                && vendor_ie->length >= VENDOR_IE_DATA_LENGTH_BASE) {
+            esp_gateway_vendor_ie_metrics_t metrics;
+
+            vendor_ie_decode_ext(vendor_ie->payload + VENDOR_IE_MAX, vendor_ie->length - VENDOR_IE_DATA_LENGTH_BASE, &metrics);
+            vendor_ie_parent_update(sa, vendor_ie->payload[LEVEL], vendor_ie->payload[STATION_NUMBER],
+                                    vendor_ie->payload[MAX_CONNECT_NUMBER], vendor_ie->payload[ROUTER_RSSI],
+                                    vendor_ie->payload[CONNECT_ROUTER_STATUS] == 1, rssi, &metrics);
         }
     }
     return;
 }
 
+void esp_gateway_vendor_ie_parent_reset(void)
+{
+    portENTER_CRITICAL(&s_parent_lock);
+    memset(s_parent_table, 0, sizeof(s_parent_table));
+    s_switch_wins = 0;
+    portEXIT_CRITICAL(&s_parent_lock);
+}
+
+void esp_gateway_vendor_ie_router_update(const wifi_ap_record_t *records, uint16_t number)
+{
+    for (int i = 0; i < number; i++) {
+        if (strcmp((const char *)records[i].ssid, ESP_GATEWAY_WIFI_ROUTER_STA_SSID)) {
+            continue;
+        }
+
+        bool found = false;
+
+        portENTER_CRITICAL(&s_parent_lock);
+        /**< A repeater advertising the same SSID is already known from its vendor ie */
+        vendor_ie_parent_t *entry = vendor_ie_parent_slot(records[i].bssid, &found);
+        bool repeater = found && entry->level != WIFI_ROUTER_LEVEL_0;
+        portEXIT_CRITICAL(&s_parent_lock);
+
+        if (!repeater) {
+            esp_gateway_vendor_ie_metrics_t metrics = {
+                .queue_occupancy = VENDOR_IE_METRIC_UNKNOWN,
+            };
+
+            vendor_ie_parent_update(records[i].bssid, WIFI_ROUTER_LEVEL_0, 0, 0, 0, true, records[i].rssi, &metrics);
+        }
+    }
+}
+
+bool esp_gateway_vendor_ie_select_parent(uint8_t max_level, ap_router_t *parent)
+{
+    uint32_t cost = 0;
+
+    portENTER_CRITICAL(&s_parent_lock);
+
+    const vendor_ie_parent_t *best = vendor_ie_parent_best(max_level, NULL, &cost);
+
+    if (best) {
+        vendor_ie_parent_export(best, parent);
+    } else {
+        memset(parent, 0, sizeof(ap_router_t));
+    }
+
+    portEXIT_CRITICAL(&s_parent_lock);
+
+    if (best) {
+        ESP_LOGI(TAG, "router_level: %d rssi: -%d cost: %u SoftAP MAC "MACSTR"",
+                 parent->level, parent->rssi, cost, MAC2STR(parent->router_mac));
+    }
+
+    return best != NULL;
+}
+
+bool esp_gateway_vendor_ie_better_parent(const uint8_t bssid[MAC_LEN], uint8_t own_level, ap_router_t *parent)
+{
+    bool found = false;
+    bool better = false;
+    uint32_t current_cost = UINT32_MAX;
+    uint32_t best_cost = 0;
+
+    portENTER_CRITICAL(&s_parent_lock);
+
+    const vendor_ie_parent_t *current = vendor_ie_parent_slot(bssid, &found);
+
+    if (found && current->router_connected) {
+        current_cost = vendor_ie_path_cost(current, true);
+    }
+
+    const vendor_ie_parent_t *best = vendor_ie_parent_best(own_level, bssid, &best_cost);
+
+    if (!best || best_cost + ESP_GATEWAY_VENDOR_IE_SWITCH_HYSTERESIS >= current_cost) {
+        s_switch_wins = 0;
+    } else {
+        if (s_switch_wins == 0 || memcmp(s_switch_mac, best->mac, MAC_LEN)) {
+            memcpy(s_switch_mac, best->mac, MAC_LEN);
+            s_switch_wins = 0;
+        }
+
+        if (++s_switch_wins >= ESP_GATEWAY_VENDOR_IE_SWITCH_CONFIRM) {
+            vendor_ie_parent_export(best, parent);
+            s_switch_wins = 0;
+            better = true;
+        }
+    }
+
+    portEXIT_CRITICAL(&s_parent_lock);
+
+    if (better) {
+        ESP_LOGI(TAG, "better parent, level: %d cost: %u -> %u SoftAP MAC "MACSTR"",
+                 parent->level, current_cost, best_cost, MAC2STR(parent->router_mac));
+    }
+
+    return better;
+}
+
+bool esp_gateway_vendor_ie_neighbor_available(uint8_t *station_num)
+{
+    bool found = false;
+    uint8_t own_level = WIFI_ROUTER_LEVEL_0;
+    uint8_t min_station_num = UINT8_MAX;
+    TickType_t now = xTaskGetTickCount();
+
+    portENTER_CRITICAL(&s_update_lock);
+    if (s_vendor_ie) {
+        own_level = s_vendor_ie->payload[LEVEL];
+    }
+    portEXIT_CRITICAL(&s_update_lock);
+
+    portENTER_CRITICAL(&s_parent_lock);
+
+    for (int i = 0; i < ESP_GATEWAY_VENDOR_IE_PARENT_MAX; i++) {
+        const vendor_ie_parent_t *entry = s_parent_table + i;
+
+        /**<
+         * The router has its own SSID, stations can only move between repeaters.
+         * A deeper repeater may hang off this node, a station moved there would
+         * still cross this node and one more hop.
+         */
+        if (entry->level == WIFI_ROUTER_LEVEL_0 || entry->level > own_level
+                || !vendor_ie_parent_usable(entry, now)) {
+            continue;
+        }
+
+        found = true;
+
+        if (entry->station_num < min_station_num) {
+            min_station_num = entry->station_num;
+        }
+    }
+
+    portEXIT_CRITICAL(&s_parent_lock);
+
+    if (station_num) {
+        *station_num = min_station_num;
+    }
+
+    return found;
+}
+
+/**
+ * @brief The single writer of the beacon, applies every change made since the
+ *        last update with one remove/add pair
+ */
+static void vendor_ie_update_timer_cb(void *arg)
+{
+    uint8_t buffer[sizeof(vendor_ie_data_t) + VENDOR_IE_DATA_LENGTH];
+
+    portENTER_CRITICAL(&s_update_lock);
+    memcpy(buffer, s_vendor_ie, sizeof(buffer));
+    s_update_pending = false;
+    portEXIT_CRITICAL(&s_update_lock);
+
+    if (s_vendor_ie_enabled) {
+        esp_wifi_set_vendor_ie(false, WIFI_VND_IE_TYPE_BEACON, WIFI_VND_IE_ID_0, NULL);
+    }
+
+    esp_err_t ret = esp_wifi_set_vendor_ie(true, WIFI_VND_IE_TYPE_BEACON, WIFI_VND_IE_ID_0, buffer);
+    s_vendor_ie_enabled = (ret == ESP_OK);
+    s_last_update = esp_timer_get_time();
+
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "vendor ie update fail, ret: 0x%x", ret);
+    }
+}
+
+/**
+ * @brief Called with s_update_lock held after changing s_vendor_ie, only the
+ *        first change since the last update arms the timer
+ */
+static bool vendor_ie_update_mark(void)
+{
+    bool schedule = !s_update_pending;
+
+    s_update_pending = true;
+
+    return schedule;
+}
+
+static void vendor_ie_update_schedule(void)
+{
+    int64_t delay = ESP_GATEWAY_VENDOR_IE_UPDATE_DELAY_MS * 1000LL;
+    int64_t next  = s_last_update + ESP_GATEWAY_VENDOR_IE_UPDATE_INTERVAL_MS * 1000LL - esp_timer_get_time();
+
+    esp_timer_start_once(s_update_timer, next > delay ? next : delay);
+}
+
+/**
+ * @brief Called with s_update_lock held, returns true if the update must be scheduled
+ */
+static bool vendor_ie_field_write(esp_gateway_vendor_ie_t field, uint8_t value)
+{
+    if (s_vendor_ie->payload[field] == value) {
+        return false;
+    }
+
+    s_vendor_ie->payload[field] = value;
+
+    return vendor_ie_update_mark();
+}
+
+void esp_gateway_vendor_ie_set(esp_gateway_vendor_ie_t field, uint8_t value)
+{
+    portENTER_CRITICAL(&s_update_lock);
+    bool schedule = vendor_ie_field_write(field, value);
+    portEXIT_CRITICAL(&s_update_lock);
+
+    if (schedule) {
+        vendor_ie_update_schedule();
+    }
+}
+
+void esp_gateway_vendor_ie_add(esp_gateway_vendor_ie_t field, int delta)
+{
+    portENTER_CRITICAL(&s_update_lock);
+    int value = s_vendor_ie->payload[field] + delta;
+    bool schedule = vendor_ie_field_write(field, value < 0 ? 0 : (value > UINT8_MAX ? UINT8_MAX : value));
+    portEXIT_CRITICAL(&s_update_lock);
+
+    if (schedule) {
+        vendor_ie_update_schedule();
+    }
+}
+
+void esp_gateway_vendor_ie_set_metrics(const esp_gateway_vendor_ie_metrics_t *metrics)
+{
+    uint8_t ext[VENDOR_IE_EXT_LENGTH];
+    bool schedule = false;
+
+    vendor_ie_encode_ext(ext, metrics);
+    __atomic_store_n(&s_forward_rate, metrics->forward_rate, __ATOMIC_RELAXED);
+
+    portENTER_CRITICAL(&s_update_lock);
+
+    if (memcmp(s_vendor_ie->payload + VENDOR_IE_MAX, ext, sizeof(ext))) {
+        memcpy(s_vendor_ie->payload + VENDOR_IE_MAX, ext, sizeof(ext));
+        schedule = vendor_ie_update_mark();
+    }
+
+    portEXIT_CRITICAL(&s_update_lock);
+
+    if (schedule) {
+        vendor_ie_update_schedule();
+    }
+}
+
 vendor_ie_data_t *esp_wifi_vendor_ie_init(void)
 {
     vendor_ie_data_t *vendor_ie = malloc(sizeof(vendor_ie_data_t) + (VENDOR_IE_DATA_LENGTH * sizeof(uint8_t)));
-    memset(vendor_ie, 0, sizeof(*vendor_ie));
+    memset(vendor_ie, 0, sizeof(vendor_ie_data_t) + VENDOR_IE_DATA_LENGTH);
     (*vendor_ie).element_id = WIFI_VENDOR_IE_ELEMENT_ID;
     (*vendor_ie).length = VENDOR_IE_DATA_LENGTH;
     (*vendor_ie).vendor_oui[0] = VENDOR_OUI_0;
     (*vendor_ie).vendor_oui[1] = VENDOR_OUI_1;
     (*vendor_ie).vendor_oui[2] = VENDOR_OUI_2;
 
+    esp_gateway_vendor_ie_metrics_t metrics = {
+        .queue_occupancy = VENDOR_IE_METRIC_UNKNOWN,
+    };
+
+    vendor_ie_encode_ext(vendor_ie->payload + VENDOR_IE_MAX, &metrics);
+
+    esp_timer_create_args_t timer_args = {
+        .callback = vendor_ie_update_timer_cb,
+        .name     = "vendor_ie_update",
+    };
+
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &s_update_timer));
+
+    s_vendor_ie = vendor_ie;
+    s_update_pending = true;
+    vendor_ie_update_schedule();
+
     return vendor_ie;
 }
 
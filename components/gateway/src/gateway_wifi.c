@@ -13,9 +13,11 @@
 // limitations under the License.
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "esp_system.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "esp_console.h"
 #include "esp_vfs_dev.h"
 #include "driver/uart.h"
@@ -36,6 +38,9 @@
 #include "esp_gateway_vendor_ie.h"
 #include "esp_gateway_config.h"
 #include "esp_gateway_wifi.h"
+#include "esp_gateway_wifi_scan.h"
+#include "esp_gateway_wifi_link.h"
+#include "esp_gateway_napt.h"
 #include "esp_utils.h"
 
 #define GATEWAY_EVENT_STA_CONNECTED  BIT0
@@ -46,8 +51,131 @@ static const char *TAG = "gateway_wifi";
 #if SET_VENDOR_IE
 extern vendor_ie_data_t *esp_gateway_vendor_ie;
 extern ap_router_t *ap_router;
-extern bool first_vendor_ie_tag;
 extern feat_type_t g_feat_type;
+
+#define GATEWAY_VENDOR_IE_DISCOVERY_SCAN_TIMES 2
+
+static uint8_t s_vendor_ie_discovery_scans = 0;
+static bool s_vendor_ie_switching = false;
+static esp_timer_handle_t s_vendor_ie_evaluate_timer = NULL;
+
+/* Connect to ap_router and advertise the level it gives this node */
+static void vendor_ie_connect_parent(void)
+{
+    if (ap_router->level != WIFI_ROUTER_LEVEL_0) {
+        ESP_LOGI(TAG, "wifi_router_level: %d", ap_router->level);
+        esp_gateway_wifi_set(WIFI_MODE_STA, ESP_GATEWAY_WIFI_ROUTER_AP_SSID, ESP_GATEWAY_WIFI_ROUTER_AP_PASSWORD, ap_router->router_mac);
+    } else {
+        ESP_LOGI(TAG, "wifi_router_level: %d", ap_router->level);
+        esp_gateway_wifi_set(WIFI_MODE_STA, ESP_GATEWAY_WIFI_ROUTER_STA_SSID, ESP_GATEWAY_WIFI_ROUTER_STA_PASSWORD, NULL);
+    }
+
+    esp_gateway_vendor_ie_set(CONNECT_ROUTER_STATUS, 0);
+    esp_gateway_vendor_ie_set(ROUTER_RSSI, ap_router->rssi);
+    esp_gateway_vendor_ie_set(LEVEL, ap_router->level + 1);
+
+    esp_wifi_connect();
+}
+
+/* Advertise the load the link controller measured on this node */
+static void vendor_ie_update_metrics(void)
+{
+    esp_gateway_wifi_link_state_t state;
+    esp_gateway_vendor_ie_metrics_t metrics = {
+        .queue_occupancy = VENDOR_IE_METRIC_UNKNOWN,
+    };
+
+    if (esp_gateway_wifi_link_get_state(&state) == ESP_OK) {
+        metrics.forward_rate    = state.frames_per_second > UINT16_MAX ? UINT16_MAX : state.frames_per_second;
+        metrics.queue_occupancy = state.queue_occupancy;
+    }
+
+    esp_gateway_vendor_ie_set_metrics(&metrics);
+}
+
+/* Compare the current parent with the candidates refreshed by the last scan and
+   move to a better one, the connect is issued from the disconnect event */
+static void vendor_ie_evaluate_parent(void)
+{
+    wifi_ap_record_t ap_info;
+
+    if (esp_wifi_sta_get_ap_info(&ap_info) != ESP_OK) {
+        return;
+    }
+
+    /* Keep the uplink RSSI and load seen by the children current */
+    uint8_t uplink_rssi = -ap_info.rssi;
+
+    if (abs(uplink_rssi - (*esp_gateway_vendor_ie).payload[ROUTER_RSSI]) >= 3) {
+        esp_gateway_vendor_ie_set(ROUTER_RSSI, uplink_rssi);
+    }
+
+    vendor_ie_update_metrics();
+
+    /* A level 1 node is already on the router */
+    if ((*esp_gateway_vendor_ie).payload[LEVEL] <= 1) {
+        return;
+    }
+
+    if (esp_gateway_vendor_ie_better_parent(ap_info.bssid, (*esp_gateway_vendor_ie).payload[LEVEL], ap_router)) {
+        s_vendor_ie_switching = true;
+        esp_wifi_disconnect();
+    }
+}
+
+/* Runs each time a scan finishes. The vendor ie callback has refreshed the
+   candidate parents from the beacons seen meanwhile */
+static void vendor_ie_scan_cb(const wifi_ap_record_t *records, uint16_t number, void *arg)
+{
+    if (g_feat_type != FEAT_TYPE_WIFI) {
+        return;
+    }
+
+    esp_gateway_vendor_ie_router_update(records, number);
+
+    if (s_vendor_ie_discovery_scans == 0) {
+        if (s_wifi_is_connected && !s_vendor_ie_switching) {
+            vendor_ie_evaluate_parent();
+        }
+        return;
+    }
+
+    if (--s_vendor_ie_discovery_scans > 0 && esp_gateway_wifi_scan_request() == ESP_OK) {
+        return;
+    }
+    s_vendor_ie_discovery_scans = 0;
+
+    esp_gateway_vendor_ie_select_parent(UINT8_MAX, ap_router);
+    vendor_ie_connect_parent();
+}
+
+/* Runs when the periodic scan of the current channel finishes */
+static void vendor_ie_channel_scan_cb(const wifi_ap_record_t *records, uint16_t number, void *arg)
+{
+    if (g_feat_type != FEAT_TYPE_WIFI) {
+        return;
+    }
+
+    esp_gateway_vendor_ie_router_update(records, number);
+
+    if (s_vendor_ie_discovery_scans == 0 && s_wifi_is_connected && !s_vendor_ie_switching) {
+        vendor_ie_evaluate_parent();
+    }
+}
+
+/* Every SoftAP of the tree follows the channel of its uplink, so the candidate
+   parents are all on the current one: a short scan of it finds them without
+   taking the uplink off channel for a full scan */
+static void vendor_ie_evaluate_timer_cb(void *arg)
+{
+    wifi_ap_record_t ap_info;
+
+    if (g_feat_type == FEAT_TYPE_WIFI && s_wifi_is_connected && s_vendor_ie_discovery_scans == 0
+            && esp_wifi_sta_get_ap_info(&ap_info) == ESP_OK) {
+        esp_gateway_wifi_scan_request_channel(ap_info.primary, ESP_GATEWAY_VENDOR_IE_EVALUATE_DWELL_MS,
+                                              vendor_ie_channel_scan_cb, NULL);
+    }
+}
 #endif
 
 /* Event handler for catching system events */
@@ -61,9 +189,8 @@ static void event_handler(void *arg, esp_event_base_t event_base,
         ESP_LOGI(TAG, "Connected with IP Address:" IPSTR, IP2STR(&event->ip_info.ip));
 #if SET_VENDOR_IE
         if (g_feat_type == FEAT_TYPE_WIFI) {
-            ESP_ERROR_CHECK(esp_wifi_set_vendor_ie(false, WIFI_VND_IE_TYPE_BEACON, WIFI_VND_IE_ID_0, esp_gateway_vendor_ie));
-            (*esp_gateway_vendor_ie).payload[CONNECT_ROUTER_STATUS] = 1;
-            ESP_ERROR_CHECK(esp_wifi_set_vendor_ie(true, WIFI_VND_IE_TYPE_BEACON, WIFI_VND_IE_ID_0, esp_gateway_vendor_ie));
+            esp_gateway_vendor_ie_set(CONNECT_ROUTER_STATUS, 1);
+            vendor_ie_update_metrics();
         }
 #endif
         /* Signal main application to continue execution */
@@ -73,30 +200,24 @@ static void event_handler(void *arg, esp_event_base_t event_base,
         ESP_LOGE(TAG, "Disconnected. Connecting to the AP again...");
 #if SET_VENDOR_IE
         if (g_feat_type == FEAT_TYPE_WIFI) {
-            if ((*esp_gateway_vendor_ie).payload[LEVEL] != 1) {
-                first_vendor_ie_tag = true;
-                for (int i = 0; i < 2; i++) {
-                    ESP_ERROR_CHECK(esp_wifi_scan_start(NULL, true));
+            if (s_vendor_ie_switching) {
+                /* Leaving the parent on purpose, ap_router is already the new one */
+                s_vendor_ie_switching = false;
+                s_wifi_is_connected = false;
+                vendor_ie_connect_parent();
+                return;
+            } else if ((*esp_gateway_vendor_ie).payload[LEVEL] != 1) {
+                /* Look for the best parent again without blocking the event loop,
+                   the connect is issued from vendor_ie_scan_cb() */
+                esp_gateway_vendor_ie_parent_reset();
+                s_wifi_is_connected = false;
+                s_vendor_ie_discovery_scans = GATEWAY_VENDOR_IE_DISCOVERY_SCAN_TIMES;
+                if (esp_gateway_wifi_scan_request() == ESP_OK) {
+                    return;
                 }
-                ESP_ERROR_CHECK(esp_wifi_scan_stop());
-
-                if (ap_router->level != WIFI_ROUTER_LEVEL_0) {
-                    ESP_LOGI(TAG, "wifi_router_level: %d", ap_router->level);
-                    esp_gateway_wifi_set(WIFI_MODE_STA, ESP_GATEWAY_WIFI_ROUTER_AP_SSID, ESP_GATEWAY_WIFI_ROUTER_AP_PASSWORD, ap_router->router_mac);
-                } else {
-                    ESP_LOGI(TAG, "wifi_router_level: %d", ap_router->level);
-                    esp_gateway_wifi_set(WIFI_MODE_STA, ESP_GATEWAY_WIFI_ROUTER_STA_SSID, ESP_GATEWAY_WIFI_ROUTER_STA_PASSWORD, NULL);
-                }
-
-                ESP_ERROR_CHECK(esp_wifi_set_vendor_ie(false, WIFI_VND_IE_TYPE_BEACON, WIFI_VND_IE_ID_0, esp_gateway_vendor_ie));
-                (*esp_gateway_vendor_ie).payload[CONNECT_ROUTER_STATUS] = 0;
-                (*esp_gateway_vendor_ie).payload[ROUTER_RSSI] = ap_router->rssi;
-                (*esp_gateway_vendor_ie).payload[LEVEL] = ap_router->level + 1;
-                ESP_ERROR_CHECK(esp_wifi_set_vendor_ie(true, WIFI_VND_IE_TYPE_BEACON, WIFI_VND_IE_ID_0, esp_gateway_vendor_ie));
+                s_vendor_ie_discovery_scans = 0;
             } else {
-                ESP_ERROR_CHECK(esp_wifi_set_vendor_ie(false, WIFI_VND_IE_TYPE_BEACON, WIFI_VND_IE_ID_0, esp_gateway_vendor_ie));
-                (*esp_gateway_vendor_ie).payload[CONNECT_ROUTER_STATUS] = 0;
-                ESP_ERROR_CHECK(esp_wifi_set_vendor_ie(true, WIFI_VND_IE_TYPE_BEACON, WIFI_VND_IE_ID_0, esp_gateway_vendor_ie));
+                esp_gateway_vendor_ie_set(CONNECT_ROUTER_STATUS, 0);
             }
         }
 #endif
@@ -106,18 +227,14 @@ static void event_handler(void *arg, esp_event_base_t event_base,
         ESP_LOGE(TAG, "STA Connecting to the AP again...");
 #if SET_VENDOR_IE
         if (g_feat_type == FEAT_TYPE_WIFI) {
-            ESP_ERROR_CHECK(esp_wifi_set_vendor_ie(false, WIFI_VND_IE_TYPE_BEACON, WIFI_VND_IE_ID_0, esp_gateway_vendor_ie));
-            (*esp_gateway_vendor_ie).payload[STATION_NUMBER]++;
-            ESP_ERROR_CHECK(esp_wifi_set_vendor_ie(true, WIFI_VND_IE_TYPE_BEACON, WIFI_VND_IE_ID_0, esp_gateway_vendor_ie));
+            esp_gateway_vendor_ie_add(STATION_NUMBER, 1);
         }
 #endif
     } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_AP_STADISCONNECTED) {
         ESP_LOGE(TAG, "STA Disconnect to the AP");
 #if SET_VENDOR_IE
         if (g_feat_type == FEAT_TYPE_WIFI) {
-            ESP_ERROR_CHECK(esp_wifi_set_vendor_ie(false, WIFI_VND_IE_TYPE_BEACON, WIFI_VND_IE_ID_0, esp_gateway_vendor_ie));
-            (*esp_gateway_vendor_ie).payload[STATION_NUMBER]--;
-            ESP_ERROR_CHECK(esp_wifi_set_vendor_ie(true, WIFI_VND_IE_TYPE_BEACON, WIFI_VND_IE_ID_0, esp_gateway_vendor_ie));
+            esp_gateway_vendor_ie_add(STATION_NUMBER, -1);
         }
 #endif
     }
@@ -126,6 +243,7 @@ static void event_handler(void *arg, esp_event_base_t event_base,
 esp_err_t esp_gateway_wifi_ap_init(void)
 {
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
+    esp_gateway_wifi_link_init_config(&cfg, ESP_GATEWAY_WIFI_LINK_PROFILE_ROUTER);
     ESP_ERROR_CHECK(esp_wifi_init(&cfg));
     ESP_ERROR_CHECK(esp_wifi_set_storage(WIFI_STORAGE_RAM));
     wifi_config_t wifi_config = {
@@ -143,6 +261,7 @@ esp_err_t esp_gateway_wifi_ap_init(void)
     }
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_AP));
     ESP_ERROR_CHECK(esp_wifi_set_config(ESP_IF_WIFI_AP, &wifi_config));
+    ESP_ERROR_CHECK(esp_gateway_wifi_scan_init());
 
     return ESP_OK;
 }
@@ -166,7 +285,9 @@ esp_netif_t *esp_gateway_wifi_init(wifi_mode_t mode)
     }
 
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
+    esp_gateway_wifi_link_init_config(&cfg, ESP_GATEWAY_WIFI_LINK_PROFILE_ROUTER);
     ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+    ESP_ERROR_CHECK(esp_gateway_wifi_scan_init());
 
     /* Register our event handler for Wi-Fi, IP and Provisioning related events */
     ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &event_handler, NULL));
@@ -176,6 +297,18 @@ esp_netif_t *esp_gateway_wifi_init(wifi_mode_t mode)
     ESP_ERROR_CHECK(esp_wifi_set_storage(WIFI_STORAGE_RAM));
     ESP_ERROR_CHECK(esp_wifi_start());
 
+#if SET_VENDOR_IE
+    ESP_ERROR_CHECK(esp_gateway_wifi_scan_subscribe(vendor_ie_scan_cb, NULL));
+
+    esp_timer_create_args_t timer_args = {
+        .callback = vendor_ie_evaluate_timer_cb,
+        .name     = "vendor_ie_evaluate",
+    };
+
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &s_vendor_ie_evaluate_timer));
+    ESP_ERROR_CHECK(esp_timer_start_periodic(s_vendor_ie_evaluate_timer, ESP_GATEWAY_VENDOR_IE_EVALUATE_PERIOD_MS * 1000ULL));
+#endif
+
     return wifi_netif;
 }
 
@@ -201,7 +334,7 @@ esp_err_t esp_gateway_wifi_set(wifi_mode_t mode, const char *ssid, const char *p
     }
 
     if (mode & WIFI_MODE_AP) {
-        wifi_cfg.ap.max_connection = 10;
+        wifi_cfg.ap.max_connection = ESP_GATEWAY_WIFI_ROUTER_MAX_STA_CONN;
         wifi_cfg.ap.authmode = strlen(password) < 8 ? WIFI_AUTH_OPEN : WIFI_AUTH_WPA2_PSK;
         strlcpy((char *)wifi_cfg.ap.ssid, ssid, sizeof(wifi_cfg.ap.ssid));
         strlcpy((char *)wifi_cfg.ap.password, password, sizeof(wifi_cfg.ap.password));
@@ -220,13 +353,10 @@ esp_err_t esp_gateway_wifi_napt_enable(uint32_t ip)
     esp_netif_ip_info_t info_t;
     memset(&info_t, 0, sizeof(esp_netif_ip_info_t));
     ip4addr_aton((const char *)(ESP_GATEWAY_AP_STATIC_IP_ADDR), (ip4_addr_t*)&info_t.ip);
-    ip_napt_enable(info_t.ip.addr, 1);
-#else
-    ip_napt_enable(ip, 1);
+    ip = info_t.ip.addr;
 #endif
-    ESP_LOGI(TAG, "NAT is enabled");
 
-    return ESP_OK;
+    return esp_gateway_napt_enable(ip);
 }
 
 esp_err_t esp_gateway_wifi_set_dhcps(esp_netif_t *netif, uint32_t addr)
@@ -0,0 +1,353 @@
+// Copyright 2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_event.h"
+#include "esp_wifi.h"
+#include "esp_private/wifi.h"
+
+#include "esp_utils.h"
+#include "esp_gateway_wifi.h"
+#include "esp_gateway_wifi_bridge.h"
+#include "esp_gateway_wifi_link.h"
+
+#define BRIDGE_ETH_HDR_LEN          14
+#define BRIDGE_ETH_TYPE_IP          0x0800
+#define BRIDGE_ETH_TYPE_ARP         0x0806
+#define BRIDGE_ARP_LEN              28
+#define BRIDGE_IP_HDR_MIN_LEN       20
+#define BRIDGE_IP_PROTO_UDP         17
+#define BRIDGE_DHCP_SERVER_PORT     67
+#define BRIDGE_BOOTP_FLAGS_OFFSET   10      /**< op, htype, hlen, hops, xid and secs come first */
+
+/* Offsets in the frame */
+#define BRIDGE_ETH_DEST             0
+#define BRIDGE_ETH_SRC              6
+#define BRIDGE_ETH_TYPE             12
+#define BRIDGE_ARP_SHA              (BRIDGE_ETH_HDR_LEN + 8)
+#define BRIDGE_ARP_SPA              (BRIDGE_ETH_HDR_LEN + 14)
+#define BRIDGE_ARP_THA              (BRIDGE_ETH_HDR_LEN + 18)
+#define BRIDGE_ARP_TPA              (BRIDGE_ETH_HDR_LEN + 24)
+#define BRIDGE_IP_SRC               (BRIDGE_ETH_HDR_LEN + 12)
+#define BRIDGE_IP_DEST              (BRIDGE_ETH_HDR_LEN + 16)
+
+typedef struct {
+    uint32_t ip;            /**< In network order as found in the frame, 0 if the entry is free */
+    uint8_t mac[6];
+    TickType_t last_seen;
+} bridge_mac_nat_entry_t;
+
+static const char *TAG = "gateway_bridge";
+
+static bool s_bridge_running = false;
+static esp_netif_t *s_bridge_sta_netif = NULL;
+static uint8_t s_bridge_sta_mac[6] = {0};
+static portMUX_TYPE s_bridge_spinlock = portMUX_INITIALIZER_UNLOCKED;
+static bridge_mac_nat_entry_t s_bridge_mac_nat[ESP_GATEWAY_BRIDGE_MAC_NAT_MAX] = {0};
+static esp_gateway_wifi_bridge_stats_t s_bridge_stats = {0};
+
+static inline uint16_t bridge_get_be16(const uint8_t *data)
+{
+    return (data[0] << 8) | data[1];
+}
+
+static inline uint32_t bridge_get_ip(const uint8_t *data)
+{
+    uint32_t ip;
+    memcpy(&ip, data, sizeof(ip));
+    return ip;
+}
+
+static void bridge_mac_nat_learn(uint32_t ip, const uint8_t *mac)
+{
+    bridge_mac_nat_entry_t *entry  = NULL;
+    bridge_mac_nat_entry_t *victim = &s_bridge_mac_nat[0];
+    TickType_t now = xTaskGetTickCount();
+
+    /**< 0.0.0.0 is used by DHCP clients, multicast (first octet 224~239, the low byte
+         on this little endian CPU) and broadcast addresses are not hosts */
+    if (!ip || (ip & 0xF0) == 0xE0 || ip == 0xFFFFFFFF || (mac[0] & 0x01)) {
+        return;
+    }
+
+    portENTER_CRITICAL(&s_bridge_spinlock);
+
+    for (int i = 0; i < ESP_GATEWAY_BRIDGE_MAC_NAT_MAX; i++) {
+        if (s_bridge_mac_nat[i].ip == ip) {
+            entry = &s_bridge_mac_nat[i];
+            break;
+        }
+
+        /**< Otherwise use a free entry, or the one not seen for the longest time */
+        if (victim->ip && (!s_bridge_mac_nat[i].ip
+                           || now - s_bridge_mac_nat[i].last_seen > now - victim->last_seen)) {
+            victim = &s_bridge_mac_nat[i];
+        }
+    }
+
+    if (!entry) {
+        entry = victim;
+
+        if (entry->ip && now - entry->last_seen < pdMS_TO_TICKS(ESP_GATEWAY_BRIDGE_MAC_NAT_AGE_MS)) {
+            ESP_LOGD(TAG, "MAC-NAT table full, replace "MACSTR, MAC2STR(entry->mac));
+        }
+    }
+
+    entry->ip        = ip;
+    entry->last_seen = now;
+    memcpy(entry->mac, mac, sizeof(entry->mac));
+
+    portEXIT_CRITICAL(&s_bridge_spinlock);
+}
+
+static bool bridge_mac_nat_lookup_ip(uint32_t ip, uint8_t *mac)
+{
+    bool found = false;
+
+    portENTER_CRITICAL(&s_bridge_spinlock);
+
+    for (int i = 0; i < ESP_GATEWAY_BRIDGE_MAC_NAT_MAX; i++) {
+        if (s_bridge_mac_nat[i].ip == ip && ip) {
+            memcpy(mac, s_bridge_mac_nat[i].mac, 6);
+            found = true;
+            break;
+        }
+    }
+
+    portEXIT_CRITICAL(&s_bridge_spinlock);
+
+    return found;
+}
+
+static bool bridge_mac_nat_has_mac(const uint8_t *mac)
+{
+    bool found = false;
+
+    portENTER_CRITICAL(&s_bridge_spinlock);
+
+    for (int i = 0; i < ESP_GATEWAY_BRIDGE_MAC_NAT_MAX; i++) {
+        if (s_bridge_mac_nat[i].ip && !memcmp(s_bridge_mac_nat[i].mac, mac, 6)) {
+            found = true;
+            break;
+        }
+    }
+
+    portEXIT_CRITICAL(&s_bridge_spinlock);
+
+    return found;
+}
+
+/**
+ * @brief The router answers DHCP to the client hardware address, which it cannot
+ *        reach behind the bridge, so clients are asked for broadcast replies
+ */
+static void bridge_dhcp_set_broadcast(uint8_t *frame, uint16_t len, uint8_t ip_hdr_len)
+{
+    uint8_t *udp = frame + BRIDGE_ETH_HDR_LEN + ip_hdr_len;
+
+    if (len < BRIDGE_ETH_HDR_LEN + ip_hdr_len + 8 + BRIDGE_BOOTP_FLAGS_OFFSET + 2
+            || bridge_get_be16(udp + 2) != BRIDGE_DHCP_SERVER_PORT) {
+        return;
+    }
+
+    udp[8 + BRIDGE_BOOTP_FLAGS_OFFSET] |= 0x80;
+
+    /**< A zero UDP checksum means none was computed, valid for IPv4 */
+    udp[6] = 0;
+    udp[7] = 0;
+}
+
+// Forward packets from SoftAP clients to the router
+static esp_err_t bridge_ap_rx(void *buffer, uint16_t len, void *eb)
+{
+    uint8_t *frame = (uint8_t *)buffer;
+    uint16_t type  = 0;
+
+    esp_gateway_wifi_link_activity(1);
+
+    if (!s_bridge_running || len < BRIDGE_ETH_HDR_LEN) {
+        s_bridge_stats.dropped_frames++;
+        goto exit;
+    }
+
+    type = bridge_get_be16(frame + BRIDGE_ETH_TYPE);
+
+    if (type == BRIDGE_ETH_TYPE_ARP && len >= BRIDGE_ETH_HDR_LEN + BRIDGE_ARP_LEN) {
+        bridge_mac_nat_learn(bridge_get_ip(frame + BRIDGE_ARP_SPA), frame + BRIDGE_ARP_SHA);
+    } else if (type == BRIDGE_ETH_TYPE_IP && len >= BRIDGE_ETH_HDR_LEN + BRIDGE_IP_HDR_MIN_LEN) {
+        bridge_mac_nat_learn(bridge_get_ip(frame + BRIDGE_IP_SRC), frame + BRIDGE_ETH_SRC);
+    }
+
+    /**< Broadcast and multicast also go to the other clients, unicast between clients stays in the BSS */
+    if (frame[BRIDGE_ETH_DEST] & 0x01) {
+        esp_wifi_internal_tx(ESP_IF_WIFI_AP, frame, len);
+    } else if (bridge_mac_nat_has_mac(frame + BRIDGE_ETH_DEST)) {
+        esp_wifi_internal_tx(ESP_IF_WIFI_AP, frame, len);
+        s_bridge_stats.downlink_frames++;
+        goto exit;
+    }
+
+    if (type == BRIDGE_ETH_TYPE_ARP && len >= BRIDGE_ETH_HDR_LEN + BRIDGE_ARP_LEN) {
+        memcpy(frame + BRIDGE_ARP_SHA, s_bridge_sta_mac, 6);
+    } else if (type == BRIDGE_ETH_TYPE_IP && len >= BRIDGE_ETH_HDR_LEN + BRIDGE_IP_HDR_MIN_LEN) {
+        uint8_t ip_hdr_len = (frame[BRIDGE_ETH_HDR_LEN] & 0x0F) * 4;
+
+        if (frame[BRIDGE_ETH_HDR_LEN + 9] == BRIDGE_IP_PROTO_UDP) {
+            bridge_dhcp_set_broadcast(frame, len, ip_hdr_len);
+        }
+    }
+
+    memcpy(frame + BRIDGE_ETH_SRC, s_bridge_sta_mac, 6);
+
+    if (esp_wifi_internal_tx(ESP_IF_WIFI_STA, frame, len) == ESP_OK) {
+        s_bridge_stats.uplink_frames++;
+    } else {
+        s_bridge_stats.dropped_frames++;
+    }
+
+exit:
+    esp_wifi_internal_free_rx_buffer(eb);
+    return ESP_OK;
+}
+
+// Forward packets from the router to SoftAP clients, the rest goes to lwIP
+static esp_err_t bridge_sta_rx(void *buffer, uint16_t len, void *eb)
+{
+    uint8_t *frame = (uint8_t *)buffer;
+    uint8_t client_mac[6] = {0};
+    uint16_t type = 0;
+    bool to_client = false;
+
+    esp_gateway_wifi_link_activity(1);
+
+    if (!s_bridge_running || len < BRIDGE_ETH_HDR_LEN) {
+        goto local;
+    }
+
+    /**< Broadcast and multicast are for the clients and for the gateway itself */
+    if (frame[BRIDGE_ETH_DEST] & 0x01) {
+        esp_wifi_internal_tx(ESP_IF_WIFI_AP, frame, len);
+        s_bridge_stats.downlink_frames++;
+        goto local;
+    }
+
+    if (memcmp(frame + BRIDGE_ETH_DEST, s_bridge_sta_mac, 6)) {
+        goto local;
+    }
+
+    type = bridge_get_be16(frame + BRIDGE_ETH_TYPE);
+
+    if (type == BRIDGE_ETH_TYPE_IP && len >= BRIDGE_ETH_HDR_LEN + BRIDGE_IP_HDR_MIN_LEN) {
+        to_client = bridge_mac_nat_lookup_ip(bridge_get_ip(frame + BRIDGE_IP_DEST), client_mac);
+    } else if (type == BRIDGE_ETH_TYPE_ARP && len >= BRIDGE_ETH_HDR_LEN + BRIDGE_ARP_LEN) {
+        to_client = bridge_mac_nat_lookup_ip(bridge_get_ip(frame + BRIDGE_ARP_TPA), client_mac);
+
+        if (to_client) {
+            memcpy(frame + BRIDGE_ARP_THA, client_mac, 6);
+        }
+    }
+
+    if (!to_client) {
+        goto local;
+    }
+
+    memcpy(frame + BRIDGE_ETH_DEST, client_mac, 6);
+
+    if (esp_wifi_internal_tx(ESP_IF_WIFI_AP, frame, len) == ESP_OK) {
+        s_bridge_stats.downlink_frames++;
+    } else {
+        s_bridge_stats.dropped_frames++;
+    }
+
+    esp_wifi_internal_free_rx_buffer(eb);
+    return ESP_OK;
+
+local:
+    s_bridge_stats.local_frames++;
+    return esp_netif_receive(s_bridge_sta_netif, buffer, len, eb);
+}
+
+// Event handler for Wi-Fi, registered after the netif ones so that the receive callbacks set here win
+static void bridge_wifi_event_handler(void *arg, esp_event_base_t event_base,
+                                      int32_t event_id, void *event_data)
+{
+    switch (event_id) {
+        case WIFI_EVENT_STA_CONNECTED:
+            esp_wifi_internal_reg_rxcb(ESP_IF_WIFI_STA, bridge_sta_rx);
+            break;
+
+        case WIFI_EVENT_AP_START:
+            esp_wifi_internal_reg_rxcb(ESP_IF_WIFI_AP, bridge_ap_rx);
+            break;
+
+        default:
+            break;
+    }
+}
+
+esp_err_t esp_gateway_wifi_bridge_start(esp_netif_t *sta_netif)
+{
+    ESP_PARAM_CHECK(sta_netif);
+
+    wifi_ap_record_t ap_info = {0};
+
+    s_bridge_sta_netif = sta_netif;
+    ESP_ERROR_CHECK(esp_wifi_get_mac(ESP_IF_WIFI_STA, s_bridge_sta_mac));
+    memset(s_bridge_mac_nat, 0, sizeof(s_bridge_mac_nat));
+    memset(&s_bridge_stats, 0, sizeof(s_bridge_stats));
+    s_bridge_running = true;
+
+    ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_STA_CONNECTED, &bridge_wifi_event_handler, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_AP_START, &bridge_wifi_event_handler, NULL));
+
+    esp_wifi_internal_reg_rxcb(ESP_IF_WIFI_AP, bridge_ap_rx);
+
+    if (esp_wifi_sta_get_ap_info(&ap_info) == ESP_OK) {
+        esp_wifi_internal_reg_rxcb(ESP_IF_WIFI_STA, bridge_sta_rx);
+    }
+
+    ESP_LOGI(TAG, "Wi-Fi bridge started, STA MAC "MACSTR, MAC2STR(s_bridge_sta_mac));
+
+    return ESP_OK;
+}
+
+esp_err_t esp_gateway_wifi_bridge_stop(void)
+{
+    ESP_ERROR_RETURN(!s_bridge_running, ESP_ERR_INVALID_STATE, "Wi-Fi bridge is not running");
+
+    esp_event_handler_unregister(WIFI_EVENT, WIFI_EVENT_STA_CONNECTED, &bridge_wifi_event_handler);
+    esp_event_handler_unregister(WIFI_EVENT, WIFI_EVENT_AP_START, &bridge_wifi_event_handler);
+    esp_wifi_internal_reg_rxcb(ESP_IF_WIFI_AP, NULL);
+
+    /**< bridge_sta_rx() stays registered and hands every frame to lwIP until the next connection */
+    s_bridge_running = false;
+
+    ESP_LOGI(TAG, "Wi-Fi bridge stopped");
+
+    return ESP_OK;
+}
+
+esp_err_t esp_gateway_wifi_bridge_get_stats(esp_gateway_wifi_bridge_stats_t *stats)
+{
+    ESP_PARAM_CHECK(stats);
+
+    memcpy(stats, &s_bridge_stats, sizeof(esp_gateway_wifi_bridge_stats_t));
+
+    return ESP_OK;
+}
@@ -0,0 +1,332 @@
+// Copyright 2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+
+#include "lwip/opt.h"
+#include "lwip/memp.h"
+#include "lwip/stats.h"
+
+#include "esp_utils.h"
+#include "esp_gateway_wifi_link.h"
+#include "esp_gateway_wifi_scan.h"
+
+static const char *TAG = "gateway_link";
+
+static esp_timer_handle_t s_link_timer = NULL;
+static esp_gateway_wifi_link_state_t s_link_state = {
+    .queue_occupancy = UINT8_MAX,
+};
+static uint32_t s_link_frames = 0;
+static uint8_t s_link_idle_periods = 0;
+static bool s_link_ps_failed = false;     /**< esp_wifi_set_ps() refused, e.g. under BLE coexistence */
+#if LWIP_STATS && LINK_STATS
+static STAT_COUNTER s_link_lwip_frames = 0;
+#endif
+
+void esp_gateway_wifi_link_init_config(wifi_init_config_t *cfg, esp_gateway_wifi_link_profile_t profile)
+{
+    int static_rx_buf_num  = ESP_GATEWAY_WIFI_LINK_ROUTER_STATIC_RX_BUF;
+    int dynamic_rx_buf_num = ESP_GATEWAY_WIFI_LINK_ROUTER_DYNAMIC_RX_BUF;
+    int dynamic_tx_buf_num = ESP_GATEWAY_WIFI_LINK_ROUTER_DYNAMIC_TX_BUF;
+
+    if (profile == ESP_GATEWAY_WIFI_LINK_PROFILE_DONGLE) {
+        static_rx_buf_num  = ESP_GATEWAY_WIFI_LINK_DONGLE_STATIC_RX_BUF;
+        dynamic_rx_buf_num = ESP_GATEWAY_WIFI_LINK_DONGLE_DYNAMIC_RX_BUF;
+        dynamic_tx_buf_num = ESP_GATEWAY_WIFI_LINK_DONGLE_DYNAMIC_TX_BUF;
+    }
+
+    if (cfg->static_rx_buf_num < static_rx_buf_num) {
+        cfg->static_rx_buf_num = static_rx_buf_num;
+    }
+
+    /**< 0 means no limit */
+    if (cfg->dynamic_rx_buf_num && cfg->dynamic_rx_buf_num < dynamic_rx_buf_num) {
+        cfg->dynamic_rx_buf_num = dynamic_rx_buf_num;
+    }
+
+    if (cfg->tx_buf_type == 1 && cfg->dynamic_tx_buf_num < dynamic_tx_buf_num) {
+        cfg->dynamic_tx_buf_num = dynamic_tx_buf_num;
+    }
+}
+
+void esp_gateway_wifi_link_activity(uint32_t frames)
+{
+    __atomic_fetch_add(&s_link_frames, frames, __ATOMIC_RELAXED);
+}
+
+static uint32_t link_frames_read(void)
+{
+    uint32_t frames = __atomic_exchange_n(&s_link_frames, 0, __ATOMIC_RELAXED);
+
+#if LWIP_STATS && LINK_STATS
+    STAT_COUNTER lwip_frames = lwip_stats.link.recv + lwip_stats.link.xmit;
+
+    frames += (STAT_COUNTER)(lwip_frames - s_link_lwip_frames);
+    s_link_lwip_frames = lwip_frames;
+#endif
+
+    return frames;
+}
+
+/**
+ * @brief Frames lwIP receives wait in the tcpip mailbox, each one holding a
+ *        TCPIP_MSG_INPKT until the tcpip task takes it, so the peak use of
+ *        that pool during a period is the peak depth of the input queue
+ */
+static uint8_t link_queue_read(void)
+{
+#if LWIP_STATS && MEMP_STATS && !LWIP_TCPIP_CORE_LOCKING_INPUT
+    struct stats_mem *stats = lwip_stats.memp[MEMP_TCPIP_MSG_INPKT];
+    uint32_t peak = stats->max;
+
+    /**< Start the next period from the current depth, racing the tcpip task at worst loses one peak */
+    stats->max = stats->used;
+    peak = peak * 100 / TCPIP_MBOX_SIZE;
+
+    return peak > 100 ? 100 : peak;
+#else
+    return UINT8_MAX;
+#endif
+}
+
+/**
+ * @brief Modem sleep only helps a station-only link. With IDF v4.4 the Wi-Fi
+ *        driver does not sleep while a SoftAP is up, it has to send every beacon
+ *        and stay awake for the stations it serves, so APSTA repeaters never sleep.
+ */
+static void link_adapt_power_save(wifi_mode_t mode)
+{
+    wifi_ps_type_t ps_type = WIFI_PS_NONE;
+
+    if (s_link_ps_failed) {
+        return;
+    }
+
+    if (mode == WIFI_MODE_STA) {
+        if (s_link_state.frames_per_second >= ESP_GATEWAY_WIFI_LINK_IDLE_FPS) {
+            s_link_idle_periods = 0;
+        } else if (s_link_idle_periods < ESP_GATEWAY_WIFI_LINK_IDLE_PERIODS) {
+            s_link_idle_periods++;
+        }
+
+        if (s_link_idle_periods >= ESP_GATEWAY_WIFI_LINK_IDLE_PERIODS) {
+            ps_type = WIFI_PS_MIN_MODEM;
+        }
+    }
+
+    if (ps_type == s_link_state.ps_type) {
+        return;
+    }
+
+    esp_err_t ret = esp_wifi_set_ps(ps_type);
+
+    if (ret != ESP_OK) {
+        /**< It fails the same way every period, keep the current mode until the next start */
+        ESP_LOGW(TAG, "esp_wifi_set_ps(%d), power save adaptation stopped, err: %s", ps_type, esp_err_to_name(ret));
+        s_link_ps_failed = true;
+        return;
+    }
+
+    ESP_LOGD(TAG, "power save: %d, frames per second: %u", ps_type, s_link_state.frames_per_second);
+    s_link_state.ps_type = ps_type;
+}
+
+static void link_adapt_tx_power(wifi_mode_t mode)
+{
+    int weakest_rssi = 0;
+    int tx_power = ESP_GATEWAY_WIFI_LINK_TX_POWER_MAX;
+    int sta_num = 0;
+
+    if (mode & WIFI_MODE_AP) {
+        wifi_sta_list_t sta_list;
+
+        if (esp_wifi_ap_get_sta_list(&sta_list) == ESP_OK) {
+            sta_num = sta_list.num;
+
+            for (int i = 0; i < sta_list.num; i++) {
+                if (sta_list.sta[i].rssi < 0 && (!weakest_rssi || sta_list.sta[i].rssi < weakest_rssi)) {
+                    weakest_rssi = sta_list.sta[i].rssi;
+                }
+            }
+        }
+    }
+
+    if (mode & WIFI_MODE_STA) {
+        wifi_ap_record_t ap_info;
+
+        if (esp_wifi_sta_get_ap_info(&ap_info) == ESP_OK && ap_info.rssi < 0
+                && (!weakest_rssi || ap_info.rssi < weakest_rssi)) {
+            weakest_rssi = ap_info.rssi;
+        }
+    }
+
+    /**< The peer hears us at our TX power minus the path loss it sees us with */
+    if (weakest_rssi) {
+        tx_power = (ESP_GATEWAY_WIFI_LINK_TARGET_RSSI + ESP_GATEWAY_WIFI_LINK_PEER_TX_POWER - weakest_rssi) * 4;
+    }
+
+    if (tx_power > ESP_GATEWAY_WIFI_LINK_TX_POWER_MAX) {
+        tx_power = ESP_GATEWAY_WIFI_LINK_TX_POWER_MAX;
+    } else if (tx_power < ESP_GATEWAY_WIFI_LINK_TX_POWER_MIN) {
+        tx_power = ESP_GATEWAY_WIFI_LINK_TX_POWER_MIN;
+    }
+
+    /**<
+     * Child repeaters rank their parents by the RSSI they hear us at, lowering
+     * the power under them would raise our path cost and could make them switch
+     * back and forth with this controller. Only go down with no station attached.
+     */
+    if (sta_num && tx_power < s_link_state.tx_power) {
+        tx_power = s_link_state.tx_power;
+    }
+
+    /**< Go up at once, come down slowly so a fading peer is not lost */
+    if (tx_power < s_link_state.tx_power - ESP_GATEWAY_WIFI_LINK_TX_POWER_STEP) {
+        tx_power = s_link_state.tx_power - ESP_GATEWAY_WIFI_LINK_TX_POWER_STEP;
+    }
+
+    s_link_state.weakest_rssi = weakest_rssi;
+
+    if (tx_power != s_link_state.tx_power && esp_wifi_set_max_tx_power(tx_power) == ESP_OK) {
+        ESP_LOGD(TAG, "tx power: %d, weakest rssi: %d", tx_power, weakest_rssi);
+        s_link_state.tx_power = tx_power;
+    }
+}
+
+static void link_timer_cb(void *arg)
+{
+    wifi_mode_t mode = WIFI_MODE_NULL;
+
+    if (esp_wifi_get_mode(&mode) != ESP_OK) {
+        return;
+    }
+
+    s_link_state.frames_per_second = link_frames_read() * 1000 / ESP_GATEWAY_WIFI_LINK_PERIOD_MS;
+
+    int queue_occupancy = link_queue_read();
+
+    if (queue_occupancy != UINT8_MAX) {
+        s_link_state.queue_occupancy += (queue_occupancy - s_link_state.queue_occupancy) / 4;
+    }
+
+    link_adapt_power_save(mode);
+    link_adapt_tx_power(mode);
+}
+
+/**
+ * @brief Pick the SoftAP bandwidth from the BSSs the last scan found around its channel
+ */
+static void link_scan_cb(const wifi_ap_record_t *records, uint16_t number, void *arg)
+{
+    wifi_mode_t mode = WIFI_MODE_NULL;
+    uint8_t primary = 0;
+    wifi_second_chan_t second = WIFI_SECOND_CHAN_NONE;
+    int overlap = 0;
+
+    if (esp_wifi_get_mode(&mode) != ESP_OK || !(mode & WIFI_MODE_AP)
+            || esp_wifi_get_channel(&primary, &second) != ESP_OK) {
+        return;
+    }
+
+    /**< Records are sorted by RSSI. BSSs on the primary channel share the airtime either way */
+    for (int i = 0; i < number && records[i].rssi >= ESP_GATEWAY_WIFI_LINK_HT40_RSSI; i++) {
+        int distance = abs(records[i].primary - primary);
+
+        if (distance > 0 && distance <= 6) {
+            overlap++;
+        }
+    }
+
+    wifi_bandwidth_t bandwidth = overlap <= ESP_GATEWAY_WIFI_LINK_HT40_OVERLAP_MAX ? WIFI_BW_HT40 : WIFI_BW_HT20;
+
+    if (bandwidth != s_link_state.ap_bandwidth && esp_wifi_set_bandwidth(WIFI_IF_AP, bandwidth) == ESP_OK) {
+        ESP_LOGI(TAG, "SoftAP bandwidth: %s, overlapping BSSs: %d", bandwidth == WIFI_BW_HT40 ? "HT40" : "HT20", overlap);
+        s_link_state.ap_bandwidth = bandwidth;
+    }
+}
+
+esp_err_t esp_gateway_wifi_link_start(void)
+{
+    wifi_mode_t mode = WIFI_MODE_NULL;
+
+    ESP_ERROR_RETURN(s_link_timer, ESP_ERR_INVALID_STATE, "link adaptation already started");
+
+    esp_err_t ret = esp_wifi_get_mode(&mode);
+    ESP_ERROR_RETURN(ret != ESP_OK, ret, "Wi-Fi is not initialized");
+
+    if (mode & WIFI_MODE_STA) {
+        esp_wifi_set_protocol(WIFI_IF_STA, WIFI_PROTOCOL_11B | WIFI_PROTOCOL_11G | WIFI_PROTOCOL_11N);
+    }
+
+    if (mode & WIFI_MODE_AP) {
+        esp_wifi_set_protocol(WIFI_IF_AP, WIFI_PROTOCOL_11B | WIFI_PROTOCOL_11G | WIFI_PROTOCOL_11N);
+        esp_wifi_get_bandwidth(WIFI_IF_AP, &s_link_state.ap_bandwidth);
+    }
+
+    esp_wifi_get_ps(&s_link_state.ps_type);
+    esp_wifi_get_max_tx_power(&s_link_state.tx_power);
+    link_frames_read();
+    s_link_state.queue_occupancy = link_queue_read();
+    s_link_idle_periods = 0;
+    s_link_ps_failed    = false;
+
+    esp_timer_create_args_t timer_args = {
+        .callback = link_timer_cb,
+        .name     = "wifi_link",
+    };
+
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &s_link_timer));
+    ESP_ERROR_CHECK(esp_gateway_wifi_scan_init());
+    ESP_ERROR_CHECK(esp_gateway_wifi_scan_subscribe(link_scan_cb, NULL));
+    ESP_ERROR_CHECK(esp_timer_start_periodic(s_link_timer, ESP_GATEWAY_WIFI_LINK_PERIOD_MS * 1000ULL));
+
+    /**< Use the scan done during start-up, if any, without waiting for the next one */
+    uint16_t number = ESP_GATEWAY_WIFI_SCAN_CACHE_SIZE;
+    wifi_ap_record_t *records = malloc(number * sizeof(wifi_ap_record_t));
+
+    if (records && esp_gateway_wifi_scan_get_records(records, &number, NULL) == ESP_OK) {
+        link_scan_cb(records, number, NULL);
+    }
+
+    free(records);
+
+    return ESP_OK;
+}
+
+esp_err_t esp_gateway_wifi_link_stop(void)
+{
+    ESP_ERROR_RETURN(!s_link_timer, ESP_ERR_INVALID_STATE, "link adaptation not started");
+
+    esp_timer_stop(s_link_timer);
+    esp_timer_delete(s_link_timer);
+    s_link_timer = NULL;
+    esp_gateway_wifi_scan_unsubscribe(link_scan_cb, NULL);
+
+    return ESP_OK;
+}
+
+esp_err_t esp_gateway_wifi_link_get_state(esp_gateway_wifi_link_state_t *state)
+{
+    ESP_PARAM_CHECK(state);
+
+    *state = s_link_state;
+
+    return ESP_OK;
+}
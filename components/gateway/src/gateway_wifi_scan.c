@@ -0,0 +1,358 @@
+// Copyright 2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+#include <stdlib.h>
+#include <sys/param.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+
+#include "esp_log.h"
+#include "esp_event.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+
+#include "esp_utils.h"
+#include "esp_gateway_wifi_scan.h"
+
+#define GATEWAY_WIFI_SCAN_DONE_BIT  BIT0
+
+typedef struct {
+    esp_gateway_wifi_scan_cb_t cb;
+    void *arg;
+} scan_subscriber_t;
+
+static const char *TAG = "gateway_scan";
+
+static SemaphoreHandle_t s_scan_lock = NULL;
+static EventGroupHandle_t s_scan_event_group = NULL;
+static portMUX_TYPE s_scan_spinlock = portMUX_INITIALIZER_UNLOCKED;
+static bool s_scan_running = false;
+static uint8_t s_scan_channel = 0;          /**< Channel of the running scan, 0 for all channels */
+static bool s_scan_full_pending = false;    /**< All channels were requested during a channel scan */
+static esp_gateway_wifi_scan_cb_t s_scan_channel_cb = NULL;
+static void *s_scan_channel_arg = NULL;
+
+static wifi_ap_record_t *s_scan_cache = NULL;
+static uint16_t s_scan_cache_num = 0;
+static int64_t s_scan_cache_time = -1;      /**< esp_timer time of the last successful scan, -1 if none */
+static scan_subscriber_t s_scan_subscriber[ESP_GATEWAY_WIFI_SCAN_SUBSCRIBER_MAX] = {0};
+
+static int scan_record_rssi_cmp(const void *a, const void *b)
+{
+    return ((const wifi_ap_record_t *)b)->rssi - ((const wifi_ap_record_t *)a)->rssi;
+}
+
+static void scan_done_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+    wifi_event_sta_scan_done_t *event = (wifi_event_sta_scan_done_t *)event_data;
+    bool success = event->status == 0;
+    uint16_t number = 0;
+    wifi_ap_record_t *records = NULL;
+    wifi_ap_record_t spare;
+
+    portENTER_CRITICAL(&s_scan_spinlock);
+    uint8_t channel = s_scan_channel;
+    esp_gateway_wifi_scan_cb_t channel_cb = s_scan_channel_cb;
+    void *channel_arg = s_scan_channel_arg;
+    s_scan_channel_cb = NULL;
+    portEXIT_CRITICAL(&s_scan_spinlock);
+
+    xSemaphoreTake(s_scan_lock, portMAX_DELAY);
+
+    /**< Read every record into a separate buffer, the strongest ones are kept and a failed scan leaves the cache alone */
+    if (esp_wifi_scan_get_ap_num(&number) == ESP_OK && number > 0) {
+        records = malloc(number * sizeof(wifi_ap_record_t));
+
+        if (!records && success) {
+            ESP_LOGW(TAG, "records malloc fail, drop the %d APs found", number);
+            success = false;
+        }
+    }
+
+    if (!records) {
+        records = &spare;
+        number  = MIN(number, 1);
+    }
+
+    /**< Always fetch the records, this also frees the driver's copy of the list */
+    if (esp_wifi_scan_get_ap_records(&number, records) != ESP_OK) {
+        number = 0;
+    }
+
+    if (success) {
+        qsort(records, number, sizeof(wifi_ap_record_t), scan_record_rssi_cmp);
+    }
+
+    if (success && !channel) {
+        number = MIN(number, ESP_GATEWAY_WIFI_SCAN_CACHE_SIZE);
+        memcpy(s_scan_cache, records, number * sizeof(wifi_ap_record_t));
+
+        s_scan_cache_num  = number;
+        s_scan_cache_time = esp_timer_get_time();
+        ESP_LOGD(TAG, "scan done, %d APs found, %d cached", event->number, number);
+    } else if (success) {
+        ESP_LOGD(TAG, "channel %d scan done, %d APs found", channel, number);
+    } else {
+        ESP_LOGW(TAG, "scan failed, keep the previous %d records", s_scan_cache_num);
+    }
+
+    portENTER_CRITICAL(&s_scan_spinlock);
+    bool full_pending   = channel && s_scan_full_pending;
+    s_scan_full_pending = false;
+    s_scan_channel      = 0;
+    s_scan_running      = full_pending;
+    portEXIT_CRITICAL(&s_scan_spinlock);
+
+    /**< Scans of all channels asked for during a channel scan were merged into it, run them now */
+    if (full_pending && esp_wifi_scan_start(NULL, false) != ESP_OK) {
+        ESP_LOGW(TAG, "pending scan start fail");
+        portENTER_CRITICAL(&s_scan_spinlock);
+        s_scan_running = false;
+        portEXIT_CRITICAL(&s_scan_spinlock);
+        full_pending = false;
+        xEventGroupSetBits(s_scan_event_group, GATEWAY_WIFI_SCAN_DONE_BIT);
+    }
+
+    if (!channel) {
+        xEventGroupSetBits(s_scan_event_group, GATEWAY_WIFI_SCAN_DONE_BIT);
+
+        /**< Subscribers are told about failed scans too, they then see the previous results */
+        for (int i = 0; i < ESP_GATEWAY_WIFI_SCAN_SUBSCRIBER_MAX; i++) {
+            if (s_scan_subscriber[i].cb) {
+                s_scan_subscriber[i].cb(s_scan_cache, s_scan_cache_num, s_scan_subscriber[i].arg);
+            }
+        }
+    }
+
+    if (channel_cb && !channel) {
+        channel_cb(s_scan_cache, s_scan_cache_num, channel_arg);
+    } else if (channel_cb) {
+        channel_cb(success ? records : NULL, success ? number : 0, channel_arg);
+    }
+
+    if (records != &spare) {
+        free(records);
+    }
+
+    xSemaphoreGive(s_scan_lock);
+}
+
+esp_err_t esp_gateway_wifi_scan_init(void)
+{
+    if (s_scan_lock) {
+        return ESP_OK;
+    }
+
+    s_scan_cache = calloc(ESP_GATEWAY_WIFI_SCAN_CACHE_SIZE, sizeof(wifi_ap_record_t));
+    ESP_ERROR_RETURN(!s_scan_cache, ESP_ERR_NO_MEM, "scan cache calloc fail");
+
+    s_scan_lock = xSemaphoreCreateMutex();
+    s_scan_event_group = xEventGroupCreate();
+    ESP_ERROR_RETURN(!s_scan_lock || !s_scan_event_group, ESP_ERR_NO_MEM, "scan lock create fail");
+
+    return esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_SCAN_DONE, &scan_done_handler, NULL);
+}
+
+esp_err_t esp_gateway_wifi_scan_request(void)
+{
+    ESP_ERROR_RETURN(!s_scan_lock, ESP_ERR_INVALID_STATE, "scan service is not initialized");
+
+    bool running = false;
+    esp_err_t ret = ESP_OK;
+
+    portENTER_CRITICAL(&s_scan_spinlock);
+    running = s_scan_running;
+    s_scan_running = true;
+    bool pending = running && s_scan_channel;
+    s_scan_full_pending |= pending;
+    portEXIT_CRITICAL(&s_scan_spinlock);
+
+    /**< Waiters of the pending scan must not see the bit of an earlier one */
+    if (pending) {
+        xEventGroupClearBits(s_scan_event_group, GATEWAY_WIFI_SCAN_DONE_BIT);
+    }
+
+    if (running) {
+        return ESP_OK;
+    }
+
+    xEventGroupClearBits(s_scan_event_group, GATEWAY_WIFI_SCAN_DONE_BIT);
+
+    ret = esp_wifi_scan_start(NULL, false);
+
+    if (ret != ESP_OK) {
+        portENTER_CRITICAL(&s_scan_spinlock);
+        s_scan_running = false;
+        portEXIT_CRITICAL(&s_scan_spinlock);
+        ESP_LOGW(TAG, "scan start fail, ret: %s", esp_err_to_name(ret));
+    }
+
+    return ret;
+}
+
+esp_err_t esp_gateway_wifi_scan_request_channel(uint8_t channel, uint16_t dwell_ms,
+        esp_gateway_wifi_scan_cb_t cb, void *arg)
+{
+    ESP_PARAM_CHECK(channel);
+    ESP_PARAM_CHECK(cb);
+    ESP_ERROR_RETURN(!s_scan_lock, ESP_ERR_INVALID_STATE, "scan service is not initialized");
+
+    bool running = false;
+    esp_err_t ret = ESP_OK;
+
+    portENTER_CRITICAL(&s_scan_spinlock);
+
+    if (s_scan_channel_cb) {
+        portEXIT_CRITICAL(&s_scan_spinlock);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    running = s_scan_running;
+    s_scan_channel_cb  = cb;
+    s_scan_channel_arg = arg;
+
+    if (!running) {
+        s_scan_running = true;
+        s_scan_channel = channel;
+    }
+
+    portEXIT_CRITICAL(&s_scan_spinlock);
+
+    /**< A scan of all channels is running, it covers this one too */
+    if (running) {
+        return ESP_OK;
+    }
+
+    wifi_scan_config_t scan_config = {
+        .channel   = channel,
+        .scan_type = WIFI_SCAN_TYPE_ACTIVE,
+        .scan_time.active = {
+            .min = dwell_ms,
+            .max = dwell_ms,
+        },
+    };
+
+    ret = esp_wifi_scan_start(&scan_config, false);
+
+    if (ret != ESP_OK) {
+        portENTER_CRITICAL(&s_scan_spinlock);
+        s_scan_running    = false;
+        s_scan_channel    = 0;
+        s_scan_channel_cb = NULL;
+        portEXIT_CRITICAL(&s_scan_spinlock);
+        ESP_LOGW(TAG, "channel %d scan start fail, ret: %s", channel, esp_err_to_name(ret));
+    }
+
+    return ret;
+}
+
+static bool scan_cache_is_fresh(uint32_t max_age_ms)
+{
+    return s_scan_cache_time >= 0
+           && (esp_timer_get_time() - s_scan_cache_time) <= (int64_t)max_age_ms * 1000;
+}
+
+esp_err_t esp_gateway_wifi_scan_wait(uint32_t max_age_ms, uint32_t wait_ms)
+{
+    ESP_ERROR_RETURN(!s_scan_lock, ESP_ERR_INVALID_STATE, "scan service is not initialized");
+
+    if (scan_cache_is_fresh(max_age_ms)) {
+        return ESP_OK;
+    }
+
+    esp_err_t ret = esp_gateway_wifi_scan_request();
+    ESP_ERROR_RETURN(ret != ESP_OK, ret, "");
+
+    EventBits_t bits = xEventGroupWaitBits(s_scan_event_group, GATEWAY_WIFI_SCAN_DONE_BIT,
+                                           pdFALSE, pdTRUE, pdMS_TO_TICKS(wait_ms));
+    ESP_ERROR_RETURN(!(bits & GATEWAY_WIFI_SCAN_DONE_BIT), ESP_ERR_TIMEOUT, "scan wait timeout");
+
+    /**< The scan itself may have failed, in which case the cache is still stale */
+    return scan_cache_is_fresh(max_age_ms + wait_ms) ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_gateway_wifi_scan_get_records(wifi_ap_record_t *records, uint16_t *number, uint32_t *age_ms)
+{
+    ESP_PARAM_CHECK(records);
+    ESP_PARAM_CHECK(number);
+    ESP_ERROR_RETURN(!s_scan_lock, ESP_ERR_INVALID_STATE, "scan service is not initialized");
+
+    xSemaphoreTake(s_scan_lock, portMAX_DELAY);
+
+    if (s_scan_cache_time < 0) {
+        xSemaphoreGive(s_scan_lock);
+        *number = 0;
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    *number = MIN(*number, s_scan_cache_num);
+    memcpy(records, s_scan_cache, *number * sizeof(wifi_ap_record_t));
+
+    if (age_ms) {
+        *age_ms = (esp_timer_get_time() - s_scan_cache_time) / 1000;
+    }
+
+    xSemaphoreGive(s_scan_lock);
+
+    return ESP_OK;
+}
+
+esp_err_t esp_gateway_wifi_scan_subscribe(esp_gateway_wifi_scan_cb_t cb, void *arg)
+{
+    ESP_PARAM_CHECK(cb);
+    ESP_ERROR_RETURN(!s_scan_lock, ESP_ERR_INVALID_STATE, "scan service is not initialized");
+
+    esp_err_t ret = ESP_ERR_NO_MEM;
+
+    xSemaphoreTake(s_scan_lock, portMAX_DELAY);
+
+    for (int i = 0; i < ESP_GATEWAY_WIFI_SCAN_SUBSCRIBER_MAX; i++) {
+        if (!s_scan_subscriber[i].cb) {
+            s_scan_subscriber[i].cb  = cb;
+            s_scan_subscriber[i].arg = arg;
+            ret = ESP_OK;
+            break;
+        }
+    }
+
+    xSemaphoreGive(s_scan_lock);
+
+    return ret;
+}
+
+esp_err_t esp_gateway_wifi_scan_unsubscribe(esp_gateway_wifi_scan_cb_t cb, void *arg)
+{
+    ESP_PARAM_CHECK(cb);
+    ESP_ERROR_RETURN(!s_scan_lock, ESP_ERR_INVALID_STATE, "scan service is not initialized");
+
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+
+    xSemaphoreTake(s_scan_lock, portMAX_DELAY);
+
+    for (int i = 0; i < ESP_GATEWAY_WIFI_SCAN_SUBSCRIBER_MAX; i++) {
+        if (s_scan_subscriber[i].cb == cb && s_scan_subscriber[i].arg == arg) {
+            s_scan_subscriber[i].cb  = NULL;
+            s_scan_subscriber[i].arg = NULL;
+            ret = ESP_OK;
+            break;
+        }
+    }
+
+    xSemaphoreGive(s_scan_lock);
+
+    return ret;
+}
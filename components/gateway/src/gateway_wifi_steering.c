@@ -0,0 +1,286 @@
+// Copyright 2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+
+#include "esp_utils.h"
+#include "esp_gateway_config.h"
+#include "esp_gateway_vendor_ie.h"
+#include "esp_gateway_wifi_steering.h"
+
+#if SET_VENDOR_IE
+
+static const char *TAG = "gateway_steering";
+
+typedef struct {
+    uint8_t mac[MAC_LEN];
+    bool valid;
+    bool seen;                  /**< Listed by the current check */
+    uint8_t weak_checks;
+    int16_t rssi_x4;            /**< Smoothed RSSI, 1/4 dBm */
+    TickType_t joined;
+} steering_sta_t;
+
+typedef struct {
+    uint8_t mac[MAC_LEN];
+    uint8_t rejects;
+    TickType_t expire;          /**< 0 if the entry is free */
+} steering_blacklist_t;
+
+static steering_sta_t s_steering_sta[ESP_WIFI_MAX_CONN_NUM];
+static steering_blacklist_t s_steering_blacklist[ESP_GATEWAY_STEERING_BLACKLIST_MAX];
+static portMUX_TYPE s_steering_lock = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t s_steering_timer = NULL;
+static esp_gateway_wifi_steering_stats_t s_steering_stats = {0};
+
+static steering_sta_t *steering_sta_get(const uint8_t *mac)
+{
+    steering_sta_t *free_entry = NULL;
+
+    for (int i = 0; i < ESP_WIFI_MAX_CONN_NUM; i++) {
+        if (!s_steering_sta[i].valid) {
+            if (!free_entry) {
+                free_entry = s_steering_sta + i;
+            }
+        } else if (!memcmp(s_steering_sta[i].mac, mac, MAC_LEN)) {
+            return s_steering_sta + i;
+        }
+    }
+
+    if (free_entry) {
+        memset(free_entry, 0, sizeof(steering_sta_t));
+        memcpy(free_entry->mac, mac, MAC_LEN);
+        free_entry->valid  = true;
+        free_entry->joined = xTaskGetTickCount();
+    }
+
+    return free_entry;
+}
+
+static void steering_blacklist_add(const uint8_t *mac)
+{
+    TickType_t now = xTaskGetTickCount();
+    steering_blacklist_t *victim = s_steering_blacklist;
+
+    portENTER_CRITICAL(&s_steering_lock);
+
+    for (int i = 0; i < ESP_GATEWAY_STEERING_BLACKLIST_MAX; i++) {
+        steering_blacklist_t *entry = s_steering_blacklist + i;
+
+        if (!entry->expire || (int32_t)(entry->expire - now) <= 0 || !memcmp(entry->mac, mac, MAC_LEN)) {
+            victim = entry;
+            break;
+        }
+
+        if ((int32_t)(entry->expire - victim->expire) < 0) {
+            victim = entry;
+        }
+    }
+
+    memcpy(victim->mac, mac, MAC_LEN);
+    victim->rejects = 0;
+    victim->expire  = (now + pdMS_TO_TICKS(ESP_GATEWAY_STEERING_BLACKLIST_MS)) | 1;
+
+    portEXIT_CRITICAL(&s_steering_lock);
+}
+
+/**
+ * @brief Decide whether a rejoining station is refused, it is let back in once
+ *        the window expired or it came back ESP_GATEWAY_STEERING_REJECT_MAX times
+ */
+static bool steering_blacklist_reject(const uint8_t *mac)
+{
+    bool reject = false;
+    TickType_t now = xTaskGetTickCount();
+
+    portENTER_CRITICAL(&s_steering_lock);
+
+    for (int i = 0; i < ESP_GATEWAY_STEERING_BLACKLIST_MAX; i++) {
+        steering_blacklist_t *entry = s_steering_blacklist + i;
+
+        if (!entry->expire || memcmp(entry->mac, mac, MAC_LEN)) {
+            continue;
+        }
+
+        if ((int32_t)(entry->expire - now) > 0 && entry->rejects < ESP_GATEWAY_STEERING_REJECT_MAX) {
+            entry->rejects++;
+            s_steering_stats.rejected++;
+            reject = true;
+        } else {
+            if (entry->rejects >= ESP_GATEWAY_STEERING_REJECT_MAX) {
+                s_steering_stats.readmitted++;
+            }
+
+            entry->expire = 0;
+        }
+
+        break;
+    }
+
+    portEXIT_CRITICAL(&s_steering_lock);
+
+    return reject;
+}
+
+static void steering_deauth(const uint8_t *mac)
+{
+    uint16_t aid = 0;
+
+    steering_blacklist_add(mac);
+
+    if (esp_wifi_ap_get_sta_aid(mac, &aid) == ESP_OK) {
+        esp_wifi_deauth_sta(aid);
+    }
+}
+
+static void steering_timer_cb(void *arg)
+{
+    wifi_sta_list_t sta_list;
+    uint8_t neighbor_station_num = 0;
+    steering_sta_t *weakest = NULL;
+    steering_sta_t *steer = NULL;
+    TickType_t now = xTaskGetTickCount();
+
+    if (esp_wifi_ap_get_sta_list(&sta_list) != ESP_OK) {
+        return;
+    }
+
+    for (int i = 0; i < ESP_WIFI_MAX_CONN_NUM; i++) {
+        s_steering_sta[i].seen = false;
+    }
+
+    for (int i = 0; i < sta_list.num; i++) {
+        steering_sta_t *sta = steering_sta_get(sta_list.sta[i].mac);
+
+        if (!sta) {
+            continue;
+        }
+
+        if (sta->rssi_x4 == 0) {
+            sta->rssi_x4 = sta_list.sta[i].rssi * 4;
+        } else {
+            sta->rssi_x4 += (sta_list.sta[i].rssi * 4 - sta->rssi_x4) / 4;
+        }
+
+        sta->seen = true;
+        /**< Saturate, a wrap back to 0 would restart the detection of a client that is still weak */
+        if (sta->rssi_x4 / 4 >= ESP_GATEWAY_STEERING_RSSI_MIN) {
+            sta->weak_checks = 0;
+        } else if (sta->weak_checks < UINT8_MAX) {
+            sta->weak_checks++;
+        }
+
+        if (now - sta->joined < pdMS_TO_TICKS(ESP_GATEWAY_STEERING_HOLD_MS)) {
+            continue;
+        }
+
+        if (!weakest || sta->rssi_x4 < weakest->rssi_x4) {
+            weakest = sta;
+        }
+
+        if (sta->weak_checks >= ESP_GATEWAY_STEERING_WEAK_CHECKS && (!steer || sta->rssi_x4 < steer->rssi_x4)) {
+            steer = sta;
+        }
+    }
+
+    for (int i = 0; i < ESP_WIFI_MAX_CONN_NUM; i++) {
+        if (!s_steering_sta[i].seen) {
+            s_steering_sta[i].valid = false;
+        }
+    }
+
+    if (!weakest || !esp_gateway_vendor_ie_neighbor_available(&neighbor_station_num)) {
+        return;
+    }
+
+    /**< One station per check, so the neighbors' beacons catch up with the move */
+    if (steer) {
+        ESP_LOGI(TAG, "steer weak station "MACSTR", rssi: %d", MAC2STR(steer->mac), steer->rssi_x4 / 4);
+        s_steering_stats.weak_steered++;
+    } else if (sta_list.num >= ESP_GATEWAY_WIFI_ROUTER_MAX_STA_CONN - 1
+               && neighbor_station_num + ESP_GATEWAY_STEERING_LOAD_MARGIN < sta_list.num) {
+        steer = weakest;
+        ESP_LOGI(TAG, "steer station "MACSTR" off a crowded AP, stations: %d, neighbor: %d",
+                 MAC2STR(steer->mac), sta_list.num, neighbor_station_num);
+        s_steering_stats.load_steered++;
+    } else {
+        return;
+    }
+
+    steering_deauth(steer->mac);
+    steer->valid = false;
+}
+
+static void steering_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+    wifi_event_ap_staconnected_t *event = (wifi_event_ap_staconnected_t *)event_data;
+
+    if (steering_blacklist_reject(event->mac)) {
+        ESP_LOGD(TAG, "refuse steered station "MACSTR"", MAC2STR(event->mac));
+        esp_wifi_deauth_sta(event->aid);
+    }
+}
+
+esp_err_t esp_gateway_wifi_steering_start(void)
+{
+    ESP_ERROR_RETURN(s_steering_timer, ESP_ERR_INVALID_STATE, "steering already started");
+
+    esp_timer_create_args_t timer_args = {
+        .callback = steering_timer_cb,
+        .name     = "wifi_steering",
+    };
+
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &s_steering_timer));
+    ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_AP_STACONNECTED, steering_event_handler, NULL));
+    ESP_ERROR_CHECK(esp_timer_start_periodic(s_steering_timer, ESP_GATEWAY_STEERING_PERIOD_MS * 1000ULL));
+
+    return ESP_OK;
+}
+
+esp_err_t esp_gateway_wifi_steering_stop(void)
+{
+    ESP_ERROR_RETURN(!s_steering_timer, ESP_ERR_INVALID_STATE, "steering not started");
+
+    esp_timer_stop(s_steering_timer);
+    esp_timer_delete(s_steering_timer);
+    s_steering_timer = NULL;
+    esp_event_handler_unregister(WIFI_EVENT, WIFI_EVENT_AP_STACONNECTED, steering_event_handler);
+
+    portENTER_CRITICAL(&s_steering_lock);
+    memset(s_steering_blacklist, 0, sizeof(s_steering_blacklist));
+    portEXIT_CRITICAL(&s_steering_lock);
+    memset(s_steering_sta, 0, sizeof(s_steering_sta));
+
+    return ESP_OK;
+}
+
+esp_err_t esp_gateway_wifi_steering_get_stats(esp_gateway_wifi_steering_stats_t *stats)
+{
+    ESP_PARAM_CHECK(stats);
+
+    portENTER_CRITICAL(&s_steering_lock);
+    *stats = s_steering_stats;
+    portEXIT_CRITICAL(&s_steering_lock);
+
+    return ESP_OK;
+}
+
+#endif // SET_VENDOR_IE
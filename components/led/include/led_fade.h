@@ -0,0 +1,177 @@
+// Copyright 2017-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef __LED_FADE_H__
+#define __LED_FADE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "driver/ledc.h"
+
+#define HW_TIMER_GROUP (0)                                 /**< Hardware timer group */
+#define HW_TIMER_ID (0)                                    /**< Hardware timer number */
+#define HW_TIMER_DIVIDER (16)                              /**< Hardware timer clock divider */
+#define HW_TIMER_SCALE (TIMER_BASE_CLK / HW_TIMER_DIVIDER) /**< Convert counter value to seconds */
+#define GAMMA_CORRECTION 0.8                               /**< Gamma curve parameter, the built-in table is generated for it */
+#define GAMMA_TABLE_SIZE 256                               /**< Gamma table size, used for led fade*/
+#define DUTY_SET_CYCLE (20)                                /**< Set duty cycle */
+
+/**
+ * @brief A multi-channel keyframe
+ *
+ * Every selected channel reaches its value after the same number of duty
+ * cycles, so the channels of one colour move in phase.
+ */
+typedef struct {
+    uint32_t channel_mask;           /**< Bit n selects LEDC channel n */
+    uint8_t value[LEDC_CHANNEL_MAX]; /**< Target brightness of each selected channel, (0 .. 255) */
+    uint32_t fade_ms;                /**< The time from the current values to the target values */
+} led_fade_keyframe_t;
+
+/**
+  * @brief Initialize the ledc timer and the hardware timer that drives all the fades
+  *
+  * @param timer_num The timer index of ledc timer group
+  *     This parameter can be one of LEDC_TIMER_x where x can be (0 .. 3)
+  *
+  * @param speed_mode speed mode of ledc timer
+  *     This parameter can be one of LEDC_x_SPEED_MODE where x can be (LOW, HIGH)
+  *
+  * @param freq_hz frequency of ledc timer
+  *     This parameter must be less than 5000
+  *
+  * @return
+  *     - ESP_OK if sucess
+  *     - ESP_ERR_INVALID_ARG Parameter error
+  *     - ESP_ERR_INVALID_STATE The fade engine has been initialized
+  *     - ESP_FAIL Can not find a proper pre-divider number base on the given frequency
+  *         and the current duty_resolution.
+*/
+esp_err_t led_fade_init(ledc_timer_t timer_num, ledc_mode_t speed_mode, uint32_t freq_hz);
+
+/**
+  * @brief Stop the hardware timer and free the fade engine
+  *
+  * @return
+  *     - ESP_OK if sucess
+*/
+esp_err_t led_fade_deinit(void);
+
+/**
+  * @brief Associate a ledc channel with the output gpio
+  *
+  * @param channel The ledc channel
+  * @param gpio_num the ledc output gpio_num
+  *
+  * @return
+  *     - ESP_OK if sucess
+  *     - ESP_ERR_INVALID_ARG Parameter error
+  *     - ESP_ERR_INVALID_STATE led_fade_init() is not called yet
+*/
+esp_err_t led_fade_regist_channel(ledc_channel_t channel, gpio_num_t gpio_num);
+
+/**
+  * @brief Returns the current value of the channel, including a fade in progress
+  *
+  * @param channel The ledc channel
+  * @param dst The address where the channel value is stored
+  *
+  * @return
+  *     - ESP_OK if sucess
+  *     - ESP_ERR_INVALID_ARG Parameter error
+  *     - ESP_ERR_INVALID_STATE led_fade_init() is not called yet
+*/
+esp_err_t led_fade_get_channel(ledc_channel_t channel, uint8_t *dst);
+
+/**
+  * @brief Fade one channel to the value, a keyframe selecting only this channel
+  *
+  * @param channel The ledc channel
+  * @param value The target brightness, (0 .. 255)
+  * @param fade_ms The time from the current value to the target value
+  *
+  * @return
+  *     - ESP_OK if sucess
+  *     - ESP_ERR_INVALID_ARG Parameter error
+  *     - ESP_ERR_INVALID_STATE led_fade_init() is not called yet
+*/
+esp_err_t led_fade_set_channel(ledc_channel_t channel, uint8_t value, uint32_t fade_ms);
+
+/**
+  * @brief Schedule a keyframe, the selected channels start and end their fades
+  *     in the same duty cycle. Blinks on the selected channels are stopped.
+  *
+  * @param keyframe The keyframe, copied before return
+  *
+  * @return
+  *     - ESP_OK if sucess
+  *     - ESP_ERR_INVALID_ARG Parameter error
+  *     - ESP_ERR_INVALID_STATE led_fade_init() is not called yet
+*/
+esp_err_t led_fade_set_keyframe(const led_fade_keyframe_t *keyframe);
+
+/**
+  * @brief Set the blink state or loop fade for the specified channel
+  *
+  * @param channel The ledc channel
+  * @param value The output brightness, (0 .. 255)
+  * @param period_ms Blink cycle
+  * @param fade_flag select loop fade or blink
+  *     1 for loop fade
+  *     0 for blink
+  *
+  * @return
+  *     - ESP_OK if sucess
+  *     - ESP_ERR_INVALID_ARG Parameter error
+  *     - ESP_ERR_INVALID_STATE led_fade_init() is not called yet
+*/
+esp_err_t led_fade_start_blink(ledc_channel_t channel, uint8_t value, uint32_t period_ms, bool fade_flag);
+
+/**
+  * @brief Stop the blink state or loop fade for the specified channel
+  *
+  * @param channel The ledc channel
+  *
+  * @return
+  *     - ESP_OK if sucess
+  *     - ESP_ERR_INVALID_ARG Parameter error
+  *     - ESP_ERR_INVALID_STATE led_fade_init() is not called yet
+*/
+esp_err_t led_fade_stop_blink(ledc_channel_t channel);
+
+/**
+  * @brief Set the specified gamma_table to control the fade effect, usually
+  *     no need to set
+  *
+  * @param gamma_table[GAMMA_TABLE_SIZE] Expected gamma table value
+  *
+  * @note  The element type is uint16_t. Each element is treated as a binary
+  *     fixed-point number. The decimal point is before the eighth bit
+  *     and after the ninth bit, so the range of expressions can be
+  *     0x00.00 ~ 0xff.ff.
+  * @note The built-in table is used until this is called
+  *
+  * @return
+  *     - ESP_OK if sucess
+  *     - ESP_ERR_INVALID_STATE led_fade_init() is not called yet
+*/
+esp_err_t led_fade_set_gamma_table(const uint16_t gamma_table[GAMMA_TABLE_SIZE]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /**< __LED_FADE_H__ */
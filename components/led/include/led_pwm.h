@@ -20,14 +20,7 @@ extern "C" {
 #endif
 
 #include "driver/ledc.h"
-
-#define HW_TIMER_GROUP (0)                                 /**< Hardware timer group */
-#define HW_TIMER_ID (0)                                    /**< Hardware timer number */
-#define HW_TIMER_DIVIDER (16)                              /**< Hardware timer clock divider */
-#define HW_TIMER_SCALE (TIMER_BASE_CLK / HW_TIMER_DIVIDER) /**< Convert counter value to seconds */
-#define GAMMA_CORRECTION 0.8                               /**< Gamma curve parameter */
-#define GAMMA_TABLE_SIZE 256                               /**< Gamma table size, used for led fade*/
-#define DUTY_SET_CYCLE (20)                                /**< Set duty cycle */
+#include "led_fade.h"
 
 /**
   * @brief Initialize and set the ledc timer for the iot led
@@ -107,6 +100,19 @@ esp_err_t led_pwm_get_channel(ledc_channel_t channel, uint8_t *dst);
 */
 esp_err_t led_pwm_set_channel(ledc_channel_t channel, uint8_t value, uint32_t fade_ms);
 
+/**
+  * @brief Fade several channels to a keyframe, they start and end together
+  * @note before calling this function, you need to call led_pwm_regist_channel() to
+  *     set the channels
+  *
+  * @param keyframe The channel mask, the target values and the fade time
+  * @return
+  *	    - ESP_OK if sucess
+  *	    - ESP_ERR_INVALID_ARG Parameter error
+  *	    - ESP_ERR_INVALID_STATE if lot_led_init() is not called yet
+*/
+esp_err_t led_pwm_set_keyframe(const led_fade_keyframe_t *keyframe);
+
 /**
   * @brief Set the blink state or loop fade for the specified channel
   * @note before calling this function, you need to call led_pwm_regist_channel() to
@@ -0,0 +1,517 @@
+// Copyright 2017-2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_attr.h"
+
+#include "soc/soc_caps.h"
+#include "soc/ledc_reg.h"
+#include "soc/ledc_struct.h"
+#include "driver/timer.h"
+#include "driver/ledc.h"
+#include "led_fade.h"
+
+#define LEDC_FADE_MARGIN (10)
+#define LEDC_VALUE_TO_DUTY(value) (value * ((1 << LEDC_TIMER_13_BIT) - 1) / UINT16_MAX)
+#define LEDC_FIXED_Q (8)
+#define FLOATINT_2_FIXED(X, Q) ((int)((X)*(0x1U << Q)))
+#define FIXED_2_FLOATING(X, Q) ((int)((X)/(0x1U << Q)))
+#define GET_FIXED_INTEGER_PART(X, Q) (X >> Q)
+#define GET_FIXED_DECIMAL_PART(X, Q) (X & ((0x1U << Q) - 1))
+
+#if SOC_LEDC_SUPPORT_HS_MODE
+#define LEDC_FADE_DUTY_INC_V   LEDC_DUTY_INC_HSCH0_V
+#define LEDC_FADE_DUTY_INC_S   LEDC_DUTY_INC_HSCH0_S
+#define LEDC_FADE_DUTY_NUM_V   LEDC_DUTY_NUM_HSCH0_V
+#define LEDC_FADE_DUTY_NUM_S   LEDC_DUTY_NUM_HSCH0_S
+#define LEDC_FADE_DUTY_CYCLE_V LEDC_DUTY_CYCLE_HSCH0_V
+#define LEDC_FADE_DUTY_CYCLE_S LEDC_DUTY_CYCLE_HSCH0_S
+#define LEDC_FADE_DUTY_SCALE_V LEDC_DUTY_SCALE_HSCH0_V
+#define LEDC_FADE_DUTY_SCALE_S LEDC_DUTY_SCALE_HSCH0_S
+#else
+#define LEDC_FADE_DUTY_INC_V   LEDC_DUTY_INC_LSCH0_V
+#define LEDC_FADE_DUTY_INC_S   LEDC_DUTY_INC_LSCH0_S
+#define LEDC_FADE_DUTY_NUM_V   LEDC_DUTY_NUM_LSCH0_V
+#define LEDC_FADE_DUTY_NUM_S   LEDC_DUTY_NUM_LSCH0_S
+#define LEDC_FADE_DUTY_CYCLE_V LEDC_DUTY_CYCLE_LSCH0_V
+#define LEDC_FADE_DUTY_CYCLE_S LEDC_DUTY_CYCLE_LSCH0_S
+#define LEDC_FADE_DUTY_SCALE_V LEDC_DUTY_SCALE_LSCH0_V
+#define LEDC_FADE_DUTY_SCALE_S LEDC_DUTY_SCALE_LSCH0_S
+#endif /**< SOC_LEDC_SUPPORT_HS_MODE */
+
+typedef struct {
+    int cur;       /**< Current value, Q8 */
+    int final;     /**< Keyframe value, or the blink value, Q8 */
+    int step;      /**< Value added every duty cycle, Q8, computed when the keyframe is set */
+    int cycle;     /**< Duty cycles of a half blink period, 0 if not blinking */
+    size_t num;    /**< Duty cycles left to the keyframe value */
+    uint32_t duty; /**< Duty the channel settles at in the current duty cycle */
+} led_fade_data_t;
+
+typedef struct {
+    led_fade_data_t fade_data[LEDC_CHANNEL_MAX];
+    ledc_mode_t speed_mode;
+    ledc_timer_t timer_num;
+    uint32_t fade_cycles; /**< PWM periods the hardware fade takes within one duty cycle */
+} led_fade_t;
+
+static const char *TAG = "led_fade";
+static DRAM_ATTR led_fade_t *g_fade_config = NULL;
+static DRAM_ATTR uint16_t g_duty_table[GAMMA_TABLE_SIZE + 1] = {0};
+static DRAM_ATTR bool g_hw_timer_started = false;
+static portMUX_TYPE g_fade_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief gamma curve formula: y=a*x^(1/gm), gm = GAMMA_CORRECTION
+ * x ∈ (0,(GAMMA_TABLE_SIZE-1)/GAMMA_TABLE_SIZE)
+ * a = GAMMA_TABLE_SIZE
+ *
+ * Generated offline so that initialization needs no floating point
+ */
+static const uint16_t g_gamma_table_default[GAMMA_TABLE_SIZE] = {
+        0,    64,   152,   252,   362,   478,   600,   728,   861,   997,
+     1138,  1282,  1429,  1579,  1733,  1889,  2048,  2209,  2372,  2538,
+     2706,  2877,  3049,  3223,  3399,  3577,  3757,  3938,  4122,  4307,
+     4493,  4681,  4870,  5062,  5254,  5448,  5643,  5840,  6038,  6237,
+     6438,  6639,  6842,  7047,  7252,  7459,  7667,  7875,  8085,  8297,
+     8509,  8722,  8936,  9152,  9368,  9585,  9804, 10023, 10243, 10465,
+    10687, 10910, 11134, 11359, 11585, 11811, 12039, 12267, 12497, 12727,
+    12958, 13190, 13422, 13656, 13890, 14125, 14361, 14598, 14835, 15073,
+    15312, 15552, 15792, 16033, 16275, 16517, 16761, 17005, 17249, 17495,
+    17741, 17987, 18235, 18483, 18732, 18981, 19231, 19482, 19733, 19985,
+    20238, 20491, 20745, 21000, 21255, 21511, 21767, 22024, 22282, 22540,
+    22799, 23058, 23318, 23579, 23840, 24101, 24364, 24627, 24890, 25154,
+    25418, 25683, 25949, 26215, 26482, 26749, 27017, 27285, 27554, 27823,
+    28093, 28364, 28635, 28906, 29178, 29450, 29723, 29997, 30271, 30545,
+    30820, 31095, 31371, 31648, 31925, 32202, 32480, 32758, 33037, 33316,
+    33596, 33876, 34157, 34438, 34720, 35002, 35284, 35567, 35851, 36134,
+    36419, 36703, 36989, 37274, 37560, 37847, 38134, 38421, 38709, 38997,
+    39286, 39575, 39864, 40154, 40445, 40735, 41027, 41318, 41610, 41903,
+    42195, 42489, 42782, 43076, 43371, 43666, 43961, 44257, 44553, 44849,
+    45146, 45443, 45741, 46039, 46337, 46636, 46935, 47234, 47534, 47835,
+    48135, 48436, 48738, 49039, 49342, 49644, 49947, 50250, 50554, 50858,
+    51162, 51467, 51772, 52078, 52383, 52689, 52996, 53303, 53610, 53918,
+    54226, 54534, 54843, 55151, 55461, 55770, 56080, 56391, 56702, 57013,
+    57324, 57636, 57948, 58260, 58573, 58886, 59199, 59513, 59827, 60141,
+    60456, 60771, 61087, 61402, 61718, 62035, 62351, 62668, 62986, 63303,
+    63621, 63939, 64258, 64577, 64896, 65216
+};
+
+/**
+ * @brief The gamma curve scaled to duty once, the fade timer only interpolates
+ */
+static void duty_table_create(const uint16_t *gamma_table)
+{
+    for (int i = 0; i < GAMMA_TABLE_SIZE; i++) {
+        g_duty_table[i] = LEDC_VALUE_TO_DUTY((uint32_t)gamma_table[i]);
+    }
+
+    /* The full scale value reads one entry past the curve */
+    g_duty_table[GAMMA_TABLE_SIZE] = g_duty_table[GAMMA_TABLE_SIZE - 1];
+}
+
+static IRAM_ATTR uint32_t gamma_value_to_duty(int value)
+{
+    uint32_t tmp_q = GET_FIXED_INTEGER_PART(value, LEDC_FIXED_Q);
+    uint32_t tmp_r = GET_FIXED_DECIMAL_PART(value, LEDC_FIXED_Q);
+
+    int cur  = g_duty_table[tmp_q];
+    int next = g_duty_table[tmp_q + 1];
+    return cur + (next - cur) * (int)tmp_r / (0x1 << LEDC_FIXED_Q);
+}
+
+/**
+ * @brief Program the move from duty_from to duty_to without starting it.
+ *     A zero fade_cycles sets duty_to directly.
+ */
+static IRAM_ATTR void ledc_fade_config(ledc_mode_t speed_mode, ledc_channel_t channel,
+                                       uint32_t duty_from, uint32_t duty_to, uint32_t fade_cycles)
+{
+    uint32_t duty      = duty_to;
+    uint32_t direction = LEDC_DUTY_DIR_INCREASE;
+    uint32_t delta     = duty_to - duty_from;
+    uint32_t num       = 1;
+    uint32_t cycle     = 1;
+    uint32_t scale     = 0;
+
+    if (duty_from > duty_to) {
+        direction = LEDC_DUTY_DIR_DECREASE;
+        delta     = duty_from - duty_to;
+    }
+
+    if (fade_cycles > 0 && delta > 0) {
+        if (fade_cycles > delta) {
+            scale = 1;
+            cycle = fade_cycles / delta;
+            cycle = cycle > LEDC_FADE_DUTY_CYCLE_V ? LEDC_FADE_DUTY_CYCLE_V : cycle;
+        } else {
+            scale = delta / fade_cycles;
+            scale = scale > LEDC_FADE_DUTY_SCALE_V ? LEDC_FADE_DUTY_SCALE_V : scale;
+        }
+
+        num = delta / scale;
+
+        if (num > LEDC_FADE_DUTY_NUM_V) {
+            num   = LEDC_FADE_DUTY_NUM_V;
+            scale = delta / num;
+        }
+
+        duty = duty_from;
+    }
+
+    LEDC.channel_group[speed_mode].channel[channel].duty.duty = duty << 4;
+    LEDC.channel_group[speed_mode].channel[channel].conf1.val = ((direction & LEDC_FADE_DUTY_INC_V) << LEDC_FADE_DUTY_INC_S) |
+            ((num & LEDC_FADE_DUTY_NUM_V) << LEDC_FADE_DUTY_NUM_S) |
+            ((cycle & LEDC_FADE_DUTY_CYCLE_V) << LEDC_FADE_DUTY_CYCLE_S) |
+            ((scale & LEDC_FADE_DUTY_SCALE_V) << LEDC_FADE_DUTY_SCALE_S);
+}
+
+/**
+ * @brief Start the programmed moves of the channels back to back
+ */
+static IRAM_ATTR void ledc_fade_start(ledc_mode_t speed_mode, uint32_t channel_mask)
+{
+    for (int channel = 0; channel_mask; channel++, channel_mask >>= 1) {
+        if (!(channel_mask & 0x1)) {
+            continue;
+        }
+
+        LEDC.channel_group[speed_mode].channel[channel].conf0.sig_out_en = 1;
+        LEDC.channel_group[speed_mode].channel[channel].conf1.duty_start = 1;
+
+        if (speed_mode == LEDC_LOW_SPEED_MODE) {
+            LEDC.channel_group[speed_mode].channel[channel].conf0.low_speed_update = 1;
+        }
+    }
+}
+
+/**
+ * @brief One pass per duty cycle: every channel is stepped and programmed
+ *     first, then all of them are started together
+ */
+static IRAM_ATTR bool fade_timercb(void *arg)
+{
+    led_fade_t *fade_config = g_fade_config;
+    uint32_t update_mask    = 0;
+    bool busy               = false;
+
+    portENTER_CRITICAL_ISR(&g_fade_lock);
+
+    for (int channel = 0; channel < LEDC_CHANNEL_MAX; channel++) {
+        led_fade_data_t *fade_data = fade_config->fade_data + channel;
+        uint32_t fade_cycles       = fade_config->fade_cycles;
+
+        if (fade_data->num > 0) {
+            fade_data->num--;
+            fade_data->cur += fade_data->step;
+
+            if (fade_data->num == 0 && fade_data->cycle == 0) {
+                /* The steps are truncated, land on the keyframe value exactly */
+                fade_data->cur = fade_data->final;
+                fade_cycles    = 0;
+            }
+        } else if (fade_data->cycle) {
+            fade_data->num = fade_data->cycle - 1;
+
+            if (fade_data->step) {
+                fade_data->step *= -1;
+                fade_data->cur  += fade_data->step;
+            } else {
+                fade_data->cur = (fade_data->cur == fade_data->final) ? 0 : fade_data->final;
+            }
+        } else {
+            continue;
+        }
+
+        busy = true;
+        uint32_t duty = gamma_value_to_duty(fade_data->cur);
+
+        if (duty != fade_data->duty) {
+            ledc_fade_config(fade_config->speed_mode, channel, fade_data->duty, duty, fade_cycles);
+            fade_data->duty = duty;
+            update_mask |= BIT(channel);
+        }
+    }
+
+    ledc_fade_start(fade_config->speed_mode, update_mask);
+
+    if (!busy) {
+        timer_group_set_counter_enable_in_isr(HW_TIMER_GROUP, HW_TIMER_ID, TIMER_PAUSE);
+        g_hw_timer_started = false;
+    }
+
+    portEXIT_CRITICAL_ISR(&g_fade_lock);
+
+    return false;
+}
+
+static esp_err_t fade_timer_create(uint32_t timer_interval_ms)
+{
+    esp_err_t ret = ESP_OK;
+
+    /* Select and initialize basic parameters of the timer */
+    timer_config_t config;
+    config.divider     = HW_TIMER_DIVIDER;
+    config.counter_dir = TIMER_COUNT_UP;
+    config.counter_en  = TIMER_PAUSE;
+    config.alarm_en    = TIMER_ALARM_EN;
+    config.intr_type   = TIMER_INTR_LEVEL;
+    config.auto_reload = TIMER_AUTORELOAD_EN;
+    ret = timer_init(HW_TIMER_GROUP, HW_TIMER_ID, &config);
+
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    /* The counter reloads from 0 on every alarm */
+    timer_set_counter_value(HW_TIMER_GROUP, HW_TIMER_ID, 0x00000000ULL);
+    timer_set_alarm_value(HW_TIMER_GROUP, HW_TIMER_ID, timer_interval_ms * HW_TIMER_SCALE / 1000);
+    timer_enable_intr(HW_TIMER_GROUP, HW_TIMER_ID);
+
+    /* The driver clears the interrupt and re-arms the alarm around the callback */
+    return timer_isr_callback_add(HW_TIMER_GROUP, HW_TIMER_ID, fade_timercb, NULL, ESP_INTR_FLAG_IRAM);
+}
+
+esp_err_t led_fade_init(ledc_timer_t timer_num, ledc_mode_t speed_mode, uint32_t freq_hz)
+{
+    esp_err_t ret = ESP_OK;
+
+    if (g_fade_config != NULL) {
+        ESP_LOGW(TAG, "led_fade_init() has been called");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    const ledc_timer_config_t ledc_time_config = {
+        .speed_mode = speed_mode,
+        .timer_num  = timer_num,
+        .freq_hz    = freq_hz,
+        .duty_resolution = LEDC_TIMER_13_BIT,
+    };
+
+    ret = ledc_timer_config(&ledc_time_config);
+
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "LEDC timer configuration");
+        return ret;
+    }
+
+    led_fade_t *fade_config = calloc(1, sizeof(led_fade_t));
+
+    if (fade_config == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    fade_config->timer_num   = timer_num;
+    fade_config->speed_mode  = speed_mode;
+    fade_config->fade_cycles = (DUTY_SET_CYCLE - LEDC_FADE_MARGIN) * ledc_get_freq(speed_mode, timer_num) / 1000;
+    duty_table_create(g_gamma_table_default);
+    g_fade_config = fade_config;
+
+    ret = fade_timer_create(DUTY_SET_CYCLE);
+
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "fade timer configuration");
+        g_fade_config = NULL;
+        free(fade_config);
+        return ret;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t led_fade_deinit(void)
+{
+    if (g_fade_config == NULL) {
+        return ESP_OK;
+    }
+
+    timer_pause(HW_TIMER_GROUP, HW_TIMER_ID);
+    timer_isr_callback_remove(HW_TIMER_GROUP, HW_TIMER_ID);
+    timer_deinit(HW_TIMER_GROUP, HW_TIMER_ID);
+    g_hw_timer_started = false;
+
+    free(g_fade_config);
+    g_fade_config = NULL;
+
+    return ESP_OK;
+}
+
+esp_err_t led_fade_regist_channel(ledc_channel_t channel, gpio_num_t gpio_num)
+{
+    esp_err_t ret = ESP_OK;
+
+    if (g_fade_config == NULL) {
+        ESP_LOGW(TAG, "led_fade_init() must be called first");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    const ledc_channel_config_t ledc_ch_config = {
+        .gpio_num   = gpio_num,
+        .channel    = channel,
+        .intr_type  = LEDC_INTR_DISABLE,
+        .speed_mode = g_fade_config->speed_mode,
+        .timer_sel  = g_fade_config->timer_num,
+    };
+
+    ret = ledc_channel_config(&ledc_ch_config);
+
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "LEDC channel configuration, %d", gpio_num);
+        return ret;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t led_fade_get_channel(ledc_channel_t channel, uint8_t *dst)
+{
+    if (g_fade_config == NULL) {
+        ESP_LOGW(TAG, "led_fade_init() must be called first");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (channel >= LEDC_CHANNEL_MAX || dst == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    int cur = g_fade_config->fade_data[channel].cur;
+    *dst = FIXED_2_FLOATING(cur, LEDC_FIXED_Q);
+
+    return ESP_OK;
+}
+
+esp_err_t led_fade_set_channel(ledc_channel_t channel, uint8_t value, uint32_t fade_ms)
+{
+    if (channel >= LEDC_CHANNEL_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    led_fade_keyframe_t keyframe = {
+        .channel_mask = BIT(channel),
+        .fade_ms      = fade_ms,
+    };
+    keyframe.value[channel] = value;
+
+    return led_fade_set_keyframe(&keyframe);
+}
+
+esp_err_t led_fade_set_keyframe(const led_fade_keyframe_t *keyframe)
+{
+    bool timer_start_flag = false;
+
+    if (g_fade_config == NULL) {
+        ESP_LOGW(TAG, "led_fade_init() must be called first");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (keyframe == NULL || keyframe->channel_mask >= BIT(LEDC_CHANNEL_MAX)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    /* One duty cycle count for the whole keyframe, every channel arrives on the same tick */
+    int num = (keyframe->fade_ms < DUTY_SET_CYCLE) ? 1 : keyframe->fade_ms / DUTY_SET_CYCLE;
+
+    portENTER_CRITICAL(&g_fade_lock);
+
+    for (int channel = 0; channel < LEDC_CHANNEL_MAX; channel++) {
+        if (!(keyframe->channel_mask & BIT(channel))) {
+            continue;
+        }
+
+        led_fade_data_t *fade_data = g_fade_config->fade_data + channel;
+        fade_data->final = FLOATINT_2_FIXED(keyframe->value[channel], LEDC_FIXED_Q);
+        fade_data->step  = (fade_data->final - fade_data->cur) / num;
+        fade_data->num   = num;
+        fade_data->cycle = 0;
+    }
+
+    timer_start_flag   = !g_hw_timer_started;
+    g_hw_timer_started = true;
+
+    portEXIT_CRITICAL(&g_fade_lock);
+
+    if (timer_start_flag) {
+        timer_start(HW_TIMER_GROUP, HW_TIMER_ID);
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t led_fade_start_blink(ledc_channel_t channel, uint8_t value, uint32_t period_ms, bool fade_flag)
+{
+    bool timer_start_flag = false;
+
+    if (g_fade_config == NULL) {
+        ESP_LOGW(TAG, "led_fade_init() must be called first");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (channel >= LEDC_CHANNEL_MAX || period_ms < 2 * DUTY_SET_CYCLE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&g_fade_lock);
+
+    led_fade_data_t *fade_data = g_fade_config->fade_data + channel;
+    fade_data->final = fade_data->cur = FLOATINT_2_FIXED(value, LEDC_FIXED_Q);
+    fade_data->cycle = period_ms / 2 / DUTY_SET_CYCLE;
+    fade_data->num   = (fade_flag) ? fade_data->cycle : 0;
+    fade_data->step  = (fade_flag) ? fade_data->cur / fade_data->cycle * -1 : 0;
+
+    timer_start_flag   = !g_hw_timer_started;
+    g_hw_timer_started = true;
+
+    portEXIT_CRITICAL(&g_fade_lock);
+
+    if (timer_start_flag) {
+        timer_start(HW_TIMER_GROUP, HW_TIMER_ID);
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t led_fade_stop_blink(ledc_channel_t channel)
+{
+    if (g_fade_config == NULL) {
+        ESP_LOGW(TAG, "led_fade_init() must be called first");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (channel >= LEDC_CHANNEL_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&g_fade_lock);
+    led_fade_data_t *fade_data = g_fade_config->fade_data + channel;
+    fade_data->cycle = fade_data->num = 0;
+    portEXIT_CRITICAL(&g_fade_lock);
+
+    return ESP_OK;
+}
+
+esp_err_t led_fade_set_gamma_table(const uint16_t gamma_table[GAMMA_TABLE_SIZE])
+{
+    if (g_fade_config == NULL) {
+        ESP_LOGW(TAG, "led_fade_init() must be called first");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    portENTER_CRITICAL(&g_fade_lock);
+    duty_table_create(gamma_table);
+    portEXIT_CRITICAL(&g_fade_lock);
+
+    return ESP_OK;
+}
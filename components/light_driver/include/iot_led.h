@@ -20,14 +20,7 @@ extern "C" {
 #endif
 
 #include "driver/ledc.h"
-
-#define HW_TIMER_GROUP (0)                                 /**< Hardware timer group */
-#define HW_TIMER_ID (0)                                    /**< Hardware timer number */
-#define HW_TIMER_DIVIDER (16)                              /**< Hardware timer clock divider */
-#define HW_TIMER_SCALE (TIMER_BASE_CLK / HW_TIMER_DIVIDER) /**< Convert counter value to seconds */
-#define GAMMA_CORRECTION 0.8                               /**< Gamma curve parameter */
-#define GAMMA_TABLE_SIZE 256                               /**< Gamma table size, used for led fade*/
-#define DUTY_SET_CYCLE (20)                                /**< Set duty cycle */
+#include "led_fade.h"
 
 /**
  * Macro which can be used to check the error code,
@@ -126,6 +119,18 @@ esp_err_t iot_led_get_channel(ledc_channel_t channel, uint8_t *dst);
 */
 esp_err_t iot_led_set_channel(ledc_channel_t channel, uint8_t value, uint32_t fade_ms);
 
+/**
+  * @brief Fade several channels to a keyframe, they start and end together
+  * @note before calling this function, you need to call iot_led_regist_channel() to
+  *     set the channels
+  *
+  * @param keyframe The channel mask, the target values and the fade time
+  * @return
+  *     - ESP_OK if sucess
+  *     - ESP_ERR_INVALID_ARG Parameter error
+*/
+esp_err_t iot_led_set_keyframe(const led_fade_keyframe_t *keyframe);
+
 /**
   * @brief Set the blink state or loop fade for the specified channel
   * @note before calling this function, you need to call iot_led_regist_channel() to
@@ -165,7 +170,7 @@ esp_err_t iot_led_stop_blink(ledc_channel_t channel);
   *     fixed-point number. The decimal point is before the eighth bit
   *     and after the ninth bit, so the range of expressions can be
   *     0x00.00 ~ 0xff.ff.
-  * @note default gamma_table is created in iot_led_init()
+  * @note the built-in gamma_table is used until this is called
   *
   * @return
   *     - ESP_OK if sucess
@@ -0,0 +1,131 @@
+// Copyright 2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _LIGHT_COLOR_H_
+#define _LIGHT_COLOR_H_
+
+/*
+ * Color conversion kernels of the light driver. They have no ESP-IDF
+ * dependency, test_host/ builds them with the host compiler.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/param.h>
+
+/**
+ * @brief Percent to a 16-bit fraction of full scale, round(i * 65535 / 100)
+ */
+static const uint16_t g_percent_to_u16[101] = {
+        0,   655,  1311,  1966,  2621,  3277,  3932,  4587,  5243,  5898,
+     6554,  7209,  7864,  8520,  9175,  9830, 10486, 11141, 11796, 12452,
+    13107, 13762, 14418, 15073, 15728, 16384, 17039, 17694, 18350, 19005,
+    19661, 20316, 20971, 21627, 22282, 22937, 23593, 24248, 24903, 25559,
+    26214, 26869, 27525, 28180, 28835, 29491, 30146, 30801, 31457, 32112,
+    32768, 33423, 34078, 34734, 35389, 36044, 36700, 37355, 38010, 38666,
+    39321, 39976, 40632, 41287, 41942, 42598, 43253, 43908, 44564, 45219,
+    45875, 46530, 47185, 47841, 48496, 49151, 49807, 50462, 51117, 51773,
+    52428, 53083, 53739, 54394, 55049, 55705, 56360, 57015, 57671, 58326,
+    58982, 59637, 60292, 60948, 61603, 62258, 62914, 63569, 64224, 64880,
+    65535
+};
+
+/**
+ * @brief Position of a hue inside its 60 degree sector, round(i * 65536 / 60)
+ */
+static const uint16_t g_hue_to_frac[60] = {
+        0,  1092,  2185,  3277,  4369,  5461,  6554,  7646,  8738,  9830,
+    10923, 12015, 13107, 14199, 15292, 16384, 17476, 18569, 19661, 20753,
+    21845, 22938, 24030, 25122, 26214, 27307, 28399, 29491, 30583, 31676,
+    32768, 33860, 34953, 36045, 37137, 38229, 39322, 40414, 41506, 42598,
+    43691, 44783, 45875, 46967, 48060, 49152, 50244, 51337, 52429, 53521,
+    54613, 55706, 56798, 57890, 58982, 60075, 61167, 62259, 63351, 64444
+};
+
+#define LIGHT_U16_TO_U8(x) (((uint32_t)(x) * 255 + 32767) / 65535)
+#define LIGHT_U16_TO_PERCENT(x) (((uint32_t)(x) * 100 + 32767) / 65535)
+
+/**
+ * The conversions work on 16-bit fractions with integer arithmetic only, the C3
+ * has no FPU and a fade converts a color on every step.
+ */
+static inline void light_color_hsv2rgb_sector(uint32_t sector, uint32_t frac, uint32_t s, uint32_t v,
+                                              uint8_t *red, uint8_t *green, uint8_t *blue)
+{
+    uint32_t p = v * (65535 - s) >> 16;
+    uint32_t q = v * (65535 - (s * frac >> 16)) >> 16;
+    uint32_t t = v * (65535 - (s * (65536 - frac) >> 16)) >> 16;
+    uint32_t rgb[3];
+
+    switch (sector) {
+        case 0: rgb[0] = v; rgb[1] = t; rgb[2] = p; break;
+        case 1: rgb[0] = q; rgb[1] = v; rgb[2] = p; break;
+        case 2: rgb[0] = p; rgb[1] = v; rgb[2] = t; break;
+        case 3: rgb[0] = p; rgb[1] = q; rgb[2] = v; break;
+        case 4: rgb[0] = t; rgb[1] = p; rgb[2] = v; break;
+        default: rgb[0] = v; rgb[1] = p; rgb[2] = q; break;
+    }
+
+    *red   = LIGHT_U16_TO_U8(rgb[0]);
+    *green = LIGHT_U16_TO_U8(rgb[1]);
+    *blue  = LIGHT_U16_TO_U8(rgb[2]);
+}
+
+static inline void light_color_hsv2rgb(uint16_t hue, uint8_t saturation, uint8_t value,
+                                       uint8_t *red, uint8_t *green, uint8_t *blue)
+{
+    light_color_hsv2rgb_sector(hue / 60 % 6, g_hue_to_frac[hue % 60],
+                               g_percent_to_u16[saturation], g_percent_to_u16[value], red, green, blue);
+}
+
+/**
+ * @brief Same as light_color_hsv2rgb() with every input a 16-bit fraction, the
+ *        hue covering the whole circle, so a fade is not cut into percent steps
+ */
+static inline void light_color_hsv2rgb_u16(uint16_t hue, uint16_t saturation, uint16_t value,
+                                           uint8_t *red, uint8_t *green, uint8_t *blue)
+{
+    uint32_t hue6 = (uint32_t)hue * 6;
+
+    light_color_hsv2rgb_sector(hue6 >> 16, hue6 & 0xFFFF, saturation, value, red, green, blue);
+}
+
+// refence: https://axonflux.com/handy-rgb-to-hsl-and-rgb-to-hsv-color-model-c
+static inline void light_color_hsl2rgb(uint16_t hue, uint8_t saturation, uint8_t lightness,
+                                       uint8_t *red, uint8_t *green, uint8_t *blue)
+{
+    uint32_t sector = hue / 60 % 6;
+    uint32_t frac   = g_hue_to_frac[hue % 60];
+    uint32_t s      = g_percent_to_u16[saturation];
+    uint32_t l      = g_percent_to_u16[lightness];
+    uint32_t c      = (65535 - (uint32_t)abs(2 * (int32_t)l - 65535)) * s >> 16;
+    uint32_t x      = c * ((sector & 1) ? 65536 - frac : frac) >> 16;
+    uint32_t m      = l - c / 2;
+    uint32_t rgb[3];
+
+    switch (sector) {
+        case 0: rgb[0] = c; rgb[1] = x; rgb[2] = 0; break; /* hue 0~60 */
+        case 1: rgb[0] = x; rgb[1] = c; rgb[2] = 0; break; /* hue 60~120 */
+        case 2: rgb[0] = 0; rgb[1] = c; rgb[2] = x; break; /* hue 120~180 */
+        case 3: rgb[0] = 0; rgb[1] = x; rgb[2] = c; break; /* hue 180~240 */
+        case 4: rgb[0] = x; rgb[1] = 0; rgb[2] = c; break; /* hue 240~300 */
+        default: rgb[0] = c; rgb[1] = 0; rgb[2] = x; break; /* hue 300~360 */
+    }
+
+    *red   = LIGHT_U16_TO_U8(MIN(rgb[0] + m, 65535));
+    *green = LIGHT_U16_TO_U8(MIN(rgb[1] + m, 65535));
+    *blue  = LIGHT_U16_TO_U8(MIN(rgb[2] + m, 65535));
+}
+
+#endif /* _LIGHT_COLOR_H_ */
@@ -56,6 +56,46 @@ typedef struct {
     uint32_t blink_period_ms; /**< Period of flashing lights */
 } light_driver_config_t;
 
+/**
+ * @brief A color in the HSV space
+ */
+typedef struct {
+    uint16_t hue;       /**< Hue, 0 ~ 360 */
+    uint8_t saturation; /**< Saturation, 0 ~ 100 */
+    uint8_t value;      /**< Value, 0 ~ 100 */
+} light_driver_hsv_t;
+
+/**
+ * @brief A color in the HSL space
+ */
+typedef struct {
+    uint16_t hue;       /**< Hue, 0 ~ 360 */
+    uint8_t saturation; /**< Saturation, 0 ~ 100 */
+    uint8_t lightness;  /**< Lightness, 0 ~ 100 */
+} light_driver_hsl_t;
+
+/**
+ * @brief A color in the RGB space
+ */
+typedef struct {
+    uint8_t red;   /**< Red, 0 ~ 255 */
+    uint8_t green; /**< Green, 0 ~ 255 */
+    uint8_t blue;  /**< Blue, 0 ~ 255 */
+} light_driver_rgb_t;
+
+/**
+ * @brief One output frame of the light, written to every channel in a single pass
+ */
+typedef struct {
+    bool on;                   /**< Whether the light is on */
+    light_mode_t mode;         /**< MODE_HSV drives the color channels, MODE_CTB the white channels */
+    uint16_t hue;               /**< Hue, 0 ~ UINT16_MAX for the whole circle */
+    uint16_t saturation;        /**< Saturation, 0 ~ UINT16_MAX */
+    uint16_t value;             /**< Value, 0 ~ UINT16_MAX */
+    uint16_t color_temperature; /**< Color temperature, 0 ~ UINT16_MAX */
+    uint16_t brightness;        /**< Brightness, 0 ~ UINT16_MAX */
+} light_driver_frame_t;
+
 #ifdef CONFIG_LIGHT_TYPE_MESHKIT
 #define COFNIG_LIGHT_TYPE_DEFAULT() { \
             .type            = "meshlight",\
@@ -145,6 +185,22 @@ esp_err_t light_driver_set_mode(light_mode_t mode);
 
 /**@}*/
 
+/**
+ * @brief  Write one frame of a transition stepped by the caller
+ *
+ * @note   All five channels are updated together without the driver fade, and the
+ *         state is not saved in nvs, the caller stores the settled state itself.
+ *         The duty is computed from the 16-bit fields, the percent state kept by
+ *         the driver is rounded from them.
+ *
+ * @param  frame The output of the light
+ *
+ * @return
+ *      - ESP_OK
+ *      - ESP_ERR_INVALID_ARG
+ */
+esp_err_t light_driver_set_frame(const light_driver_frame_t *frame);
+
 /**@{*/
 /**
  * @brief  Set the status of the light
@@ -179,6 +235,25 @@ esp_err_t light_driver_blink_start(uint8_t red, uint8_t green, uint8_t blue);
 esp_err_t light_driver_blink_stop(void);
 /**@}*/
 
+/**@{*/
+/**
+ * @brief  Convert an array of colors to channel values in one call, for strips
+ *         or several lights updated together
+ *
+ * @note   Integer arithmetic only, each channel is within one step of the exact value
+ *
+ * @param  hsv/hsl The colors to convert
+ * @param  rgb     The converted colors, count entries
+ * @param  count   Number of colors
+ *
+ * @return
+ *      - ESP_OK
+ *      - ESP_ERR_INVALID_ARG
+ */
+esp_err_t light_driver_hsv2rgb_array(const light_driver_hsv_t *hsv, light_driver_rgb_t *rgb, size_t count);
+esp_err_t light_driver_hsl2rgb_array(const light_driver_hsl_t *hsl, light_driver_rgb_t *rgb, size_t count);
+/**@}*/
+
 /**@{*/
 /**
  * @brief  Color gradient
@@ -38,6 +38,7 @@
 #include "driver/gpio.h"
 
 #include "light_driver.h"
+#include "light_color.h"
 #include "light_nvs.h"
 
 /**
@@ -68,6 +69,10 @@ enum light_channel {
 };
 
 #define LIGHT_FADE_PERIOD_MAX_MS (3 * 1000)
+#define LIGHT_CHANNEL_NUM        (CHANNEL_ID_COLD + 1)
+#define LIGHT_CHANNEL_RGB        (BIT(CHANNEL_ID_RED) | BIT(CHANNEL_ID_GREEN) | BIT(CHANNEL_ID_BLUE))
+#define LIGHT_CHANNEL_CW         (BIT(CHANNEL_ID_WARM) | BIT(CHANNEL_ID_COLD))
+#define LIGHT_CHANNEL_ALL        (LIGHT_CHANNEL_RGB | LIGHT_CHANNEL_CW)
 
 static const char *TAG               = "light_driver";
 static light_status_t g_light_status = {0};
@@ -132,24 +137,32 @@ esp_err_t light_driver_config(uint32_t fade_period_ms, uint32_t blink_period_ms)
     return ESP_OK;
 }
 
-esp_err_t light_driver_set_rgb(uint8_t red, uint8_t green, uint8_t blue)
+/**
+ * @brief Fade the masked channels as one keyframe so that the colour does not shift on the way
+ */
+static esp_err_t light_channel_fade(uint32_t channel_mask, const uint8_t value[LIGHT_CHANNEL_NUM], uint32_t fade_ms)
 {
-    esp_err_t ret = 0;
-
-    ret = iot_led_set_channel(CHANNEL_ID_RED, red, 0);
-    LIGHT_ERROR_CHECK(ret < 0, ret, "iot_led_set_channel, ret: %d", ret);
+    led_fade_keyframe_t keyframe = {
+        .channel_mask = channel_mask,
+        .fade_ms      = fade_ms,
+    };
 
-    ret = iot_led_set_channel(CHANNEL_ID_GREEN, green, 0);
-    LIGHT_ERROR_CHECK(ret < 0, ret, "iot_led_set_channel, ret: %d", ret);
+    memcpy(keyframe.value, value, LIGHT_CHANNEL_NUM);
 
-    ret = iot_led_set_channel(CHANNEL_ID_BLUE, blue, 0);
-    LIGHT_ERROR_CHECK(ret < 0, ret, "iot_led_set_channel, ret: %d", ret);
+    return iot_led_set_keyframe(&keyframe);
+}
 
-    ret = iot_led_set_channel(CHANNEL_ID_WARM, 0, 0);
-    LIGHT_ERROR_CHECK(ret < 0, ret, "iot_led_set_channel, ret: %d", ret);
+esp_err_t light_driver_set_rgb(uint8_t red, uint8_t green, uint8_t blue)
+{
+    esp_err_t ret = 0;
+    uint8_t value[LIGHT_CHANNEL_NUM] = {
+        [CHANNEL_ID_RED]   = red,
+        [CHANNEL_ID_GREEN] = green,
+        [CHANNEL_ID_BLUE]  = blue,
+    };
 
-    ret = iot_led_set_channel(CHANNEL_ID_COLD, 0, 0);
-    LIGHT_ERROR_CHECK(ret < 0, ret, "iot_led_set_channel, ret: %d", ret);
+    ret = light_channel_fade(LIGHT_CHANNEL_ALL, value, 0);
+    LIGHT_ERROR_CHECK(ret < 0, ret, "light_channel_fade, ret: %d", ret);
 
     return ESP_OK;
 }
@@ -157,56 +170,9 @@ esp_err_t light_driver_set_rgb(uint8_t red, uint8_t green, uint8_t blue)
 static esp_err_t light_driver_hsv2rgb(uint16_t hue, uint8_t saturation, uint8_t value,
                                       uint8_t *red, uint8_t *green, uint8_t *blue)
 {
-    uint16_t hi = (hue / 60) % 6;
-    uint16_t F = 100 * hue / 60 - 100 * hi;
-    uint16_t P = value * (100 - saturation) / 100;
-    uint16_t Q = value * (10000 - F * saturation) / 10000;
-    uint16_t T = value * (10000 - saturation * (100 - F)) / 10000;
-
-    switch (hi) {
-        case 0:
-            *red   = value;
-            *green = T;
-            *blue  = P;
-            break;
-
-        case 1:
-            *red   = Q;
-            *green = value;
-            *blue  = P;
-            break;
-
-        case 2:
-            *red   = P;
-            *green = value;
-            *blue  = T;
-            break;
-
-        case 3:
-            *red   = P;
-            *green = Q;
-            *blue  = value;
-            break;
-
-        case 4:
-            *red   = T;
-            *green = P;
-            *blue  = value;
-            break;
-
-        case 5:
-            *red   = value;
-            *green = P;
-            *blue  = Q;
-            break;
-
-        default:
-            return ESP_FAIL;
-    }
+    LIGHT_PARAM_CHECK(hue <= 360 && saturation <= 100 && value <= 100);
 
-    *red   = *red * 255 / 100;
-    *green = *green * 255 / 100;
-    *blue  = *blue * 255 / 100;
+    light_color_hsv2rgb(hue, saturation, value, red, green, blue);
 
     return ESP_OK;
 }
@@ -214,92 +180,71 @@ static esp_err_t light_driver_hsv2rgb(uint16_t hue, uint8_t saturation, uint8_t
 static void light_driver_rgb2hsv(uint16_t red, uint16_t green, uint16_t blue,
                                  uint16_t *h, uint8_t *s, uint8_t *v)
 {
-    double hue, saturation, value;
-    double m_max = MAX(red, MAX(green, blue));
-    double m_min = MIN(red, MIN(green, blue));
-    double m_delta = m_max - m_min;
+    int32_t m_max   = MAX(red, MAX(green, blue));
+    int32_t m_min   = MIN(red, MIN(green, blue));
+    int32_t m_delta = m_max - m_min;
+    int32_t hue     = 0;
 
-    value = m_max / 255.0;
+    *v = (m_max * 100 + 127) / 255;
 
     if (m_delta == 0) {
-        hue = 0;
-        saturation = 0;
-    } else {
-        saturation = m_delta / m_max;
+        *h = 0;
+        *s = 0;
+        return;
+    }
 
-        if (red == m_max) {
-            hue = (green - blue) / m_delta;
-        } else if (green == m_max) {
-            hue = 2 + (blue - red) / m_delta;
-        } else {
-            hue = 4 + (red - green) / m_delta;
-        }
+    *s = (m_delta * 100 + m_max / 2) / m_max;
 
-        hue = hue * 60;
+    /* The hue scaled by m_delta, divided once at the end with rounding */
+    if (red == m_max) {
+        hue = 60 * ((int32_t)green - blue);
+    } else if (green == m_max) {
+        hue = 120 * m_delta + 60 * ((int32_t)blue - red);
+    } else {
+        hue = 240 * m_delta + 60 * ((int32_t)red - green);
+    }
 
-        if (hue < 0) {
-            hue = hue + 360;
-        }
+    if (hue < 0) {
+        hue += 360 * m_delta;
     }
 
-    *h = (int)(hue + 0.5);
-    *s = (int)(saturation * 100 + 0.5);
-    *v = (int)(value * 100 + 0.5);
+    *h = (2 * hue + m_delta) / (2 * m_delta);
 }
 
-// refence: https://axonflux.com/handy-rgb-to-hsl-and-rgb-to-hsv-color-model-c
 static esp_err_t light_driver_hsl2rgb(uint16_t hue, uint8_t saturation, uint8_t lightness,
                                       uint8_t *red, uint8_t *green, uint8_t *blue)
 {
-    uint16_t hi = (hue / 60) % 6;
-    uint16_t C  = (100 - abs(2 * lightness - 100)) * saturation / 100;
-    uint16_t M  = 100 * (lightness - 0.5 * C) / 100;
-    uint16_t X  = C * (100 - abs((hue * 100 / 60 ) % 200 - 100)) / 100;
-
-    switch (hi) {
-        case 0: /* hue 0~60 */
-            *red   = C + M;
-            *green = X + M;
-            *blue  = M;
-            break;
-
-        case 1: /* hue 60~120 */
-            *red   = X + M;
-            *green = C + M;
-            *blue  = M;
-            break;
-
-        case 2: /* hue 120~180 */
-            *red   = M;
-            *green = C + M;
-            *blue  = X + M;
-            break;
-
-        case 3: /* hue 180~240 */
-            *red   = M;
-            *green = X + M;
-            *blue  = C + M;
-            break;
-
-        case 4: /* hue 240~300 */
-            *red   = X + M;
-            *green = M;
-            *blue  = C + M;
-            break;
-
-        case 5: /* hue 300~360 */
-            *red   = C + M;
-            *green = M;
-            *blue  = X + M;
-            break;
-
-        default:
-            return ESP_FAIL;
+    LIGHT_PARAM_CHECK(hue <= 360 && saturation <= 100 && lightness <= 100);
+
+    light_color_hsl2rgb(hue, saturation, lightness, red, green, blue);
+
+    return ESP_OK;
+}
+
+esp_err_t light_driver_hsv2rgb_array(const light_driver_hsv_t *hsv, light_driver_rgb_t *rgb, size_t count)
+{
+    LIGHT_PARAM_CHECK(hsv || !count);
+    LIGHT_PARAM_CHECK(rgb || !count);
+
+    for (size_t i = 0; i < count; ++i) {
+        LIGHT_PARAM_CHECK(hsv[i].hue <= 360 && hsv[i].saturation <= 100 && hsv[i].value <= 100);
+        light_color_hsv2rgb(hsv[i].hue, hsv[i].saturation, hsv[i].value,
+                            &rgb[i].red, &rgb[i].green, &rgb[i].blue);
     }
 
-    *red   = *red * 255 / 100;
-    *green = *green * 255 / 100;
-    *blue  = *blue * 255 / 100;
+    return ESP_OK;
+}
+
+esp_err_t light_driver_hsl2rgb_array(const light_driver_hsl_t *hsl, light_driver_rgb_t *rgb, size_t count)
+{
+    LIGHT_PARAM_CHECK(hsl || !count);
+    LIGHT_PARAM_CHECK(rgb || !count);
+
+    for (size_t i = 0; i < count; ++i) {
+        LIGHT_PARAM_CHECK(hsl[i].hue <= 360 && hsl[i].saturation <= 100 && hsl[i].lightness <= 100);
+        light_color_hsl2rgb(hsl[i].hue, hsl[i].saturation, hsl[i].lightness,
+                            &rgb[i].red, &rgb[i].green, &rgb[i].blue);
+    }
 
     return ESP_OK;
 }
@@ -320,22 +265,15 @@ esp_err_t light_driver_set_hsv(uint16_t hue, uint8_t saturation, uint8_t value)
 
     ESP_LOGV(TAG, "red: %d, green: %d, blue: %d", red, green, blue);
 
-    ret = iot_led_set_channel(CHANNEL_ID_RED, red, g_light_status.fade_period_ms);
-    LIGHT_ERROR_CHECK(ret < 0, ret, "iot_led_set_channel, ret: %d", ret);
-
-    ret = iot_led_set_channel(CHANNEL_ID_GREEN, green, g_light_status.fade_period_ms);
-    LIGHT_ERROR_CHECK(ret < 0, ret, "iot_led_set_channel, ret: %d", ret);
+    uint8_t channel_value[LIGHT_CHANNEL_NUM] = {
+        [CHANNEL_ID_RED]   = red,
+        [CHANNEL_ID_GREEN] = green,
+        [CHANNEL_ID_BLUE]  = blue,
+    };
+    uint32_t channel_mask = (g_light_status.mode != MODE_HSV) ? LIGHT_CHANNEL_ALL : LIGHT_CHANNEL_RGB;
 
-    ret = iot_led_set_channel(CHANNEL_ID_BLUE, blue, g_light_status.fade_period_ms);
-    LIGHT_ERROR_CHECK(ret < 0, ret, "iot_led_set_channel, ret: %d", ret);
-
-    if (g_light_status.mode != MODE_HSV) {
-        ret = iot_led_set_channel(CHANNEL_ID_WARM, 0, g_light_status.fade_period_ms);
-        LIGHT_ERROR_CHECK(ret < 0, ret, "iot_led_set_channel, ret: %d", ret);
-
-        ret = iot_led_set_channel(CHANNEL_ID_COLD, 0, g_light_status.fade_period_ms);
-        LIGHT_ERROR_CHECK(ret < 0, ret, "iot_led_set_channel, ret: %d", ret);
-    }
+    ret = light_channel_fade(channel_mask, channel_value, g_light_status.fade_period_ms);
+    LIGHT_ERROR_CHECK(ret < 0, ret, "light_channel_fade, ret: %d", ret);
 
     g_light_status.mode       = MODE_HSV;
     g_light_status.on         = 1;
@@ -420,24 +358,14 @@ esp_err_t light_driver_set_ctb(uint8_t color_temperature, uint8_t brightness)
     warm_tmp         = warm_tmp < 15 ? warm_tmp : 14 + warm_tmp * 86 / 100;
     cold_tmp         = cold_tmp < 15 ? cold_tmp : 14 + cold_tmp * 86 / 100;
 
-    ret = iot_led_set_channel(CHANNEL_ID_COLD,
-                              cold_tmp * 255 / 100, g_light_status.fade_period_ms);
-    LIGHT_ERROR_CHECK(ret < 0, ret, "iot_led_set_channel, ret: %d", ret);
-
-    ret = iot_led_set_channel(CHANNEL_ID_WARM,
-                              warm_tmp * 255 / 100, g_light_status.fade_period_ms);
-    LIGHT_ERROR_CHECK(ret < 0, ret, "iot_led_set_channel, ret: %d", ret);
-
-    if (g_light_status.mode != MODE_CTB) {
-        ret = iot_led_set_channel(CHANNEL_ID_RED, 0, g_light_status.fade_period_ms);
-        LIGHT_ERROR_CHECK(ret < 0, ret, "iot_led_set_channel, ret: %d", ret);
-
-        ret = iot_led_set_channel(CHANNEL_ID_GREEN, 0, g_light_status.fade_period_ms);
-        LIGHT_ERROR_CHECK(ret < 0, ret, "iot_led_set_channel, ret: %d", ret);
+    uint8_t channel_value[LIGHT_CHANNEL_NUM] = {
+        [CHANNEL_ID_WARM] = warm_tmp * 255 / 100,
+        [CHANNEL_ID_COLD] = cold_tmp * 255 / 100,
+    };
+    uint32_t channel_mask = (g_light_status.mode != MODE_CTB) ? LIGHT_CHANNEL_ALL : LIGHT_CHANNEL_CW;
 
-        ret = iot_led_set_channel(CHANNEL_ID_BLUE, 0, g_light_status.fade_period_ms);
-        LIGHT_ERROR_CHECK(ret < 0, ret, "iot_led_set_channel, ret: %d", ret);
-    }
+    ret = light_channel_fade(channel_mask, channel_value, g_light_status.fade_period_ms);
+    LIGHT_ERROR_CHECK(ret < 0, ret, "light_channel_fade, ret: %d", ret);
 
     g_light_status.mode              = MODE_CTB;
     g_light_status.on                = 1;
@@ -497,22 +425,15 @@ esp_err_t light_driver_set_hsl(uint16_t hue, uint8_t saturation, uint8_t lightne
 
     ESP_LOGV(TAG, "red: %d, green: %d, blue: %d", red, green, blue);
 
-    ret = iot_led_set_channel(CHANNEL_ID_RED, red, g_light_status.fade_period_ms);
-    LIGHT_ERROR_CHECK(ret < 0, ret, "iot_led_set_channel, ret: %d", ret);
-
-    ret = iot_led_set_channel(CHANNEL_ID_GREEN, green, g_light_status.fade_period_ms);
-    LIGHT_ERROR_CHECK(ret < 0, ret, "iot_led_set_channel, ret: %d", ret);
+    uint8_t channel_value[LIGHT_CHANNEL_NUM] = {
+        [CHANNEL_ID_RED]   = red,
+        [CHANNEL_ID_GREEN] = green,
+        [CHANNEL_ID_BLUE]  = blue,
+    };
+    uint32_t channel_mask = (g_light_status.mode != MODE_HSL) ? LIGHT_CHANNEL_ALL : LIGHT_CHANNEL_RGB;
 
-    ret = iot_led_set_channel(CHANNEL_ID_BLUE, blue, g_light_status.fade_period_ms);
-    LIGHT_ERROR_CHECK(ret < 0, ret, "iot_led_set_channel, ret: %d", ret);
-
-    if (g_light_status.mode != MODE_HSL) {
-        ret = iot_led_set_channel(CHANNEL_ID_WARM, 0, g_light_status.fade_period_ms);
-        LIGHT_ERROR_CHECK(ret < 0, ret, "iot_led_set_channel, ret: %d", ret);
-
-        ret = iot_led_set_channel(CHANNEL_ID_COLD, 0, g_light_status.fade_period_ms);
-        LIGHT_ERROR_CHECK(ret < 0, ret, "iot_led_set_channel, ret: %d", ret);
-    }
+    ret = light_channel_fade(channel_mask, channel_value, g_light_status.fade_period_ms);
+    LIGHT_ERROR_CHECK(ret < 0, ret, "light_channel_fade, ret: %d", ret);
 
     g_light_status.mode       = MODE_HSL;
     g_light_status.on         = 1;
@@ -555,21 +476,10 @@ esp_err_t light_driver_set_switch(bool on)
     g_light_status.on = on;
 
     if (!g_light_status.on) {
-        ret = iot_led_set_channel(CHANNEL_ID_RED, 0, g_light_status.fade_period_ms);
-        LIGHT_ERROR_CHECK(ret < 0, ESP_FAIL, "iot_led_set_channel, ret: %d", ret);
-
-        ret = iot_led_set_channel(CHANNEL_ID_GREEN, 0, g_light_status.fade_period_ms);
-        LIGHT_ERROR_CHECK(ret < 0, ESP_FAIL, "iot_led_set_channel, ret: %d", ret);
-
-        ret = iot_led_set_channel(CHANNEL_ID_BLUE, 0, g_light_status.fade_period_ms);
-        LIGHT_ERROR_CHECK(ret < 0, ESP_FAIL, "iot_led_set_channel, ret: %d", ret);
-
-        ret = iot_led_set_channel(CHANNEL_ID_COLD, 0, g_light_status.fade_period_ms);
-        LIGHT_ERROR_CHECK(ret < 0, ESP_FAIL, "iot_led_set_channel, ret: %d", ret);
-
-        ret = iot_led_set_channel(CHANNEL_ID_WARM, 0, g_light_status.fade_period_ms);
-        LIGHT_ERROR_CHECK(ret < 0, ESP_FAIL, "iot_led_set_channel, ret: %d", ret);
+        const uint8_t channel_value[LIGHT_CHANNEL_NUM] = {0};
 
+        ret = light_channel_fade(LIGHT_CHANNEL_ALL, channel_value, g_light_status.fade_period_ms);
+        LIGHT_ERROR_CHECK(ret < 0, ESP_FAIL, "light_channel_fade, ret: %d", ret);
     } else {
         switch (g_light_status.mode) {
             case MODE_HSV:
@@ -602,6 +512,47 @@ esp_err_t light_driver_set_switch(bool on)
     return ESP_OK;
 }
 
+esp_err_t light_driver_set_frame(const light_driver_frame_t *frame)
+{
+    LIGHT_PARAM_CHECK(frame);
+    LIGHT_PARAM_CHECK(frame->mode == MODE_HSV || frame->mode == MODE_CTB);
+
+    esp_err_t ret = ESP_OK;
+    uint8_t duty[LIGHT_CHANNEL_NUM] = {0};
+
+    if (frame->on && frame->mode == MODE_HSV) {
+        light_color_hsv2rgb_u16(frame->hue, frame->saturation, frame->value,
+                                &duty[CHANNEL_ID_RED], &duty[CHANNEL_ID_GREEN], &duty[CHANNEL_ID_BLUE]);
+    } else if (frame->on) {
+        /* The curve of light_driver_set_ctb() on 16-bit fractions */
+        uint32_t warm_tmp = (uint32_t)frame->color_temperature * frame->brightness / UINT16_MAX;
+        uint32_t cold_tmp = (uint32_t)(UINT16_MAX - frame->color_temperature) * frame->brightness / UINT16_MAX;
+        warm_tmp          = warm_tmp < g_percent_to_u16[15] ? warm_tmp : g_percent_to_u16[14] + warm_tmp * 86 / 100;
+        cold_tmp          = cold_tmp < g_percent_to_u16[15] ? cold_tmp : g_percent_to_u16[14] + cold_tmp * 86 / 100;
+
+        duty[CHANNEL_ID_WARM] = LIGHT_U16_TO_U8(warm_tmp);
+        duty[CHANNEL_ID_COLD] = LIGHT_U16_TO_U8(cold_tmp);
+    }
+
+    /* The caller steps the transition, the channels follow within one duty cycle */
+    ret = light_channel_fade(LIGHT_CHANNEL_ALL, duty, 0);
+    LIGHT_ERROR_CHECK(ret < 0, ret, "light_channel_fade, ret: %d", ret);
+
+    g_light_status.mode = frame->mode;
+    g_light_status.on   = frame->on;
+
+    if (frame->mode == MODE_HSV) {
+        g_light_status.hue        = ((uint32_t)frame->hue * 360 + 32768) >> 16;
+        g_light_status.saturation = LIGHT_U16_TO_PERCENT(frame->saturation);
+        g_light_status.value      = LIGHT_U16_TO_PERCENT(frame->value);
+    } else {
+        g_light_status.color_temperature = LIGHT_U16_TO_PERCENT(frame->color_temperature);
+        g_light_status.brightness        = LIGHT_U16_TO_PERCENT(frame->brightness);
+    }
+
+    return ESP_OK;
+}
+
 esp_err_t light_driver_set_mode(light_mode_t mode)
 {
     g_light_status.mode = mode;
@@ -678,7 +629,7 @@ esp_err_t light_driver_fade_brightness(uint8_t brightness)
             LIGHT_ERROR_CHECK(ret < 0, ESP_FAIL, "iot_led_get_channel, ret: %d", ret);
 
             uint8_t max_color       = MAX(MAX(red, green), blue);
-            uint8_t change_value    = brightness * 255 / 100 - max_color;
+            uint8_t change_value    = abs(brightness * 255 / 100 - max_color);
             fade_period_ms = LIGHT_FADE_PERIOD_MAX_MS * change_value / 255;
         } else {
             fade_period_ms = LIGHT_FADE_PERIOD_MAX_MS * MAX(MAX(red, green), blue) / 255;
@@ -688,14 +639,15 @@ esp_err_t light_driver_fade_brightness(uint8_t brightness)
         g_light_status.value = brightness;
         light_driver_hsv2rgb(g_light_status.hue, g_light_status.saturation, g_light_status.value, &red, &green, &blue);
 
-        ret = iot_led_set_channel(CHANNEL_ID_RED, red, fade_period_ms);
-        LIGHT_ERROR_CHECK(ret < 0, ret, "iot_led_set_channel, ret: %d", ret);
+        /* One period for the three channels, they reach the new brightness together */
+        uint8_t channel_value[LIGHT_CHANNEL_NUM] = {
+            [CHANNEL_ID_RED]   = red,
+            [CHANNEL_ID_GREEN] = green,
+            [CHANNEL_ID_BLUE]  = blue,
+        };
 
-        ret = iot_led_set_channel(CHANNEL_ID_GREEN, green, fade_period_ms);
-        LIGHT_ERROR_CHECK(ret < 0, ret, "iot_led_set_channel, ret: %d", ret);
-
-        ret = iot_led_set_channel(CHANNEL_ID_BLUE, blue, fade_period_ms);
-        LIGHT_ERROR_CHECK(ret < 0, ret, "iot_led_set_channel, ret: %d", ret);
+        ret = light_channel_fade(LIGHT_CHANNEL_RGB, channel_value, fade_period_ms);
+        LIGHT_ERROR_CHECK(ret < 0, ret, "light_channel_fade, ret: %d", ret);
 
     } else if (g_light_status.mode == MODE_CTB) {
         uint8_t warm_tmp = 0;
@@ -703,19 +655,19 @@ esp_err_t light_driver_fade_brightness(uint8_t brightness)
         fade_period_ms = LIGHT_FADE_PERIOD_MAX_MS * g_light_status.brightness / 100;
 
         if (brightness != 0) {
-            uint8_t change_value = brightness - g_light_status.brightness;
+            uint8_t change_value = abs(brightness - g_light_status.brightness);
             warm_tmp = g_light_status.color_temperature;
             cold_tmp = (brightness - g_light_status.color_temperature);
             fade_period_ms = LIGHT_FADE_PERIOD_MAX_MS * change_value / 100;
         }
 
-        ret = iot_led_set_channel(CHANNEL_ID_COLD,
-                                  cold_tmp * 255 / 100, fade_period_ms);
-        LIGHT_ERROR_CHECK(ret < 0, ret, "iot_led_set_channel, ret: %d", ret);
+        uint8_t channel_value[LIGHT_CHANNEL_NUM] = {
+            [CHANNEL_ID_WARM] = warm_tmp * 255 / 100,
+            [CHANNEL_ID_COLD] = cold_tmp * 255 / 100,
+        };
 
-        ret = iot_led_set_channel(CHANNEL_ID_WARM,
-                                  warm_tmp * 255 / 100, fade_period_ms);
-        LIGHT_ERROR_CHECK(ret < 0, ret, "iot_led_set_channel, ret: %d", ret);
+        ret = light_channel_fade(LIGHT_CHANNEL_CW, channel_value, fade_period_ms);
+        LIGHT_ERROR_CHECK(ret < 0, ret, "light_channel_fade, ret: %d", ret);
 
         g_light_status.brightness = brightness;
     }
@@ -760,9 +712,13 @@ static void light_fade_timer_cb(TimerHandle_t timer)
 
     light_driver_hsv2rgb(g_light_status.hue, g_light_status.saturation, g_light_status.value, &red, &green, &blue);
 
-    iot_led_set_channel(CHANNEL_ID_RED, red, fade_period_ms);
-    iot_led_set_channel(CHANNEL_ID_GREEN, green, fade_period_ms);
-    iot_led_set_channel(CHANNEL_ID_BLUE, blue, fade_period_ms);
+    uint8_t channel_value[LIGHT_CHANNEL_NUM] = {
+        [CHANNEL_ID_RED]   = red,
+        [CHANNEL_ID_GREEN] = green,
+        [CHANNEL_ID_BLUE]  = blue,
+    };
+
+    light_channel_fade(LIGHT_CHANNEL_RGB, channel_value, fade_period_ms);
 }
 
 esp_err_t light_driver_fade_hue(uint16_t hue)
@@ -774,11 +730,10 @@ esp_err_t light_driver_fade_hue(uint16_t hue)
     light_fade_timer_stop();
 
     if (g_light_status.mode != MODE_HSV) {
-        ret = iot_led_set_channel(CHANNEL_ID_WARM, 0, 0);
-        LIGHT_ERROR_CHECK(ret < 0, ret, "iot_led_set_channel, ret: %d", ret);
+        const uint8_t channel_value[LIGHT_CHANNEL_NUM] = {0};
 
-        ret = iot_led_set_channel(CHANNEL_ID_COLD, 0, 0);
-        LIGHT_ERROR_CHECK(ret < 0, ret, "iot_led_set_channel, ret: %d", ret);
+        ret = light_channel_fade(LIGHT_CHANNEL_CW, channel_value, 0);
+        LIGHT_ERROR_CHECK(ret < 0, ret, "light_channel_fade, ret: %d", ret);
     }
 
     g_light_status.mode     = MODE_HSV;
@@ -800,24 +755,21 @@ esp_err_t light_driver_fade_warm(uint8_t color_temperature)
     g_fade_mode   = MODE_CTB;
 
     if (g_light_status.mode != MODE_CTB) {
-        ret = iot_led_set_channel(CHANNEL_ID_RED, 0, g_light_status.fade_period_ms);
-        LIGHT_ERROR_CHECK(ret < 0, ret, "iot_led_set_channel, ret: %d", ret);
+        const uint8_t rgb_value[LIGHT_CHANNEL_NUM] = {0};
 
-        ret = iot_led_set_channel(CHANNEL_ID_GREEN, 0, g_light_status.fade_period_ms);
-        LIGHT_ERROR_CHECK(ret < 0, ret, "iot_led_set_channel, ret: %d", ret);
-
-        ret = iot_led_set_channel(CHANNEL_ID_BLUE, 0, g_light_status.fade_period_ms);
-        LIGHT_ERROR_CHECK(ret < 0, ret, "iot_led_set_channel, ret: %d", ret);
+        ret = light_channel_fade(LIGHT_CHANNEL_RGB, rgb_value, g_light_status.fade_period_ms);
+        LIGHT_ERROR_CHECK(ret < 0, ret, "light_channel_fade, ret: %d", ret);
     }
 
     uint8_t warm_tmp =  color_temperature * g_light_status.brightness / 100;
     uint8_t cold_tmp = (100 - color_temperature) * g_light_status.brightness / 100;
+    uint8_t channel_value[LIGHT_CHANNEL_NUM] = {
+        [CHANNEL_ID_WARM] = warm_tmp * 255 / 100,
+        [CHANNEL_ID_COLD] = cold_tmp * 255 / 100,
+    };
 
-    ret = iot_led_set_channel(CHANNEL_ID_COLD, cold_tmp * 255 / 100, LIGHT_FADE_PERIOD_MAX_MS);
-    LIGHT_ERROR_CHECK(ret < 0, ret, "iot_led_set_channel, ret: %d", ret);
-
-    ret = iot_led_set_channel(CHANNEL_ID_WARM, warm_tmp * 255 / 100, LIGHT_FADE_PERIOD_MAX_MS);
-    LIGHT_ERROR_CHECK(ret < 0, ret, "iot_led_set_channel, ret: %d", ret);
+    ret = light_channel_fade(LIGHT_CHANNEL_CW, channel_value, LIGHT_FADE_PERIOD_MAX_MS);
+    LIGHT_ERROR_CHECK(ret < 0, ret, "light_channel_fade, ret: %d", ret);
 
     g_light_status.mode              = MODE_CTB;
     g_light_status.color_temperature = color_temperature;
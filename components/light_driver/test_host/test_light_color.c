@@ -0,0 +1,272 @@
+// Copyright 2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "light_color.h"
+
+/* The kernels round 16-bit fractions to 8 bits, the table rounding adds a little */
+#define MAX_ERROR_LSB   0.55
+#define BENCH_ROUNDS    50
+
+static int g_failures = 0;
+
+#define TEST_ASSERT(cond) do { \
+        if (!(cond)) { \
+            printf("%s:%d: %s failed\n", __FILE__, __LINE__, #cond); \
+            g_failures++; \
+        } \
+    } while (0)
+
+typedef void (*color_kernel_t)(uint16_t hue, uint8_t saturation, uint8_t level,
+                               uint8_t *red, uint8_t *green, uint8_t *blue);
+
+/**
+ * @brief The float conversion the kernels replaced, outputs in (0 .. 255) not rounded
+ */
+static void ref_hsv2rgb_frac(double hue, double s, double v, double rgb[3])
+{
+    double h = fmod(hue, 360) / 60.0;
+    int    i = (int)h;
+    double f = h - i;
+    double p = v * (1 - s);
+    double q = v * (1 - s * f);
+    double t = v * (1 - s * (1 - f));
+
+    switch (i) {
+        case 0: rgb[0] = v; rgb[1] = t; rgb[2] = p; break;
+        case 1: rgb[0] = q; rgb[1] = v; rgb[2] = p; break;
+        case 2: rgb[0] = p; rgb[1] = v; rgb[2] = t; break;
+        case 3: rgb[0] = p; rgb[1] = q; rgb[2] = v; break;
+        case 4: rgb[0] = t; rgb[1] = p; rgb[2] = v; break;
+        default: rgb[0] = v; rgb[1] = p; rgb[2] = q; break;
+    }
+
+    for (int j = 0; j < 3; ++j) {
+        rgb[j] *= 255;
+    }
+}
+
+static void ref_hsv2rgb(uint16_t hue, uint8_t saturation, uint8_t value, double rgb[3])
+{
+    ref_hsv2rgb_frac(hue, saturation / 100.0, value / 100.0, rgb);
+}
+
+static void ref_hsl2rgb(uint16_t hue, uint8_t saturation, uint8_t lightness, double rgb[3])
+{
+    double h = (hue % 360) / 60.0;
+    double s = saturation / 100.0;
+    double l = lightness / 100.0;
+    double c = (1 - fabs(2 * l - 1)) * s;
+    double x = c * (1 - fabs(fmod(h, 2) - 1));
+    double m = l - c / 2;
+
+    switch ((int)h) {
+        case 0: rgb[0] = c; rgb[1] = x; rgb[2] = 0; break;
+        case 1: rgb[0] = x; rgb[1] = c; rgb[2] = 0; break;
+        case 2: rgb[0] = 0; rgb[1] = c; rgb[2] = x; break;
+        case 3: rgb[0] = 0; rgb[1] = x; rgb[2] = c; break;
+        case 4: rgb[0] = x; rgb[1] = 0; rgb[2] = c; break;
+        default: rgb[0] = c; rgb[1] = 0; rgb[2] = x; break;
+    }
+
+    for (int j = 0; j < 3; ++j) {
+        rgb[j] = (rgb[j] + m) * 255;
+    }
+}
+
+/**
+ * @brief Largest distance from the float reference over every hue, saturation and level
+ */
+static double max_error(color_kernel_t kernel, void (*ref)(uint16_t, uint8_t, uint8_t, double *))
+{
+    double max = 0;
+
+    for (uint16_t h = 0; h <= 360; ++h) {
+        for (uint8_t s = 0; s <= 100; ++s) {
+            for (uint8_t l = 0; l <= 100; ++l) {
+                uint8_t rgb[3];
+                double  expect[3];
+
+                kernel(h, s, l, &rgb[0], &rgb[1], &rgb[2]);
+                ref(h, s, l, expect);
+
+                for (int j = 0; j < 3; ++j) {
+                    max = fmax(max, fabs(rgb[j] - expect[j]));
+                }
+            }
+        }
+    }
+
+    return max;
+}
+
+static void test_hsv2rgb(void)
+{
+    uint8_t r, g, b;
+    double  error = max_error(light_color_hsv2rgb, ref_hsv2rgb);
+
+    printf("hsv2rgb max error %.3f LSB\n", error);
+    TEST_ASSERT(error <= MAX_ERROR_LSB);
+
+    /* The primaries and the extremes are exact */
+    light_color_hsv2rgb(0, 100, 100, &r, &g, &b);
+    TEST_ASSERT(r == 255 && g == 0 && b == 0);
+    light_color_hsv2rgb(120, 100, 100, &r, &g, &b);
+    TEST_ASSERT(r == 0 && g == 255 && b == 0);
+    light_color_hsv2rgb(240, 100, 100, &r, &g, &b);
+    TEST_ASSERT(r == 0 && g == 0 && b == 255);
+    light_color_hsv2rgb(360, 100, 100, &r, &g, &b);
+    TEST_ASSERT(r == 255 && g == 0 && b == 0);
+    light_color_hsv2rgb(200, 0, 100, &r, &g, &b);
+    TEST_ASSERT(r == 255 && g == 255 && b == 255);
+    light_color_hsv2rgb(200, 100, 0, &r, &g, &b);
+    TEST_ASSERT(r == 0 && g == 0 && b == 0);
+}
+
+/**
+ * @brief The 16-bit inputs of a fade, on a grid that does not fall on whole percents
+ */
+static void test_hsv2rgb_u16(void)
+{
+    uint8_t r, g, b;
+    double  error = 0;
+
+    for (uint32_t h = 0; h <= UINT16_MAX; h += 97) {
+        for (uint32_t s = 0; s <= UINT16_MAX; s += 1283) {
+            for (uint32_t v = 0; v <= UINT16_MAX; v += 1283) {
+                double expect[3];
+
+                light_color_hsv2rgb_u16(h, s, v, &r, &g, &b);
+                ref_hsv2rgb_frac(h * 360.0 / 65536, s / 65535.0, v / 65535.0, expect);
+
+                error = fmax(error, fabs(r - expect[0]));
+                error = fmax(error, fabs(g - expect[1]));
+                error = fmax(error, fabs(b - expect[2]));
+            }
+        }
+    }
+
+    printf("hsv2rgb_u16 max error %.3f LSB\n", error);
+    TEST_ASSERT(error <= MAX_ERROR_LSB);
+
+    light_color_hsv2rgb_u16(0, UINT16_MAX, UINT16_MAX, &r, &g, &b);
+    TEST_ASSERT(r == 255 && g == 0 && b == 0);
+    light_color_hsv2rgb_u16(0x5555, UINT16_MAX, UINT16_MAX, &r, &g, &b);
+    TEST_ASSERT(r == 0 && g == 255 && b == 0);
+    light_color_hsv2rgb_u16(0xAAAB, UINT16_MAX, UINT16_MAX, &r, &g, &b);
+    TEST_ASSERT(r == 0 && g == 0 && b == 255);
+    light_color_hsv2rgb_u16(UINT16_MAX, UINT16_MAX, UINT16_MAX, &r, &g, &b);
+    TEST_ASSERT(r == 255 && g == 0 && b == 0);
+    light_color_hsv2rgb_u16(0x8000, 0, UINT16_MAX, &r, &g, &b);
+    TEST_ASSERT(r == 255 && g == 255 && b == 255);
+
+    /* One percent of value is 655 steps, the duty follows well inside them */
+    light_color_hsv2rgb_u16(0, UINT16_MAX, 257, &r, &g, &b);
+    TEST_ASSERT(r == 1 && g == 0 && b == 0);
+}
+
+static void test_hsl2rgb(void)
+{
+    uint8_t r, g, b;
+    double  error = max_error(light_color_hsl2rgb, ref_hsl2rgb);
+
+    printf("hsl2rgb max error %.3f LSB\n", error);
+    TEST_ASSERT(error <= MAX_ERROR_LSB);
+
+    light_color_hsl2rgb(0, 100, 50, &r, &g, &b);
+    TEST_ASSERT(r == 255 && g == 0 && b == 0);
+    light_color_hsl2rgb(120, 100, 50, &r, &g, &b);
+    TEST_ASSERT(r == 0 && g == 255 && b == 0);
+    light_color_hsl2rgb(240, 100, 50, &r, &g, &b);
+    TEST_ASSERT(r == 0 && g == 0 && b == 255);
+    light_color_hsl2rgb(200, 100, 100, &r, &g, &b);
+    TEST_ASSERT(r == 255 && g == 255 && b == 255);
+    light_color_hsl2rgb(200, 100, 0, &r, &g, &b);
+    TEST_ASSERT(r == 0 && g == 0 && b == 0);
+}
+
+/**
+ * @brief Round the float reference the way the driver used to, for the benchmark
+ */
+#define REF_KERNEL(name, ref) \
+    static void name(uint16_t hue, uint8_t saturation, uint8_t level, \
+                     uint8_t *red, uint8_t *green, uint8_t *blue) \
+    { \
+        double rgb[3]; \
+        ref(hue, saturation, level, rgb); \
+        *red   = (uint8_t)lround(rgb[0]); \
+        *green = (uint8_t)lround(rgb[1]); \
+        *blue  = (uint8_t)lround(rgb[2]); \
+    }
+
+REF_KERNEL(float_hsv2rgb, ref_hsv2rgb)
+REF_KERNEL(float_hsl2rgb, ref_hsl2rgb)
+
+static double bench_ns(color_kernel_t kernel)
+{
+    volatile uint32_t sink  = 0;
+    uint32_t          count = 0;
+    struct timespec   start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (int round = 0; round < BENCH_ROUNDS; ++round) {
+        for (uint16_t h = 0; h <= 360; ++h) {
+            for (uint8_t s = 0; s <= 100; ++s) {
+                for (uint8_t l = 0; l <= 100; ++l) {
+                    uint8_t r, g, b;
+
+                    kernel(h, s, l, &r, &g, &b);
+                    sink += r + g + b;
+                    count++;
+                }
+            }
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    (void)sink;
+
+    return ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / count;
+}
+
+static void bench(void)
+{
+    printf("hsv2rgb: %.2f ns/color, float %.2f ns/color\n", bench_ns(light_color_hsv2rgb), bench_ns(float_hsv2rgb));
+    printf("hsl2rgb: %.2f ns/color, float %.2f ns/color\n", bench_ns(light_color_hsl2rgb), bench_ns(float_hsl2rgb));
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1 && !strcmp(argv[1], "bench")) {
+        bench();
+        return 0;
+    }
+
+    test_hsv2rgb();
+    test_hsv2rgb_u16();
+    test_hsl2rgb();
+
+    if (g_failures) {
+        printf("%d check(s) failed\n", g_failures);
+        return 1;
+    }
+
+    printf("All checks passed\n");
+    return 0;
+}
@@ -15,7 +15,13 @@
 #ifndef __MLINK_SNIFFER_H__
 #define __MLINK_SNIFFER_H__
 
-#include "mdf_common.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "sdkconfig.h"
+#include "esp_err.h"
+#include "esp_event.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -53,24 +59,62 @@ typedef struct {
     uint8_t data[0]; /**< The contents of the packet, where the fields are in ltv format */
 } __attribute__((packed)) mlink_sniffer_data_t;
 
+#define MLINK_SNIFFER_DEVICE_MAX    128 /**< Capacity of the device table, the upper bound of `buffer_num` */
+
+/**
+ * @brief Events posted to the default event loop
+ */
+ESP_EVENT_DECLARE_BASE(MLINK_SNIFFER_EVENT);
+
+typedef enum {
+    MLINK_SNIFFER_EVENT_BUFFER_FULL,    /**< The table holds more than `notice_percentage` of `buffer_num` devices */
+} mlink_sniffer_event_t;
+
 /**
  * @brief Sniffer configuration
  */
 typedef struct {
     sniffer_type_t enable_type; /**< Enable wireless packet type for listening */
-    size_t buffer_num;          /**< Buffer space size */
-    uint8_t notice_percentage;  /**< When the proportion of the buffer space is exceeded, send a UDP notification APP to get */
+    size_t buffer_num;          /**< Buffer space size, (1 .. MLINK_SNIFFER_DEVICE_MAX) devices */
+    uint8_t notice_percentage;  /**< When the proportion of the buffer space is exceeded, post MLINK_SNIFFER_EVENT_BUFFER_FULL */
     bool esp_filter;            /**< Filter the espressif module to eliminate its own interference */
-    uint16_t ble_scan_interval; /**< BLE scan interval */
-    uint16_t ble_scan_window;   /**< BLE time per scan */
+    uint16_t ble_scan_interval; /**< BLE scan interval, in milliseconds */
+    uint16_t ble_scan_window;   /**< BLE time per scan, in milliseconds */
 } mlink_sniffer_config_t;
 
+#define MLINK_SNIFFER_CHANNEL_MAX   14
+
+/**
+ * @brief Channel hopping configuration
+ *
+ *        The time spent on each channel is adapted between `min_dwell_ms` and
+ *        `max_dwell_ms` according to the rate of probe requests seen there.
+ */
+typedef struct {
+    uint8_t channel_num;                            /**< Number of channels in `channel` */
+    uint8_t channel[MLINK_SNIFFER_CHANNEL_MAX];     /**< Channels to visit, in order */
+    uint16_t min_dwell_ms;                          /**< Dwell time of a channel without traffic */
+    uint16_t max_dwell_ms;                          /**< Dwell time of the busiest channel */
+} mlink_sniffer_hop_config_t;
+
+/**
+ * @brief Per-channel counters
+ */
+typedef struct {
+    uint8_t channel;
+    uint32_t packets;           /**< Frames received on this channel */
+    uint32_t probes;            /**< Probe requests captured on this channel */
+    uint32_t visits;            /**< Times the scheduler switched to this channel */
+    uint32_t dwell_ms;          /**< Total time spent on this channel */
+    uint16_t next_dwell_ms;     /**< Dwell time of the next visit */
+} mlink_sniffer_channel_stats_t;
+
 /**
  * @brief Start Wi-Fi scanning
  *
  * @return
- *    - MDF_OK
- *    - MDF_FAIL
+ *    - ESP_OK
+ *    - ESP_FAIL
  */
 esp_err_t mlink_sniffer_wifi_start();
 
@@ -78,18 +122,56 @@ esp_err_t mlink_sniffer_wifi_start();
  * @brief Stop Wi-Fi scanning
  *
  * @return
- *    - MDF_OK
- *    - MDF_FAIL
+ *    - ESP_OK
+ *    - ESP_FAIL
  */
 esp_err_t mlink_sniffer_wifi_stop();
 
-#ifdef CONFIG_IDF_TARGET_ESP32
+/**
+ * @brief Start hopping over the configured channels
+ *
+ * @note  While the SoftAP has stations connected or the station is connected to a router,
+ *        the radio stays on that channel and hopping resumes once it is free again.
+ *
+ * @param config Channels and dwell times
+ *
+ * @return
+ *    - ESP_OK
+ *    - ESP_ERR_INVALID_ARG
+ *    - ESP_FAIL
+ */
+esp_err_t mlink_sniffer_hop_start(const mlink_sniffer_hop_config_t *config);
+
+/**
+ * @brief Stop channel hopping and return to the channel used before it started
+ *
+ * @return
+ *    - ESP_OK
+ */
+esp_err_t mlink_sniffer_hop_stop();
+
+/**
+ * @brief Get the per-channel counters
+ *
+ * @param stats Array to fill
+ * @param num   In: capacity of `stats`; out: number of channels written
+ *
+ * @return
+ *    - ESP_OK
+ */
+esp_err_t mlink_sniffer_get_channel_stats(mlink_sniffer_channel_stats_t *stats, size_t *num);
+
+#ifdef CONFIG_BT_BLUEDROID_ENABLED
 /**
  * @brief Start BLE scanning
  *
+ * @note  The controller and Bluedroid must be enabled. This registers the GAP callback
+ *        of the application, so it cannot be used while another module scans or
+ *        advertises through the GAP API.
+ *
  * @return
- *    - MDF_OK
- *    - MDF_FAIL
+ *    - ESP_OK
+ *    - ESP_FAIL
  */
 esp_err_t mlink_sniffer_ble_start();
 
@@ -97,8 +179,8 @@ esp_err_t mlink_sniffer_ble_start();
  * @brief Stop BLE scanning
  *
  * @return
- *    - MDF_OK
- *    - MDF_FAIL
+ *    - ESP_OK
+ *    - ESP_FAIL
  */
 esp_err_t mlink_sniffer_ble_stop();
 
@@ -110,8 +192,8 @@ esp_err_t mlink_sniffer_ble_stop();
  * @param config The configuration of the sniffer
  *
  * @return
- *    - MDF_OK
- *    - MDF_FAIL
+ *    - ESP_OK
+ *    - ESP_ERR_INVALID_ARG `buffer_num` is 0 or above MLINK_SNIFFER_DEVICE_MAX
  */
 esp_err_t mlink_sniffer_set_config(const mlink_sniffer_config_t *config);
 
@@ -121,8 +203,8 @@ esp_err_t mlink_sniffer_set_config(const mlink_sniffer_config_t *config);
  * @param config The configuration of the sniffer
  *
  * @return
- *    - MDF_OK
- *    - MDF_FAIL
+ *    - ESP_OK
+ *    - ESP_FAIL
  */
 esp_err_t mlink_sniffer_get_config(mlink_sniffer_config_t *config);
 
@@ -144,26 +226,44 @@ esp_err_t mlink_sniffer_get_config(mlink_sniffer_config_t *config);
  * @param size The size of data
  *
  * @return
- *    - MDF_OK
- *    - MDF_FAIL
+ *    - ESP_OK
+ *    - ESP_FAIL
  */
 esp_err_t mlink_sniffer_data(uint8_t **data, size_t *size);
 
+/**
+ * @brief Export the devices in the binary format described in sniffer_export.h
+ *
+ *        Unlike mlink_sniffer_data(), the devices are kept. Passing the `sequence`
+ *        of the previous export as `since` returns only the devices seen after it.
+ *        Sequence numbers restart with the `epoch` of the header, a `since` ahead of
+ *        the current sequence gets a full export, see mlink_sniffer_export_need_resync().
+ *
+ * @param since Sequence number of the previous export, 0 for all devices
+ * @param data  Export data, to be freed by the caller
+ * @param size  The size of data
+ *
+ * @return
+ *    - ESP_OK
+ *    - ESP_ERR_NO_MEM
+ */
+esp_err_t mlink_sniffer_export(uint32_t since, uint8_t **data, size_t *size);
+
 /**
  * @brief Initialize sniffer
  *
  * @return
- *    - MDF_OK
- *    - MDF_FAIL
+ *    - ESP_OK
+ *    - ESP_FAIL
  */
 esp_err_t mlink_sniffer_init();
 
 /**
- * @brief De-initialize sniffer
+ * @brief De-initialize sniffer, stops the Wi-Fi capture and waits for the aggregation task to exit
  *
  * @return
- *    - MDF_OK
- *    - MDF_FAIL
+ *    - ESP_OK
+ *    - ESP_FAIL
  */
 esp_err_t mlink_sniffer_deinit();
 
@@ -0,0 +1,122 @@
+// Copyright 2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef __MLINK_SNIFFER_EXPORT_H__
+#define __MLINK_SNIFFER_EXPORT_H__
+
+/**
+ * Binary export format of the sniffer, all fields little endian:
+ *
+ *   [ header (20 bytes) | record (record_size bytes) * record_num ]
+ *
+ * Newer versions may only append fields to the header and the records, so a
+ * decoder reads `header_size` and `record_size` from the data instead of assuming them.
+ * This header has no ESP-IDF dependency so collectors can build the decoder too.
+ *
+ * A collector keeps the devices of a full export (`since` 0) and applies the
+ * delta exports requested with the `sequence` of the previous one. Sequence
+ * numbers are only meaningful within one `epoch`: the device picks a new one
+ * whenever its table starts over, at boot or when the devices are taken with
+ * mlink_sniffer_data(). mlink_sniffer_export_need_resync() tells a collector when
+ * to drop its devices and request a full export again.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /*!< _cplusplus */
+
+#define MLINK_SNIFFER_EXPORT_MAGIC          0x534E  /**< "NS" when read as bytes */
+#define MLINK_SNIFFER_EXPORT_VERSION        2
+#define MLINK_SNIFFER_EXPORT_HEADER_SIZE    20
+#define MLINK_SNIFFER_EXPORT_HEADER_MIN_SIZE 16     /**< Version 1 header, without `epoch` */
+#define MLINK_SNIFFER_EXPORT_RECORD_SIZE    16
+
+/**
+ * @brief Export header
+ */
+typedef struct {
+    uint16_t magic;         /**< MLINK_SNIFFER_EXPORT_MAGIC */
+    uint8_t version;        /**< MLINK_SNIFFER_EXPORT_VERSION */
+    uint8_t header_size;    /**< Size of the encoded header */
+    uint8_t record_size;    /**< Size of each encoded record */
+    uint8_t reserved;
+    uint16_t record_num;    /**< Number of records following the header */
+    uint32_t since;         /**< Sequence number the export was requested from, 0 for a full export */
+    uint32_t sequence;      /**< Sequence number of the latest change, pass it as `since` next time */
+    uint32_t epoch;         /**< Random id of the device table the sequence numbers belong to, 0 if unknown (version 1) */
+} mlink_sniffer_export_header_t;
+
+/**
+ * @brief One device
+ */
+typedef struct {
+    uint8_t addr[6];
+    uint8_t type;           /**< MLINK_SNIFFER_WIFI or MLINK_SNIFFER_BLE */
+    int8_t rssi;
+    uint8_t channel;        /**< 0 if unknown */
+    uint8_t reserved[3];
+    uint32_t age_ms;        /**< Time since the device was last seen, when the export was made */
+} mlink_sniffer_export_record_t;
+
+/**
+ * @brief Encode the header at the start of `data`, MLINK_SNIFFER_EXPORT_HEADER_SIZE bytes
+ */
+void mlink_sniffer_export_encode_header(uint8_t *data, const mlink_sniffer_export_header_t *header);
+
+/**
+ * @brief Encode a record at `data`, MLINK_SNIFFER_EXPORT_RECORD_SIZE bytes
+ */
+void mlink_sniffer_export_encode_record(uint8_t *data, const mlink_sniffer_export_record_t *record);
+
+/**
+ * @brief Check and decode the header of an export
+ *
+ * @param data   Export data
+ * @param size   Size of data
+ * @param header Decoded header
+ *
+ * @return true if the data holds a complete export of a version this decoder understands
+ */
+bool mlink_sniffer_export_decode_header(const uint8_t *data, size_t size, mlink_sniffer_export_header_t *header);
+
+/**
+ * @brief Check whether a collector has to start over from a full export
+ *
+ * @param header Decoded header of the latest export
+ * @param epoch  `epoch` of the exports the collector's devices were built from
+ *
+ * @return true if the device table was started over since, the collector then drops
+ *         its devices and requests a full export with `since` 0. A full export
+ *         never needs a resync, it replaces the collector's devices.
+ */
+bool mlink_sniffer_export_need_resync(const mlink_sniffer_export_header_t *header, uint32_t epoch);
+
+/**
+ * @brief Decode record `index` of an export whose header has been checked
+ *        with mlink_sniffer_export_decode_header()
+ *
+ * @return false if `index` is out of range
+ */
+bool mlink_sniffer_export_decode_record(const uint8_t *data, const mlink_sniffer_export_header_t *header,
+                                        uint16_t index, mlink_sniffer_export_record_t *record);
+
+#ifdef __cplusplus
+}
+#endif /*!< _cplusplus */
+
+#endif /*!< __MLINK_SNIFFER_EXPORT_H__ */
@@ -12,9 +12,23 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <sys/param.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
 #include "esp_wifi.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "esp_utils.h"
 
-#include "mlink.h"
+#include "sniffer.h"
+#include "sniffer_export.h"
+#include "sniffer_hop.h"
 
 /**
  * @brief Wi-Fi packet format
@@ -27,17 +41,90 @@ typedef struct {
     uint8_t payload[0];
 } sniffer_payload_t;
 
-typedef struct sniffer_data_list {
-    struct sniffer_data_list *next;
-    mlink_sniffer_data_t data;
-} __attribute__((packed)) sniffer_data_list_t;
+#define sniffer_timestamp() (xTaskGetTickCount() * portTICK_PERIOD_MS)
 
-#define sniffer_timestamp() (xTaskGetTickCount() * portTICK_RATE_MS)
+#define MLINK_SNIFFER_HASH_SIZE         (MLINK_SNIFFER_DEVICE_MAX * 2)  /**< Keep the load factor at or below 0.5 */
+#define MLINK_SNIFFER_HASH_MASK         (MLINK_SNIFFER_HASH_SIZE - 1)
+#define MLINK_SNIFFER_INDEX_NONE        0xFFFF
+#define MLINK_SNIFFER_EXTRA_MAX_LEN     32                              /**< BLE name and manufacturer, in ltv format */
+
+#define MLINK_SNIFFER_RING_SIZE         256                             /**< Must be a power of two */
+#define MLINK_SNIFFER_RING_MASK         (MLINK_SNIFFER_RING_SIZE - 1)
+#define MLINK_SNIFFER_AGGREGATE_INTERVAL_MS  100
+#define MLINK_SNIFFER_AGGREGATE_TASK_STACK   3072
+#define MLINK_SNIFFER_AGGREGATE_TASK_PRIO    (tskIDLE_PRIORITY + 4)
+
+/**
+ * @brief Device table, one entry per address, in struct-of-arrays layout
+ *
+ *        `slot` is an open-addressing (linear probing) index keyed by address that
+ *        holds entry numbers. Entries in use are also linked in LRU order, most
+ *        recently seen first, so that the oldest one is evicted when the table is full.
+ */
+typedef struct {
+    uint16_t slot[MLINK_SNIFFER_HASH_SIZE];
+    uint8_t addr[MLINK_SNIFFER_DEVICE_MAX][6];
+    uint32_t timestamp[MLINK_SNIFFER_DEVICE_MAX];
+    uint32_t sequence[MLINK_SNIFFER_DEVICE_MAX];    /**< Value of `g_sniffer_sequence` at the last update */
+    int8_t rssi[MLINK_SNIFFER_DEVICE_MAX];
+    uint8_t channel[MLINK_SNIFFER_DEVICE_MAX];
+    uint8_t type[MLINK_SNIFFER_DEVICE_MAX];
+#ifdef CONFIG_BT_BLUEDROID_ENABLED
+    uint8_t extra_len[MLINK_SNIFFER_DEVICE_MAX];
+    uint8_t extra[MLINK_SNIFFER_DEVICE_MAX][MLINK_SNIFFER_EXTRA_MAX_LEN];
+#endif
+    uint16_t lru_prev[MLINK_SNIFFER_DEVICE_MAX];
+    uint16_t lru_next[MLINK_SNIFFER_DEVICE_MAX];
+    uint16_t lru_head;      /**< Most recently seen entry */
+    uint16_t lru_tail;      /**< Least recently seen entry, evicted first */
+    uint16_t free_head;     /**< Unused entries, chained through lru_next */
+} sniffer_table_t;
+
+/**
+ * @brief Capture record passed from the promiscuous callback to the aggregation task
+ */
+typedef struct {
+    uint8_t addr[6];
+    int8_t rssi;
+    uint8_t channel;
+    uint32_t timestamp;
+    uint8_t type;
+    uint8_t reserved[3];
+} sniffer_record_t;
+
+_Static_assert(sizeof(sniffer_record_t) == 16, "sniffer_record_t must stay 16 bytes");
+
+typedef struct {
+    sniffer_record_t record[MLINK_SNIFFER_RING_SIZE];
+    uint32_t head;          /**< Written by the producer only */
+    uint32_t tail;          /**< Written by the consumer only */
+    uint32_t dropped;       /**< Records lost because the ring was full */
+} sniffer_ring_t;
+
+ESP_EVENT_DEFINE_BASE(MLINK_SNIFFER_EVENT);
 
 static const char *TAG       = "mlink_sniffer";
-static void *g_sniffer_lock  = NULL;
+static SemaphoreHandle_t g_sniffer_lock = NULL;
 static uint32_t g_device_num = 0;
-static sniffer_data_list_t *g_sniffer_list = NULL;
+static uint32_t g_sniffer_sequence = 0;     /**< Bumped on every table update, never reset */
+static uint32_t g_sniffer_epoch    = 0;     /**< Random id of the table contents, renewed whenever they start over */
+static sniffer_table_t *g_sniffer_table = NULL;
+static sniffer_ring_t g_sniffer_ring    = {0};
+static TaskHandle_t g_sniffer_aggregate_task = NULL;
+static uint32_t g_sniffer_cb_active = 0;    /**< Promiscuous callbacks running, waited for by mlink_sniffer_deinit() */
+static SemaphoreHandle_t g_sniffer_aggregate_exit = NULL;  /**< Given by the aggregation task when it exits */
+
+static esp_timer_handle_t g_hop_timer = NULL;
+static SemaphoreHandle_t g_hop_lock = NULL;  /**< Serializes the timer callback with start and stop */
+static bool g_hop_running           = false;
+static mlink_sniffer_hop_config_t g_hop_config = {0};
+static uint8_t g_hop_index          = 0;
+static uint8_t g_hop_home_channel   = 0;    /**< Channel in use when hopping started */
+static uint8_t g_hop_channel        = 0;    /**< Channel currently being listened to */
+static int64_t g_hop_visit_start    = 0;
+static uint32_t g_hop_visit_probes  = 0;    /**< `probes` of the current channel when the visit started */
+static uint32_t g_hop_rate[MLINK_SNIFFER_CHANNEL_MAX + 1] = {0};
+static mlink_sniffer_channel_stats_t g_channel_stats[MLINK_SNIFFER_CHANNEL_MAX + 1] = {0};
 static mlink_sniffer_config_t g_sniffer_config   = {
     .enable_type       = MLINK_SNIFFER_NONE,
     .notice_percentage = 50,
@@ -47,11 +134,12 @@ static mlink_sniffer_config_t g_sniffer_config   = {
     .ble_scan_window   = 50,
 };
 
-static const uint8_t esp_module_addr[32][3] = {
-    {0x54, 0x5A, 0xA6}, {0x24, 0x0A, 0xC4}, {0xD8, 0xA0, 0x1D}, {0xEC, 0xFA, 0xBC},
-    {0xA0, 0x20, 0xA6}, {0x90, 0x97, 0xD5}, {0x18, 0xFE, 0x34}, {0x60, 0x01, 0x94},
-    {0x2C, 0x3A, 0xE8}, {0xA4, 0x7B, 0x9D}, {0xDC, 0x4F, 0x22}, {0x5C, 0xCF, 0x7F},
-    {0xAC, 0xD0, 0x74}, {0x30, 0xAE, 0xA4}, {0x24, 0xB2, 0xDE}, {0x68, 0xC6, 0x3A},
+/**
+ * @brief Espressif OUIs, sorted so they can be binary searched
+ */
+static const uint32_t esp_module_oui[] = {
+    0x18FE34, 0x240AC4, 0x24B2DE, 0x2C3AE8, 0x30AEA4, 0x545AA6, 0x5CCF7F, 0x600194,
+    0x68C63A, 0x9097D5, 0xA020A6, 0xA47B9D, 0xACD074, 0xD8A01D, 0xDC4F22, 0xECFABC,
 };
 
 static uint8_t ltv_data_insert(uint8_t *data, uint8_t type, uint8_t length, const void *value)
@@ -67,146 +155,330 @@ static uint8_t ltv_data_insert(uint8_t *data, uint8_t type, uint8_t length, cons
     return length + sizeof(length) + sizeof(type);
 }
 
-static uint8_t *ltv_data_get(const uint8_t *data, uint8_t type,
-                             uint8_t total_length, uint8_t *length)
+static bool sniffer_is_esp_module(const uint8_t *addr)
 {
-    uint8_t *value = (uint8_t *)data;
-
-    for (uint8_t tmp_len = *value++; tmp_len && (value - data <= total_length);
-            value += tmp_len - sizeof(tmp_len) /* skip the length of data */, tmp_len = *value++) {
-        if (*value++ == type) {
-            /* length doesn't include itself */
-            *length = tmp_len - sizeof(tmp_len); /* minus the length of type */
-            return value;
+    uint32_t oui = (addr[0] << 16) | (addr[1] << 8) | addr[2];
+    int low  = 0;
+    int high = sizeof(esp_module_oui) / sizeof(esp_module_oui[0]) - 1;
+
+    while (low <= high) {
+        int mid = (low + high) / 2;
+
+        if (esp_module_oui[mid] == oui) {
+            return true;
+        } else if (esp_module_oui[mid] < oui) {
+            low = mid + 1;
+        } else {
+            high = mid - 1;
         }
     }
 
-    *length = 0;
-    return NULL;
+    return false;
 }
 
-static esp_err_t mlink_sniffer_list_insert(const mlink_sniffer_data_t *sniffer_data)
+static inline uint16_t sniffer_addr_hash(const uint8_t *addr)
 {
-    sniffer_data_list_t *sniffer_node = NULL;
-    uint8_t addr_len                  = 0;
-    static int notice_percentage      = 0;
-    uint8_t *sniffer_data_addr        = ltv_data_get(sniffer_data->data, MLINK_SNIFFER_DATA_ADDR,
-                                        sniffer_data->size - 1, &addr_len);
+    /**< The last four bytes are the most random part of an address */
+    uint32_t key = (addr[2] << 24) | (addr[3] << 16) | (addr[4] << 8) | addr[5];
 
-    if (!g_sniffer_list) {
-        g_sniffer_list       = MDF_MALLOC(sizeof(sniffer_data_list_t));
-        g_sniffer_list->next = NULL;
+    return ((key ^ (addr[1] << 8) ^ addr[0]) * 2654435761U) >> 16 & MLINK_SNIFFER_HASH_MASK;
+}
+
+static void sniffer_table_reset(sniffer_table_t *table)
+{
+    memset(table->slot, 0, sizeof(table->slot));
+
+    for (uint16_t i = 0; i < MLINK_SNIFFER_DEVICE_MAX; ++i) {
+        table->lru_next[i] = (i + 1 < MLINK_SNIFFER_DEVICE_MAX) ? i + 1 : MLINK_SNIFFER_INDEX_NONE;
     }
 
-    if (!g_sniffer_lock) {
-        g_sniffer_lock  = xSemaphoreCreateMutex();
+    table->free_head = 0;
+    table->lru_head  = MLINK_SNIFFER_INDEX_NONE;
+    table->lru_tail  = MLINK_SNIFFER_INDEX_NONE;
+    g_device_num     = 0;
+
+    /**< Collectors holding devices of the previous contents have to start over, 0 means unknown to them */
+    do {
+        g_sniffer_epoch = esp_random();
+    } while (!g_sniffer_epoch);
+}
+
+/**
+ * @brief Find the slot holding `addr`, or the empty slot where it would be inserted
+ */
+static uint16_t sniffer_table_find_slot(const sniffer_table_t *table, const uint8_t *addr)
+{
+    uint16_t pos = sniffer_addr_hash(addr);
+
+    /**< The load factor is at most 0.5, so there is always an empty slot */
+    while (table->slot[pos] && memcmp(table->addr[table->slot[pos] - 1], addr, 6)) {
+        pos = (pos + 1) & MLINK_SNIFFER_HASH_MASK;
     }
 
-    xSemaphoreTake(g_sniffer_lock, portMAX_DELAY);
+    return pos;
+}
 
-    if (/* esp_get_free_heap_size() < 20 * 1024 || */ g_device_num > g_sniffer_config.buffer_num) {
-        g_device_num = 0;
+static void sniffer_lru_unlink(sniffer_table_t *table, uint16_t index)
+{
+    uint16_t prev = table->lru_prev[index];
+    uint16_t next = table->lru_next[index];
 
-        for (sniffer_node = g_sniffer_list->next; sniffer_node; sniffer_node = g_sniffer_list->next) {
-            g_sniffer_list->next = sniffer_node->next;
-            free(sniffer_node);
-        }
+    if (prev != MLINK_SNIFFER_INDEX_NONE) {
+        table->lru_next[prev] = next;
+    } else {
+        table->lru_head = next;
+    }
+
+    if (next != MLINK_SNIFFER_INDEX_NONE) {
+        table->lru_prev[next] = prev;
+    } else {
+        table->lru_tail = prev;
     }
+}
 
-    notice_percentage = (!g_device_num) ? g_sniffer_config.notice_percentage : notice_percentage;
+static void sniffer_lru_push_front(sniffer_table_t *table, uint16_t index)
+{
+    table->lru_prev[index] = MLINK_SNIFFER_INDEX_NONE;
+    table->lru_next[index] = table->lru_head;
 
-    if (notice_percentage && g_device_num > g_sniffer_config.buffer_num * notice_percentage / 100) {
-        mdf_event_loop_send(MDF_EVENT_MLINK_BUFFER_FULL, NULL);
-        IDF_LOGD(TAG, "sniffer notice percentage: %d%%, g_device_num: %d",
-                 notice_percentage, g_device_num);
-        notice_percentage += notice_percentage;
+    if (table->lru_head != MLINK_SNIFFER_INDEX_NONE) {
+        table->lru_prev[table->lru_head] = index;
+    } else {
+        table->lru_tail = index;
     }
 
+    table->lru_head = index;
+}
+
+/**
+ * @brief Remove an entry, shifting back the entries that probed past its slot
+ */
+static void sniffer_table_remove(sniffer_table_t *table, uint16_t index)
+{
+    uint16_t hole = sniffer_table_find_slot(table, table->addr[index]);
 
-    for (int i = 0; g_sniffer_config.esp_filter && i < 32; ++i) {
-        if (!memcmp(sniffer_data_addr, esp_module_addr[i], 3)) {
-            xSemaphoreGive(g_sniffer_lock);
-            return ESP_OK;
+    for (uint16_t pos = (hole + 1) & MLINK_SNIFFER_HASH_MASK; table->slot[pos];
+            pos = (pos + 1) & MLINK_SNIFFER_HASH_MASK) {
+        uint16_t home = sniffer_addr_hash(table->addr[table->slot[pos] - 1]);
+
+        /**< The entry may move into the hole only if its home slot is not in (hole, pos] */
+        if (((pos - home) & MLINK_SNIFFER_HASH_MASK) >= ((pos - hole) & MLINK_SNIFFER_HASH_MASK)) {
+            table->slot[hole] = table->slot[pos];
+            hole = pos;
         }
     }
 
-    for (sniffer_node = g_sniffer_list->next; sniffer_node; sniffer_node = sniffer_node->next) {
-        uint8_t *sniffer_node_addr = ltv_data_get(sniffer_node->data.data, MLINK_SNIFFER_DATA_ADDR,
-                                     sniffer_node->data.size - 1, &addr_len);
+    table->slot[hole] = 0;
 
-        if (!sniffer_node_addr) {
-            esp_log_buffer_hex(TAG, sniffer_node->data.data, sniffer_node->data.size);
-        }
+    sniffer_lru_unlink(table, index);
+    table->lru_next[index] = table->free_head;
+    table->free_head = index;
+    g_device_num--;
+}
 
-        MDF_ERROR_BREAK(!sniffer_node_addr, "ltv_data_get, ret: %p", sniffer_node_addr);
+static void mlink_sniffer_notice_check(void)
+{
+    static int notice_percentage = 0;
 
-        if (!memcmp(sniffer_node_addr, sniffer_data_addr, addr_len)) {
-            if (sniffer_node->data.size < sniffer_data->size) {
-                IDF_LOGD(TAG, "new broadcast packet data length changes");
-                sniffer_node = NULL;
-            }
+    notice_percentage = (g_device_num <= 1) ? g_sniffer_config.notice_percentage : notice_percentage;
 
-            break;
+    if (notice_percentage && g_device_num > g_sniffer_config.buffer_num * notice_percentage / 100) {
+        /**< Called with `g_sniffer_lock` held, so never wait for room in the event queue */
+        esp_event_post(MLINK_SNIFFER_EVENT, MLINK_SNIFFER_EVENT_BUFFER_FULL, NULL, 0, 0);
+        ESP_LOGD(TAG, "sniffer notice percentage: %d%%, g_device_num: %" PRIu32,
+                 notice_percentage, g_device_num);
+        notice_percentage += notice_percentage;
+    }
+}
+
+/**
+ * @brief Insert or refresh a device, `g_sniffer_lock` must be held
+ */
+static void sniffer_table_update_locked(uint8_t type, const uint8_t *addr, int8_t rssi, uint8_t channel,
+                                        uint32_t timestamp, const uint8_t *extra, uint8_t extra_len)
+{
+    sniffer_table_t *table = g_sniffer_table;
+    size_t capacity = g_sniffer_config.buffer_num;   /**< Checked by mlink_sniffer_set_config() */
+    uint16_t pos   = sniffer_table_find_slot(table, addr);
+    uint16_t index = table->slot[pos] ? table->slot[pos] - 1 : MLINK_SNIFFER_INDEX_NONE;
+
+    if (index != MLINK_SNIFFER_INDEX_NONE) {
+        sniffer_lru_unlink(table, index);
+    } else {
+        while (g_device_num >= capacity && table->lru_tail != MLINK_SNIFFER_INDEX_NONE) {
+            ESP_LOGD(TAG, "sniffer table full, evict " MACSTR, MAC2STR(table->addr[table->lru_tail]));
+            sniffer_table_remove(table, table->lru_tail);
+            /**< Removing shifts entries, the insert position has to be looked up again */
+            pos = sniffer_table_find_slot(table, addr);
         }
+
+        index = table->free_head;
+        table->free_head = table->lru_next[index];
+        table->slot[pos] = index + 1;
+        memcpy(table->addr[index], addr, 6);
+        g_device_num++;
+#ifdef CONFIG_BT_BLUEDROID_ENABLED
+        table->extra_len[index] = 0;
+#endif
+    }
+
+    table->type[index]      = type;
+    table->rssi[index]      = rssi;
+    table->channel[index]   = channel;
+    table->timestamp[index] = timestamp;
+    table->sequence[index]  = ++g_sniffer_sequence;
+
+#ifdef CONFIG_BT_BLUEDROID_ENABLED
+    /**< Like before, a packet carrying less data does not overwrite what is known */
+    if (extra_len >= table->extra_len[index]) {
+        table->extra_len[index] = extra_len;
+        memcpy(table->extra[index], extra, extra_len);
     }
+#endif
 
-    if (!sniffer_node) {
-        sniffer_node         = MDF_MALLOC(sizeof(sniffer_data_list_t) + sniffer_data->size);
-        sniffer_node->next   = g_sniffer_list->next;
-        g_sniffer_list->next = sniffer_node;
+    sniffer_lru_push_front(table, index);
+    mlink_sniffer_notice_check();
+}
+
+#ifdef CONFIG_BT_BLUEDROID_ENABLED
+static esp_err_t mlink_sniffer_table_update(uint8_t type, const uint8_t *addr, int8_t rssi, uint8_t channel,
+        uint32_t timestamp, const uint8_t *extra, uint8_t extra_len)
+{
+    if (g_sniffer_config.esp_filter && sniffer_is_esp_module(addr)) {
+        return ESP_OK;
     }
 
-    memcpy(&sniffer_node->data, sniffer_data, sniffer_data->size + sizeof(sniffer_data->size));
-    g_device_num++;
+    if (!g_sniffer_table) {
+        return ESP_ERR_INVALID_STATE;
+    }
 
+    xSemaphoreTake(g_sniffer_lock, portMAX_DELAY);
+    sniffer_table_update_locked(type, addr, rssi, channel, timestamp, extra, extra_len);
     xSemaphoreGive(g_sniffer_lock);
 
     return ESP_OK;
 }
+#endif /**< CONFIG_BT_BLUEDROID_ENABLED */
 
-static void sniffer_wifi_cb(void *recv_buf, wifi_promiscuous_pkt_type_t type)
+/**
+ * @brief Single producer, single consumer ring of capture records
+ *
+ *        The promiscuous callback is the only producer and the aggregation task the
+ *        only consumer, so each index is written by one side only and no lock is needed.
+ *        `head` and `tail` run freely and are reduced modulo the size when used.
+ */
+static bool sniffer_ring_push(const sniffer_record_t *record)
+{
+    uint32_t head = __atomic_load_n(&g_sniffer_ring.head, __ATOMIC_RELAXED);
+    uint32_t tail = __atomic_load_n(&g_sniffer_ring.tail, __ATOMIC_ACQUIRE);
+
+    if (head - tail >= MLINK_SNIFFER_RING_SIZE) {
+        g_sniffer_ring.dropped++;
+        return false;
+    }
+
+    g_sniffer_ring.record[head & MLINK_SNIFFER_RING_MASK] = *record;
+    __atomic_store_n(&g_sniffer_ring.head, head + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+static bool sniffer_ring_pop(sniffer_record_t *record)
 {
-    wifi_promiscuous_pkt_t *wifi_promiscuous_pkt = (wifi_promiscuous_pkt_t *)recv_buf;
-    sniffer_payload_t *sniffer_payload           = (sniffer_payload_t *)wifi_promiscuous_pkt->payload;
+    uint32_t tail = __atomic_load_n(&g_sniffer_ring.tail, __ATOMIC_RELAXED);
+    uint32_t head = __atomic_load_n(&g_sniffer_ring.head, __ATOMIC_ACQUIRE);
+
+    if (head == tail) {
+        return false;
+    }
+
+    *record = g_sniffer_ring.record[tail & MLINK_SNIFFER_RING_MASK];
+    __atomic_store_n(&g_sniffer_ring.tail, tail + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+static void sniffer_aggregate_task(void *arg)
+{
+    sniffer_record_t record = {0};
+
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(MLINK_SNIFFER_AGGREGATE_INTERVAL_MS));
+
+        /**< Cleared by mlink_sniffer_deinit(), the task leaves on its own so no notification targets a deleted task */
+        if (__atomic_load_n(&g_sniffer_aggregate_task, __ATOMIC_SEQ_CST) != xTaskGetCurrentTaskHandle()) {
+            break;
+        }
+
+        if (!sniffer_ring_pop(&record)) {
+            continue;
+        }
+
+        /**< Drain everything queued under one lock, the producer never waits for it */
+        xSemaphoreTake(g_sniffer_lock, portMAX_DELAY);
+
+        do {
+            if (!g_sniffer_config.esp_filter || !sniffer_is_esp_module(record.addr)) {
+                sniffer_table_update_locked(record.type, record.addr, record.rssi, record.channel,
+                                            record.timestamp, NULL, 0);
+            }
+        } while (sniffer_ring_pop(&record));
+
+        xSemaphoreGive(g_sniffer_lock);
+    }
+
+    xSemaphoreGive(g_sniffer_aggregate_exit);
+    vTaskDelete(NULL);
+}
+
+static void sniffer_wifi_capture(const wifi_promiscuous_pkt_t *wifi_promiscuous_pkt)
+{
+    const sniffer_payload_t *sniffer_payload = (const sniffer_payload_t *)wifi_promiscuous_pkt->payload;
+
+    uint8_t channel = wifi_promiscuous_pkt->rx_ctrl.channel;
+
+    if (channel <= MLINK_SNIFFER_CHANNEL_MAX) {
+        g_channel_stats[channel].packets++;
+    }
 
     if (sniffer_payload->header[0] != 0x40) {
         return;
     }
 
-    int8_t rssi        = wifi_promiscuous_pkt->rx_ctrl.rssi;
-    uint8_t channel    = wifi_promiscuous_pkt->rx_ctrl.channel;
-    uint32_t timestamp = sniffer_timestamp();
-    mlink_sniffer_data_t *sniffer_data = MDF_CALLOC(1, 22);
+    if (channel <= MLINK_SNIFFER_CHANNEL_MAX) {
+        g_channel_stats[channel].probes++;
+    }
 
-    IDF_LOGD(TAG, "Wi-Fi, addr: "MACSTR", rssi: %d, channel: %d",
-             MAC2STR(sniffer_payload->source_addr), rssi, channel);
+    sniffer_record_t record = {
+        .type      = MLINK_SNIFFER_WIFI,
+        .rssi      = wifi_promiscuous_pkt->rx_ctrl.rssi,
+        .channel   = channel,
+        .timestamp = sniffer_timestamp(),
+    };
 
-    sniffer_data->type  = MLINK_SNIFFER_WIFI;
-    sniffer_data->size  = ltv_data_insert(sniffer_data->data, MLINK_SNIFFER_DATA_ADDR,
-                                          6, sniffer_payload->source_addr);
-    sniffer_data->size += ltv_data_insert(sniffer_data->data + sniffer_data->size, MLINK_SNIFFER_DATA_TIMESTAMP,
-                                          sizeof(uint32_t), &timestamp);
-    sniffer_data->size += ltv_data_insert(sniffer_data->data + sniffer_data->size, MLINK_SNIFFER_DATA_RSSI,
-                                          sizeof(uint8_t), &rssi);
-    sniffer_data->size += ltv_data_insert(sniffer_data->data + sniffer_data->size, MLINK_SNIFFER_DATA_CHANNEL,
-                                          sizeof(uint8_t), &channel);
-    sniffer_data->size += sizeof(sniffer_data->type);
+    memcpy(record.addr, sniffer_payload->source_addr, sizeof(record.addr));
 
-    mlink_sniffer_list_insert(sniffer_data);
+    /**< Runs in the Wi-Fi task: never block here, the aggregation task does the rest */
+    TaskHandle_t aggregate_task = __atomic_load_n(&g_sniffer_aggregate_task, __ATOMIC_SEQ_CST);
+
+    if (sniffer_ring_push(&record) && aggregate_task) {
+        xTaskNotifyGive(aggregate_task);
+    }
+}
 
-    free(sniffer_data);
+static void sniffer_wifi_cb(void *recv_buf, wifi_promiscuous_pkt_type_t type)
+{
+    /**< Counted before the task handle is read, see mlink_sniffer_deinit() */
+    __atomic_add_fetch(&g_sniffer_cb_active, 1, __ATOMIC_SEQ_CST);
+    sniffer_wifi_capture((const wifi_promiscuous_pkt_t *)recv_buf);
+    __atomic_sub_fetch(&g_sniffer_cb_active, 1, __ATOMIC_SEQ_CST);
 }
 
-#if CONFIG_BT_ENABLED
+#ifdef CONFIG_BT_BLUEDROID_ENABLED
 #include "esp_gap_ble_api.h"
-#endif /**< CONFIG_BT_ENABLED */
 
-#ifdef CONFIG_IDF_TARGET_ESP32
-static esp_err_t mlink_sniffer_ble_cb(void *data, size_t size)
+static void mlink_sniffer_ble_cb(esp_ble_gap_cb_param_t *scan_result)
 {
-#if CONFIG_BT_ENABLED
-
-    esp_ble_gap_cb_param_t *scan_result = (esp_ble_gap_cb_param_t *)data;
     uint8_t adv_name_len = 0;
     uint8_t *adv_name    = esp_ble_resolve_adv_data(scan_result->scan_rst.ble_adv,
                            ESP_BLE_AD_TYPE_NAME_CMPL, &adv_name_len);
@@ -216,39 +488,59 @@ static esp_err_t mlink_sniffer_ble_cb(void *data, size_t size)
                                    ESP_BLE_AD_MANUFACTURER_SPECIFIC_TYPE, &adv_manufacturer_len);
 
     adv_manufacturer_len = adv_manufacturer_len < 2 ? 0 : adv_manufacturer_len;
-    IDF_LOGD(TAG, "BLE, addr: " MACSTR ", rssi: %d, name_len: %d, name: %.*s, adv_manufacturer_len: %d, manufacturer: 0x%04x",
+    ESP_LOGD(TAG, "BLE, addr: " MACSTR ", rssi: %d, name_len: %d, name: %.*s, adv_manufacturer_len: %d, manufacturer: 0x%04x",
              MAC2STR(scan_result->scan_rst.bda), scan_result->scan_rst.rssi,
              adv_name_len, adv_name_len, (char *)adv_name, adv_manufacturer_len,
-             (adv_manufacturer_len ? * ((uint16_t *)adv_manufacturer) : 0));
+             (adv_manufacturer_len ? adv_manufacturer[0] | adv_manufacturer[1] << 8 : 0));
 
-    uint32_t timestamp = sniffer_timestamp();
-    mlink_sniffer_data_t *sniffer_data = MDF_CALLOC(1, sizeof(mlink_sniffer_data_t) + 21 + adv_name_len + adv_manufacturer_len);
+    uint8_t extra[MLINK_SNIFFER_EXTRA_MAX_LEN];
+    uint8_t extra_len = 0;
 
-    sniffer_data->type = MLINK_SNIFFER_BLE;
-    sniffer_data->size += ltv_data_insert(sniffer_data->data, MLINK_SNIFFER_DATA_ADDR,
-                                          6, scan_result->scan_rst.bda);
-    sniffer_data->size += ltv_data_insert(sniffer_data->data + sniffer_data->size, MLINK_SNIFFER_DATA_TIMESTAMP,
-                                          sizeof(uint32_t), &timestamp);
-    sniffer_data->size += ltv_data_insert(sniffer_data->data + sniffer_data->size, MLINK_SNIFFER_DATA_RSSI,
-                                          sizeof(uint8_t), &scan_result->scan_rst.rssi);
-    sniffer_data->size += ltv_data_insert(sniffer_data->data + sniffer_data->size, MLINK_SNIFFER_DATA_NAME,
-                                          adv_name_len, adv_name);
-    sniffer_data->size += ltv_data_insert(sniffer_data->data + sniffer_data->size, MLINK_SNIFFER_DATA_MANUFACTURER,
-                                          adv_manufacturer_len, adv_manufacturer);
-    sniffer_data->size += sizeof(sniffer_data->type);
-    mlink_sniffer_list_insert(sniffer_data);
+    /**< Fields that do not fit in the table are dropped rather than truncated */
+    if (adv_name_len + 2 <= sizeof(extra)) {
+        extra_len += ltv_data_insert(extra, MLINK_SNIFFER_DATA_NAME, adv_name_len, adv_name);
+    }
 
-    free(sniffer_data);
+    if (extra_len + adv_manufacturer_len + 2 <= sizeof(extra)) {
+        extra_len += ltv_data_insert(extra + extra_len, MLINK_SNIFFER_DATA_MANUFACTURER,
+                                     adv_manufacturer_len, adv_manufacturer);
+    }
 
-#endif /**< CONFIG_BT_ENABLED */
+    mlink_sniffer_table_update(MLINK_SNIFFER_BLE, scan_result->scan_rst.bda, scan_result->scan_rst.rssi,
+                               0, sniffer_timestamp(), extra, extra_len);
+}
 
-    return ESP_OK;
+static void mlink_sniffer_gap_cb(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param)
+{
+    switch (event) {
+        case ESP_GAP_BLE_SCAN_PARAM_SET_COMPLETE_EVT:
+            if (param->scan_param_cmpl.status == ESP_BT_STATUS_SUCCESS) {
+                esp_ble_gap_start_scanning(0);
+            }
+
+            break;
+
+        case ESP_GAP_BLE_SCAN_RESULT_EVT:
+            if (param->scan_rst.search_evt == ESP_GAP_SEARCH_INQ_RES_EVT) {
+                mlink_sniffer_ble_cb(param);
+            }
+
+            break;
+
+        default:
+            break;
+    }
 }
-#endif
+#endif /**< CONFIG_BT_BLUEDROID_ENABLED */
 
 esp_err_t mlink_sniffer_set_config(const mlink_sniffer_config_t *config)
 {
-    // MDF_PARAM_CHECK(config);
+    ESP_PARAM_CHECK(config);
+
+    /**< The table is allocated at its full size, an empty one would have nothing to evict */
+    if (!config->buffer_num || config->buffer_num > MLINK_SNIFFER_DEVICE_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
 
     memcpy(&g_sniffer_config, config, sizeof(mlink_sniffer_config_t));
 
@@ -257,56 +549,147 @@ esp_err_t mlink_sniffer_set_config(const mlink_sniffer_config_t *config)
 
 esp_err_t mlink_sniffer_get_config(mlink_sniffer_config_t *config)
 {
-    // MDF_PARAM_CHECK(config);
+    ESP_PARAM_CHECK(config);
 
     memcpy(config, &g_sniffer_config, sizeof(mlink_sniffer_config_t));
 
     return ESP_OK;
 }
 
+/**
+ * @brief Serialize one entry as [ size | type | < len | data_type | data > ... ]
+ */
+static size_t sniffer_entry_serialize(const sniffer_table_t *table, uint16_t index,
+                                      uint32_t now, uint8_t *data)
+{
+    mlink_sniffer_data_t *sniffer_data = (mlink_sniffer_data_t *)data;
+    uint32_t age = now - table->timestamp[index];
+
+    sniffer_data->type  = table->type[index];
+    sniffer_data->size  = ltv_data_insert(sniffer_data->data, MLINK_SNIFFER_DATA_ADDR,
+                                          6, table->addr[index]);
+    sniffer_data->size += ltv_data_insert(sniffer_data->data + sniffer_data->size, MLINK_SNIFFER_DATA_TIMESTAMP,
+                                          sizeof(uint32_t), &age);
+    sniffer_data->size += ltv_data_insert(sniffer_data->data + sniffer_data->size, MLINK_SNIFFER_DATA_RSSI,
+                                          sizeof(uint8_t), &table->rssi[index]);
+
+    if (table->type[index] == MLINK_SNIFFER_WIFI) {
+        sniffer_data->size += ltv_data_insert(sniffer_data->data + sniffer_data->size, MLINK_SNIFFER_DATA_CHANNEL,
+                                              sizeof(uint8_t), &table->channel[index]);
+    }
+
+#ifdef CONFIG_BT_BLUEDROID_ENABLED
+    memcpy(sniffer_data->data + sniffer_data->size, table->extra[index], table->extra_len[index]);
+    sniffer_data->size += table->extra_len[index];
+#endif
+
+    sniffer_data->size += sizeof(sniffer_data->type);
+
+    return sniffer_data->size + sizeof(sniffer_data->size);
+}
+
 esp_err_t mlink_sniffer_data(uint8_t **data, size_t *size)
 {
-    // MDF_PARAM_CHECK(data);
-    // MDF_PARAM_CHECK(size);
+    ESP_PARAM_CHECK(data);
+    ESP_PARAM_CHECK(size);
 
     *size = 0;
     *data = NULL;
 
-    if (!g_sniffer_list || !g_sniffer_list->next || !g_sniffer_lock) {
-        IDF_LOGD(TAG, "sniffer data NULL");
+    if (!g_sniffer_table || !g_device_num) {
+        ESP_LOGD(TAG, "sniffer data NULL");
         return ESP_OK;
     }
 
     xSemaphoreTake(g_sniffer_lock, portMAX_DELAY);
 
-    uint32_t timestamp  = sniffer_timestamp();
+    /**< [ size | type ] + ADDR, TIMESTAMP, RSSI and CHANNEL ltv + BLE extras */
+    const size_t entry_max_size = 2 + (2 + 6) + (2 + 4) + (2 + 1) + (2 + 1) + MLINK_SNIFFER_EXTRA_MAX_LEN;
+    uint32_t timestamp = sniffer_timestamp();
 
-    for (sniffer_data_list_t *sniffer_node = g_sniffer_list->next; sniffer_node;
-            sniffer_node = g_sniffer_list->next) {
-        size_t data_size       = *size;
-        uint8_t timestamp_len  = 0;
-        uint8_t *timestamp_ptr = ltv_data_get(sniffer_node->data.data, MLINK_SNIFFER_DATA_TIMESTAMP,
-                                              sniffer_node->data.size - 1, &timestamp_len);
+    *data = malloc(g_device_num * entry_max_size);
 
-        *size += sniffer_node->data.size + sizeof(sniffer_node->data.size);
+    if (!*data) {
+        xSemaphoreGive(g_sniffer_lock);
+        return ESP_ERR_NO_MEM;
+    }
 
-        if (!(*data = realloc(*data, *size))) {
-            free(*data);
-            return MDF_ERR_NO_MEM;
-        }
+    for (uint16_t index = g_sniffer_table->lru_head; index != MLINK_SNIFFER_INDEX_NONE;
+            index = g_sniffer_table->lru_next[index]) {
+        *size += sniffer_entry_serialize(g_sniffer_table, index, timestamp, *data + *size);
+    }
+
+    sniffer_table_reset(g_sniffer_table);
+    ESP_LOGD(TAG, "sniffer_node, total_size: %d, dropped: %" PRIu32, (int)*size, g_sniffer_ring.dropped);
+
+    xSemaphoreGive(g_sniffer_lock);
+
+    return ESP_OK;
+}
+
+esp_err_t mlink_sniffer_export(uint32_t since, uint8_t **data, size_t *size)
+{
+    ESP_PARAM_CHECK(data);
+    ESP_PARAM_CHECK(size);
+
+    mlink_sniffer_export_header_t header = {
+        .magic       = MLINK_SNIFFER_EXPORT_MAGIC,
+        .version     = MLINK_SNIFFER_EXPORT_VERSION,
+        .header_size = MLINK_SNIFFER_EXPORT_HEADER_SIZE,
+        .record_size = MLINK_SNIFFER_EXPORT_RECORD_SIZE,
+        .since       = since,
+    };
+    mlink_sniffer_export_record_t record = {0};
+
+    *size = 0;
+    *data = NULL;
+
+    if (!g_sniffer_table) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(g_sniffer_lock, portMAX_DELAY);
+
+    uint32_t timestamp = sniffer_timestamp();
+
+    /**< A `since` ahead of the sequence comes from before a reboot, answer with everything */
+    if ((int32_t)(g_sniffer_sequence - since) < 0) {
+        header.since = since = 0;
+    }
+
+    /**< Size for every device, a delta export just uses less of it */
+    *data = malloc(MLINK_SNIFFER_EXPORT_HEADER_SIZE + g_device_num * MLINK_SNIFFER_EXPORT_RECORD_SIZE);
+
+    if (!*data) {
+        xSemaphoreGive(g_sniffer_lock);
+        return ESP_ERR_NO_MEM;
+    }
+
+    *size = MLINK_SNIFFER_EXPORT_HEADER_SIZE;
 
-        *((uint32_t *)timestamp_ptr) = timestamp - *((uint32_t *)timestamp_ptr);
-        memcpy(*data + data_size, &sniffer_node->data, sniffer_node->data.size + sizeof(sniffer_node->data.size));
+    /**< Entries are in LRU order, so the walk can stop at the first one not changed since `since` */
+    for (uint16_t index = g_sniffer_table->lru_head; index != MLINK_SNIFFER_INDEX_NONE
+            && (int32_t)(g_sniffer_table->sequence[index] - since) > 0; index = g_sniffer_table->lru_next[index]) {
+        memcpy(record.addr, g_sniffer_table->addr[index], sizeof(record.addr));
+        record.type    = g_sniffer_table->type[index];
+        record.rssi    = g_sniffer_table->rssi[index];
+        record.channel = g_sniffer_table->channel[index];
+        record.age_ms  = timestamp - g_sniffer_table->timestamp[index];
 
-        g_sniffer_list->next = sniffer_node->next;
-        free(sniffer_node);
+        mlink_sniffer_export_encode_record(*data + *size, &record);
+        *size += MLINK_SNIFFER_EXPORT_RECORD_SIZE;
+        header.record_num++;
     }
 
-    g_device_num = 0;
-    IDF_LOGD(TAG, "sniffer_node, total_size: %d", *size);
+    header.sequence = g_sniffer_sequence;
+    header.epoch    = g_sniffer_epoch;
+    mlink_sniffer_export_encode_header(*data, &header);
 
     xSemaphoreGive(g_sniffer_lock);
 
+    ESP_LOGD(TAG, "sniffer export, since: %" PRIu32 ", sequence: %" PRIu32 ", record_num: %d",
+             since, header.sequence, header.record_num);
+
     return ESP_OK;
 }
 
@@ -315,10 +698,10 @@ esp_err_t mlink_sniffer_wifi_start()
     esp_err_t ret = ESP_OK;
 
     ret = esp_wifi_set_promiscuous_rx_cb(sniffer_wifi_cb);
-    // MDF_ERROR_CHECK(ret != ESP_OK, ret, "esp_wifi_set_promiscuous_rx_cb");
+    ESP_ERROR_RETURN(ret != ESP_OK, ret, "esp_wifi_set_promiscuous_rx_cb");
 
-    ret = esp_wifi_set_promiscuous(1);
-    // MDF_ERROR_CHECK(ret != ESP_OK, ret, "esp_wifi_set_promiscuous");
+    ret = esp_wifi_set_promiscuous(true);
+    ESP_ERROR_RETURN(ret != ESP_OK, ret, "esp_wifi_set_promiscuous");
 
     ESP_LOGI(TAG, "mesh wifi sniffer start");
 
@@ -329,25 +712,232 @@ esp_err_t mlink_sniffer_wifi_stop()
 {
     esp_err_t ret = ESP_OK;
 
-    ret = esp_wifi_set_promiscuous_rx_cb(NULL);
-    // MDF_ERROR_CHECK(ret != ESP_OK, ret, "esp_wifi_set_promiscuous_rx_cb");
+    ret = esp_wifi_set_promiscuous(false);
+    ESP_ERROR_RETURN(ret != ESP_OK, ret, "esp_wifi_set_promiscuous");
 
-    ret = esp_wifi_set_promiscuous(0);
-    // MDF_ERROR_CHECK(ret != ESP_OK, ret, "esp_wifi_set_promiscuous");
+    ret = esp_wifi_set_promiscuous_rx_cb(NULL);
+    ESP_ERROR_RETURN(ret != ESP_OK, ret, "esp_wifi_set_promiscuous_rx_cb");
 
     ESP_LOGI(TAG, "mesh wifi sniffer stop");
 
     return ESP_OK;
 }
 
-#ifdef CONFIG_IDF_TARGET_ESP32
+/**
+ * @brief Channel the gateway is serving clients on, 0 if it is free to hop
+ */
+static uint8_t sniffer_hop_serving_channel()
+{
+    wifi_mode_t mode = WIFI_MODE_NULL;
+    wifi_ap_record_t ap_info = {0};
+    wifi_sta_list_t sta_list = {0};
+    wifi_config_t wifi_config = {0};
+
+    if (esp_wifi_get_mode(&mode) != ESP_OK) {
+        return 0;
+    }
+
+    if ((mode & WIFI_MODE_STA) && esp_wifi_sta_get_ap_info(&ap_info) == ESP_OK) {
+        return ap_info.primary;
+    }
+
+    if ((mode & WIFI_MODE_AP) && esp_wifi_ap_get_sta_list(&sta_list) == ESP_OK && sta_list.num
+            && esp_wifi_get_config(WIFI_IF_AP, &wifi_config) == ESP_OK) {
+        return wifi_config.ap.channel;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Dwell time scaled between min and max by the channel's probe rate,
+ *        relative to the busiest configured channel
+ */
+static uint16_t sniffer_hop_dwell(uint8_t channel)
+{
+    uint32_t max_rate = 0;
+
+    /**< Give every channel one long visit before its rate is trusted */
+    if (!g_channel_stats[channel].visits) {
+        return g_hop_config.max_dwell_ms;
+    }
+
+    for (int i = 0; i < g_hop_config.channel_num; ++i) {
+        max_rate = MAX(max_rate, g_hop_rate[g_hop_config.channel[i]]);
+    }
+
+    return sniffer_hop_dwell_scale(g_hop_config.min_dwell_ms, g_hop_config.max_dwell_ms,
+                                   g_hop_rate[channel], max_rate);
+}
+
+static void sniffer_hop_switch(uint8_t channel, int64_t now)
+{
+    if (channel != g_hop_channel && esp_wifi_set_channel(channel, WIFI_SECOND_CHAN_NONE) != ESP_OK) {
+        ESP_LOGD(TAG, "esp_wifi_set_channel %d fail, stay on %d", channel, g_hop_channel);
+        channel = g_hop_channel;
+    }
+
+    g_hop_channel      = channel;
+    g_hop_visit_start  = now;
+    g_hop_visit_probes = g_channel_stats[channel].probes;
+    g_channel_stats[channel].visits++;
+}
+
+static void sniffer_hop_timer_cb(void *arg)
+{
+    xSemaphoreTake(g_hop_lock, portMAX_DELAY);
+
+    /**< esp_timer_stop() does not wait for a callback already running, it must not re-arm the timer */
+    if (!g_hop_running) {
+        xSemaphoreGive(g_hop_lock);
+        return;
+    }
+
+    int64_t now = esp_timer_get_time();
+    mlink_sniffer_channel_stats_t *stats = &g_channel_stats[g_hop_channel];
+    uint32_t elapsed_ms = (now - g_hop_visit_start) / 1000;
+    uint8_t serving_channel = sniffer_hop_serving_channel();
+    uint8_t next_channel    = serving_channel;
+
+    stats->dwell_ms += elapsed_ms;
+    g_hop_rate[g_hop_channel] = sniffer_hop_rate_average(g_hop_rate[g_hop_channel],
+                                sniffer_hop_rate(stats->probes - g_hop_visit_probes, elapsed_ms));
+
+    if (!serving_channel) {
+        g_hop_index  = (g_hop_index + 1) % g_hop_config.channel_num;
+        next_channel = g_hop_config.channel[g_hop_index];
+    }
+
+    sniffer_hop_switch(next_channel, now);
+
+    /**< While serving clients, check at the longest interval whether they have gone */
+    stats = &g_channel_stats[g_hop_channel];
+    stats->next_dwell_ms = serving_channel ? g_hop_config.max_dwell_ms : sniffer_hop_dwell(g_hop_channel);
+    esp_timer_start_once(g_hop_timer, stats->next_dwell_ms * 1000ULL);
+
+    xSemaphoreGive(g_hop_lock);
+}
+
+esp_err_t mlink_sniffer_hop_start(const mlink_sniffer_hop_config_t *config)
+{
+    ESP_PARAM_CHECK(config);
+
+    wifi_second_chan_t second = WIFI_SECOND_CHAN_NONE;
+
+    if (!config->channel_num || config->channel_num > MLINK_SNIFFER_CHANNEL_MAX
+            || !config->min_dwell_ms || config->min_dwell_ms > config->max_dwell_ms) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    for (int i = 0; i < config->channel_num; ++i) {
+        if (!config->channel[i] || config->channel[i] > MLINK_SNIFFER_CHANNEL_MAX) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    if (!g_hop_lock) {
+        g_hop_lock = xSemaphoreCreateMutex();
+        ESP_ERROR_RETURN(!g_hop_lock, ESP_ERR_NO_MEM, "xSemaphoreCreateMutex");
+    }
+
+    if (!g_hop_timer) {
+        esp_timer_create_args_t timer_args = {
+            .callback = sniffer_hop_timer_cb,
+            .name     = "sniffer_hop",
+        };
+
+        if (esp_timer_create(&timer_args, &g_hop_timer) != ESP_OK) {
+            return ESP_FAIL;
+        }
+    }
+
+    xSemaphoreTake(g_hop_lock, portMAX_DELAY);
+
+    esp_timer_stop(g_hop_timer);
+
+    memcpy(&g_hop_config, config, sizeof(mlink_sniffer_hop_config_t));
+    memset(g_hop_rate, 0, sizeof(g_hop_rate));
+    memset(g_channel_stats, 0, sizeof(g_channel_stats));
+
+    esp_wifi_get_channel(&g_hop_home_channel, &second);
+    g_hop_channel = g_hop_home_channel;
+    g_hop_index   = config->channel_num - 1;
+
+    /**< The first timer expiry switches to the first channel of the list */
+    g_hop_visit_start  = esp_timer_get_time();
+    g_hop_visit_probes = g_channel_stats[g_hop_channel].probes;
+    g_hop_running      = true;
+    esp_timer_start_once(g_hop_timer, 0);
+
+    xSemaphoreGive(g_hop_lock);
+
+    ESP_LOGI(TAG, "sniffer channel hopping start, %d channels, dwell %d~%d ms",
+             config->channel_num, config->min_dwell_ms, config->max_dwell_ms);
+
+    return ESP_OK;
+}
+
+esp_err_t mlink_sniffer_hop_stop()
+{
+    if (!g_hop_timer) {
+        return ESP_OK;
+    }
+
+    xSemaphoreTake(g_hop_lock, portMAX_DELAY);
+
+    g_hop_running = false;
+    esp_timer_stop(g_hop_timer);
+
+    if (!sniffer_hop_serving_channel() && g_hop_home_channel) {
+        esp_wifi_set_channel(g_hop_home_channel, WIFI_SECOND_CHAN_NONE);
+    }
+
+    xSemaphoreGive(g_hop_lock);
+
+    ESP_LOGI(TAG, "sniffer channel hopping stop");
+
+    return ESP_OK;
+}
+
+esp_err_t mlink_sniffer_get_channel_stats(mlink_sniffer_channel_stats_t *stats, size_t *num)
+{
+    ESP_PARAM_CHECK(stats);
+    ESP_PARAM_CHECK(num);
+
+    size_t count = 0;
+
+    for (int i = 1; i <= MLINK_SNIFFER_CHANNEL_MAX && count < *num; ++i) {
+        if (g_channel_stats[i].packets || g_channel_stats[i].visits) {
+            memcpy(stats + count, g_channel_stats + i, sizeof(mlink_sniffer_channel_stats_t));
+            stats[count++].channel = i;
+        }
+    }
+
+    *num = count;
+
+    return ESP_OK;
+}
+
+#ifdef CONFIG_BT_BLUEDROID_ENABLED
 esp_err_t mlink_sniffer_ble_start()
 {
     esp_err_t ret = ESP_OK;
 
-    ret = mlink_ble_set_scan((uint16_t)(g_sniffer_config.ble_scan_interval * 1.6),
-                             (uint16_t)g_sniffer_config.ble_scan_window * 1.6, mlink_sniffer_ble_cb);
-    // MDF_ERROR_CHECK(ret != ESP_OK, ret, "ble_set_scan");
+    /**< Scanning starts once the parameters are set, see mlink_sniffer_gap_cb() */
+    esp_ble_scan_params_t scan_params = {
+        .scan_type          = BLE_SCAN_TYPE_ACTIVE,
+        .own_addr_type      = BLE_ADDR_TYPE_PUBLIC,
+        .scan_filter_policy = BLE_SCAN_FILTER_ALLOW_ALL,
+        .scan_interval      = g_sniffer_config.ble_scan_interval * 8 / 5,   /**< In 0.625 ms units */
+        .scan_window        = g_sniffer_config.ble_scan_window * 8 / 5,
+        .scan_duplicate     = BLE_SCAN_DUPLICATE_DISABLE,
+    };
+
+    ret = esp_ble_gap_register_callback(mlink_sniffer_gap_cb);
+    ESP_ERROR_RETURN(ret != ESP_OK, ret, "esp_ble_gap_register_callback");
+
+    ret = esp_ble_gap_set_scan_params(&scan_params);
+    ESP_ERROR_RETURN(ret != ESP_OK, ret, "esp_ble_gap_set_scan_params");
 
     ESP_LOGI(TAG, "mesh ble sniffer start");
 
@@ -358,24 +948,35 @@ esp_err_t mlink_sniffer_ble_stop()
 {
     esp_err_t ret = ESP_OK;
 
-    ret = mlink_ble_set_scan(0, 0, NULL);
-    // MDF_ERROR_CHECK(ret != ESP_OK, ret, "ble_set_scan, ret: %x", ret);
+    ret = esp_ble_gap_stop_scanning();
+    ESP_ERROR_RETURN(ret != ESP_OK, ret, "esp_ble_gap_stop_scanning");
 
     ESP_LOGI(TAG, "mesh ble sniffer stop");
 
     return ESP_OK;
 }
-#endif
+#endif /**< CONFIG_BT_BLUEDROID_ENABLED */
 
 esp_err_t mlink_sniffer_init()
 {
-    if (!g_sniffer_list) {
-        g_sniffer_list = MDF_MALLOC(sizeof(sniffer_data_list_t));
-        g_sniffer_list->next = NULL;
-    }
-
     if (!g_sniffer_lock) {
         g_sniffer_lock  = xSemaphoreCreateMutex();
+        g_sniffer_aggregate_exit = xSemaphoreCreateBinary();
+    }
+
+    if (!g_sniffer_table) {
+        g_sniffer_table = malloc(sizeof(sniffer_table_t));
+
+        if (!g_sniffer_table) {
+            return ESP_ERR_NO_MEM;
+        }
+
+        sniffer_table_reset(g_sniffer_table);
+    }
+
+    if (!g_sniffer_aggregate_task) {
+        xTaskCreate(sniffer_aggregate_task, "sniffer_aggregate", MLINK_SNIFFER_AGGREGATE_TASK_STACK,
+                    NULL, MLINK_SNIFFER_AGGREGATE_TASK_PRIO, &g_sniffer_aggregate_task);
     }
 
     return ESP_OK;
@@ -383,21 +984,34 @@ esp_err_t mlink_sniffer_init()
 
 esp_err_t mlink_sniffer_deinit()
 {
-    if (!g_sniffer_lock) {
+    if (!g_sniffer_lock || !g_sniffer_table) {
         return ESP_OK;
     }
 
+    /**< No new record may be captured once the aggregation task is gone */
+    mlink_sniffer_wifi_stop();
+
     xSemaphoreTake(g_sniffer_lock, portMAX_DELAY);
 
-    g_device_num = 0;
+    TaskHandle_t aggregate_task = g_sniffer_aggregate_task;
+    __atomic_store_n(&g_sniffer_aggregate_task, NULL, __ATOMIC_SEQ_CST);
+    sniffer_table_reset(g_sniffer_table);
 
-    for (sniffer_data_list_t *sniffer_node = g_sniffer_list->next; sniffer_node;
-            sniffer_node = g_sniffer_list->next) {
-        g_sniffer_list->next = sniffer_node->next;
-        free(sniffer_node);
+    xSemaphoreGive(g_sniffer_lock);
+
+    /**< A callback that started before the capture stopped may still hold the task handle,
+         the task must outlive it. Any callback counted after this sees a NULL handle */
+    while (__atomic_load_n(&g_sniffer_cb_active, __ATOMIC_SEQ_CST)) {
+        vTaskDelay(1);
     }
 
-    xSemaphoreGive(g_sniffer_lock);
+    if (aggregate_task) {
+        xTaskNotifyGive(aggregate_task);
+        xSemaphoreTake(g_sniffer_aggregate_exit, portMAX_DELAY);
+    }
+
+    /**< Nothing produces or consumes any more, drop what was left so a later init starts empty */
+    g_sniffer_ring.tail = g_sniffer_ring.head;
 
     return ESP_OK;
 }
@@ -0,0 +1,124 @@
+// Copyright 2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+
+#include "sniffer_export.h"
+
+static inline void put_le16(uint8_t *data, uint16_t value)
+{
+    data[0] = value;
+    data[1] = value >> 8;
+}
+
+static inline void put_le32(uint8_t *data, uint32_t value)
+{
+    data[0] = value;
+    data[1] = value >> 8;
+    data[2] = value >> 16;
+    data[3] = value >> 24;
+}
+
+static inline uint16_t get_le16(const uint8_t *data)
+{
+    return data[0] | (data[1] << 8);
+}
+
+static inline uint32_t get_le32(const uint8_t *data)
+{
+    return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+void mlink_sniffer_export_encode_header(uint8_t *data, const mlink_sniffer_export_header_t *header)
+{
+    put_le16(data, header->magic);
+    data[2] = header->version;
+    data[3] = header->header_size;
+    data[4] = header->record_size;
+    data[5] = 0;
+    put_le16(data + 6, header->record_num);
+    put_le32(data + 8, header->since);
+    put_le32(data + 12, header->sequence);
+    put_le32(data + 16, header->epoch);
+}
+
+void mlink_sniffer_export_encode_record(uint8_t *data, const mlink_sniffer_export_record_t *record)
+{
+    memcpy(data, record->addr, 6);
+    data[6] = record->type;
+    data[7] = (uint8_t)record->rssi;
+    data[8] = record->channel;
+    memset(data + 9, 0, 3);
+    put_le32(data + 12, record->age_ms);
+}
+
+bool mlink_sniffer_export_decode_header(const uint8_t *data, size_t size, mlink_sniffer_export_header_t *header)
+{
+    if (!data || !header || size < MLINK_SNIFFER_EXPORT_HEADER_MIN_SIZE) {
+        return false;
+    }
+
+    header->magic       = get_le16(data);
+    header->version     = data[2];
+    header->header_size = data[3];
+    header->record_size = data[4];
+    header->reserved    = 0;
+    header->record_num  = get_le16(data + 6);
+    header->since       = get_le32(data + 8);
+    header->sequence    = get_le32(data + 12);
+    header->epoch       = 0;
+
+    /**< Later versions are accepted as long as they only grew the layout */
+    if (header->magic != MLINK_SNIFFER_EXPORT_MAGIC || header->version < 1
+            || header->header_size < MLINK_SNIFFER_EXPORT_HEADER_MIN_SIZE
+            || header->record_size < MLINK_SNIFFER_EXPORT_RECORD_SIZE
+            || size < header->header_size + (size_t)header->record_size * header->record_num) {
+        return false;
+    }
+
+    if (header->header_size >= MLINK_SNIFFER_EXPORT_HEADER_SIZE) {
+        header->epoch = get_le32(data + 16);
+    }
+
+    return true;
+}
+
+bool mlink_sniffer_export_need_resync(const mlink_sniffer_export_header_t *header, uint32_t epoch)
+{
+    if (!header->since) {
+        return false;
+    }
+
+    /**< Version 1 has no epoch, a sequence behind `since` is the only sign of a restart it gives */
+    return header->epoch != epoch || (int32_t)(header->sequence - header->since) < 0;
+}
+
+bool mlink_sniffer_export_decode_record(const uint8_t *data, const mlink_sniffer_export_header_t *header,
+                                        uint16_t index, mlink_sniffer_export_record_t *record)
+{
+    if (!data || !header || !record || index >= header->record_num) {
+        return false;
+    }
+
+    data += header->header_size + (size_t)header->record_size * index;
+
+    memcpy(record->addr, data, 6);
+    record->type    = data[6];
+    record->rssi    = (int8_t)data[7];
+    record->channel = data[8];
+    memset(record->reserved, 0, sizeof(record->reserved));
+    record->age_ms  = get_le32(data + 12);
+
+    return true;
+}
@@ -0,0 +1,65 @@
+// Copyright 2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef __MLINK_SNIFFER_HOP_H__
+#define __MLINK_SNIFFER_HOP_H__
+
+/**
+ * Dwell time arithmetic of the channel hopping, private to sniffer.c.
+ * It has no ESP-IDF dependency so the host test can check it.
+ */
+
+#include <stdint.h>
+
+#define MLINK_SNIFFER_HOP_RATE_SHIFT    4   /**< Probe rates are kept in 1/16 probes per second */
+
+/**
+ * @brief Probe rate of a visit, in 1/16 probes per second, 0 for an empty visit
+ */
+static inline uint32_t sniffer_hop_rate(uint32_t probes, uint32_t elapsed_ms)
+{
+    if (!elapsed_ms) {
+        return 0;
+    }
+
+    uint64_t rate = ((uint64_t)probes * 1000 << MLINK_SNIFFER_HOP_RATE_SHIFT) / elapsed_ms;
+
+    return rate > UINT32_MAX ? UINT32_MAX : (uint32_t)rate;
+}
+
+/**
+ * @brief Exponentially weighted rate, each visit counts for a quarter
+ */
+static inline uint32_t sniffer_hop_rate_average(uint32_t average, uint32_t rate)
+{
+    return ((uint64_t)average * 3 + rate) / 4;
+}
+
+/**
+ * @brief Dwell time scaled between `min_ms` and `max_ms` by `rate`, relative to the busiest channel
+ */
+static inline uint16_t sniffer_hop_dwell_scale(uint16_t min_ms, uint16_t max_ms, uint32_t rate, uint32_t max_rate)
+{
+    if (!max_rate) {
+        return min_ms;
+    }
+
+    if (rate > max_rate) {
+        rate = max_rate;
+    }
+
+    return min_ms + (uint64_t)(max_ms - min_ms) * rate / max_rate;
+}
+
+#endif /*!< __MLINK_SNIFFER_HOP_H__ */
@@ -0,0 +1,261 @@
+// Copyright 2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sniffer_export.h"
+
+#define RECORD_NUM  40
+
+static int g_failures = 0;
+
+#define TEST_ASSERT(cond) do { \
+        if (!(cond)) { \
+            printf("%s:%d: %s failed\n", __FILE__, __LINE__, #cond); \
+            g_failures++; \
+        } \
+    } while (0)
+
+static bool record_equal(const mlink_sniffer_export_record_t *a, const mlink_sniffer_export_record_t *b)
+{
+    return !memcmp(a->addr, b->addr, sizeof(a->addr)) && a->type == b->type && a->rssi == b->rssi
+           && a->channel == b->channel && a->age_ms == b->age_ms;
+}
+
+static void make_record(uint16_t i, mlink_sniffer_export_record_t *record)
+{
+    memset(record, 0, sizeof(*record));
+
+    for (int j = 0; j < 6; ++j) {
+        record->addr[j] = (uint8_t)(i * 37 + j * 11);
+    }
+
+    record->type    = (i & 1) ? 2 : 1;
+    record->rssi    = (int8_t)(-100 + i);
+    record->channel = i % 15;
+    record->age_ms  = 0xFFFFFFF0U - i * 1000003U;
+}
+
+/**
+ * @brief Encode with the given layout sizes, padding the grown parts with 0xAA
+ */
+static size_t encode(uint8_t *data, uint8_t header_size, uint8_t record_size, uint16_t record_num)
+{
+    mlink_sniffer_export_header_t header = {
+        .magic       = MLINK_SNIFFER_EXPORT_MAGIC,
+        .version     = MLINK_SNIFFER_EXPORT_VERSION,
+        .header_size = header_size,
+        .record_size = record_size,
+        .record_num  = record_num,
+        .since       = 0x01020304,
+        .sequence    = 0xA0B0C0D0,
+        .epoch       = 0x55667788,
+    };
+    mlink_sniffer_export_record_t record;
+    size_t size = header_size + (size_t)record_size * record_num;
+
+    memset(data, 0xAA, size);
+    mlink_sniffer_export_encode_header(data, &header);
+
+    for (uint16_t i = 0; i < record_num; ++i) {
+        make_record(i, &record);
+        mlink_sniffer_export_encode_record(data + header_size + (size_t)record_size * i, &record);
+    }
+
+    return size;
+}
+
+static void test_round_trip(uint8_t header_size, uint8_t record_size)
+{
+    uint8_t data[64 + 64 * RECORD_NUM];
+    size_t size = encode(data, header_size, record_size, RECORD_NUM);
+    mlink_sniffer_export_header_t header;
+    mlink_sniffer_export_record_t expect, record;
+
+    TEST_ASSERT(mlink_sniffer_export_decode_header(data, size, &header));
+    TEST_ASSERT(header.magic == MLINK_SNIFFER_EXPORT_MAGIC);
+    TEST_ASSERT(header.version == MLINK_SNIFFER_EXPORT_VERSION);
+    TEST_ASSERT(header.header_size == header_size);
+    TEST_ASSERT(header.record_size == record_size);
+    TEST_ASSERT(header.record_num == RECORD_NUM);
+    TEST_ASSERT(header.since == 0x01020304);
+    TEST_ASSERT(header.sequence == 0xA0B0C0D0);
+    TEST_ASSERT(header.epoch == 0x55667788);
+
+    for (uint16_t i = 0; i < RECORD_NUM; ++i) {
+        make_record(i, &expect);
+        TEST_ASSERT(mlink_sniffer_export_decode_record(data, &header, i, &record));
+        TEST_ASSERT(record_equal(&record, &expect));
+    }
+
+    TEST_ASSERT(!mlink_sniffer_export_decode_record(data, &header, RECORD_NUM, &record));
+
+    /**< Every truncation of a complete export is rejected */
+    for (size_t len = 0; len < size; ++len) {
+        if (mlink_sniffer_export_decode_header(data, len, &header)) {
+            printf("truncated export of %zu of %zu bytes accepted\n", len, size);
+            g_failures++;
+            break;
+        }
+    }
+}
+
+static void test_wire_layout(void)
+{
+    static const uint8_t expect[MLINK_SNIFFER_EXPORT_HEADER_SIZE + MLINK_SNIFFER_EXPORT_RECORD_SIZE] = {
+        0x4E, 0x53, 0x02, 0x14, 0x10, 0x00, 0x01, 0x00,
+        0x04, 0x03, 0x02, 0x01, 0xD0, 0xC0, 0xB0, 0xA0,
+        0x88, 0x77, 0x66, 0x55,
+        0x00, 0x0B, 0x16, 0x21, 0x2C, 0x37, 0x01, 0x9C,
+        0x00, 0x00, 0x00, 0x00, 0xF0, 0xFF, 0xFF, 0xFF,
+    };
+    uint8_t data[sizeof(expect)];
+
+    encode(data, MLINK_SNIFFER_EXPORT_HEADER_SIZE, MLINK_SNIFFER_EXPORT_RECORD_SIZE, 1);
+    TEST_ASSERT(!memcmp(data, expect, sizeof(expect)));
+}
+
+static void test_reject(void)
+{
+    uint8_t data[MLINK_SNIFFER_EXPORT_HEADER_SIZE + MLINK_SNIFFER_EXPORT_RECORD_SIZE];
+    size_t size = encode(data, MLINK_SNIFFER_EXPORT_HEADER_SIZE, MLINK_SNIFFER_EXPORT_RECORD_SIZE, 1);
+    mlink_sniffer_export_header_t header;
+
+    TEST_ASSERT(!mlink_sniffer_export_decode_header(NULL, size, &header));
+
+    data[0] ^= 0xFF;
+    TEST_ASSERT(!mlink_sniffer_export_decode_header(data, size, &header));
+    data[0] ^= 0xFF;
+
+    data[2] = 0;
+    TEST_ASSERT(!mlink_sniffer_export_decode_header(data, size, &header));
+    data[2] = MLINK_SNIFFER_EXPORT_VERSION;
+
+    /**< A layout smaller than version 1 can not be decoded */
+    data[3] = MLINK_SNIFFER_EXPORT_HEADER_MIN_SIZE - 1;
+    TEST_ASSERT(!mlink_sniffer_export_decode_header(data, size, &header));
+    data[3] = MLINK_SNIFFER_EXPORT_HEADER_SIZE;
+
+    data[4] = MLINK_SNIFFER_EXPORT_RECORD_SIZE - 1;
+    TEST_ASSERT(!mlink_sniffer_export_decode_header(data, size, &header));
+    data[4] = MLINK_SNIFFER_EXPORT_RECORD_SIZE;
+
+    TEST_ASSERT(mlink_sniffer_export_decode_header(data, size, &header));
+}
+
+/**
+ * @brief An export of a version 1 device, whose header has no epoch
+ */
+static void test_version_1(void)
+{
+    static const uint8_t data[MLINK_SNIFFER_EXPORT_HEADER_MIN_SIZE + MLINK_SNIFFER_EXPORT_RECORD_SIZE] = {
+        0x4E, 0x53, 0x01, 0x10, 0x10, 0x00, 0x01, 0x00,
+        0x04, 0x03, 0x02, 0x01, 0xD0, 0xC0, 0xB0, 0xA0,
+        0x00, 0x0B, 0x16, 0x21, 0x2C, 0x37, 0x01, 0x9C,
+        0x00, 0x00, 0x00, 0x00, 0xF0, 0xFF, 0xFF, 0xFF,
+    };
+    mlink_sniffer_export_header_t header;
+    mlink_sniffer_export_record_t expect, record;
+
+    TEST_ASSERT(mlink_sniffer_export_decode_header(data, sizeof(data), &header));
+    TEST_ASSERT(header.version == 1);
+    TEST_ASSERT(header.header_size == MLINK_SNIFFER_EXPORT_HEADER_MIN_SIZE);
+    TEST_ASSERT(header.sequence == 0xA0B0C0D0);
+    TEST_ASSERT(header.epoch == 0);
+
+    make_record(0, &expect);
+    TEST_ASSERT(mlink_sniffer_export_decode_record(data, &header, 0, &record));
+    TEST_ASSERT(record_equal(&record, &expect));
+}
+
+/**
+ * @brief A collector following a device across a restart of its table
+ */
+static void test_resync(void)
+{
+    uint8_t data[MLINK_SNIFFER_EXPORT_HEADER_SIZE];
+    mlink_sniffer_export_header_t header = {
+        .magic       = MLINK_SNIFFER_EXPORT_MAGIC,
+        .version     = MLINK_SNIFFER_EXPORT_VERSION,
+        .header_size = MLINK_SNIFFER_EXPORT_HEADER_SIZE,
+        .record_size = MLINK_SNIFFER_EXPORT_RECORD_SIZE,
+        .since       = 0,
+        .sequence    = 500,
+        .epoch       = 0x1234,
+    };
+    mlink_sniffer_export_header_t decoded;
+
+    /**< A full export is taken as is, whatever the collector held before */
+    mlink_sniffer_export_encode_header(data, &header);
+    TEST_ASSERT(mlink_sniffer_export_decode_header(data, sizeof(data), &decoded));
+    TEST_ASSERT(!mlink_sniffer_export_need_resync(&decoded, 0));
+    TEST_ASSERT(!mlink_sniffer_export_need_resync(&decoded, 0x9999));
+
+    uint32_t epoch = decoded.epoch;
+
+    /**< A delta of the same table */
+    header.since    = 500;
+    header.sequence = 520;
+    mlink_sniffer_export_encode_header(data, &header);
+    TEST_ASSERT(mlink_sniffer_export_decode_header(data, sizeof(data), &decoded));
+    TEST_ASSERT(!mlink_sniffer_export_need_resync(&decoded, epoch));
+
+    /**< Nothing changed, still the same table */
+    header.since = 520;
+    mlink_sniffer_export_encode_header(data, &header);
+    TEST_ASSERT(mlink_sniffer_export_decode_header(data, sizeof(data), &decoded));
+    TEST_ASSERT(!mlink_sniffer_export_need_resync(&decoded, epoch));
+
+    /**< The device rebooted and its sequence went past `since` again: only the epoch tells */
+    header.sequence = 600;
+    header.epoch    = 0x5678;
+    mlink_sniffer_export_encode_header(data, &header);
+    TEST_ASSERT(mlink_sniffer_export_decode_header(data, sizeof(data), &decoded));
+    TEST_ASSERT(mlink_sniffer_export_need_resync(&decoded, epoch));
+
+    /**< Same epoch but a sequence behind `since`, as a version 1 device shows a reboot */
+    header.sequence = 10;
+    header.epoch    = 0;
+    mlink_sniffer_export_encode_header(data, &header);
+    TEST_ASSERT(mlink_sniffer_export_decode_header(data, sizeof(data), &decoded));
+    TEST_ASSERT(mlink_sniffer_export_need_resync(&decoded, 0));
+
+    /**< Sequence numbers that wrapped around are still ahead */
+    header.since    = 0xFFFFFFF0;
+    header.sequence = 0x10;
+    header.epoch    = epoch;
+    mlink_sniffer_export_encode_header(data, &header);
+    TEST_ASSERT(mlink_sniffer_export_decode_header(data, sizeof(data), &decoded));
+    TEST_ASSERT(!mlink_sniffer_export_need_resync(&decoded, epoch));
+}
+
+int main(void)
+{
+    test_round_trip(MLINK_SNIFFER_EXPORT_HEADER_SIZE, MLINK_SNIFFER_EXPORT_RECORD_SIZE);
+    /**< A newer version that appended fields is still readable */
+    test_round_trip(MLINK_SNIFFER_EXPORT_HEADER_SIZE + 8, MLINK_SNIFFER_EXPORT_RECORD_SIZE + 4);
+    test_wire_layout();
+    test_reject();
+    test_version_1();
+    test_resync();
+
+    if (g_failures) {
+        printf("sniffer export: %d failure(s)\n", g_failures);
+        return 1;
+    }
+
+    printf("sniffer export: all tests passed\n");
+    return 0;
+}
@@ -0,0 +1,83 @@
+// Copyright 2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+
+#include "sniffer_hop.h"
+
+#define RATE_ONE    (1 << MLINK_SNIFFER_HOP_RATE_SHIFT)    /**< One probe per second */
+
+static int g_failures = 0;
+
+#define TEST_ASSERT(cond) do { \
+        if (!(cond)) { \
+            printf("%s:%d: %s failed\n", __FILE__, __LINE__, #cond); \
+            g_failures++; \
+        } \
+    } while (0)
+
+static void test_rate(void)
+{
+    TEST_ASSERT(sniffer_hop_rate(10, 0) == 0);
+    TEST_ASSERT(sniffer_hop_rate(0, 500) == 0);
+    TEST_ASSERT(sniffer_hop_rate(1, 1000) == RATE_ONE);
+    TEST_ASSERT(sniffer_hop_rate(5, 500) == 10 * RATE_ONE);
+    /**< Below one probe per second is still told apart from none */
+    TEST_ASSERT(sniffer_hop_rate(1, 4000) == RATE_ONE / 4);
+    /**< A count that would overflow 32 bits saturates */
+    TEST_ASSERT(sniffer_hop_rate(UINT32_MAX, 1) == UINT32_MAX);
+}
+
+static void test_rate_average(void)
+{
+    uint32_t average = 0;
+
+    TEST_ASSERT(sniffer_hop_rate_average(0, 4 * RATE_ONE) == RATE_ONE);
+    TEST_ASSERT(sniffer_hop_rate_average(4 * RATE_ONE, 0) == 3 * RATE_ONE);
+    TEST_ASSERT(sniffer_hop_rate_average(UINT32_MAX, UINT32_MAX) == UINT32_MAX);
+
+    /**< Converges to a steady rate */
+    for (int i = 0; i < 64; ++i) {
+        average = sniffer_hop_rate_average(average, 100 * RATE_ONE);
+    }
+
+    TEST_ASSERT(average <= 100 * RATE_ONE && average >= 100 * RATE_ONE - 4);
+}
+
+static void test_dwell_scale(void)
+{
+    TEST_ASSERT(sniffer_hop_dwell_scale(100, 1000, 0, 0) == 100);
+    TEST_ASSERT(sniffer_hop_dwell_scale(100, 1000, 0, RATE_ONE) == 100);
+    TEST_ASSERT(sniffer_hop_dwell_scale(100, 1000, RATE_ONE, RATE_ONE) == 1000);
+    TEST_ASSERT(sniffer_hop_dwell_scale(100, 1000, RATE_ONE, 2 * RATE_ONE) == 550);
+    TEST_ASSERT(sniffer_hop_dwell_scale(200, 200, 5, 10) == 200);
+    /**< Never above the maximum, even with rates that overflow 32-bit products */
+    TEST_ASSERT(sniffer_hop_dwell_scale(0, UINT16_MAX, UINT32_MAX, UINT32_MAX) == UINT16_MAX);
+    TEST_ASSERT(sniffer_hop_dwell_scale(100, 1000, UINT32_MAX, RATE_ONE) == 1000);
+}
+
+int main(void)
+{
+    test_rate();
+    test_rate_average();
+    test_dwell_scale();
+
+    if (g_failures) {
+        printf("sniffer hop: %d failure(s)\n", g_failures);
+        return 1;
+    }
+
+    printf("sniffer hop: all tests passed\n");
+    return 0;
+}
@@ -29,11 +29,35 @@ extern "C" {
 #define HCIT_TYPE_SCO_DATA  3
 #define HCIT_TYPE_EVENT     4
 
+#define TUSB_BTH_EVT_BUF_NUM      8     /* Controller events waiting for the USB interrupt endpoint */
+#define TUSB_BTH_EVT_RESERVED_NUM 3     /* Event buffers advertising reports can not take */
+#define TUSB_BTH_ACL_IN_BUF_NUM   8     /* Controller ACL packets waiting for the USB bulk IN endpoint */
+#define TUSB_BTH_EVT_SIZE_MAX     (2 + 255)
+
+/**
+ * @brief Counters of the HCI bridge.
+ */
+typedef struct {
+    uint32_t evt_sent;
+    uint32_t evt_dropped;       /* No free event buffer */
+    uint32_t evt_adv_dropped;   /* Of evt_dropped, advertising reports refused to keep the reserved buffers */
+    uint32_t acl_in_sent;
+    uint32_t acl_in_dropped;
+    uint32_t acl_out_sent;
+    uint32_t acl_out_deferred;  /* Held back until the controller had a free buffer */
+    uint32_t acl_out_dropped;   /* The host sent more packets than the controller has buffers */
+} tusb_bth_stats_t;
+
 /**
  * @brief Initialize BTH Device.
  */
 void tusb_bth_init(void);
 
+/**
+ * @brief Get the counters of the HCI bridge.
+ */
+void tusb_bth_get_stats(tusb_bth_stats_t *stats);
+
 #ifdef __cplusplus
 }
 #endif
\ No newline at end of file
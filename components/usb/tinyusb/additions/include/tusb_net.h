@@ -37,6 +37,11 @@ esp_err_t pkt_wifi2virtual(void *buffer, uint16_t len, void *eb);
 
 esp_err_t usb_send_data(void *buffer, uint16_t len);
 
+/**
+ * @brief Free a received packet, the `driver_free_rx_buffer` of the esp_netif the packets go to.
+ */
+void tusb_net_free_rx_buffer(void *h, void *buffer);
+
 /**
  * @brief Initialize NET Device.
  */
@@ -14,6 +14,9 @@
 
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include "esp_err.h"
 
 #ifdef __cplusplus
@@ -24,7 +27,7 @@ extern "C" {
  * @brief This helper function creates and starts a task which wraps `tud_task()`.
  *
  * The wrapper function basically wraps tud_task and some log.
- * Default parameters: stack size and priority as configured, argument = NULL, not pinned to any core.
+ * Default parameters: stack size, priority and core affinity as configured, argument = NULL.
  * If you have more requirements for this task, you can create your own task which calls tud_task as the last step.
  *
  * @retval ESP_OK run tinyusb main task successfully
@@ -41,6 +44,68 @@ esp_err_t tusb_run_task(void);
  */
 esp_err_t tusb_stop_task(void);
 
+/**
+ * @brief Classes owning a work queue, each queue is served by its own task
+ */
+typedef enum {
+    TUSB_WORK_NET = 0,
+    TUSB_WORK_CDC,
+    TUSB_WORK_MSC,
+    TUSB_WORK_MAX,
+} tusb_work_class_t;
+
+typedef void (*tusb_work_fn_t)(void *arg, size_t size);
+
+/**
+ * @brief Latency statistics of the TinyUSB task and of the work queues, in microseconds
+ */
+typedef struct {
+    uint32_t callback_count;                    /*!< Class callbacks run in the TinyUSB task */
+    uint32_t callback_time_avg;                 /*!< Time the TinyUSB task spent in a class callback */
+    uint32_t callback_time_max;
+    uint32_t work_count[TUSB_WORK_MAX];
+    uint32_t work_latency_max[TUSB_WORK_MAX];   /*!< Time a job waited in its queue */
+    uint32_t work_dropped[TUSB_WORK_MAX];       /*!< Jobs refused because the queue was full */
+} tusb_task_stats_t;
+
+/**
+ * @brief Create the work queue of a class and its task, priority and core affinity as configured.
+ *
+ * @note Calling it again for a started class does nothing.
+ *
+ * @retval ESP_OK the work queue is running
+ * @retval ESP_ERR_NO_MEM the queue or its task could not be created
+ */
+esp_err_t tusb_work_queue_start(tusb_work_class_t work_class);
+
+/**
+ * @brief Hand a job over to the work queue of a class, used by the class callbacks
+ *        so the TinyUSB task goes back to the bus at once.
+ *
+ * @param fn   - job to run in the work task
+ * @param arg  - job argument, e.g. a buffer the job owns from now on
+ * @param size - size of `arg`
+ *
+ * @retval ESP_OK the job is queued
+ * @retval ESP_ERR_INVALID_STATE the work queue of this class is not started
+ * @retval ESP_ERR_NO_MEM the queue is full, the caller still owns `arg`
+ */
+esp_err_t tusb_work_submit(tusb_work_class_t work_class, tusb_work_fn_t fn, void *arg, size_t size);
+
+/**
+ * @brief Mark the start and the end of a class callback run by the TinyUSB task.
+ *
+ * `tud_task()` blocks inside its event queue, so the time the task spends
+ * between two events is measured around the callbacks instead.
+ */
+void tusb_task_probe_begin(void);
+void tusb_task_probe_end(void);
+
+/**
+ * @brief Get the latency statistics, `reset` clears them afterwards
+ */
+void tusb_task_get_stats(tusb_task_stats_t *stats, bool reset);
+
 #ifdef __cplusplus
 }
 #endif
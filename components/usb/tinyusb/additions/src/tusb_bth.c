@@ -14,6 +14,7 @@
  *      limitations under the License.
  */
 
+#include <string.h>
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
@@ -25,12 +26,48 @@
 #define BUFFER_SIZE_MAX  256
 #define LE_READ_BUFF_SIZE                  0x2002
 #define HCI_H4_CMD_PREAMBLE_SIZE           (4)
+#define HCI_ACL_HDR_SIZE                   (4)
+#define HCI_CMD_SIZE_MAX                   (3 + 255)
+#define HCI_EVT_CMD_COMPLETE               0x0E
+#define HCI_EVT_LE_META                    0x3E
+#define HCI_LE_ADV_REPORT                  0x02
+#define HCI_LE_DIRECT_ADV_REPORT           0x0B
+#define HCI_LE_EXT_ADV_REPORT              0x0D
+#define HCI_LE_PERIODIC_ADV_REPORT         0x0F
 #define UINT16_TO_STREAM(p, u16) {*(p)++ = (uint8_t)(u16); *(p)++ = (uint8_t)((u16) >> 8);}
 #define UINT8_TO_STREAM(p, u8)   {*(p)++ = (uint8_t)(u8);}
 
+/**
+ * Packets are stored in H4 format, data[0] is the packet type. The USB side
+ * references the same buffer from data + 1, so nothing is copied again.
+ */
+typedef struct bth_buf {
+    struct bth_buf *next;
+    uint16_t len;                   /* Bytes in data, H4 type included */
+    uint8_t data[];
+} bth_buf_t;
+
+typedef struct {
+    bth_buf_t *free;
+    uint16_t free_num;
+    bth_buf_t *head;                /* Oldest packet waiting to be sent */
+    bth_buf_t *tail;
+    bth_buf_t *in_flight;           /* Owned by the USB endpoint until its sent callback */
+    uint16_t buf_size;              /* Capacity of data */
+    uint32_t sent;
+    uint32_t dropped;
+} bth_channel_t;
+
 static const char *TAG = "tusb_bth";
-static uint16_t acl_buf_size_max = 0;
-uint8_t * p_acl_buf = NULL;
+static portMUX_TYPE s_bth_lock = portMUX_INITIALIZER_UNLOCKED;
+static bth_channel_t s_bth_evt = {0};       /* Controller events to the host */
+static bth_channel_t s_bth_acl_in = {0};    /* Controller ACL data to the host */
+static bth_channel_t s_bth_acl_out = {0};   /* Host ACL data to the controller, one buffer per controller buffer */
+static uint32_t s_evt_adv_dropped = 0;
+static uint32_t s_acl_out_deferred = 0;
+static SemaphoreHandle_t s_acl_out_mutex = NULL;
+static bool s_acl_out_retry = false;
+static uint8_t s_hci_cmd_buf[1 + HCI_CMD_SIZE_MAX];
 
 void ble_controller_init(void) {
     esp_err_t ret;
@@ -52,13 +89,240 @@ void ble_controller_init(void) {
     }
 }
 
+static bool bth_channel_init(bth_channel_t *channel, uint16_t buf_num, uint16_t buf_size)
+{
+    size_t stride = (sizeof(bth_buf_t) + buf_size + 3) & ~3;
+    uint8_t *pool = calloc(buf_num, stride);
+
+    if (!pool) {
+        ESP_LOGE(TAG, "HCI buffer pool alloc fail, num: %d, size: %d", buf_num, buf_size);
+        return false;
+    }
+
+    channel->buf_size = buf_size;
+
+    for (int i = 0; i < buf_num; i++) {
+        bth_buf_t *buf = (bth_buf_t *)(pool + i * stride);
+        buf->next = channel->free;
+        channel->free = buf;
+    }
+
+    channel->free_num = buf_num;
+
+    return true;
+}
+
+/*
+ * @brief: Take a free buffer as long as more than `reserved` are left
+ */
+static bth_buf_t *bth_buf_alloc(bth_channel_t *channel, uint16_t reserved)
+{
+    bth_buf_t *buf = NULL;
+
+    portENTER_CRITICAL(&s_bth_lock);
+
+    if (channel->free_num > reserved) {
+        buf = channel->free;
+        channel->free = buf->next;
+        channel->free_num--;
+    } else {
+        channel->dropped++;
+    }
+
+    portEXIT_CRITICAL(&s_bth_lock);
+
+    return buf;
+}
+
+static void bth_channel_drop(bth_channel_t *channel)
+{
+    portENTER_CRITICAL(&s_bth_lock);
+    channel->dropped++;
+    portEXIT_CRITICAL(&s_bth_lock);
+}
+
+static void bth_buf_free(bth_channel_t *channel, bth_buf_t *buf)
+{
+    portENTER_CRITICAL(&s_bth_lock);
+    buf->next = channel->free;
+    channel->free = buf;
+    channel->free_num++;
+    portEXIT_CRITICAL(&s_bth_lock);
+}
+
+static void bth_channel_push(bth_channel_t *channel, bth_buf_t *buf)
+{
+    buf->next = NULL;
+
+    portENTER_CRITICAL(&s_bth_lock);
+
+    if (channel->tail) {
+        channel->tail->next = buf;
+    } else {
+        channel->head = buf;
+    }
+
+    channel->tail = buf;
+
+    portEXIT_CRITICAL(&s_bth_lock);
+}
+
+static bth_buf_t *bth_channel_pop(bth_channel_t *channel)
+{
+    portENTER_CRITICAL(&s_bth_lock);
+
+    bth_buf_t *buf = channel->head;
+
+    if (buf) {
+        channel->head = buf->next;
+
+        if (!channel->head) {
+            channel->tail = NULL;
+        }
+    }
+
+    portEXIT_CRITICAL(&s_bth_lock);
+
+    return buf;
+}
+
+/*
+ * @brief: Start the USB transfer of the oldest waiting packet unless one is
+ *         already in flight on this endpoint
+ */
+static void bth_channel_kick(bth_channel_t *channel)
+{
+    bth_buf_t *buf = NULL;
+    bool ret = false;
+
+    portENTER_CRITICAL(&s_bth_lock);
+
+    if (!channel->in_flight && channel->head) {
+        buf = channel->head;
+        channel->head = buf->next;
+
+        if (!channel->head) {
+            channel->tail = NULL;
+        }
+
+        channel->in_flight = buf;
+    }
+
+    portEXIT_CRITICAL(&s_bth_lock);
+
+    if (!buf) {
+        return;
+    }
+
+    if (channel == &s_bth_evt) {
+        ret = tud_bt_event_send(buf->data + 1, buf->len - 1);
+    } else {
+        ret = tud_bt_acl_data_send(buf->data + 1, buf->len - 1);
+    }
+
+    /* Endpoint not ready, e.g. not mounted yet: keep the packet first in line */
+    if (!ret) {
+        portENTER_CRITICAL(&s_bth_lock);
+        buf->next = channel->head;
+        channel->head = buf;
+
+        if (!channel->tail) {
+            channel->tail = buf;
+        }
+
+        channel->in_flight = NULL;
+        portEXIT_CRITICAL(&s_bth_lock);
+    }
+}
+
+static void bth_channel_complete(bth_channel_t *channel)
+{
+    portENTER_CRITICAL(&s_bth_lock);
+
+    bth_buf_t *buf = channel->in_flight;
+
+    if (buf) {
+        channel->in_flight = NULL;
+        buf->next = channel->free;
+        channel->free = buf;
+        channel->free_num++;
+        channel->sent++;
+    }
+
+    portEXIT_CRITICAL(&s_bth_lock);
+
+    bth_channel_kick(channel);
+}
+
+/*
+ * @brief: Hand the reassembled host ACL packets to the controller while it has
+ *         free buffers. Called from the TinyUSB task and from the controller
+ *         task, whoever finds the other one flushing leaves the work to it.
+ */
+static void bth_acl_out_flush(void)
+{
+    __atomic_store_n(&s_acl_out_retry, true, __ATOMIC_SEQ_CST);
+
+    while (__atomic_load_n(&s_acl_out_retry, __ATOMIC_SEQ_CST)) {
+        if (xSemaphoreTake(s_acl_out_mutex, 0) != pdTRUE) {
+            return;
+        }
+
+        __atomic_store_n(&s_acl_out_retry, false, __ATOMIC_SEQ_CST);
+
+        while (esp_vhci_host_check_send_available()) {
+            bth_buf_t *buf = bth_channel_pop(&s_bth_acl_out);
+
+            if (!buf) {
+                break;
+            }
+
+            esp_vhci_host_send_packet(buf->data, buf->len);
+
+            portENTER_CRITICAL(&s_bth_lock);
+            buf->next = s_bth_acl_out.free;
+            s_bth_acl_out.free = buf;
+            s_bth_acl_out.free_num++;
+            s_bth_acl_out.sent++;
+            portEXIT_CRITICAL(&s_bth_lock);
+        }
+
+        xSemaphoreGive(s_acl_out_mutex);
+    }
+}
+
 /*
  * @brief: BT controller callback function, used to notify the upper layer that
  *         controller is ready to receive command
  */
 static void controller_rcv_pkt_ready(void)
 {
-    //TODO
+    if (s_bth_acl_out.head) {
+        bth_acl_out_flush();
+    }
+}
+
+/*
+ * @brief: Advertising reports flood in during a scan and the host loses little
+ *         when one is dropped, unlike the Command Complete, Command Status or
+ *         Number Of Completed Packets events it waits for
+ */
+static bool bth_evt_is_adv_report(const uint8_t *data, uint16_t len)
+{
+    if (len < 4 || data[1] != HCI_EVT_LE_META) {
+        return false;
+    }
+
+    switch (data[3]) {
+        case HCI_LE_ADV_REPORT:
+        case HCI_LE_DIRECT_ADV_REPORT:
+        case HCI_LE_EXT_ADV_REPORT:
+        case HCI_LE_PERIODIC_ADV_REPORT:
+            return true;
+
+        default:
+            return false;
+    }
 }
 
 /*
@@ -67,21 +331,45 @@ static void controller_rcv_pkt_ready(void)
  */
 static int host_rcv_pkt(uint8_t *data, uint16_t len)
 {
-    uint16_t act_len = len - 1;
-
-    if(data[0] == HCIT_TYPE_EVENT) { // event data from controller
-        uint8_t *hci_buf = (uint8_t *)malloc(len);
-        memcpy(hci_buf, data +1 , act_len);
-        ESP_LOGI(TAG, "evt_data from controller, evt_data_length: %d :", act_len);
-        tud_bt_event_send(hci_buf, act_len);
-        free(hci_buf);
-    } else if(data[0] == HCIT_TYPE_ACL_DATA) { // acl data from controller
-        uint8_t *hci_acl_buf_contr = (uint8_t *)malloc(len);
-        memcpy(hci_acl_buf_contr, data +1 , act_len);
-        ESP_LOGI(TAG, "acl_data from controller, acl_data_length: %d :", act_len);
-        tud_bt_acl_data_send(hci_acl_buf_contr, act_len);
-        free(hci_acl_buf_contr);
+    bth_channel_t *channel = NULL;
+    uint16_t reserved = 0;
+
+    if (data[0] == HCIT_TYPE_EVENT) { // event data from controller
+        channel = &s_bth_evt;
+
+        if (bth_evt_is_adv_report(data, len)) {
+            reserved = TUSB_BTH_EVT_RESERVED_NUM;
+        }
+    } else if (data[0] == HCIT_TYPE_ACL_DATA) { // acl data from controller
+        channel = &s_bth_acl_in;
+    } else {
+        return 0;
+    }
+
+    if (len > channel->buf_size) {
+        bth_channel_drop(channel);
+        return 0;
+    }
+
+    /* The controller reuses `data` once this returns, copy it once into a pool buffer */
+    bth_buf_t *buf = bth_buf_alloc(channel, reserved);
+
+    if (!buf) {
+        if (reserved) {
+            portENTER_CRITICAL(&s_bth_lock);
+            s_evt_adv_dropped++;
+            portEXIT_CRITICAL(&s_bth_lock);
+        }
+
+        return 0;
     }
+
+    memcpy(buf->data, data, len);
+    buf->len = len;
+
+    bth_channel_push(channel, buf);
+    bth_channel_kick(channel);
+
     return 0;
 }
 
@@ -91,24 +379,34 @@ static esp_vhci_host_callback_t vhci_host_cb = {
 };
 
 static int host_rcv_pkt_test (uint8_t *data, uint16_t len) {
-    
-    ESP_LOGI(TAG, "host_rcv_pkt_test evt_data_length: %d :", len);
-    if(data[1] == 0x0e && data[2] == 0x07 
-        && data[4] == 0x02 && data[5] == 0x20) {
-        // LE Read Buffer size command complete event
-        uint16_t* size_p = NULL;
-        uint16_t cmd_value;
-        size_p = (uint8_t*)(&cmd_value);
-        *size_p = data[7];
-        *(size_p+1) = data[8];
-        acl_buf_size_max = *size_p;
-        ESP_LOGI(TAG, "acl_buf_size_max: %d", acl_buf_size_max);
+    uint16_t acl_buf_size_max = 0;
+    uint8_t acl_buf_num = 0;
+
+    // LE Read Buffer size command complete event
+    if (len < 10 || data[0] != HCIT_TYPE_EVENT || data[1] != HCI_EVT_CMD_COMPLETE
+            || data[4] != (LE_READ_BUFF_SIZE & 0xff) || data[5] != (LE_READ_BUFF_SIZE >> 8)) {
+        return 0;
     }
+
+    acl_buf_size_max = data[7] | (data[8] << 8);
+    acl_buf_num = data[9];
+
+    /* 0 means the LE buffers are shared with BR/EDR ones */
     if (!acl_buf_size_max) {
         acl_buf_size_max = BUFFER_SIZE_MAX;
     }
 
-    p_acl_buf = (uint8_t *)malloc(acl_buf_size_max + 1);
+    if (!acl_buf_num) {
+        acl_buf_num = TUSB_BTH_ACL_IN_BUF_NUM;
+    }
+
+    ESP_LOGI(TAG, "acl_buf_size_max: %d, acl_buf_num: %d", acl_buf_size_max, acl_buf_num);
+
+    if (!bth_channel_init(&s_bth_acl_in, TUSB_BTH_ACL_IN_BUF_NUM, 1 + HCI_ACL_HDR_SIZE + acl_buf_size_max)
+            || !bth_channel_init(&s_bth_acl_out, acl_buf_num, 1 + HCI_ACL_HDR_SIZE + acl_buf_size_max)) {
+        return 0;
+    }
+
     esp_vhci_host_register_callback(&vhci_host_cb);
     return 0;
 }
@@ -128,6 +426,13 @@ static esp_vhci_host_callback_t vhci_host_cb_test = {
 
 void tusb_bth_init(void)
 {
+    s_acl_out_mutex = xSemaphoreCreateMutex();
+
+    if (!s_acl_out_mutex || !bth_channel_init(&s_bth_evt, TUSB_BTH_EVT_BUF_NUM, 1 + TUSB_BTH_EVT_SIZE_MAX)) {
+        ESP_LOGE(TAG, "BTH init fail");
+        return;
+    }
+
     ble_controller_init();
     // register vhci_host_cb_test, test le read buffer size
     esp_vhci_host_register_callback(&vhci_host_cb_test);
@@ -136,6 +441,20 @@ void tusb_bth_init(void)
     esp_vhci_host_send_packet(buf, sz);
 }
 
+void tusb_bth_get_stats(tusb_bth_stats_t *stats)
+{
+    portENTER_CRITICAL(&s_bth_lock);
+    stats->evt_sent         = s_bth_evt.sent;
+    stats->evt_dropped      = s_bth_evt.dropped;
+    stats->evt_adv_dropped  = s_evt_adv_dropped;
+    stats->acl_in_sent      = s_bth_acl_in.sent;
+    stats->acl_in_dropped   = s_bth_acl_in.dropped;
+    stats->acl_out_sent     = s_bth_acl_out.sent;
+    stats->acl_out_deferred = s_acl_out_deferred;
+    stats->acl_out_dropped  = s_bth_acl_out.dropped;
+    portEXIT_CRITICAL(&s_bth_lock);
+}
+
 //--------------------------------------------------------------------+
 // tinyusb callbacks
 //--------------------------------------------------------------------+
@@ -147,13 +466,14 @@ void tusb_bth_init(void)
 // 1 byte for parameter total length) to 258.
 void tud_bt_hci_cmd_cb(void *hci_cmd, size_t cmd_len)
 {
-    uint8_t *hci_cmd_buf = (uint8_t *)malloc(cmd_len + 1);
-
-    hci_cmd_buf[0] = HCIT_TYPE_COMMAND;
-    memcpy(hci_cmd_buf+1, hci_cmd, cmd_len);
-    esp_vhci_host_send_packet(hci_cmd_buf, cmd_len +1);
+    if (cmd_len > HCI_CMD_SIZE_MAX) {
+        return;
+    }
 
-    free(hci_cmd_buf);
+    // The controller copies the command, the buffer is reused for the next one
+    s_hci_cmd_buf[0] = HCIT_TYPE_COMMAND;
+    memcpy(s_hci_cmd_buf + 1, hci_cmd, cmd_len);
+    esp_vhci_host_send_packet(s_hci_cmd_buf, cmd_len + 1);
 }
 
 // Invoked when ACL data was received over USB from Bluetooth host.
@@ -161,46 +481,61 @@ void tud_bt_hci_cmd_cb(void *hci_cmd, size_t cmd_len)
 // Part E, 5.4.2.
 // Length is from 4 bytes, (12 bits for Handle, 4 bits for flags
 // and 16 bits for data total length) to endpoint size.
-static bool prepare_write = false;
-static uint16_t write_offset = 0;
-static uint16_t acl_data_length = 0;
+static bth_buf_t *s_acl_out_cur = NULL;
+static uint16_t s_acl_out_remain = 0;   // Bytes of the current packet still to come
 void tud_bt_acl_data_received_cb(void *acl_data, uint16_t data_len)
 {
+    const uint8_t *data = (const uint8_t *)acl_data;
 
-    // if acl_data is long data
-    if(!prepare_write) {
-        // first get acl_data_length
-        acl_data_length = *(((uint16_t * )acl_data) + 1);
-        if(acl_data_length > data_len) {
-            prepare_write = true;
-            p_acl_buf[0] = HCIT_TYPE_ACL_DATA;
-            memcpy(p_acl_buf + 1, acl_data, data_len);
-            write_offset = data_len + 1;
+    if (!s_acl_out_remain) {
+        // first chunk of a packet carries its header
+        if (data_len < HCI_ACL_HDR_SIZE || !s_bth_acl_out.buf_size) {
+            return;
+        }
+
+        s_acl_out_remain = HCI_ACL_HDR_SIZE + (data[2] | (data[3] << 8));
+
+        if (1 + s_acl_out_remain > s_bth_acl_out.buf_size) {
+            bth_channel_drop(&s_bth_acl_out);
         } else {
-            p_acl_buf[0] = HCIT_TYPE_ACL_DATA;
-            memcpy(p_acl_buf + 1, acl_data, data_len);
-            ESP_LOGI(TAG, "short acl_data from host, will send to controller, length: %d", (data_len + 1));
-            esp_vhci_host_send_packet(p_acl_buf, data_len + 1);
+            s_acl_out_cur = bth_buf_alloc(&s_bth_acl_out, 0);
         }
-    } else {
-        memcpy(p_acl_buf + write_offset, acl_data, data_len);
-        write_offset += data_len;
-        if(acl_data_length > write_offset) {
-            ESP_LOGI(TAG, "Remaining bytes: %d", (acl_data_length - write_offset));
-            return;
+
+        if (s_acl_out_cur) {
+            s_acl_out_cur->data[0] = HCIT_TYPE_ACL_DATA;
+            s_acl_out_cur->len = 1;
         }
-        ESP_LOGI(TAG, "long acl_data from host, will send to controller, length: %d", (data_len + 1));
-        prepare_write = false;
-        esp_vhci_host_send_packet(p_acl_buf, data_len + write_offset);
     }
-    //free(hci_data_buf);
+
+    // a dropped packet is still consumed up to its end
+    uint16_t len = data_len < s_acl_out_remain ? data_len : s_acl_out_remain;
+
+    if (s_acl_out_cur) {
+        memcpy(s_acl_out_cur->data + s_acl_out_cur->len, data, len);
+        s_acl_out_cur->len += len;
+    }
+
+    s_acl_out_remain -= len;
+
+    if (s_acl_out_remain || !s_acl_out_cur) {
+        return;
+    }
+
+    bth_channel_push(&s_bth_acl_out, s_acl_out_cur);
+    s_acl_out_cur = NULL;
+
+    if (!esp_vhci_host_check_send_available()) {
+        s_acl_out_deferred++;
+    }
+
+    bth_acl_out_flush();
 }
 
 // Called when event sent with tud_bt_event_send() was delivered to BT stack.
 // Controller can release/reuse buffer with Event packet at this point.
 void tud_bt_event_sent_cb(uint16_t sent_bytes)
 {
-    //TODO
+    bth_channel_complete(&s_bth_evt);
 }
 
 // Called when ACL data that was sent with tud_bt_acl_data_send()
@@ -208,5 +543,5 @@ void tud_bt_event_sent_cb(uint16_t sent_bytes)
 // Controller can release/reuse buffer with ACL packet at this point.
 void tud_bt_acl_data_sent_cb(uint16_t sent_bytes)
 {
-    //TODO
-}
\ No newline at end of file
+    bth_channel_complete(&s_bth_acl_in);
+}
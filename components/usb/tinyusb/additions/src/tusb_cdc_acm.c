@@ -20,6 +20,7 @@
 #include "freertos/task.h"
 #include "tusb.h"
 #include "tusb_cdc_acm.h"
+#include "tusb_tasks.h"
 #include "cdc.h"
 #include "sdkconfig.h"
 
@@ -36,6 +37,7 @@ typedef struct {
     tusb_cdcacm_callback_t callback_rx_wanted_char;
     tusb_cdcacm_callback_t callback_line_state_changed;
     tusb_cdcacm_callback_t callback_line_coding_changed;
+    bool rx_cb_pending; // An RX event is queued to the CDC work task, later RX data joins it
 } esp_tusb_cdcacm_t; /*!< CDC_AMC object */
 
 static const char *TAG = "tusb_cdc_acm";
@@ -87,9 +89,27 @@ void tud_cdc_line_state_cb(uint8_t itf, bool dtr, bool rts)
 }
 
 
+static void cdc_rx_work(void *arg, size_t size)
+{
+    tinyusb_cdcacm_itf_t itf = (tinyusb_cdcacm_itf_t)(uintptr_t)arg;
+    esp_tusb_cdcacm_t *acm = get_acm(itf);
+    if (!acm) {
+        return;
+    }
+    __atomic_store_n(&acm->rx_cb_pending, false, __ATOMIC_SEQ_CST);
+    tusb_cdcacm_callback_t cb = acm->callback_rx;
+    if (cb) {
+        cdcacm_event_t event = {
+            .type = CDC_EVENT_RX
+        };
+        cb(itf, &event);
+    }
+}
+
 /* Invoked when CDC interface received data from host */
 void tud_cdc_rx_cb(uint8_t itf)
 {
+    tusb_task_probe_begin();
     esp_tusb_cdcacm_t *acm = get_acm(itf);
     if (acm) {
         if (!acm->rx_unread_buf) {
@@ -98,6 +118,7 @@ void tud_cdc_rx_cb(uint8_t itf)
         }
     } else {
         tud_cdc_n_read_flush(itf); // we have no place to store data, so just drop it
+        tusb_task_probe_end();
         return;
     }
     while (tud_cdc_n_available(itf)) {
@@ -113,15 +134,13 @@ void tud_cdc_rx_cb(uint8_t itf)
             ESP_LOGV(TAG, "Sent %d bytes to the buffer", read_res);
         }
     }
-    if (acm) {
-        tusb_cdcacm_callback_t cb = acm->callback_rx;
-        if (cb) {
-            cdcacm_event_t event = {
-                .type = CDC_EVENT_RX
-            };
-            cb(itf, &event);
+    if (acm && acm->callback_rx && !__atomic_exchange_n(&acm->rx_cb_pending, true, __ATOMIC_SEQ_CST)) {
+        // The user callback may be slow, it runs in the CDC work task
+        if (tusb_work_submit(TUSB_WORK_CDC, cdc_rx_work, (void *)(uintptr_t)itf, 0) != ESP_OK) {
+            __atomic_store_n(&acm->rx_cb_pending, false, __ATOMIC_SEQ_CST);
         }
     }
+    tusb_task_probe_end();
 }
 
 // Invoked when line coding is change via SET_LINE_CODING
@@ -369,6 +388,7 @@ esp_err_t tusb_cdc_acm_init(const tinyusb_config_cdcacm_t *cfg)
         .cdc_class = TUSB_CLASS_CDC,
         .cdc_subclass.comm_subclass = CDC_COMM_SUBCLASS_ABSTRACT_CONTROL_MODEL
     };
+    ESP_RETURN_ON_ERROR(tusb_work_queue_start(TUSB_WORK_CDC), TAG, "tusb_work_queue_start failed");
     ESP_RETURN_ON_ERROR(tinyusb_cdc_init(itf, &cdc_cfg), TAG, "tinyusb_cdc_init failed");
     ESP_RETURN_ON_ERROR(alloc_obj(itf), TAG, "alloc_obj failed");
 
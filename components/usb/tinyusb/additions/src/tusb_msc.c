@@ -12,19 +12,345 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include "esp_bit_defs.h"
 #include "esp_err.h"
 #include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
 #include "ffconf.h"
 #include "ff.h"
 #include "diskio.h"
 #include "tusb_msc.h"
+#include "tusb_tasks.h"
 
+#define SCSI_CMD_SYNCHRONIZE_CACHE_10 0x35
+#define MSC_CACHE_BLK_NONE            UINT32_MAX
+
+static const char *TAG = "tusb_msc";
 static uint8_t s_pdrv = 0;
 static int s_disk_block_size = 0;
 
 #define LOGICAL_DISK_NUM 1
 static bool ejected[LOGICAL_DISK_NUM] = {true};
 
+/**
+ * @brief One cache block, CONFIG_TINYUSB_MSC_CACHE_SIZE bytes aligned on the disk
+ */
+typedef struct {
+    uint32_t blk;               /* Block number, MSC_CACHE_BLK_NONE if empty */
+    uint32_t dirty;             /* Bitmap of the sectors written by the host */
+    uint8_t *data;
+} msc_cache_block_t;
+
+/**
+ * The USB callbacks only copy to and from RAM. Written sectors are gathered
+ * in `fill`, which is handed over to the MSC work task as `flush` when the host
+ * moves on to another block or stops writing. Reads are served from `read`,
+ * which loads a whole block at once and is kept coherent with the writes.
+ */
+typedef struct {
+    SemaphoreHandle_t lock;
+    SemaphoreHandle_t flush_done;
+    esp_timer_handle_t idle_timer;
+    bool idle_armed;
+    msc_cache_block_t fill;
+    msc_cache_block_t flush;
+    msc_cache_block_t read;
+    uint32_t block_size;        /* Bytes per cache block */
+    uint32_t sectors;           /* Sectors per cache block */
+    uint32_t disk_sectors;      /* Sectors on the disk, the last block may be partial */
+    TickType_t last_write;
+    bool flush_error;
+} msc_cache_t;
+
+static msc_cache_t s_cache = {0};
+
+static void msc_cache_write_back(msc_cache_block_t *block)
+{
+    uint32_t sector = 0;
+
+    /* Write each run of dirty sectors with one call, a whole block is one erase */
+    while (sector < s_cache.sectors) {
+        if (!(block->dirty & BIT(sector))) {
+            sector++;
+            continue;
+        }
+
+        uint32_t count = 1;
+        while (sector + count < s_cache.sectors && (block->dirty & BIT(sector + count))) {
+            count++;
+        }
+
+        if (disk_write(s_pdrv, block->data + sector * s_disk_block_size,
+                       block->blk * s_cache.sectors + sector, count) != RES_OK) {
+            ESP_LOGE(TAG, "write back block %u failed", block->blk);
+            s_cache.flush_error = true;
+        }
+
+        sector += count;
+    }
+}
+
+/* Called with the lock held, waits until the work task owns no block */
+static void msc_cache_wait_flush(void)
+{
+    while (s_cache.flush.blk != MSC_CACHE_BLK_NONE) {
+        xSemaphoreGive(s_cache.lock);
+        xSemaphoreTake(s_cache.flush_done, portMAX_DELAY);
+        xSemaphoreTake(s_cache.lock, portMAX_DELAY);
+    }
+}
+
+static void msc_cache_flush_work(void *arg, size_t size)
+{
+    /* The flush block belongs to this task until it is cleared */
+    msc_cache_write_back(&s_cache.flush);
+
+    xSemaphoreTake(s_cache.lock, portMAX_DELAY);
+    s_cache.flush.blk = MSC_CACHE_BLK_NONE;
+    s_cache.flush.dirty = 0;
+    xSemaphoreGive(s_cache.lock);
+    xSemaphoreGive(s_cache.flush_done);
+}
+
+/* Called with the lock held and the flush block free */
+static void msc_cache_hand_over(void)
+{
+    uint8_t *data = s_cache.flush.data;
+
+    s_cache.flush = s_cache.fill;
+    s_cache.fill.data = data;
+    s_cache.fill.blk = MSC_CACHE_BLK_NONE;
+    s_cache.fill.dirty = 0;
+
+    if (tusb_work_submit(TUSB_WORK_MSC, msc_cache_flush_work, NULL, 0) != ESP_OK) {
+        msc_cache_write_back(&s_cache.flush);
+        s_cache.flush.blk = MSC_CACHE_BLK_NONE;
+        s_cache.flush.dirty = 0;
+    }
+}
+
+/* Called with the lock held */
+static void msc_cache_arm_idle(uint32_t delay_ms)
+{
+    if (!s_cache.idle_armed && esp_timer_start_once(s_cache.idle_timer, delay_ms * 1000ULL) == ESP_OK) {
+        s_cache.idle_armed = true;
+    }
+}
+
+/**
+ * @brief The host stopped writing, do not keep its data in RAM any longer.
+ *        A non-NULL `arg` flushes at once.
+ */
+static void msc_cache_idle_work(void *arg, size_t size)
+{
+    xSemaphoreTake(s_cache.lock, portMAX_DELAY);
+    s_cache.idle_armed = false;
+
+    if (s_cache.fill.dirty) {
+        TickType_t elapsed = xTaskGetTickCount() - s_cache.last_write;
+
+        if (s_cache.flush.blk == MSC_CACHE_BLK_NONE
+                && (arg || elapsed >= pdMS_TO_TICKS(CONFIG_TINYUSB_MSC_FLUSH_DELAY_MS))) {
+            msc_cache_hand_over();
+        } else if (elapsed < pdMS_TO_TICKS(CONFIG_TINYUSB_MSC_FLUSH_DELAY_MS)) {
+            msc_cache_arm_idle(CONFIG_TINYUSB_MSC_FLUSH_DELAY_MS - elapsed * portTICK_PERIOD_MS);
+        } else {
+            msc_cache_arm_idle(CONFIG_TINYUSB_MSC_FLUSH_DELAY_MS);
+        }
+    }
+
+    xSemaphoreGive(s_cache.lock);
+}
+
+static void msc_cache_idle_timer_cb(void *arg)
+{
+    /* The wait for the lock does not belong in the esp_timer task */
+    if (tusb_work_submit(TUSB_WORK_MSC, msc_cache_idle_work, NULL, 0) != ESP_OK) {
+        esp_timer_start_once(s_cache.idle_timer, CONFIG_TINYUSB_MSC_FLUSH_DELAY_MS * 1000ULL);
+    }
+}
+
+static bool msc_cache_alloc(void)
+{
+    uint32_t block_size = MAX(CONFIG_TINYUSB_MSC_CACHE_SIZE, s_disk_block_size);
+
+    if (s_cache.block_size == block_size) {
+        return true;
+    }
+
+    if (s_cache.block_size || block_size % s_disk_block_size || block_size / s_disk_block_size > 32) {
+        ESP_LOGE(TAG, "cache block size %u does not fit sector size %d", block_size, s_disk_block_size);
+        return false;
+    }
+
+    uint8_t *data = malloc(3 * block_size);
+
+    if (!data) {
+        ESP_LOGE(TAG, "cache alloc fail, size: %u", 3 * block_size);
+        return false;
+    }
+
+    xSemaphoreTake(s_cache.lock, portMAX_DELAY);
+    s_cache.fill  = (msc_cache_block_t) {.blk = MSC_CACHE_BLK_NONE, .data = data};
+    s_cache.flush = (msc_cache_block_t) {.blk = MSC_CACHE_BLK_NONE, .data = data + block_size};
+    s_cache.read  = (msc_cache_block_t) {.blk = MSC_CACHE_BLK_NONE, .data = data + 2 * block_size};
+    s_cache.sectors = block_size / s_disk_block_size;
+    s_cache.block_size = block_size;
+    xSemaphoreGive(s_cache.lock);
+
+    return true;
+}
+
+/* Called with the lock held */
+static bool msc_cache_load(uint32_t blk)
+{
+    if (s_cache.read.blk == blk) {
+        return true;
+    }
+
+    /* The disk is only current once a pending flush of this block is done */
+    if (s_cache.flush.blk == blk) {
+        msc_cache_wait_flush();
+    }
+
+    s_cache.read.blk = MSC_CACHE_BLK_NONE;
+
+    /* Do not read ahead past the end of the disk */
+    uint32_t sector = blk * s_cache.sectors;
+
+    if (sector >= s_cache.disk_sectors
+            || disk_read(s_pdrv, s_cache.read.data, sector, MIN(s_cache.sectors, s_cache.disk_sectors - sector)) != RES_OK) {
+        return false;
+    }
+
+    if (s_cache.fill.blk == blk) {
+        for (uint32_t sector = 0; sector < s_cache.sectors; sector++) {
+            if (s_cache.fill.dirty & BIT(sector)) {
+                memcpy(s_cache.read.data + sector * s_disk_block_size,
+                       s_cache.fill.data + sector * s_disk_block_size, s_disk_block_size);
+            }
+        }
+    }
+
+    s_cache.read.blk = blk;
+    return true;
+}
+
+static int32_t msc_cache_read(uint64_t addr, uint8_t *buffer, uint32_t size)
+{
+    uint32_t done = 0;
+
+    xSemaphoreTake(s_cache.lock, portMAX_DELAY);
+
+    while (done < size) {
+        uint32_t blk = (addr + done) / s_cache.block_size;
+        uint32_t offset = (addr + done) % s_cache.block_size;
+        uint32_t len = MIN(size - done, s_cache.block_size - offset);
+
+        if (!msc_cache_load(blk)) {
+            break;
+        }
+
+        memcpy(buffer + done, s_cache.read.data + offset, len);
+        done += len;
+    }
+
+    xSemaphoreGive(s_cache.lock);
+
+    return done ? done : -1;
+}
+
+static int32_t msc_cache_write(uint64_t addr, const uint8_t *buffer, uint32_t size)
+{
+    uint32_t done = 0;
+
+    xSemaphoreTake(s_cache.lock, portMAX_DELAY);
+
+    while (done < size) {
+        uint32_t blk = (addr + done) / s_cache.block_size;
+        uint32_t offset = (addr + done) % s_cache.block_size;
+        uint32_t len = MIN(size - done, s_cache.block_size - offset);
+
+        if (s_cache.fill.blk != blk) {
+            if (s_cache.fill.dirty) {
+                msc_cache_wait_flush();
+                msc_cache_hand_over();
+            }
+
+            s_cache.fill.blk = blk;
+        }
+
+        /* TinyUSB splits sectors larger than its buffer, keep the head of a sector the host starts past */
+        uint32_t first = offset / s_disk_block_size;
+
+        if (offset % s_disk_block_size && !(s_cache.fill.dirty & BIT(first))) {
+            if (s_cache.flush.blk == blk) {
+                msc_cache_wait_flush();
+            }
+
+            if (disk_read(s_pdrv, s_cache.fill.data + first * s_disk_block_size, blk * s_cache.sectors + first, 1) != RES_OK) {
+                /* Writing the sector back with a garbage head would corrupt it */
+                ESP_LOGE(TAG, "read sector %u failed", blk * s_cache.sectors + first);
+                break;
+            }
+        }
+
+        memcpy(s_cache.fill.data + offset, buffer + done, len);
+
+        for (uint32_t sector = offset / s_disk_block_size; sector * s_disk_block_size < offset + len; sector++) {
+            s_cache.fill.dirty |= BIT(sector);
+        }
+
+        if (s_cache.read.blk == blk) {
+            memcpy(s_cache.read.data + offset, buffer + done, len);
+        }
+
+        done += len;
+    }
+
+    if (done) {
+        s_cache.last_write = xTaskGetTickCount();
+        msc_cache_arm_idle(CONFIG_TINYUSB_MSC_FLUSH_DELAY_MS);
+    }
+
+    xSemaphoreGive(s_cache.lock);
+
+    return done ? done : -1;
+}
+
+/**
+ * @brief Write everything the host wrote to the disk, used for SYNCHRONIZE CACHE and eject
+ */
+static bool msc_cache_sync(void)
+{
+    if (s_cache.block_size) {
+        xSemaphoreTake(s_cache.lock, portMAX_DELAY);
+        msc_cache_wait_flush();
+
+        if (s_cache.fill.dirty) {
+            msc_cache_hand_over();
+            msc_cache_wait_flush();
+        }
+
+        s_cache.fill.blk = MSC_CACHE_BLK_NONE;
+        bool error = s_cache.flush_error;
+        s_cache.flush_error = false;
+        xSemaphoreGive(s_cache.lock);
+
+        if (error) {
+            return false;
+        }
+    }
+
+    return disk_ioctl(s_pdrv, CTRL_SYNC, NULL) == RES_OK;
+}
+
 esp_err_t tusb_msc_init(const tinyusb_config_msc_t *cfg)
 {
     if (cfg == NULL) {
@@ -36,6 +362,26 @@ esp_err_t tusb_msc_init(const tinyusb_config_msc_t *cfg)
     }
 
     s_pdrv = cfg->pdrv;
+
+    if (s_cache.idle_timer) {
+        return ESP_OK;
+    }
+
+    esp_timer_create_args_t timer_args = {
+        .callback = msc_cache_idle_timer_cb,
+        .name     = "msc_idle",
+    };
+
+    s_cache.lock = xSemaphoreCreateMutex();
+    s_cache.flush_done = xSemaphoreCreateBinary();
+    s_cache.fill.blk = s_cache.flush.blk = s_cache.read.blk = MSC_CACHE_BLK_NONE;
+
+    if (!s_cache.lock || !s_cache.flush_done || tusb_work_queue_start(TUSB_WORK_MSC) != ESP_OK
+            || esp_timer_create(&timer_args, &s_cache.idle_timer) != ESP_OK) {
+        ESP_LOGE(TAG, "create MSC cache failed");
+        return ESP_ERR_NO_MEM;
+    }
+
     return ESP_OK;
 }
 
@@ -59,6 +405,11 @@ void tud_mount_cb(void)
 void tud_umount_cb(void)
 {
     ESP_LOGW(__func__, "");
+
+    // The host may have left without syncing, do not wait for the write-back delay
+    if (s_cache.block_size) {
+        tusb_work_submit(TUSB_WORK_MSC, msc_cache_idle_work, (void *)1, 0);
+    }
 }
 
 // Invoked when usb bus is suspended
@@ -153,6 +504,10 @@ void tud_msc_capacity_cb(uint8_t lun, uint32_t *block_count, uint16_t *block_siz
     disk_ioctl(s_pdrv, GET_SECTOR_COUNT, block_count);
     disk_ioctl(s_pdrv, GET_SECTOR_SIZE, block_size);
     s_disk_block_size = *block_size;
+    xSemaphoreTake(s_cache.lock, portMAX_DELAY);
+    s_cache.disk_sectors = *block_count;
+    xSemaphoreGive(s_cache.lock);
+    msc_cache_alloc();
     ESP_LOGD(__func__, "GET_SECTOR_COUNT = %d，GET_SECTOR_SIZE = %d", *block_count, *block_size);
 }
 
@@ -184,7 +539,7 @@ bool tud_msc_start_stop_cb(uint8_t lun, uint8_t power_condition, bool start, boo
     if (load_eject) {
         if (!start) {
             // Eject but first flush.
-            if (disk_ioctl(s_pdrv, CTRL_SYNC, NULL) != RES_OK) {
+            if (!msc_cache_sync()) {
                 return false;
             } else {
                 ejected[lun] = true;
@@ -196,7 +551,7 @@ bool tud_msc_start_stop_cb(uint8_t lun, uint8_t power_condition, bool start, boo
     } else {
         if (!start) {
             // Stop the unit but don't eject.
-            if (disk_ioctl(s_pdrv, CTRL_SYNC, NULL) != RES_OK) {
+            if (!msc_cache_sync()) {
                 return false;
             }
         }
@@ -218,9 +573,15 @@ int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset, void *buff
         return 0;
     }
 
-    const uint32_t block_count = bufsize / s_disk_block_size;
-    disk_read(s_pdrv, buffer, lba, block_count);
-    return block_count * s_disk_block_size;
+    if (!s_cache.block_size) {
+        const uint32_t block_count = bufsize / s_disk_block_size;
+        return disk_read(s_pdrv, buffer, lba, block_count) == RES_OK ? block_count * s_disk_block_size : -1;
+    }
+
+    tusb_task_probe_begin();
+    int32_t ret = msc_cache_read((uint64_t)lba * s_disk_block_size + offset, buffer, bufsize);
+    tusb_task_probe_end();
+    return ret;
 }
 
 // Callback invoked when received WRITE10 command.
@@ -228,16 +589,21 @@ int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset, void *buff
 int32_t tud_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset, uint8_t *buffer, uint32_t bufsize)
 {
     ESP_LOGD(__func__, "");
-    (void) offset;
 
     if (lun >= LOGICAL_DISK_NUM) {
         ESP_LOGE(__func__, "invalid lun number %u", lun);
         return 0;
     }
 
-    const uint32_t block_count = bufsize / s_disk_block_size;
-    disk_write(s_pdrv, buffer, lba, block_count);
-    return block_count * s_disk_block_size;
+    if (!s_cache.block_size) {
+        const uint32_t block_count = bufsize / s_disk_block_size;
+        return disk_write(s_pdrv, buffer, lba, block_count) == RES_OK ? block_count * s_disk_block_size : -1;
+    }
+
+    tusb_task_probe_begin();
+    int32_t ret = msc_cache_write((uint64_t)lba * s_disk_block_size + offset, buffer, bufsize);
+    tusb_task_probe_end();
+    return ret;
 }
 
 // Callback invoked when received an SCSI command not in built-in list below
@@ -254,7 +620,7 @@ int32_t tud_msc_scsi_cb(uint8_t lun, uint8_t const scsi_cmd[16], void *buffer, u
     }
 
     void const *response = NULL;
-    uint16_t resplen = 0;
+    int32_t resplen = 0;
 
     // most scsi handled is input
     bool in_xfer = true;
@@ -265,6 +631,16 @@ int32_t tud_msc_scsi_cb(uint8_t lun, uint8_t const scsi_cmd[16], void *buffer, u
             resplen = 0;
             break;
 
+        case SCSI_CMD_SYNCHRONIZE_CACHE_10:
+            // Host wants the written data on the disk
+            if (msc_cache_sync()) {
+                resplen = 0;
+            } else {
+                tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x0C, 0x00);
+                resplen = -1;
+            }
+            break;
+
         default:
             // Set Sense = Invalid Command Operation
             tud_msc_set_sense(lun, SCSI_SENSE_ILLEGAL_REQUEST, 0x20, 0x00);
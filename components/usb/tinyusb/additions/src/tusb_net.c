@@ -14,6 +14,8 @@
  *      limitations under the License.
  */
 
+#include <stdlib.h>
+#include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 #include "lwip/netif.h"
@@ -22,6 +24,7 @@
 #include "esp_log.h"
 
 #include "tusb_net.h"
+#include "tusb_tasks.h"
 
 static const char *TAG = "tusb_net";
 
@@ -56,9 +59,24 @@ esp_err_t pkt_netif2driver(void *buffer, uint16_t len)
     return ESP_OK;
 }
 
+void tusb_net_free_rx_buffer(void *h, void *buffer)
+{
+    free(buffer);
+}
+
+/*
+ * @brief: Runs in the network work task, the buffer is freed by esp_netif
+ *         through tusb_net_free_rx_buffer() once the stack is done with it
+ */
+static void net_recv_work(void *arg, size_t size)
+{
+    esp_netif_receive(dongle_netif, arg, size, arg);
+}
+
 void tusb_net_init(void)
 {
     vSemaphoreCreateBinary(Net_Semphore);
+    ESP_ERROR_CHECK(tusb_work_queue_start(TUSB_WORK_NET));
 }
 
 //--------------------------------------------------------------------+
@@ -68,8 +86,21 @@ void tusb_net_init(void)
 bool tud_network_recv_cb(const uint8_t *src, uint16_t size)
 {
     // ESP_LOG_BUFFER_HEXDUMP(" usb ==> netif", src, size, ESP_LOG_INFO);
-    esp_netif_receive(dongle_netif, src, size, NULL);
+    tusb_task_probe_begin();
+
+    // The class has a single receive buffer, copy the packet out so it can be renewed at once
+    void *buffer = malloc(size);
+
+    if (buffer) {
+        memcpy(buffer, src, size);
+
+        if (tusb_work_submit(TUSB_WORK_NET, net_recv_work, buffer, size) != ESP_OK) {
+            free(buffer);
+        }
+    }
+
     tud_network_recv_renew();
+    tusb_task_probe_end();
     return true;
 }
 
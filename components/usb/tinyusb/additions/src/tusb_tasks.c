@@ -12,16 +12,46 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <string.h>
 #include "sdkconfig.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
 #include "freertos/task.h"
 #include "esp_log.h"
 #include "esp_check.h"
+#include "esp_timer.h"
 #include "tinyusb.h"
 #include "tusb_tasks.h"
 
+#ifndef CONFIG_TINYUSB_TASK_AFFINITY
+#define CONFIG_TINYUSB_TASK_AFFINITY 0
+#endif
+
+typedef struct {
+    tusb_work_fn_t fn;
+    void *arg;
+    size_t size;
+    int64_t queued_us;
+} tusb_work_t;
+
+typedef struct {
+    const char *name;
+    UBaseType_t priority;
+    QueueHandle_t queue;
+} tusb_work_queue_t;
+
 const static char *TAG = "tusb_tsk";
 static TaskHandle_t s_tusb_tskh;
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static tusb_task_stats_t s_stats = {0};
+static uint64_t s_callback_time_sum = 0;
+static int64_t s_probe_start_us = 0;
+
+static tusb_work_queue_t s_work_queues[TUSB_WORK_MAX] = {
+    [TUSB_WORK_NET] = {"TinyUSB_net", CONFIG_TINYUSB_WORK_NET_PRIORITY, NULL},
+    [TUSB_WORK_CDC] = {"TinyUSB_cdc", CONFIG_TINYUSB_WORK_CDC_PRIORITY, NULL},
+    [TUSB_WORK_MSC] = {"TinyUSB_msc", CONFIG_TINYUSB_WORK_MSC_PRIORITY, NULL},
+};
 
 /**
  * @brief This top level thread processes all usb events and invokes callbacks
@@ -40,7 +70,7 @@ esp_err_t tusb_run_task(void)
     // doing a sanity check anyway
     ESP_RETURN_ON_FALSE(!s_tusb_tskh, ESP_ERR_INVALID_STATE, TAG, "TinyUSB main task already started");
     // Create a task for tinyusb device stack:
-    xTaskCreatePinnedToCore(tusb_device_task, "TinyUSB", CONFIG_TINYUSB_TASK_STACK_SIZE, NULL, CONFIG_TINYUSB_TASK_PRIORITY, &s_tusb_tskh, 0);
+    xTaskCreatePinnedToCore(tusb_device_task, "TinyUSB", CONFIG_TINYUSB_TASK_STACK_SIZE, NULL, CONFIG_TINYUSB_TASK_PRIORITY, &s_tusb_tskh, CONFIG_TINYUSB_TASK_AFFINITY);
     ESP_RETURN_ON_FALSE(s_tusb_tskh, ESP_FAIL, TAG, "create TinyUSB main task failed");
     return ESP_OK;
 }
@@ -52,3 +82,106 @@ esp_err_t tusb_stop_task(void)
     s_tusb_tskh = NULL;
     return ESP_OK;
 }
+
+/**
+ * @brief Work task of a class, runs the jobs its callbacks handed over in order
+ */
+static void tusb_work_task(void *arg)
+{
+    tusb_work_class_t work_class = (tusb_work_class_t)(uintptr_t)arg;
+    QueueHandle_t queue = s_work_queues[work_class].queue;
+    tusb_work_t work;
+
+    while (1) {
+        if (xQueueReceive(queue, &work, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+
+        uint32_t latency = esp_timer_get_time() - work.queued_us;
+
+        portENTER_CRITICAL(&s_stats_lock);
+        s_stats.work_count[work_class]++;
+        if (latency > s_stats.work_latency_max[work_class]) {
+            s_stats.work_latency_max[work_class] = latency;
+        }
+        portEXIT_CRITICAL(&s_stats_lock);
+
+        work.fn(work.arg, work.size);
+    }
+}
+
+esp_err_t tusb_work_queue_start(tusb_work_class_t work_class)
+{
+    ESP_RETURN_ON_FALSE(work_class < TUSB_WORK_MAX, ESP_ERR_INVALID_ARG, TAG, "invalid work class");
+    tusb_work_queue_t *work_queue = &s_work_queues[work_class];
+
+    if (work_queue->queue) {
+        return ESP_OK;
+    }
+
+    work_queue->queue = xQueueCreate(CONFIG_TINYUSB_WORK_QUEUE_SIZE, sizeof(tusb_work_t));
+    ESP_RETURN_ON_FALSE(work_queue->queue, ESP_ERR_NO_MEM, TAG, "create %s queue failed", work_queue->name);
+
+    if (xTaskCreatePinnedToCore(tusb_work_task, work_queue->name, CONFIG_TINYUSB_WORK_TASK_STACK_SIZE, (void *)(uintptr_t)work_class,
+                                work_queue->priority, NULL, CONFIG_TINYUSB_WORK_TASK_AFFINITY) != pdPASS) {
+        vQueueDelete(work_queue->queue);
+        work_queue->queue = NULL;
+        ESP_LOGE(TAG, "create %s task failed", work_queue->name);
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t tusb_work_submit(tusb_work_class_t work_class, tusb_work_fn_t fn, void *arg, size_t size)
+{
+    if (work_class >= TUSB_WORK_MAX || !s_work_queues[work_class].queue) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    tusb_work_t work = {
+        .fn = fn,
+        .arg = arg,
+        .size = size,
+        .queued_us = esp_timer_get_time(),
+    };
+
+    if (xQueueSend(s_work_queues[work_class].queue, &work, 0) != pdTRUE) {
+        portENTER_CRITICAL(&s_stats_lock);
+        s_stats.work_dropped[work_class]++;
+        portEXIT_CRITICAL(&s_stats_lock);
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+void tusb_task_probe_begin(void)
+{
+    s_probe_start_us = esp_timer_get_time();
+}
+
+void tusb_task_probe_end(void)
+{
+    uint32_t time = esp_timer_get_time() - s_probe_start_us;
+
+    portENTER_CRITICAL(&s_stats_lock);
+    s_stats.callback_count++;
+    s_callback_time_sum += time;
+    if (time > s_stats.callback_time_max) {
+        s_stats.callback_time_max = time;
+    }
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+void tusb_task_get_stats(tusb_task_stats_t *stats, bool reset)
+{
+    portENTER_CRITICAL(&s_stats_lock);
+    *stats = s_stats;
+    stats->callback_time_avg = s_stats.callback_count ? s_callback_time_sum / s_stats.callback_count : 0;
+    if (reset) {
+        memset(&s_stats, 0, sizeof(s_stats));
+        s_callback_time_sum = 0;
+    }
+    portEXIT_CRITICAL(&s_stats_lock);
+}
@@ -37,6 +37,11 @@ const static char *TAG = "tusb_vfs";
 // Token signifying that no character is available
 #define NONE -1
 
+// Word-at-a-time byte search: a byte of `w` is zero if this is non-zero
+#define SWAR_ONES        0x01010101UL
+#define SWAR_HIGHS       0x80808080UL
+#define SWAR_HAS_ZERO(w) (((w) - SWAR_ONES) & ~(w) & SWAR_HIGHS)
+
 #define FD_CHECK(fd, ret_val) do {                      \
                                     if ((fd) != 0) {    \
                                     errno = EBADF;      \
@@ -70,6 +75,7 @@ typedef struct {
     uint32_t flags;
     char vfs_path[VFS_TUSB_MAX_PATH];
     int cdc_intf;
+    int rx_peek; // Char held back by the last read, e.g. a '\r' whose '\n' had not arrived yet
 } vfs_tinyusb_t;
 
 static vfs_tinyusb_t s_vfstusb;
@@ -105,6 +111,7 @@ static esp_err_t vfstusb_init(int cdc_intf, char const *path)
     s_vfstusb.cdc_intf = cdc_intf;
     s_vfstusb.tx_mode = DEFAULT_TX_MODE;
     s_vfstusb.rx_mode = DEFAULT_RX_MODE;
+    s_vfstusb.rx_peek = NONE;
 
     return apply_path(path);
 }
@@ -126,32 +133,65 @@ static int tusb_open(const char *path, int flags, int mode)
     return 0;
 }
 
+/**
+ * @brief Find the first `ch` in `buf`, comparing a word at a time
+ *
+ * @return index of `ch` or `len` if there is none
+ */
+static size_t find_char(const uint8_t *buf, size_t len, uint8_t ch)
+{
+    size_t i = 0;
+    uint32_t pattern = ch * SWAR_ONES;
+
+    for (; i < len && ((uintptr_t)(buf + i) & (sizeof(uint32_t) - 1)); i++) {
+        if (buf[i] == ch) {
+            return i;
+        }
+    }
+
+    for (; i + sizeof(uint32_t) <= len; i += sizeof(uint32_t)) {
+        uint32_t word;
+        memcpy(&word, buf + i, sizeof(word));
+        word ^= pattern;
+        if (SWAR_HAS_ZERO(word)) {
+            break;
+        }
+    }
+
+    for (; i < len; i++) {
+        if (buf[i] == ch) {
+            return i;
+        }
+    }
+    return len;
+}
+
 static ssize_t tusb_write(int fd, const void *data, size_t size)
 {
     FD_CHECK(fd, -1);
     size_t written_sz = 0;
-    const char *data_c = (const char *)data;
+    const uint8_t *data_c = (const uint8_t *)data;
     _lock_acquire(&(s_vfstusb.write_lock));
-    for (size_t i = 0; i < size; i++) {
-        int c = data_c[i];
-        /* handling the EOL */
-        if (c == '\n' && s_vfstusb.tx_mode != ESP_LINE_ENDINGS_LF) {
-            if (tinyusb_cdcacm_write_queue_char(s_vfstusb.cdc_intf, '\r')) {
-                written_sz++;
-            } else {
-                break; // can't write anymore
+    if (s_vfstusb.tx_mode == ESP_LINE_ENDINGS_LF) {
+        written_sz = tinyusb_cdcacm_write_queue(s_vfstusb.cdc_intf, (uint8_t *)data_c, size);
+    } else {
+        const uint8_t *eol = s_vfstusb.tx_mode == ESP_LINE_ENDINGS_CR ? (const uint8_t *)"\r" : (const uint8_t *)"\r\n";
+        size_t eol_len = s_vfstusb.tx_mode == ESP_LINE_ENDINGS_CR ? 1 : 2;
+        while (written_sz < size) {
+            /* copy the run up to the next EOL in one go */
+            size_t run = find_char(data_c + written_sz, size - written_sz, '\n');
+            size_t queued = run ? tinyusb_cdcacm_write_queue(s_vfstusb.cdc_intf, (uint8_t *)data_c + written_sz, run) : 0;
+            written_sz += queued;
+            if (queued < run || written_sz == size) {
+                break; // can't write anymore or done
             }
-            if (s_vfstusb.tx_mode == ESP_LINE_ENDINGS_CR) {
-                continue;
+            /* handling the EOL, it is written whole or not at all */
+            if (tud_cdc_n_write_available(s_vfstusb.cdc_intf) < eol_len) {
+                break;
             }
-        }
-        /* write a char */
-        if (tinyusb_cdcacm_write_queue_char(s_vfstusb.cdc_intf, c)) {
+            tinyusb_cdcacm_write_queue(s_vfstusb.cdc_intf, (uint8_t *)eol, eol_len);
             written_sz++;
-        } else {
-            break; // can't write anymore
         }
-
     }
     tud_cdc_n_write_flush(s_vfstusb.cdc_intf);
     _lock_release(&(s_vfstusb.write_lock));
@@ -164,37 +204,84 @@ static int tusb_close(int fd)
     return 0;
 }
 
+/**
+ * @brief Turn every "\r\n" of `buf` into "\n" in place
+ *
+ * @return length of the translated data
+ */
+static size_t rx_translate_crlf(uint8_t *buf, size_t len)
+{
+    size_t in = 0;
+    size_t out = 0;
+
+    while (in < len) {
+        size_t run = find_char(buf + in, len - in, '\r');
+        memmove(buf + out, buf + in, run);
+        out += run;
+        in += run;
+        if (in == len) {
+            break;
+        }
+        if (in + 1 == len) { // the '\n' may still be on its way
+            s_vfstusb.rx_peek = '\r';
+            break;
+        }
+        if (buf[in + 1] != '\n') {
+            buf[out++] = '\r';
+        }
+        in++; // the '\n' starts the next run
+    }
+    return out;
+}
+
 static ssize_t tusb_read(int fd, void *data, size_t size)
 {
     FD_CHECK(fd, -1);
-    char *data_c = (char *) data;
+    uint8_t *data_c = (uint8_t *) data;
     size_t received = 0;
     _lock_acquire(&(s_vfstusb.read_lock));
-    int cm1 = NONE;
-    int c = NONE;
-
-    while (received < size) {
-        cm1 = c; // store the old char
-        int c = tud_cdc_n_read_char(0); // get a new one
-        if (s_vfstusb.rx_mode == ESP_LINE_ENDINGS_CR) {
-            if (c == '\r') {
-                c = '\n';
+
+    if (s_vfstusb.rx_mode == ESP_LINE_ENDINGS_LF) {
+        received = tud_cdc_n_read(s_vfstusb.cdc_intf, data_c, size);
+    } else if (s_vfstusb.rx_mode == ESP_LINE_ENDINGS_CR) {
+        received = tud_cdc_n_read(s_vfstusb.cdc_intf, data_c, size);
+        for (size_t i = find_char(data_c, received, '\r'); i < received; i += 1 + find_char(data_c + i + 1, received - i - 1, '\r')) {
+            data_c[i] = '\n';
+        }
+    } else {
+        while (received < size) {
+            size_t n = 0;
+            if (s_vfstusb.rx_peek != NONE) {
+                data_c[received] = s_vfstusb.rx_peek;
+                s_vfstusb.rx_peek = NONE;
+                n = 1;
             }
-        } else if (s_vfstusb.rx_mode == ESP_LINE_ENDINGS_CR) {
-            if ((c == '\n') & (cm1 == '\r')) {
-                --received; // step back
-                c = '\n';
+            n += tud_cdc_n_read(s_vfstusb.cdc_intf, data_c + received + n, size - received - n);
+            if (n == 0) {
+                break;
+            }
+            if (n == 1 && data_c[received] == '\r' && received + 1 == size) {
+                /* no room left to read ahead into, look at the next char alone */
+                uint8_t c;
+                if (!tud_cdc_n_read(s_vfstusb.cdc_intf, &c, 1)) {
+                    s_vfstusb.rx_peek = '\r';
+                    break;
+                }
+                if (c == '\n') {
+                    data_c[received] = '\n';
+                } else {
+                    s_vfstusb.rx_peek = c;
+                }
+                received++;
+                break;
+            }
+            received += rx_translate_crlf(data_c + received, n);
+            if (s_vfstusb.rx_peek != NONE) {
+                break;
             }
-        }
-        if ( c == NONE) { // if data ends
-            break;
-        }
-        data_c[received] = (char) c;
-        ++received;
-        if (c == '\n') {
-            break;
         }
     }
+
     _lock_release(&(s_vfstusb.read_lock));
     if (received > 0) {
         return received;
@@ -0,0 +1,92 @@
+// Copyright 2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <esp_err.h>
+#include "esp_http_server.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define WEB_JSON_BUFFER_SIZE    128 /**< Bytes buffered in the writer before a chunk is sent */
+#define WEB_JSON_MAX_DEPTH      8   /**< Maximum nesting of objects and arrays */
+
+/**
+ * @brief Streaming JSON writer bound to one HTTP request.
+ *
+ * Output is staged in a small fixed buffer and sent with httpd_resp_send_chunk()
+ * whenever it fills up, so no heap is needed however long the document gets.
+ * The first error is latched in `err`; later calls become no-ops and the error
+ * is returned by web_json_writer_finish().
+ */
+typedef struct {
+    httpd_req_t *req;
+    esp_err_t err;
+    uint16_t len;
+    uint8_t depth;
+    uint16_t need_comma;                /**< Bit n set: level n already holds an element */
+    char buf[WEB_JSON_BUFFER_SIZE];
+} web_json_writer_t;
+
+/**
+ * @brief Bind a writer to a request. The caller must not send anything else on
+ *        the request until web_json_writer_finish() is called.
+ *
+ * @param writer  Writer, usually allocated on the handler's stack
+ * @param req     HTTP request to respond to
+ */
+void web_json_writer_init(web_json_writer_t *writer, httpd_req_t *req);
+
+/**
+ * @brief Open an object or an array.
+ *
+ * @param key Member name when inside an object, NULL at top level or inside an array
+ */
+void web_json_object_start(web_json_writer_t *writer, const char *key);
+void web_json_object_end(web_json_writer_t *writer);
+void web_json_array_start(web_json_writer_t *writer, const char *key);
+void web_json_array_end(web_json_writer_t *writer);
+
+/**
+ * @brief Add a string value, escaping quotes, backslashes and control characters.
+ *
+ * @note  web_json_add_string_len() stops at the first NUL, so fixed-size fields
+ *        such as `wifi_ap_record_t.ssid` can be passed with their array size.
+ */
+void web_json_add_string(web_json_writer_t *writer, const char *key, const char *value);
+void web_json_add_string_len(web_json_writer_t *writer, const char *key, const char *value, size_t max_len);
+void web_json_add_int(web_json_writer_t *writer, const char *key, int32_t value);
+void web_json_add_uint(web_json_writer_t *writer, const char *key, uint32_t value);
+void web_json_add_bool(web_json_writer_t *writer, const char *key, bool value);
+
+/**
+ * @brief Flush the staged bytes and terminate the chunked response.
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_STATE: objects/arrays were left open or nested too deep
+ *     - Others: error returned by httpd_resp_send_chunk()
+ */
+esp_err_t web_json_writer_finish(web_json_writer_t *writer);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,88 @@
+// Copyright 2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <esp_err.h>
+#include "esp_ota_ops.h"
+#include "esp_http_server.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define ESP_WEB_OTA_BUFFER_SIZE     4096 /**< Size of each of the two OTA buffers, one flash sector */
+#define ESP_WEB_OTA_SHA256_LEN      32
+
+typedef struct {
+    bool running;
+    uint32_t total_size;        /**< Content length of the image being received */
+    uint32_t received_size;     /**< Bytes received from the HTTP connection */
+    uint32_t written_size;      /**< Bytes written to the OTA partition */
+    esp_err_t last_err;         /**< Result of the last OTA, ESP_OK while running */
+} esp_web_ota_progress_t;
+
+/**
+ * @brief Receive the request body and write it to an OTA handle.
+ *
+ * Two buffers are used: while a writer task flushes one of them with esp_ota_write(),
+ * the other is filled from httpd_req_recv(). The SHA-256 of the image is computed
+ * while receiving. A flash write error aborts the transfer right away.
+ *
+ * @param req     HTTP request carrying the image, `content_len` bytes are read
+ * @param handle  Handle returned by esp_ota_begin()
+ * @param sha256  Output, SHA-256 of the received image
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_NO_MEM
+ *     - Others: receive or esp_ota_write() error
+ */
+esp_err_t esp_web_ota_receive(httpd_req_t *req, esp_ota_handle_t handle, uint8_t sha256[ESP_WEB_OTA_SHA256_LEN]);
+
+/**
+ * @brief Check that the received image carries the SHA-256 that esp_image appends.
+ *
+ * esp_ota_end() verifies that digest against the image, so every upload is
+ * checked whether or not the client sent a digest of its own.
+ *
+ * @param partition  The OTA partition the image was written to
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_IMAGE_INVALID: wrong magic or no appended digest
+ *     - Others: esp_partition_read() error
+ */
+esp_err_t esp_web_ota_check_image(const esp_partition_t *partition);
+
+/**
+ * @brief Record the final result of an OTA started by esp_web_ota_receive().
+ */
+void esp_web_ota_set_result(esp_err_t err);
+
+/**
+ * @brief Get a snapshot of the OTA progress counters.
+ *
+ * The counters are updated atomically by the receiving and writing tasks, so this
+ * can be called from any task while an upload is running.
+ */
+void esp_web_ota_get_progress(esp_web_ota_progress_t *progress);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,232 @@
+// Copyright 2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "esp_log.h"
+
+#include "web_json.h"
+
+static const char *TAG = "web_json";
+
+static void web_json_flush(web_json_writer_t *writer)
+{
+    if (writer->err != ESP_OK || writer->len == 0) {
+        return;
+    }
+
+    writer->err = httpd_resp_send_chunk(writer->req, writer->buf, writer->len);
+    if (writer->err != ESP_OK) {
+        ESP_LOGE(TAG, "send chunk fail, err: %d", writer->err);
+    }
+    writer->len = 0;
+}
+
+static void web_json_put(web_json_writer_t *writer, const char *data, size_t len)
+{
+    while (len > 0 && writer->err == ESP_OK) {
+        size_t copy_len = WEB_JSON_BUFFER_SIZE - writer->len;
+
+        if (copy_len > len) {
+            copy_len = len;
+        }
+
+        memcpy(writer->buf + writer->len, data, copy_len);
+        writer->len += copy_len;
+        data += copy_len;
+        len -= copy_len;
+
+        if (writer->len == WEB_JSON_BUFFER_SIZE) {
+            web_json_flush(writer);
+        }
+    }
+}
+
+static inline void web_json_put_char(web_json_writer_t *writer, char c)
+{
+    web_json_put(writer, &c, 1);
+}
+
+static void web_json_put_escaped(web_json_writer_t *writer, const char *str, size_t max_len)
+{
+    static const char hex[] = "0123456789abcdef";
+    const char *run = str;
+    size_t i = 0;
+
+    web_json_put_char(writer, '"');
+
+    for (i = 0; i < max_len && str[i] != '\0'; i++) {
+        uint8_t c = (uint8_t)str[i];
+        char esc[6] = {'\\', 0};
+        size_t esc_len = 2;
+
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+
+        switch (c) {
+            case '"':
+            case '\\':
+                esc[1] = c;
+                break;
+
+            case '\n':
+                esc[1] = 'n';
+                break;
+
+            case '\r':
+                esc[1] = 'r';
+                break;
+
+            case '\t':
+                esc[1] = 't';
+                break;
+
+            default:
+                esc[1] = 'u';
+                esc[2] = '0';
+                esc[3] = '0';
+                esc[4] = hex[c >> 4];
+                esc[5] = hex[c & 0xf];
+                esc_len = 6;
+                break;
+        }
+
+        /**< Copy the plain run in one go, then the escape sequence */
+        web_json_put(writer, run, str + i - run);
+        web_json_put(writer, esc, esc_len);
+        run = str + i + 1;
+    }
+
+    web_json_put(writer, run, str + i - run);
+    web_json_put_char(writer, '"');
+}
+
+static void web_json_begin_value(web_json_writer_t *writer, const char *key)
+{
+    if (writer->need_comma & (1 << writer->depth)) {
+        web_json_put_char(writer, ',');
+    }
+    writer->need_comma |= (1 << writer->depth);
+
+    if (key != NULL) {
+        web_json_put_escaped(writer, key, SIZE_MAX);
+        web_json_put_char(writer, ':');
+    }
+}
+
+static void web_json_container_start(web_json_writer_t *writer, const char *key, char open)
+{
+    if (writer->depth >= WEB_JSON_MAX_DEPTH) {
+        ESP_LOGE(TAG, "json nested too deep");
+        writer->err = ESP_ERR_INVALID_STATE;
+        return;
+    }
+
+    web_json_begin_value(writer, key);
+    web_json_put_char(writer, open);
+    writer->depth++;
+    writer->need_comma &= ~(1 << writer->depth);
+}
+
+static void web_json_container_end(web_json_writer_t *writer, char close)
+{
+    if (writer->depth == 0) {
+        writer->err = ESP_ERR_INVALID_STATE;
+        return;
+    }
+
+    writer->depth--;
+    web_json_put_char(writer, close);
+}
+
+void web_json_writer_init(web_json_writer_t *writer, httpd_req_t *req)
+{
+    memset(writer, 0, sizeof(web_json_writer_t));
+    writer->req = req;
+    writer->err = ESP_OK;
+    httpd_resp_set_type(req, HTTPD_TYPE_JSON);
+}
+
+void web_json_object_start(web_json_writer_t *writer, const char *key)
+{
+    web_json_container_start(writer, key, '{');
+}
+
+void web_json_object_end(web_json_writer_t *writer)
+{
+    web_json_container_end(writer, '}');
+}
+
+void web_json_array_start(web_json_writer_t *writer, const char *key)
+{
+    web_json_container_start(writer, key, '[');
+}
+
+void web_json_array_end(web_json_writer_t *writer)
+{
+    web_json_container_end(writer, ']');
+}
+
+void web_json_add_string_len(web_json_writer_t *writer, const char *key, const char *value, size_t max_len)
+{
+    web_json_begin_value(writer, key);
+    web_json_put_escaped(writer, value ? value : "", max_len);
+}
+
+void web_json_add_string(web_json_writer_t *writer, const char *key, const char *value)
+{
+    web_json_add_string_len(writer, key, value, SIZE_MAX);
+}
+
+void web_json_add_int(web_json_writer_t *writer, const char *key, int32_t value)
+{
+    char num[12] = {0};
+    int len = snprintf(num, sizeof(num), "%" PRId32, value);
+
+    web_json_begin_value(writer, key);
+    web_json_put(writer, num, len);
+}
+
+void web_json_add_uint(web_json_writer_t *writer, const char *key, uint32_t value)
+{
+    char num[11] = {0};
+    int len = snprintf(num, sizeof(num), "%" PRIu32, value);
+
+    web_json_begin_value(writer, key);
+    web_json_put(writer, num, len);
+}
+
+void web_json_add_bool(web_json_writer_t *writer, const char *key, bool value)
+{
+    web_json_begin_value(writer, key);
+    web_json_put(writer, value ? "true" : "false", value ? 4 : 5);
+}
+
+esp_err_t web_json_writer_finish(web_json_writer_t *writer)
+{
+    if (writer->err == ESP_OK && writer->depth != 0) {
+        ESP_LOGE(TAG, "json finished with %d open containers", writer->depth);
+        writer->err = ESP_ERR_INVALID_STATE;
+    }
+
+    web_json_flush(writer);
+
+    /**< Always terminate the chunked response, even after an error */
+    esp_err_t ret = httpd_resp_send_chunk(writer->req, NULL, 0);
+
+    return (writer->err != ESP_OK) ? writer->err : ret;
+}
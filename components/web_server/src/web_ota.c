@@ -0,0 +1,279 @@
+// Copyright 2021 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <sys/param.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+#include "esp_log.h"
+#include "esp_image_format.h"
+#include "mbedtls/sha256.h"
+
+#include "web_ota.h"
+
+#define ESP_WEB_OTA_BUFFER_NUM          2
+#define ESP_WEB_OTA_WRITER_STOP         0xFF
+#define ESP_WEB_OTA_WRITER_STACK_SIZE   4096
+#define ESP_WEB_OTA_WRITER_PRIORITY     (tskIDLE_PRIORITY + 5)
+#define ESP_WEB_OTA_QUEUE_TIMEOUT       10000  // 10s, a flash write never takes that long
+
+/**
+ * Progress of the current or last upload. It outlives the pipeline so that a reader
+ * in another task never touches freed memory, every field is accessed atomically.
+ */
+typedef struct {
+    uint32_t running;
+    uint32_t total_size;
+    uint32_t received_size;
+    uint32_t written_size;
+    int32_t last_err;
+} web_ota_counters_t;
+
+typedef struct {
+    esp_ota_handle_t handle;
+    char *buf[ESP_WEB_OTA_BUFFER_NUM];
+    size_t len[ESP_WEB_OTA_BUFFER_NUM];
+    QueueHandle_t filled_queue;     /**< Indexes of buffers waiting to be written */
+    QueueHandle_t free_queue;       /**< Indexes of buffers that can be received into */
+    volatile esp_err_t write_err;
+    web_ota_counters_t *counters;   /**< Progress counters, shared with esp_web_ota_get_progress() */
+} web_ota_pipeline_t;
+
+static const char *TAG = "web_ota";
+static web_ota_counters_t s_ota_counters = {0};
+
+static void web_ota_writer_task(void *arg)
+{
+    web_ota_pipeline_t *pipeline = (web_ota_pipeline_t *)arg;
+    uint8_t index = 0;
+
+    while (xQueueReceive(pipeline->filled_queue, &index, portMAX_DELAY) == pdTRUE
+           && index != ESP_WEB_OTA_WRITER_STOP) {
+        /**< After an error, keep recycling buffers so the receiver notices and stops */
+        if (pipeline->write_err == ESP_OK) {
+            esp_err_t err = esp_ota_write(pipeline->handle, pipeline->buf[index], pipeline->len[index]);
+
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG, "ota write failed (%s)", esp_err_to_name(err));
+                pipeline->write_err = err;
+            } else {
+                __atomic_fetch_add(&pipeline->counters->written_size, pipeline->len[index], __ATOMIC_RELAXED);
+            }
+        }
+
+        xQueueSend(pipeline->free_queue, &index, portMAX_DELAY);
+    }
+
+    /**< Hand the stop marker back as the signal that the writer is done */
+    index = ESP_WEB_OTA_WRITER_STOP;
+    xQueueSend(pipeline->free_queue, &index, portMAX_DELAY);
+    vTaskDelete(NULL);
+}
+
+static void web_ota_pipeline_destroy(web_ota_pipeline_t *pipeline)
+{
+    for (int i = 0; i < ESP_WEB_OTA_BUFFER_NUM; i++) {
+        free(pipeline->buf[i]);
+    }
+
+    if (pipeline->filled_queue) {
+        vQueueDelete(pipeline->filled_queue);
+    }
+
+    if (pipeline->free_queue) {
+        vQueueDelete(pipeline->free_queue);
+    }
+
+    free(pipeline);
+}
+
+static web_ota_pipeline_t *web_ota_pipeline_create(esp_ota_handle_t handle)
+{
+    web_ota_pipeline_t *pipeline = calloc(1, sizeof(web_ota_pipeline_t));
+
+    if (pipeline == NULL) {
+        return NULL;
+    }
+
+    pipeline->handle       = handle;
+    pipeline->write_err    = ESP_OK;
+    pipeline->counters     = &s_ota_counters;
+    pipeline->filled_queue = xQueueCreate(ESP_WEB_OTA_BUFFER_NUM + 1, sizeof(uint8_t));
+    pipeline->free_queue   = xQueueCreate(ESP_WEB_OTA_BUFFER_NUM + 1, sizeof(uint8_t));
+
+    if (!pipeline->filled_queue || !pipeline->free_queue) {
+        goto err;
+    }
+
+    for (uint8_t i = 0; i < ESP_WEB_OTA_BUFFER_NUM; i++) {
+        pipeline->buf[i] = malloc(ESP_WEB_OTA_BUFFER_SIZE);
+
+        if (pipeline->buf[i] == NULL) {
+            goto err;
+        }
+
+        xQueueSend(pipeline->free_queue, &i, 0);
+    }
+
+    if (xTaskCreate(web_ota_writer_task, "web_ota_writer", ESP_WEB_OTA_WRITER_STACK_SIZE,
+                    pipeline, ESP_WEB_OTA_WRITER_PRIORITY, NULL) != pdPASS) {
+        goto err;
+    }
+
+    return pipeline;
+
+err:
+    web_ota_pipeline_destroy(pipeline);
+    return NULL;
+}
+
+/**
+ * @brief Stop the writer task and wait until it has written everything queued.
+ */
+static void web_ota_pipeline_drain(web_ota_pipeline_t *pipeline)
+{
+    uint8_t index = ESP_WEB_OTA_WRITER_STOP;
+
+    xQueueSend(pipeline->filled_queue, &index, portMAX_DELAY);
+
+    do {
+        xQueueReceive(pipeline->free_queue, &index, portMAX_DELAY);
+    } while (index != ESP_WEB_OTA_WRITER_STOP);
+}
+
+esp_err_t esp_web_ota_receive(httpd_req_t *req, esp_ota_handle_t handle, uint8_t sha256[ESP_WEB_OTA_SHA256_LEN])
+{
+    esp_err_t err = ESP_OK;
+    int remaining_len = req->content_len;
+    int received_len = 0;
+    uint8_t index = 0;
+    mbedtls_sha256_context sha256_ctx;
+    web_ota_pipeline_t *pipeline = NULL;
+
+    pipeline = web_ota_pipeline_create(handle);
+    if (pipeline == NULL) {
+        ESP_LOGE(TAG, "ota pipeline create fail");
+        return ESP_ERR_NO_MEM;
+    }
+
+    __atomic_store_n(&pipeline->counters->total_size, req->content_len, __ATOMIC_RELAXED);
+    __atomic_store_n(&pipeline->counters->received_size, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&pipeline->counters->written_size, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&pipeline->counters->last_err, ESP_OK, __ATOMIC_RELAXED);
+    __atomic_store_n(&pipeline->counters->running, true, __ATOMIC_RELEASE);
+
+    mbedtls_sha256_init(&sha256_ctx);
+    mbedtls_sha256_starts_ret(&sha256_ctx, 0);
+
+    while (remaining_len > 0 && err == ESP_OK) {
+        if (xQueueReceive(pipeline->free_queue, &index, pdMS_TO_TICKS(ESP_WEB_OTA_QUEUE_TIMEOUT)) != pdTRUE) {
+            ESP_LOGE(TAG, "wait for free ota buffer timeout");
+            err = ESP_ERR_TIMEOUT;
+            break;
+        }
+
+        if (pipeline->write_err != ESP_OK) {
+            err = pipeline->write_err;
+            xQueueSend(pipeline->free_queue, &index, 0);
+            break;
+        }
+
+        /**< Fill the whole buffer so that flash is written one sector at a time */
+        pipeline->len[index] = 0;
+        while (pipeline->len[index] < ESP_WEB_OTA_BUFFER_SIZE && remaining_len > 0) {
+            received_len = httpd_req_recv(req, pipeline->buf[index] + pipeline->len[index],
+                                          MIN(remaining_len, ESP_WEB_OTA_BUFFER_SIZE - pipeline->len[index]));
+
+            if (received_len == HTTPD_SOCK_ERR_TIMEOUT) {
+                /* Retry if timeout occurred */
+                continue;
+            } else if (received_len <= 0) {
+                ESP_LOGE(TAG, "Failed to receive post ota data, err = %d", received_len);
+                err = ESP_FAIL;
+                break;
+            }
+
+            mbedtls_sha256_update_ret(&sha256_ctx, (const unsigned char *)pipeline->buf[index] + pipeline->len[index], received_len);
+            pipeline->len[index] += received_len;
+            remaining_len -= received_len;
+            __atomic_fetch_add(&pipeline->counters->received_size, received_len, __ATOMIC_RELAXED);
+        }
+
+        if (err != ESP_OK) {
+            xQueueSend(pipeline->free_queue, &index, 0);
+            break;
+        }
+
+        xQueueSend(pipeline->filled_queue, &index, portMAX_DELAY);
+    }
+
+    web_ota_pipeline_drain(pipeline);
+
+    if (err == ESP_OK) {
+        err = pipeline->write_err;
+    }
+
+    mbedtls_sha256_finish_ret(&sha256_ctx, sha256);
+    mbedtls_sha256_free(&sha256_ctx);
+    ESP_LOGI(TAG, "ota received %" PRIu32 " bytes, written %" PRIu32 " bytes",
+             __atomic_load_n(&pipeline->counters->received_size, __ATOMIC_RELAXED),
+             __atomic_load_n(&pipeline->counters->written_size, __ATOMIC_RELAXED));
+    web_ota_pipeline_destroy(pipeline);
+
+    return err;
+}
+
+esp_err_t esp_web_ota_check_image(const esp_partition_t *partition)
+{
+    esp_image_header_t header = {0};
+    esp_err_t err = esp_partition_read(partition, 0, &header, sizeof(esp_image_header_t));
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "ota image header read failed (%s)", esp_err_to_name(err));
+        return err;
+    }
+
+    if (header.magic != ESP_IMAGE_HEADER_MAGIC) {
+        ESP_LOGE(TAG, "ota image has a wrong magic 0x%02x", header.magic);
+        return ESP_ERR_IMAGE_INVALID;
+    }
+
+    /**< Without the appended digest esp_ota_end() could only check the XOR checksum */
+    if (header.hash_appended != 1) {
+        ESP_LOGE(TAG, "ota image has no appended SHA-256");
+        return ESP_ERR_IMAGE_INVALID;
+    }
+
+    return ESP_OK;
+}
+
+void esp_web_ota_set_result(esp_err_t err)
+{
+    __atomic_store_n(&s_ota_counters.last_err, err, __ATOMIC_RELAXED);
+    __atomic_store_n(&s_ota_counters.running, false, __ATOMIC_RELEASE);
+}
+
+void esp_web_ota_get_progress(esp_web_ota_progress_t *progress)
+{
+    progress->running       = __atomic_load_n(&s_ota_counters.running, __ATOMIC_ACQUIRE);
+    progress->total_size    = __atomic_load_n(&s_ota_counters.total_size, __ATOMIC_RELAXED);
+    progress->received_size = __atomic_load_n(&s_ota_counters.received_size, __ATOMIC_RELAXED);
+    progress->written_size  = __atomic_load_n(&s_ota_counters.written_size, __ATOMIC_RELAXED);
+    progress->last_err      = __atomic_load_n(&s_ota_counters.last_err, __ATOMIC_RELAXED);
+}
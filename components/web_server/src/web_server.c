@@ -31,7 +31,6 @@
 #include <sys/socket.h>
 #include <sys/param.h>
 #include <time.h>
-#include <sys/queue.h>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/timers.h"
@@ -43,6 +42,7 @@
 #include "esp_err.h"
 #include "esp_log.h"
 #include "esp_system.h"
+#include "esp_timer.h"
 #include "esp_vfs.h"
 #include "esp_ota_ops.h"
 #include "esp_image_format.h"
@@ -50,6 +50,10 @@
 #include "esp_partition.h"
 
 #include "esp_http_server.h"
+#include "esp_gateway_wifi_scan.h"
+#include "web_json.h"
+#include "web_ota.h"
+#include "web_index_html.h"
 // AT web can use fatfs to storge html or use embeded file to storge html.
 // If use fatfs,we should enable AT FS Command support.
 #ifdef CONFIG_WEB_USE_FATFS
@@ -84,7 +88,7 @@ static char *s_web_redirect_url = NULL;
 #define ESP_GATEWAY_WEB_IPV4_MAX_IP_LEN_DEFAULT             32
 #define ESP_GATEWAY_WEB_RECEIVED_ACK_MESSAGE                "received"
 #define ESP_GATEWAY_WEB_AP_SCAN_NUM_DEFAULT                 10
-#define ESP_GATEWAY_WEB_AP_RECORD_JSON_STR_LEN              600
+#define ESP_GATEWAY_WEB_AP_RECORD_MAX_AGE                   10000  // 10s, older scan results are refreshed in background
 #define ESP_GATEWAY_WEB_WIFI_CONNECTED_BIT                  BIT0
 #define ESP_GATEWAY_WEB_WIFI_FAIL_BIT                       BIT1
 #define ESP_GATEWAY_WEB_SCAN_RSSI_THRESHOLD                 -50
@@ -92,18 +96,46 @@ static char *s_web_redirect_url = NULL;
 #define ESP_GATEWAY_WEB_ENABLE_VIRTUAL_MAC_MATCH            1
 #define ESP_GATEWAY_WEB_ENABLE_CONNECT_HIGHEST_RSSI         1
 #define ESP_GATEWAY_WEB_HIGH_RSSI_CONNECT_COUNT             1
+#define ESP_GATEWAY_WEB_PHONE_MAC_MATCH_MIN                 5      // some phone(like XIAOMI10), the difference between SOFTAP and STA is two bytes
+#define ESP_GATEWAY_WEB_SCORE_MAC_MATCH                     200    // score bonus for a router whose mac is close to the phone's
+#define ESP_GATEWAY_WEB_SCORE_MAC_MATCH_BYTE                20     // extra score for every matched byte above ESP_GATEWAY_WEB_PHONE_MAC_MATCH_MIN
+#define ESP_GATEWAY_WEB_SCORE_VIRTUAL_MAC                   100    // score bonus for a locally administered (phone hotspot) mac
+#define ESP_GATEWAY_WEB_SCORE_FAIL_PENALTY                  300    // score penalty of one fresh connect failure
+#define ESP_GATEWAY_WEB_FAIL_DECAY_TIME                     60000  // 60s, a connect failure is forgotten linearly over this time
+#define ESP_GATEWAY_WEB_FAIL_RECORD_NUM                     8
 #define ESP_GATEWAY_WEB_WIFI_TRY_CONNECT_TIMEOUT            8000 // try connect timeout is 8000ms
 #define ESP_GATEWAY_WEB_WIFI_SSID_LEN_DEFAULT               32
 #define ESP_GATEWAY_WEB_WIFI_LAST_SCAN_TIMEOUT              10   // 10s
 #define ESP_GATEWAY_WEB_ROOT_DIR_DEFAULT                    CONFIG_WEB_ROOT_DIR
 #define ESP_GATEWAY_WEB_REDIRECT_URL_PREFIX_LEN             24
+#define ESP_GATEWAY_WEB_PROGRESS_PORT_OFFSET                1      // progress server listens on the web port + 1
+#define ESP_GATEWAY_WEB_PROGRESS_SOCKETS                    2
+#define ESP_GATEWAY_WEB_PROGRESS_STACK_SIZE                 3072
+#define ESP_GATEWAY_WEB_ASSET_HDR_LEN_MAX                   64     // longest If-None-Match/Accept-Encoding value we look at
 
-typedef struct router_obj {
+typedef struct {
     uint8_t ssid[32];
+    uint8_t mac[6];
     int8_t rssi;
+    uint8_t mac_match_len;
+    int16_t score;
+} router_candidate_t;
+
+typedef struct {
     uint8_t mac[6];
-    SLIST_ENTRY(router_obj) next;
-} router_obj_t;
+    uint8_t fail_count;
+    int64_t last_fail_time;  // esp_timer_get_time(), us
+} router_fail_record_t;
+
+typedef struct {
+    const char *type;
+    const char *etag;               // of the gzip representation
+    const uint8_t *start;
+    const uint8_t *end;
+    const char *identity_etag;      // of the uncompressed representation
+    const uint8_t *identity_start;
+    const uint8_t *identity_end;
+} web_static_asset_t;
 
 typedef struct web_server_context {
     char base_path[ESP_VFS_PATH_MAX + 1];
@@ -139,6 +171,7 @@ typedef struct {
 
 static web_server_context_t *s_web_context = NULL;
 static httpd_handle_t s_server = NULL;
+static httpd_handle_t s_progress_server = NULL;
 static int32_t s_web_wifi_reconnect_timeout = ESP_GATEWAY_WEB_WIFI_MAX_RECONNECT_TIMEOUT;
 static wifi_sta_connection_info_t s_wifi_sta_connection_info = {0};
 static wifi_sta_connect_config_t s_wifi_sta_connect_config = {0};
@@ -151,7 +184,8 @@ static const char *s_wifi_conncet_finish_response = "wifi_conncet_finish\r\n";
 static const char *s_ota_start_response = "ota_start\r\n";
 static const char *s_ota_receive_success_response = "ota_receive_success\r\n";
 static const char *s_ota_receive_fail_response = "ota_receive_fail\r\n";
-static SLIST_HEAD(router_fail_list_head_, router_obj) s_router_fail_list = SLIST_HEAD_INITIALIZER(s_router_fail_list);
+static router_fail_record_t s_router_fail_record[ESP_GATEWAY_WEB_FAIL_RECORD_NUM] = {0};
+static router_candidate_t s_router_candidates[ESP_GATEWAY_WEB_SCAN_LIST_SIZE];
 static const char *TAG = "Web Server";
 
 // web can use fatfs to storge html or use embeded file to storge html.
@@ -268,94 +302,118 @@ static esp_err_t esp_web_get_mobile_phone_mac(uint8_t *mobile_phone_mac)
     return ESP_OK;
 }
 
-// return false means repeat try error connect
-static bool check_fail_list(uint8_t *bssid)
+static router_fail_record_t *esp_web_find_fail_record(const uint8_t *mac)
 {
-    if (bssid == NULL) {
-        ESP_LOGI(TAG, "ERROR bssid");
-        return false;
+    for (int i = 0; i < ESP_GATEWAY_WEB_FAIL_RECORD_NUM; i++) {
+        if (s_router_fail_record[i].fail_count && memcmp(s_router_fail_record[i].mac, mac, sizeof(s_router_fail_record[i].mac)) == 0) {
+            return &s_router_fail_record[i];
+        }
     }
+    return NULL;
+}
+
+// Remember a failed router, replacing the oldest record when the table is full
+static void esp_web_record_connect_fail(const uint8_t *mac)
+{
+    router_fail_record_t *record = esp_web_find_fail_record(mac);
 
-    if (!SLIST_EMPTY(&s_router_fail_list)) {
-        for (router_obj_t *fail_item = SLIST_FIRST(&s_router_fail_list); fail_item != NULL; fail_item = SLIST_NEXT(fail_item, next)) {
-            if (esp_web_get_mac_match_len(fail_item->mac, bssid, sizeof(fail_item->mac)) == 6) {
-                ESP_LOGI(TAG, "Skip ssid: %s", fail_item->ssid);
-                return false;
+    if (record == NULL) {
+        record = &s_router_fail_record[0];
+        for (int i = 1; i < ESP_GATEWAY_WEB_FAIL_RECORD_NUM; i++) {
+            if (s_router_fail_record[i].last_fail_time < record->last_fail_time) {
+                record = &s_router_fail_record[i];
             }
         }
+        memset(record, 0x0, sizeof(router_fail_record_t));
+        memcpy(record->mac, mac, sizeof(record->mac));
     }
 
-    return true;
+    if (record->fail_count < UINT8_MAX) {
+        record->fail_count++;
+    }
+    record->last_fail_time = esp_timer_get_time();
 }
 
-static esp_err_t stop_scan_filter(void)
+// Failures weigh less as they age and stop counting after ESP_GATEWAY_WEB_FAIL_DECAY_TIME
+static int32_t esp_web_get_fail_penalty(const uint8_t *mac, int64_t now)
 {
-    if (!SLIST_EMPTY(&s_router_fail_list)) {
-        for (router_obj_t *fail_item = SLIST_FIRST(&s_router_fail_list); fail_item != NULL; fail_item = SLIST_NEXT(fail_item, next)) {
-            SLIST_REMOVE(&s_router_fail_list, fail_item, router_obj, next);
-            free(fail_item);
-        }
+    router_fail_record_t *record = esp_web_find_fail_record(mac);
+    int64_t age_ms = 0;
+
+    if (record == NULL) {
+        return 0;
     }
-    return ESP_OK;
+
+    age_ms = (now - record->last_fail_time) / 1000;
+    if (age_ms >= ESP_GATEWAY_WEB_FAIL_DECAY_TIME) {
+        record->fail_count = 0;
+        return 0;
+    }
+
+    return (int32_t)(record->fail_count * ESP_GATEWAY_WEB_SCORE_FAIL_PENALTY * (ESP_GATEWAY_WEB_FAIL_DECAY_TIME - age_ms) / ESP_GATEWAY_WEB_FAIL_DECAY_TIME);
 }
 
-static void insert_fail_list(router_obj_t *item)
+static bool esp_web_is_virtual_mac(const uint8_t *mac)
 {
-    if (item == NULL) {
-        return;
-    }
-    
-    SLIST_INSERT_HEAD(&s_router_fail_list, item, next);
+    return (mac[0] & 0x2) != 0; // locally administered bit, set by phones for their hotspot
 }
 
-static void esp_record_sort_by_rssi(wifi_ap_record_t *ap_record_array, int len)
+/**
+ * @brief Score one router for phone Wi-Fi provisioning, higher is better.
+ *
+ * MAC-prefix match with the phone dominates, then a virtual MAC, then RSSI;
+ * recent connect failures are subtracted. Candidates scoring <= 0 are skipped.
+ */
+static int16_t esp_web_score_candidate(router_candidate_t *candidate, int64_t now)
 {
-    int i, j;
-    wifi_ap_record_t tmp_ap_record;
-    int flag;
-    for (i = 0; i < len - 1; i++) {
-        flag = 1;
-        for (j = 0; j < len - i - 1; j++) {
-            if (ap_record_array[j].rssi < ap_record_array[j + 1].rssi) {
-                tmp_ap_record = ap_record_array[j];
-                ap_record_array[j] = ap_record_array[j + 1];
-                ap_record_array[j + 1] = tmp_ap_record;
-                flag = 0;
-            }
-        }
-        if (flag == 1) {
-            break;
-        }  
+    int32_t score = candidate->rssi + 100; // rssi is already above ESP_GATEWAY_WEB_SCAN_RSSI_THRESHOLD
+
+    if (candidate->mac_match_len >= ESP_GATEWAY_WEB_PHONE_MAC_MATCH_MIN) {
+        score += ESP_GATEWAY_WEB_SCORE_MAC_MATCH
+                 + (candidate->mac_match_len - ESP_GATEWAY_WEB_PHONE_MAC_MATCH_MIN) * ESP_GATEWAY_WEB_SCORE_MAC_MATCH_BYTE;
     }
+#if ESP_GATEWAY_WEB_ENABLE_VIRTUAL_MAC_MATCH
+    if (esp_web_is_virtual_mac(candidate->mac)) {
+        score += ESP_GATEWAY_WEB_SCORE_VIRTUAL_MAC;
+    }
+#endif
+    score -= esp_web_get_fail_penalty(candidate->mac, now);
+
+    return (int16_t)MAX(score, INT16_MIN);
+}
+
+static int esp_web_candidate_cmp(const void *a, const void *b)
+{
+    return ((const router_candidate_t *)b)->score - ((const router_candidate_t *)a)->score;
 }
 
 /**
-  * @brief Start one scan, and get AP list found in the scan.
+  * @brief Get AP list from the shared scan cache, sorted by rssi.
   *
   * @param[in,out] number As input param, it stores max AP number ap_records can hold. 
   *                As output param, it receives the actual AP number this API returns.
   * @param[out]    ap_records  wifi_ap_record_t array to hold the found APs
+  * @param[in]     max_age_ms  oldest cache accepted, a new scan is started and waited for otherwise.
   *
   * @return
   *    - ESP_OK: succeed
-  *    - ESP_ERR_WIFI_NOT_INIT: WiFi is not initialized by esp_wifi_init
-  *    - ESP_ERR_WIFI_NOT_STARTED: WiFi is not started by esp_wifi_start
   *    - ESP_ERR_INVALID_ARG: invalid argument
-  *    - ESP_ERR_NO_MEM: out of memory
+  *    - ESP_ERR_TIMEOUT: scan did not finish in time
+  *    - ESP_FAIL: scan failed or there is no ap
   */
-esp_err_t esp_web_wifi_scan_get_ap_records(uint16_t *number, wifi_ap_record_t *ap_records)
+esp_err_t esp_web_wifi_scan_get_ap_records(uint16_t *number, wifi_ap_record_t *ap_records, uint32_t max_age_ms)
 {
     if ((number == NULL) || (ap_records == NULL)) {
         return ESP_ERR_INVALID_ARG;
     }
     esp_err_t ret = ESP_FAIL;
-    ret = esp_wifi_scan_start(NULL, true);
+    ret = esp_gateway_wifi_scan_wait(max_age_ms, ESP_GATEWAY_WIFI_SCAN_WAIT_MS);
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "scan start fail");
+        ESP_LOGE(TAG, "scan fail");
         return ret;
     }
 
-    ret = esp_wifi_scan_get_ap_records(number, ap_records);
+    ret = esp_gateway_wifi_scan_get_records(ap_records, number, NULL);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "get scan fail");
         return ret;
@@ -366,8 +424,6 @@ esp_err_t esp_web_wifi_scan_get_ap_records(uint16_t *number, wifi_ap_record_t *a
         return ESP_FAIL;
     }
     ESP_LOGI(TAG, "Total APs scanned = %u", *number);
-    // sort ap_record according to rssi 
-    esp_record_sort_by_rssi(ap_records, *number);
     return ESP_OK;
 }
 
@@ -403,6 +459,10 @@ check_err:
 /**
  * @brief Start Wi-Fi scan and try connect
  *
+ * Every round the scanned routers are put into a fixed-size candidate table, scored by
+ * esp_web_score_candidate() and tried best first. Routers that don't match the phone's
+ * MAC are only tried in the last round, as the phone's hotspot may still be starting.
+ *
  * @param[in] phone_mac - the mac of phone which post the connect data.
  * @param[in] password - web server received Wi-Fi connect password.
  * @param[in] max_connect_time - the Max connection time allowed to attempt(include scan delay and try connect time, unit: s).
@@ -415,28 +475,31 @@ check_err:
  */
 static esp_err_t esp_web_start_scan_filter(uint8_t *phone_mac, uint8_t *password, int32_t max_connect_time, EventGroupHandle_t connect_event)
 {
+    static const uint8_t s_null_mac[6] = {0};
     esp_err_t ret = ESP_FAIL;
-    router_obj_t *last = NULL;
     uint8_t try_connect_count = 0;
     // Calculate the max number of try to connect
     uint8_t max_try_connect_num = (max_connect_time * 1000) / ESP_GATEWAY_WEB_WIFI_TRY_CONNECT_TIMEOUT;
-    int32_t current_available_time = max_connect_time;
+    int64_t start = esp_timer_get_time();
+    int64_t deadline = start + (int64_t)max_connect_time * 1000000;
+    int64_t now = 0;
     uint16_t ap_scan_number = 0;
+    uint16_t candidate_num = 0;
+    uint8_t rssi_fallback_count = 0;
     int32_t loop = 0;
     bool last_scan = false;
-    uint64_t start = 0;
-    uint64_t end = 0;
-    router_obj_t *item = NULL;
-    router_obj_t *head_item = NULL;
+    bool fallback_allowed = false;
     wifi_ap_record_t *ap_info = NULL;
-    uint8_t highest_rssi_connect_count = 0;
-    static uint8_t s_connect_success_flag = 0;
-    SLIST_HEAD(router_all_list_head_, router_obj) s_router_all_list = SLIST_HEAD_INITIALIZER(s_router_all_list);
+    router_candidate_t *candidates = s_router_candidates;
 
     if ((password == NULL) || (max_connect_time <= 0)) {
         return ESP_ERR_INVALID_ARG;
     }
 
+    if ((phone_mac != NULL) && (memcmp(phone_mac, s_null_mac, sizeof(s_null_mac)) == 0)) {
+        phone_mac = NULL;
+    }
+
     ap_info = (wifi_ap_record_t*) malloc(ESP_GATEWAY_WEB_SCAN_LIST_SIZE * sizeof(wifi_ap_record_t));
     if (ap_info == NULL) {
         ESP_LOGE(TAG, "ap info malloc fail");
@@ -446,183 +509,95 @@ static esp_err_t esp_web_start_scan_filter(uint8_t *phone_mac, uint8_t *password
     ESP_LOGD(TAG, "max connect time is %d", max_connect_time);
 
     while (max_try_connect_num > 0) {
-        start = clock();
-        if (current_available_time <= ESP_GATEWAY_WEB_WIFI_LAST_SCAN_TIMEOUT) {
+        now = esp_timer_get_time();
+        if ((deadline - now) / 1000000 <= ESP_GATEWAY_WEB_WIFI_LAST_SCAN_TIMEOUT) {
             last_scan = true;
         }
         // clear the value of the variable
         try_connect_count = 0;
+        rssi_fallback_count = 0;
+        candidate_num = 0;
         ap_scan_number = ESP_GATEWAY_WEB_SCAN_LIST_SIZE;
         memset(ap_info, 0, ESP_GATEWAY_WEB_SCAN_LIST_SIZE * sizeof(wifi_ap_record_t));
 
-        ret = esp_web_wifi_scan_get_ap_records(&ap_scan_number, ap_info);
+        ret = esp_web_wifi_scan_get_ap_records(&ap_scan_number, ap_info, 0); // every round needs a fresh scan
         if (ret != ESP_OK) {
             ESP_LOGE(TAG, "get scan fail");
             goto err;
         }
 
+        now = esp_timer_get_time();
         for (loop = 0; loop < ap_scan_number; loop++) {
             if (esp_web_check_ap_info(&ap_info[loop]) != ESP_OK) {
                 continue;
             }
 
-            item = (router_obj_t*) malloc(sizeof(router_obj_t));
-            if (item == NULL) {
-                ESP_LOGE(TAG, "router malloc fail");
-                break;
-            }
-            memset(item, 0x0, sizeof(router_obj_t));
-            // copy mac
-            memcpy(item->mac, ap_info[loop].bssid, sizeof(item->mac));
-            // copy ssid
-            memcpy(item->ssid, ap_info[loop].ssid, sizeof(item->ssid));
-            // cpoy rssi
-            item->rssi = ap_info[loop].rssi;
-
-            if (last == NULL) {
-                SLIST_INSERT_HEAD(&s_router_all_list, item, next);
-            } else {
-                SLIST_INSERT_AFTER(last, item, next);
-            }
-
-            last = item;
+            router_candidate_t *candidate = &candidates[candidate_num++];
+            memcpy(candidate->mac, ap_info[loop].bssid, sizeof(candidate->mac));
+            memcpy(candidate->ssid, ap_info[loop].ssid, sizeof(candidate->ssid));
+            candidate->rssi = ap_info[loop].rssi;
+            candidate->mac_match_len = esp_web_get_mac_match_len(phone_mac, candidate->mac, sizeof(candidate->mac));
+            candidate->score = esp_web_score_candidate(candidate, now);
         }
 
-        if (SLIST_EMPTY(&s_router_all_list)) {
+        if (candidate_num == 0) {
             ESP_LOGE(TAG, "Not find router");
             goto err;
         }
 
-        // If have mobile phone mac, first consider connect the router which has similar mac
-        if (phone_mac != NULL) {
-            ESP_LOGI(TAG, "Try to macth MAC");
-            for (item = SLIST_FIRST(&s_router_all_list); (item != NULL) && (try_connect_count < max_try_connect_num); item = SLIST_NEXT(item, next)) {
-                // some phone(like XIAOMI10), the difference between SOFTAP and STA is two bytes
-                if ((esp_web_get_mac_match_len(phone_mac, item->mac, sizeof(item->mac)) >= 5)) {
-                    if (check_fail_list(item->mac)) { // ignore fail connect mac
-                        try_connect_count++;
-                        ret = esp_web_try_connect(item->ssid, password, item->mac, connect_event);
-                        if (ret != ESP_OK) {
-                            ESP_LOGW(TAG, "match mac connect error");
-                            SLIST_REMOVE(&s_router_all_list, item, router_obj, next);
-                            insert_fail_list(item);
-                        } else {
-                            s_connect_success_flag = 1;
-                        }
-                        break; // find ssid, skip search
-                    }
-                }
-            }
-            if (item == NULL) {
-                ESP_LOGI(TAG, "No macth MAC");
+        qsort(candidates, candidate_num, sizeof(router_candidate_t), esp_web_candidate_cmp);
+
+        for (loop = 0; (loop < candidate_num) && (try_connect_count < max_try_connect_num); loop++) {
+            router_candidate_t *candidate = &candidates[loop];
+
+            if (candidate->score <= 0) { // everything after it failed recently too
+                ESP_LOGI(TAG, "Skip ssid: %s", candidate->ssid);
+                break;
             }
-        }
+
+            if (candidate->mac_match_len < ESP_GATEWAY_WEB_PHONE_MAC_MATCH_MIN) {
+                fallback_allowed = false;
 #if ESP_GATEWAY_WEB_ENABLE_VIRTUAL_MAC_MATCH
-        // if connect fail, try to connect the router which has virtual mac
-        if (last_scan == true && s_connect_success_flag == 0 && try_connect_count < max_try_connect_num) {
-            ESP_LOGI(TAG, "Try to connect router through virtual MAC");
-            for (item = SLIST_FIRST(&s_router_all_list); (item != NULL) && (try_connect_count < max_try_connect_num); item = SLIST_NEXT(item, next)) {
-                if ((item->mac[1]) & 0x2) { // Compare the first byte
-                    ESP_LOGI(TAG, "Find a virtual MAC: %02x:%02x:%02x:%02x:%02x:%02x, ssid: %s", MAC2STR(item->mac), item->ssid);
-                    if (check_fail_list(item->mac)) {
-                        try_connect_count++;
-                        ret = esp_web_try_connect(item->ssid, password, item->mac, connect_event);
-                        if (ret != ESP_OK) {
-                            ESP_LOGW(TAG, "virtual mac connect error");
-                            SLIST_REMOVE(&s_router_all_list, item, router_obj, next);
-                            insert_fail_list(item);
-                        } else {
-                            s_connect_success_flag = 1;
-                        }
-                        break; // find ssid, skip seach
-                    }
-                }
-            }
-            if (item == NULL) {
-                ESP_LOGI(TAG, "No virtual MAC");
-            }
-        }
+                fallback_allowed |= esp_web_is_virtual_mac(candidate->mac);
 #endif
-
 #if ESP_GATEWAY_WEB_ENABLE_CONNECT_HIGHEST_RSSI
-        // if connect fail, try to connect the router which has highest rssi
-        if (last_scan == true && s_connect_success_flag == 0 && try_connect_count < max_try_connect_num) {
-            ESP_LOGI(TAG, "Try to connect highest RSSI SSID");
-            head_item = SLIST_FIRST(&s_router_all_list);
-            highest_rssi_connect_count = ESP_GATEWAY_WEB_HIGH_RSSI_CONNECT_COUNT;
-            while ((highest_rssi_connect_count > 0) && (try_connect_count < max_try_connect_num)) {
-                if (check_fail_list(head_item->mac)) {
-                    ESP_LOGI(TAG, "Try to connect highest rssi ssid %s, rssi: %d", head_item->ssid, head_item->rssi);
-                    try_connect_count++;
-                    ret = esp_web_try_connect(head_item->ssid, password, head_item->mac, connect_event);
-                    if (ret != ESP_OK) {
-                        ESP_LOGW(TAG, "rssi connect error");
-                        SLIST_REMOVE(&s_router_all_list, head_item, router_obj, next);
-                        insert_fail_list(head_item);
-                    } else {
-                        s_connect_success_flag = 1;
-                        break;
-                    }
+                fallback_allowed |= (rssi_fallback_count < ESP_GATEWAY_WEB_HIGH_RSSI_CONNECT_COUNT);
+#endif
+                if (last_scan == false || fallback_allowed == false) {
+                    continue;
                 }
-                highest_rssi_connect_count--;
-                head_item = SLIST_NEXT(head_item, next);
-                if (head_item == NULL) {
-                    ESP_LOGE(TAG, "List is NULL");
-                    break;
+                if (!esp_web_is_virtual_mac(candidate->mac)) {
+                    rssi_fallback_count++;
                 }
-
             }
-        }
-#endif
-        // delete scan list
-        for (item = SLIST_FIRST(&s_router_all_list); item != NULL; item = SLIST_NEXT(item, next)) {
-            ESP_LOGD(TAG, "Delete SSID:%s", item->ssid);
-            SLIST_REMOVE(&s_router_all_list, item, router_obj, next);
-            free(item);
-        }
 
-        if (s_connect_success_flag) {
-            s_connect_success_flag = 0;
-            free(ap_info);
-            ap_info = NULL;
-            stop_scan_filter();
-            ESP_LOGI(TAG, "try connect count is %d", try_connect_count);
-            return ESP_OK;
-        }
+            ESP_LOGI(TAG, "Try to connect ssid %s, mac: %02x:%02x:%02x:%02x:%02x:%02x, rssi: %d, score: %d",
+                     candidate->ssid, MAC2STR(candidate->mac), candidate->rssi, candidate->score);
+            try_connect_count++;
+            ret = esp_web_try_connect(candidate->ssid, password, candidate->mac, connect_event);
+            if (ret == ESP_OK) {
+                free(ap_info);
+                ESP_LOGI(TAG, "try connect count is %d, use time is %d ms", try_connect_count, (int32_t)((esp_timer_get_time() - start) / 1000));
+                return ESP_OK;
+            }
 
-        last = NULL;
-        end = clock();
-        if (end > start) {
-            ESP_LOGI(TAG, "scan and try connect use time is %d", (int32_t)((end - start) / 1000));
-            current_available_time -= ((end - start) / 1000);
-        } else if (end < start) {
-            ESP_LOGI(TAG, "scan and try connect use time is %d", (int32_t)((end + 0xFFFFFFFFUL - start)/ 1000));
-            current_available_time -= ((end + 0xFFFFFFFFUL - start)/ 1000);
-        } else {
-            ESP_LOGE(TAG, "time interval fatal error");
-            break;
+            ESP_LOGW(TAG, "connect ssid %s error", candidate->ssid);
+            esp_web_record_connect_fail(candidate->mac);
         }
 
-        if ((current_available_time <= 0) || (current_available_time > max_connect_time)) {
+        now = esp_timer_get_time();
+        if (now >= deadline) {
             break;
-        } else {
-            max_try_connect_num = (current_available_time * 1000) / ESP_GATEWAY_WEB_WIFI_TRY_CONNECT_TIMEOUT;
-            ESP_LOGI(TAG, "current avail time is %d, max_try_connect_num is %d", current_available_time, max_try_connect_num);
         }
+        max_try_connect_num = (deadline - now) / 1000 / ESP_GATEWAY_WEB_WIFI_TRY_CONNECT_TIMEOUT;
+        ESP_LOGI(TAG, "current avail time is %d ms, max_try_connect_num is %d", (int32_t)((deadline - now) / 1000), max_try_connect_num);
     }
-    if (ap_info != NULL) {
-        free(ap_info);
-        ap_info = NULL;
-    }
-    // delete fail connect list
-    stop_scan_filter();
+
+    free(ap_info);
     ESP_LOGW(TAG, "scan filter timeout");
     return ESP_FAIL;
 err:
     free(ap_info);
-    ap_info = NULL;
-    // delete fail connect list
-    stop_scan_filter();
     ESP_LOGW(TAG, "scan filter error");
     return ESP_FAIL;
 }
@@ -735,7 +710,7 @@ static esp_err_t web_common_get_handler(httpd_req_t *req)
     web_server_context_t *s_web_context = (web_server_context_t*) req->user_ctx;
     strlcpy(filepath, s_web_context->base_path, sizeof(filepath));
     strlcat(filepath, "/index.html", sizeof(filepath)); // Now, we just send the index html for the common handler
-    
+
     ESP_LOGW(TAG, "open file : %s", filepath);
     int fd = open(filepath, O_RDONLY);
     if (fd == -1) {
@@ -776,23 +751,68 @@ static esp_err_t web_common_get_handler(httpd_req_t *req)
     return ESP_OK;
 }
 #else
-static esp_err_t index_html_get_handler(httpd_req_t *req)
+/**
+ * @brief Send an embedded, pre-compressed asset.
+ *
+ * The asset is sent straight from the flash-mapped image as gzip, or uncompressed to a
+ * client whose Accept-Encoding leaves gzip out. Every response carries the ETag of the
+ * representation sent, generated at build time, so revalidation requests get a bodyless 304.
+ */
+static esp_err_t web_static_asset_send(httpd_req_t *req, const web_static_asset_t *asset)
 {
-    extern const char html_start[] asm("_binary_index_html_start");
-    extern const char html_end[]   asm("_binary_index_html_end");
-    const size_t html_size = (html_end - html_start);
-    httpd_resp_set_type(req, "text/html");
-    /* Add file upload form and script which on execution sends a POST request to /upload */
-    httpd_resp_send_chunk(req, (const char*) html_start, html_size);
-    /* Respond with an empty chunk to signal HTTP response completion */
-    return httpd_resp_send_chunk(req, NULL, 0);
+    char header_value[ESP_GATEWAY_WEB_ASSET_HDR_LEN_MAX] = {0};
+    bool gzip = true;
+
+    // No Accept-Encoding at all means any encoding is acceptable
+    if (httpd_req_get_hdr_value_str(req, "Accept-Encoding", header_value, sizeof(header_value)) == ESP_OK
+        && strstr(header_value, "gzip") == NULL) {
+        ESP_LOGD(TAG, "client does not accept gzip, send %s uncompressed", req->uri);
+        gzip = false;
+    }
+
+    const char *etag = gzip ? asset->etag : asset->identity_etag;
+
+    httpd_resp_set_hdr(req, "ETag", etag);
+    httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache"); // always revalidate, answered by 304 below
+
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", header_value, sizeof(header_value)) == ESP_OK
+        && strstr(header_value, etag) != NULL) {
+        ESP_LOGD(TAG, "%s not modified", req->uri);
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, NULL, 0);
+    }
+
+    httpd_resp_set_type(req, asset->type);
+
+    if (!gzip) {
+        return httpd_resp_send(req, (const char *)asset->identity_start, asset->identity_end - asset->identity_start);
+    }
+
+    httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+
+    return httpd_resp_send(req, (const char *)asset->start, asset->end - asset->start);
 }
 
 /* Send HTTP response with the contents of the requested file */
 static esp_err_t web_common_get_handler(httpd_req_t *req)
 {
-    return index_html_get_handler(req);
-    return ESP_OK;
+    extern const uint8_t index_html_gz_start[] asm("_binary_index_html_gz_start");
+    extern const uint8_t index_html_gz_end[]   asm("_binary_index_html_gz_end");
+    extern const uint8_t index_html_start[]    asm("_binary_index_html_start");
+    extern const uint8_t index_html_end[]      asm("_binary_index_html_end");
+    static const web_static_asset_t index_html_asset = {
+        .type           = "text/html",
+        .etag           = WEB_INDEX_HTML_ETAG,
+        .start          = index_html_gz_start,
+        .end            = index_html_gz_end,
+        .identity_etag  = WEB_INDEX_HTML_IDENTITY_ETAG,
+        .identity_start = index_html_start,
+        .identity_end   = index_html_end,
+    };
+
+    // Now, we just send the index html for the common handler
+    return web_static_asset_send(req, &index_html_asset);
 }
 #endif
 
@@ -1182,7 +1202,8 @@ static esp_err_t config_wifi_post_handler(httpd_req_t *req)
     wifi_sta_connection_info_t *connection_info = esp_web_get_sta_connection_info();
     memset(buf, '\0', ESP_GATEWAY_WEB_SCRATCH_BUFSIZE * sizeof(char));
     esp_wifi_get_mode(&current_wifi_mode);
-    if (current_wifi_mode != WIFI_MODE_APSTA) {
+    /* A station-only dongle is configured from its host, only the phone as target AP needs the SoftAP */
+    if (!(current_wifi_mode & WIFI_MODE_STA)) {
         printf("Error, wifi mode is not correct\r\n");
         goto error_handle;
     }
@@ -1261,49 +1282,46 @@ static esp_err_t config_wifi_get_handler(httpd_req_t *req)
 {
     wifi_sta_connect_config_t *connect_config = esp_web_get_sta_connect_config();
     wifi_sta_connection_info_t *connection_info = esp_web_get_sta_connection_info();
-    char temp_str[32] = {0};
-    int32_t json_len = 0;
-    char *temp_json_str = ((web_server_context_t*) (req->user_ctx))->scratch;
-    memset(temp_json_str, '\0', ESP_GATEWAY_WEB_SCRATCH_BUFSIZE * sizeof(char));
-    httpd_resp_set_type(req, "application/json");
+    const char *message = "";
+    int32_t state = 0; // it means http context OK
+    web_json_writer_t writer;
 
     // according wifi connect status, update state
     if (connection_info->config_status == ESP_GATEWAY_WIFI_STA_CONNECT_OK) {
-        json_len += sprintf(temp_json_str + json_len, "{\"state\":1,"); // it means wifi connect success
+        state = 1; // it means wifi connect success
     } else if (connection_info->config_status == ESP_GATEWAY_WIFI_STA_CONNECT_FAIL) {
-        json_len += sprintf(temp_json_str + json_len, "{\"state\":2,"); // it means wifi connect fail
-    } else {
-        json_len += sprintf(temp_json_str + json_len, "{\"state\":0,"); // it means http context OK
+        state = 2; // it means wifi connect fail
     }
 
-    json_len += sprintf(temp_json_str + json_len, "\"sta_ssid\":\"%s\",", (char *)connect_config->ssid);
-    json_len += sprintf(temp_json_str + json_len, "\"sta_password\":\"%s\",", (char *)connect_config->password);
-
     switch (connection_info->config_status) {
     case ESP_GATEWAY_WIFI_STA_NOT_START:
-        strcpy(temp_str, "waiting config");
+        message = "waiting config";
         break;
     case ESP_GATEWAY_WIFI_STA_CONFIG_DONE:
-        strcpy(temp_str, "config done");
+        message = "config done";
         break;
     case ESP_GATEWAY_WIFI_STA_CONNECTING:
-        strcpy(temp_str, "connecting");
+        message = "connecting";
         break;
     case ESP_GATEWAY_WIFI_STA_CONNECT_FAIL:
-        strcpy(temp_str, "connect fail");
+        message = "connect fail";
         break;
     case ESP_GATEWAY_WIFI_STA_CONNECT_OK:
-        strcpy(temp_str, "connect OK");
+        message = "connect OK";
         break;
     default:
         break;
     }
-    json_len += sprintf(temp_json_str + json_len, "\"message\":\"%s\"}", temp_str);
 
-    ESP_LOGD(TAG, "now wifi get json str is %s\n", temp_json_str);
+    web_json_writer_init(&writer, req);
+    web_json_object_start(&writer, NULL);
+    web_json_add_int(&writer, "state", state);
+    web_json_add_string_len(&writer, "sta_ssid", (char *)connect_config->ssid, sizeof(connect_config->ssid));
+    web_json_add_string_len(&writer, "sta_password", (char *)connect_config->password, sizeof(connect_config->password));
+    web_json_add_string(&writer, "message", message);
+    web_json_object_end(&writer);
 
-    httpd_resp_send(req, temp_json_str, (temp_json_str == NULL) ? 0 : strlen(temp_json_str));
-    return ESP_OK;
+    return web_json_writer_finish(&writer);
 }
 
 static esp_err_t accept_wifi_result_post_handler(httpd_req_t *req)
@@ -1367,9 +1385,10 @@ static esp_err_t ap_record_get_handler(httpd_req_t *req)
 {
     uint16_t ap_number = ESP_GATEWAY_WEB_AP_SCAN_NUM_DEFAULT;
     int loop = 0;
-    int32_t json_len = 0;
-    int valid_ap_count = 1;
-    char *temp_json_str = NULL;
+    int valid_ap_count = 0;
+    uint32_t cache_age = 0;
+    esp_err_t ret = ESP_FAIL;
+    web_json_writer_t writer;
     wifi_ap_record_t *ap_info = (wifi_ap_record_t*) malloc(ESP_GATEWAY_WEB_AP_SCAN_NUM_DEFAULT * sizeof(wifi_ap_record_t));
     if (ap_info == NULL) {
         ESP_LOGE(TAG, "ap info malloc fail");
@@ -1377,36 +1396,43 @@ static esp_err_t ap_record_get_handler(httpd_req_t *req)
     }
     memset(ap_info, 0, ESP_GATEWAY_WEB_AP_SCAN_NUM_DEFAULT * sizeof(wifi_ap_record_t));
     
-    if (esp_web_wifi_scan_get_ap_records(&ap_number, ap_info) != ESP_OK) {
-        esp_web_response_error(req, HTTPD_500);
-        goto error_handle;
-    }
-
-    temp_json_str = (char*) malloc(ESP_GATEWAY_WEB_AP_RECORD_JSON_STR_LEN * sizeof(char));
-    if (temp_json_str == NULL) {
-        ESP_LOGE(TAG, "temp_json_str malloc fail");
-        goto error_handle;
+    if (esp_gateway_wifi_scan_get_records(ap_info, &ap_number, &cache_age) != ESP_OK) {
+        // nothing cached yet, the first request has to wait for one scan
+        ap_number = ESP_GATEWAY_WEB_AP_SCAN_NUM_DEFAULT;
+        if (esp_web_wifi_scan_get_ap_records(&ap_number, ap_info, 0) != ESP_OK) {
+            esp_web_response_error(req, HTTPD_500);
+            goto error_handle;
+        }
+    } else if (cache_age > ESP_GATEWAY_WEB_AP_RECORD_MAX_AGE) {
+        // answer with what we have, the next page refresh gets the new list
+        esp_gateway_wifi_scan_request();
     }
-    memset(temp_json_str, 0, ESP_GATEWAY_WEB_AP_RECORD_JSON_STR_LEN * sizeof(char));
 
-    httpd_resp_set_type(req, "application/json");
-    json_len += sprintf(temp_json_str + json_len, "{\"state\":0,\"message\":\"scan done\",\"aplist\":["); // to get a json array format str
+    // to get a json array format str
+    web_json_writer_init(&writer, req);
+    web_json_object_start(&writer, NULL);
+    web_json_add_int(&writer, "state", 0);
+    web_json_add_string(&writer, "message", "scan done");
+    web_json_array_start(&writer, "aplist");
 
     for (loop = 0; loop < ap_number; loop++) {
         if (strlen((const char*)ap_info[loop].ssid) != 0) { // ingore hidden ssid
-            json_len += sprintf(temp_json_str + json_len, "{\"ssid\":\"%s\",\"auth_mode\":%d},", (char *)ap_info[loop].ssid, ap_info[loop].authmode);
+            web_json_object_start(&writer, NULL);
+            web_json_add_string_len(&writer, "ssid", (const char *)ap_info[loop].ssid, sizeof(ap_info[loop].ssid));
+            web_json_add_int(&writer, "auth_mode", ap_info[loop].authmode);
+            web_json_object_end(&writer);
             valid_ap_count++;
         }
     }
     free(ap_info);
     ap_info = NULL;
 
-    json_len += sprintf(temp_json_str + json_len - 1, "]}");
-    ESP_LOGD(TAG, "now, valid ap num is %d, ap records json str is %s\n", valid_ap_count, temp_json_str);
-    httpd_resp_send(req, temp_json_str, (temp_json_str == NULL) ? 0 : strlen(temp_json_str));
-    free(temp_json_str);
-    temp_json_str = NULL;
-    return ESP_OK;
+    web_json_array_end(&writer);
+    web_json_object_end(&writer);
+
+    ret = web_json_writer_finish(&writer);
+    ESP_LOGD(TAG, "now, valid ap num is %d, send ret is %d", valid_ap_count, ret);
+    return ret;
 error_handle:
     free(ap_info);
     ap_info = NULL;
@@ -1416,22 +1442,21 @@ error_handle:
 static esp_err_t ota_info_get_handler(httpd_req_t *req)
 {
     // uint32_t version_uint32 =  esp_at_get_version();
-    int32_t json_len = 0;
     uint8_t version[4] = {0};
-    char *temp_json_str = ((web_server_context_t*) (req->user_ctx))->scratch;
-    
-    memset(temp_json_str, '\0', ESP_GATEWAY_WEB_SCRATCH_BUFSIZE * sizeof(char));
-    // memcpy(version, &version_uint32, sizeof(version_uint32));
+    char version_str[16] = {0};
+    web_json_writer_t writer;
 
-    httpd_resp_set_type(req, "application/json");
-    json_len += sprintf(temp_json_str + json_len, "{\"state\":0,"); // it means http context OK
-    // json_len += sprintf(temp_json_str + json_len, "\"fw_version\":\"%s\",", CONFIG_ESP_AT_FW_VERSION); // it means http context OK
-    json_len += sprintf(temp_json_str + json_len, "\"at_core_version\":\"%d.%d.%d.%d\"}", version[3], version[2], version[1], version[0]);
+    // memcpy(version, &version_uint32, sizeof(version_uint32));
+    snprintf(version_str, sizeof(version_str), "%d.%d.%d.%d", version[3], version[2], version[1], version[0]);
 
-    ESP_LOGD(TAG, "now ota get json str is %s\n", temp_json_str);
-    httpd_resp_send(req, temp_json_str, strlen(temp_json_str));
+    web_json_writer_init(&writer, req);
+    web_json_object_start(&writer, NULL);
+    web_json_add_int(&writer, "state", 0); // it means http context OK
+    // web_json_add_string(&writer, "fw_version", CONFIG_ESP_AT_FW_VERSION);
+    web_json_add_string(&writer, "at_core_version", version_str);
+    web_json_object_end(&writer);
 
-    return ESP_OK;
+    return web_json_writer_finish(&writer);
 }
 
 const esp_partition_t *esp_web_get_ota_update_partition(void)
@@ -1473,12 +1498,41 @@ esp_err_t esp_web_ota_end(esp_ota_handle_t handle, const esp_partition_t *partit
     return err;
 }
 
+/**
+ * @brief Parse the optional "X-Image-SHA256" header, a 64 character hex string.
+ *     It is an extra end-to-end check, the digest appended to the image is always
+ *     verified by esp_ota_end().
+ *
+ * @return true if the header is present and well formed
+ */
+static bool esp_web_ota_get_expected_sha256(httpd_req_t *req, uint8_t sha256[ESP_WEB_OTA_SHA256_LEN])
+{
+    char hex[ESP_WEB_OTA_SHA256_LEN * 2 + 1] = {0};
+
+    if (httpd_req_get_hdr_value_len(req, "X-Image-SHA256") != ESP_WEB_OTA_SHA256_LEN * 2
+            || httpd_req_get_hdr_value_str(req, "X-Image-SHA256", hex, sizeof(hex)) != ESP_OK) {
+        return false;
+    }
+
+    for (int i = 0; i < ESP_WEB_OTA_SHA256_LEN; i++) {
+        unsigned int byte = 0;
+
+        if (sscanf(hex + i * 2, "%2x", &byte) != 1) {
+            return false;
+        }
+
+        sha256[i] = byte;
+    }
+
+    return true;
+}
+
 static esp_err_t ota_data_post_handler(httpd_req_t *req)
 {
-    char *buf = ((web_server_context_t*) (req->user_ctx))->scratch;
     int total_len = req->content_len;
-    int remaining_len = req->content_len;
-    int received_len = 0;
+    bool sha256_check = false;
+    uint8_t sha256[ESP_WEB_OTA_SHA256_LEN] = {0};
+    uint8_t expected_sha256[ESP_WEB_OTA_SHA256_LEN] = {0};
     esp_err_t err = ESP_FAIL;
     esp_ota_handle_t update_handle = 0;
     const esp_partition_t *update_partition = esp_web_get_ota_update_partition();
@@ -1488,41 +1542,40 @@ static esp_err_t ota_data_post_handler(httpd_req_t *req)
         goto err_handler;
     }
     ESP_LOGI(TAG, "bin size is %d", total_len);
-    memset(buf, 0x0, ESP_GATEWAY_WEB_SCRATCH_BUFSIZE * sizeof(char));
+    sha256_check = esp_web_ota_get_expected_sha256(req, expected_sha256);
     // Send a message to MCU.
     // esp_at_port_write_data((uint8_t*)s_ota_start_response, strlen(s_ota_start_response));
     printf("%s\r\n", s_ota_start_response);
-    // start ota
-    err = esp_ota_begin(update_partition, OTA_SIZE_UNKNOWN, &update_handle);
+    // start ota, the image size is known so only the sectors needed are erased
+    err = esp_ota_begin(update_partition, total_len, &update_handle);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "ota begin failed (%s)", esp_err_to_name(err));
         goto err_handler;
     }
-    // receive ota data
-    while (remaining_len > 0) {
-        received_len = httpd_req_recv(req, buf, MIN(remaining_len, ESP_GATEWAY_WEB_SCRATCH_BUFSIZE)); // Receive the file part by part into a buffer
-        if (received_len <= 0) { // received error
-            if (received_len == HTTPD_SOCK_ERR_TIMEOUT) {
-                /* Retry if timeout occurred */
-                continue;
-            }
-            ESP_LOGE(TAG, "Failed to receive post ota data, err = %d", received_len);
-            esp_ota_end(update_handle);
-            goto err_handler;
-        }else { // received successfully
-            err = esp_ota_write(update_handle, buf, received_len);
-            if (err != ESP_OK) {
-                ESP_LOGE(TAG, "ota write failed (%s)", esp_err_to_name(err));
-                esp_ota_end(update_handle);
-                goto err_handler;
-            }
-            remaining_len -= received_len;
-        }
+    // receive ota data, flash writes overlap with receiving
+    err = esp_web_ota_receive(req, update_handle, sha256);
+    if (err != ESP_OK) {
+        esp_ota_end(update_handle);
+        goto err_handler;
+    }
+    // check the image digest before it can be selected for boot
+    if (sha256_check && memcmp(sha256, expected_sha256, ESP_WEB_OTA_SHA256_LEN)) {
+        ESP_LOGE(TAG, "ota image sha256 mismatch");
+        esp_ota_end(update_handle);
+        err = ESP_ERR_INVALID_CRC;
+        goto err_handler;
+    }
+    // the image must carry its own digest, esp_ota_end() verifies it
+    err = esp_web_ota_check_image(update_partition);
+    if (err != ESP_OK) {
+        esp_ota_end(update_handle);
+        goto err_handler;
     }
     err = esp_web_ota_end(update_handle, update_partition);
     if (err != ESP_OK) {
         goto err_handler;
     }
+    esp_web_ota_set_result(ESP_OK);
     esp_web_response_ok(req);
     // esp_at_port_write_data((uint8_t*)s_ota_receive_success_response, strlen(s_ota_receive_success_response));
     printf("%s\r\n", s_ota_receive_success_response);
@@ -1530,12 +1583,69 @@ static esp_err_t ota_data_post_handler(httpd_req_t *req)
     return ESP_OK;
 
 err_handler:
+    esp_web_ota_set_result(err == ESP_OK ? ESP_FAIL : err);
     esp_web_response_error(req, HTTPD_500);
     // esp_at_port_write_data((uint8_t*)s_ota_receive_fail_response, strlen(s_ota_receive_fail_response));
     printf("%s\r\n", s_ota_receive_fail_response);
     return ESP_FAIL;
 }
 
+/**
+ * @brief Serve the OTA progress counters.
+ *
+ * Registered on both servers: the main one answers it between uploads, the progress
+ * server on the next port answers it while the main one is busy receiving an image.
+ */
+static esp_err_t ota_progress_get_handler(httpd_req_t *req)
+{
+    esp_web_ota_progress_t progress = {0};
+    web_json_writer_t writer;
+
+    esp_web_ota_get_progress(&progress);
+
+    // the page is loaded from the main port, let it read the progress port
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+
+    web_json_writer_init(&writer, req);
+    web_json_object_start(&writer, NULL);
+    web_json_add_int(&writer, "state", 0); // it means http context OK
+    web_json_add_bool(&writer, "running", progress.running);
+    web_json_add_uint(&writer, "total_size", progress.total_size);
+    web_json_add_uint(&writer, "received_size", progress.received_size);
+    web_json_add_uint(&writer, "written_size", progress.written_size);
+    web_json_add_string(&writer, "result", esp_err_to_name(progress.last_err));
+    web_json_object_end(&writer);
+
+    return web_json_writer_finish(&writer);
+}
+
+/**
+ * @brief esp_http_server runs one handler at a time, so a second small server
+ *        keeps the progress readable while an upload holds the main one.
+ */
+static esp_err_t start_progress_server(uint16_t server_port)
+{
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.server_port = server_port + ESP_GATEWAY_WEB_PROGRESS_PORT_OFFSET;
+    config.ctrl_port += ESP_GATEWAY_WEB_PROGRESS_PORT_OFFSET;
+    config.max_uri_handlers = 1;
+    config.max_open_sockets = ESP_GATEWAY_WEB_PROGRESS_SOCKETS;
+    config.stack_size = ESP_GATEWAY_WEB_PROGRESS_STACK_SIZE;
+    config.lru_purge_enable = true;
+
+    httpd_uri_t progress_uri = {"/getotaprogress", HTTP_GET, ota_progress_get_handler, NULL};
+
+    ESP_GATEWAY_WEB_SERVER_CHECK(httpd_start(&s_progress_server, &config) == ESP_OK, "Start progress server failed", err);
+
+    if (httpd_register_uri_handler(s_progress_server, &progress_uri) != ESP_OK) {
+        ESP_LOGE(TAG, "httpd register progress uri fail");
+    }
+
+    return ESP_OK;
+err:
+    return ESP_FAIL;
+}
+
 #ifdef CONFIG_WEB_CAPTIVE_PORTAL_ENABLE
 /* http 404/414 error handler that redirect all requests to the root page */
 static esp_err_t http_common_error_handler(httpd_req_t *req, httpd_err_code_t err)
@@ -1584,6 +1694,7 @@ static esp_err_t start_web_server(const char *base_path, uint16_t server_port)
         {"/getaprecord", HTTP_GET, ap_record_get_handler, s_web_context},
         {"/getotainfo", HTTP_GET, ota_info_get_handler, s_web_context},
         {"/setotadata", HTTP_POST, ota_data_post_handler, s_web_context},
+        {"/getotaprogress", HTTP_GET, ota_progress_get_handler, s_web_context},
         {"/", HTTP_GET, web_common_get_handler,s_web_context},
     };
 
@@ -1605,6 +1716,9 @@ static esp_err_t start_web_server(const char *base_path, uint16_t server_port)
     httpd_register_err_handler(s_server, HTTPD_405_METHOD_NOT_ALLOWED, http_common_error_handler);
 #endif
 
+    // the portal still works without it, only the progress during an upload is lost
+    start_progress_server(server_port);
+
     return ESP_OK;
 err_start:
     free(s_web_context);
@@ -1614,6 +1728,10 @@ err:
 
 static esp_err_t stop_web_server(void)
 {
+    if (s_progress_server) {
+        httpd_stop(s_progress_server);
+        s_progress_server = NULL;
+    }
     ESP_GATEWAY_WEB_SERVER_CHECK(httpd_stop(s_server) == ESP_OK, "Stop server failed", err);
     free(s_web_context);
     s_web_context = NULL;
@@ -1779,6 +1897,10 @@ esp_err_t StartWebServer(void)
 {
     esp_err_t ret;
     esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &esp_web_got_ip_cb, NULL, NULL);
+    if ((ret = esp_gateway_wifi_scan_init()) != ESP_OK) {
+        ESP_LOGE(TAG, "wifi scan service init fail, err = %d", ret);
+        return ESP_FAIL;
+    }
 
     if ((ret = esp_web_start(80)) == ESP_OK) {
         esp_web_update_sta_reconnect_timeout(10);
@@ -0,0 +1,65 @@
+#!/usr/bin/env python
+#
+# Copyright 2021 Espressif Systems (Shanghai) PTE LTD
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""Compress a web asset for embedding and emit its ETag as a C header.
+
+usage: gzip_asset.py <input> <output.gz> <output.h> <macro_prefix>
+
+The gzip stream is written with a zero mtime so that the same input always
+produces the same image. Each representation gets its own ETag, derived from
+the compressed bytes for the gzip one and from the input for the identity one.
+"""
+
+import gzip
+import hashlib
+import io
+import sys
+
+
+def main(argv):
+    if len(argv) != 5:
+        sys.stderr.write(__doc__)
+        return 1
+
+    src, dst_gz, dst_h, prefix = argv[1:]
+
+    with open(src, 'rb') as f:
+        data = f.read()
+
+    buf = io.BytesIO()
+    with gzip.GzipFile(filename='', mode='wb', compresslevel=9, fileobj=buf, mtime=0) as gz:
+        gz.write(data)
+    compressed = buf.getvalue()
+
+    with open(dst_gz, 'wb') as f:
+        f.write(compressed)
+
+    etag = hashlib.sha256(compressed).hexdigest()[:16]
+    identity_etag = hashlib.sha256(data).hexdigest()[:16]
+
+    with open(dst_h, 'w') as f:
+        f.write('// Generated by gzip_asset.py from %s, do not edit\n' % src.replace('\\', '/').split('/')[-1])
+        f.write('#pragma once\n\n')
+        f.write('#define %s_ETAG            "\\"%s\\""\n' % (prefix, etag))
+        f.write('#define %s_IDENTITY_ETAG   "\\"%s\\""\n' % (prefix, identity_etag))
+        f.write('#define %s_SIZE            %d\n' % (prefix, len(data)))
+        f.write('#define %s_GZIP_SIZE       %d\n' % (prefix, len(compressed)))
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
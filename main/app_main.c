@@ -32,6 +32,10 @@
 
 #include "esp_storage.h"
 #include "esp_gateway_wifi.h"
+#include "esp_gateway_wifi_scan.h"
+#include "esp_gateway_wifi_bridge.h"
+#include "esp_gateway_wifi_steering.h"
+#include "esp_gateway_wifi_link.h"
 #include "esp_gateway_eth.h"
 #include "esp_gateway_modem.h"
 #include "esp_gateway_vendor_ie.h"
@@ -139,28 +143,28 @@ void app_main(void)
             ESP_LOGI(TAG, "============================");
 
             /* Create STA netif */
-            esp_gateway_wifi_init(WIFI_MODE_STA);
+            esp_netif_t *sta_wifi_netif = esp_gateway_wifi_init(WIFI_MODE_STA);
 
 #if SET_VENDOR_IE
             ap_router = malloc(sizeof(ap_router_t));
             memset(ap_router, 0, sizeof(*ap_router));
             esp_gateway_vendor_ie = esp_wifi_vendor_ie_init();
-            ESP_ERROR_CHECK(esp_wifi_set_vendor_ie(true, WIFI_VND_IE_TYPE_BEACON, WIFI_VND_IE_ID_0, esp_gateway_vendor_ie));
             ESP_ERROR_CHECK(esp_wifi_set_vendor_ie_cb((esp_vendor_ie_cb_t)esp_gateway_vendor_ie_cb, NULL));
 
+            /* Collect vendor ie beacons through the shared scan service */
             for (int i = 0; i < 2; i++) {
-                ESP_ERROR_CHECK(esp_wifi_scan_start(NULL, true));
+                if (esp_gateway_wifi_scan_wait(0, ESP_GATEWAY_WIFI_SCAN_WAIT_MS) != ESP_OK) {
+                    ESP_LOGW(TAG, "vendor ie discovery scan %d fail", i);
+                }
             }
-            ESP_ERROR_CHECK(esp_wifi_scan_stop());
+            esp_gateway_vendor_ie_select_parent(UINT8_MAX, ap_router);
 
             /* Update vendor_ie info */
-            ESP_ERROR_CHECK(esp_wifi_set_vendor_ie(false, WIFI_VND_IE_TYPE_BEACON, WIFI_VND_IE_ID_0, esp_gateway_vendor_ie));
-            (*esp_gateway_vendor_ie).payload[MAX_CONNECT_NUMBER] = 8;
-            (*esp_gateway_vendor_ie).payload[STATION_NUMBER] = 0;
-            (*esp_gateway_vendor_ie).payload[ROUTER_RSSI] = ap_router->rssi;
-            (*esp_gateway_vendor_ie).payload[LEVEL] = ap_router->level + 1;
-            (*esp_gateway_vendor_ie).payload[CONNECT_ROUTER_STATUS] = 0;
-            ESP_ERROR_CHECK(esp_wifi_set_vendor_ie(true, WIFI_VND_IE_TYPE_BEACON, WIFI_VND_IE_ID_0, esp_gateway_vendor_ie));
+            esp_gateway_vendor_ie_set(MAX_CONNECT_NUMBER, ESP_GATEWAY_WIFI_ROUTER_MAX_STA_CONN);
+            esp_gateway_vendor_ie_set(STATION_NUMBER, 0);
+            esp_gateway_vendor_ie_set(ROUTER_RSSI, ap_router->rssi);
+            esp_gateway_vendor_ie_set(LEVEL, ap_router->level + 1);
+            esp_gateway_vendor_ie_set(CONNECT_ROUTER_STATUS, 0);
 
             if (ap_router->level != WIFI_ROUTER_LEVEL_0) {
                 ESP_LOGI(TAG, "wifi_router_level: %d", ap_router->level);
@@ -171,6 +175,12 @@ void app_main(void)
             }
 #endif // SET_VENDOR_IE
 
+#if ESP_GATEWAY_WIFI_ROUTER_BRIDGE
+            /* Clients are bridged to the router, the SoftAP needs no netif, DHCP server or NAPT */
+            ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_APSTA));
+            esp_gateway_wifi_set(WIFI_MODE_AP, ESP_GATEWAY_WIFI_ROUTER_AP_SSID, ESP_GATEWAY_WIFI_ROUTER_AP_PASSWORD, NULL);
+            ESP_ERROR_CHECK(esp_gateway_wifi_bridge_start(sta_wifi_netif));
+#else
             /* Create AP netif  */
             esp_netif_t *ap_wifi_netif = esp_netif_create_default_wifi_ap();
 
@@ -193,6 +203,10 @@ void app_main(void)
 
             /* Enable napt */
             esp_gateway_wifi_napt_enable(_g_esp_netif_soft_ap_ip.ip.addr);
+#endif // ESP_GATEWAY_WIFI_ROUTER_BRIDGE
+#if SET_VENDOR_IE && ESP_GATEWAY_WIFI_ROUTER_STEERING
+            ESP_ERROR_CHECK(esp_gateway_wifi_steering_start());
+#endif
             esp_wifi_get_mac(ESP_IF_WIFI_AP, (uint8_t*)router_mac);
             ESP_LOGI(TAG, "SoftAP MAC "MACSTR"", MAC2STR(router_mac));
             break;
@@ -252,9 +266,16 @@ void app_main(void)
             esp_netif_create_default_wifi_sta();
 
             wifi_init_config_t cfg_dongle = WIFI_INIT_CONFIG_DEFAULT();
+            esp_gateway_wifi_link_init_config(&cfg_dongle, ESP_GATEWAY_WIFI_LINK_PROFILE_DONGLE);
             ESP_ERROR_CHECK(esp_wifi_init(&cfg_dongle));
             ESP_ERROR_CHECK(esp_wifi_start());
+
+#if ENABLE_SOFTAP_FOR_WIFI_CONFIG
             ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_APSTA));
+#else
+            /* Without the SoftAP the link controller can put the station in modem sleep while the host is idle */
+            ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+#endif
 
 #if ENABLE_SOFTAP_FOR_WIFI_CONFIG
             esp_netif_t *dongle_ap_netif = esp_netif_create_default_wifi_ap();
@@ -282,6 +303,10 @@ void app_main(void)
             break;
     }
 
+    if (esp_gateway_wifi_link_start() != ESP_OK) {
+        ESP_LOGW(TAG, "Wi-Fi link adaptation not started");
+    }
+
 	StartWebServer();
 
 #if CONFIG_IDF_TARGET_ESP32C3